@@ -145,6 +145,28 @@ StmtIf* newStmtIf(size_t lineNumber, size_t linePos, ExprBase* condition, Ast* i
     return ifelse;
 }
 
+StmtCase* newStmtCase(size_t lineNumber, size_t linePos, ExprBase* expr){
+    New(StmtCase, label, 1)
+    *label = (StmtCase){Ast(astStmtCase, lineNumber, linePos), expr, 0, 0, NULL};
+    return label;
+}
+
+StmtCase* newStmtDefault(size_t lineNumber, size_t linePos){
+    New(StmtCase, label, 1)
+    *label = (StmtCase){Ast(astStmtDefault, lineNumber, linePos), NULL, 0, 0, NULL};
+    return label;
+}
+
+StmtSwitch* newStmtSwitch(size_t lineNumber, size_t linePos, ExprBase* expr){
+    New(StmtSwitch, stmt, 1)
+    stmt->ast = Ast(astStmtSwitch, lineNumber, linePos);
+    stmt->expr = expr;
+    stmt->stmt = NULL;
+    arrInit(vptr)(&stmt->cases, 0, NULL, NULL);
+    stmt->defaultCase = NULL;
+    return stmt;
+}
+
 Function* newFunction(size_t lineNumber, size_t linePos, Type type, char_t* name){
     New(Function, func, 1)
     func->ast = Ast(astFunction, lineNumber, linePos);
@@ -242,6 +264,20 @@ void disposeAst(void* node){
             disposeAst(ifelse->elseStmt);
             break;
         }
+        case astStmtSwitch: {
+            StmtSwitch* stmt = (StmtSwitch*)ast;
+            disposeAst(stmt->expr);
+            disposeAst(stmt->stmt);
+            arrDispose(vptr)(&stmt->cases);
+            break;
+        }
+        case astStmtCase:
+        case astStmtDefault: {
+            StmtCase* label = (StmtCase*)ast;
+            disposeAst(label->expr);
+            disposeAst(label->stmt);
+            break;
+        }
         case astFunction: {
             Function* func = (Function*)ast;
             free(func->name);
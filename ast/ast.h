@@ -28,6 +28,9 @@ typedef enum {
     astStmtWhile,
     astStmtDoWhile,
     astStmtIf,
+    astStmtSwitch,
+    astStmtCase,
+    astStmtDefault,
     astFunction,
     astTopLevel
 } AstLabel;
@@ -157,6 +160,26 @@ typedef struct {
 } StmtIf;
 StmtIf* newStmtIf(size_t lineNumber, size_t linePos, ExprBase* condition, Ast* ifStmt, Ast* elseStmt);
 
+//Case or default label, along with the statement it labels
+typedef struct {
+    Ast ast;    //Label can be either astStmtCase or astStmtDefault
+    ExprBase* expr;     //Left null for default
+    uint64_t num;       //Value of expr in the type of the switch, sign or zero extended to 64 bits
+    size_t index;       //Position in the cases of the switch
+    Ast* stmt;
+} StmtCase;
+StmtCase* newStmtCase(size_t lineNumber, size_t linePos, ExprBase* expr);
+StmtCase* newStmtDefault(size_t lineNumber, size_t linePos);
+
+typedef struct {
+    Ast ast;
+    ExprBase* expr;
+    Ast* stmt;
+    Array(vptr) cases;      //Case labels anywhere in stmt outside of nested switches, in order. They're owned by stmt
+    StmtCase* defaultCase;  //Left null if there's no default label
+} StmtSwitch;
+StmtSwitch* newStmtSwitch(size_t lineNumber, size_t linePos, ExprBase* expr);
+
 typedef struct {
     Ast ast;
     size_t scopeId;
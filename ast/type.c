@@ -35,6 +35,27 @@ char isSignedType(Type type){
     }
 }
 
+size_t typeSize(Type type){
+    switch (type){
+        case typInt8:
+        case typUInt8:
+            return 1;
+        case typInt16:
+        case typUInt16:
+            return 2;
+        case typInt32:
+        case typUInt32:
+        case typFloat32:
+            return 4;
+        case typInt64:
+        case typUInt64:
+        case typFloat64:
+            return 8;
+        default:
+            assert(0 && "Type has no size");
+    }
+}
+
 char isIntType(Type type){
     switch(type){
         case typUInt8:
@@ -23,5 +23,6 @@ char checkTypeConvert(Type from, Type to);
 Type arithTypePromotion(Type t1, Type t2);
 
 char isSignedType(Type type);
+size_t typeSize(Type type);
 char isIntType(Type type);
 char isFloatType(Type type);
\ No newline at end of file
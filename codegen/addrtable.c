@@ -3,36 +3,50 @@
 #include "scope/scope.h"
 #include <stdint.h>
 
+// Variables keep their declared type next to their address, since the type of an identifier is overwritten when it gets converted
+typedef struct {
+    Address addr;
+    Type type;
+} VarAddress;
+
 #define KEY Symbol
-#define VAL Address
+#define VAL VarAddress
 #include "generics/gen_map.h"
 #include "generics/gen_map.c"
 #undef KEY
 #undef VAL
-static Map(Symbol, Address) addressTable;
+static Map(Symbol, VarAddress) addressTable;
 
 void initAddrTable(){
     resetScopes();
-    mapInit(Symbol, Address)(&addressTable, 4, &hashSymbol, &eqSymbol, NULL, NULL);
+    mapInit(Symbol, VarAddress)(&addressTable, 4, &hashSymbol, &eqSymbol, NULL, NULL);
 }
 
 void disposeAddrTable(){
-    mapDispose(Symbol, Address)(&addressTable);
+    mapDispose(Symbol, VarAddress)(&addressTable);
 }
 
-void insertAddress(char_t* name, Address addr){
-    if (!mapInsert(Symbol, Address)(&addressTable, (Symbol){name, curScope}, addr)){
+void insertAddress(char_t* name, Address addr, Type type){
+    if (!mapInsert(Symbol, VarAddress)(&addressTable, (Symbol){name, curScope}, (VarAddress){addr, type})){
         exit(1);
     }
 }
 
-Address findAddress(char_t* name){
+static VarAddress* findVarAddress(char_t* name){
     size_t scopeId = curScope;
-    Address* addrptr = NULL;
+    VarAddress* addrptr = NULL;
     while (addrptr == NULL){
-        addrptr = mapFind(Symbol, Address)(&addressTable, (Symbol){name, scopeId});
+        addrptr = mapFind(Symbol, VarAddress)(&addressTable, (Symbol){name, scopeId});
         if (scopeId == GLOBAL_SCOPE) break;
         scopeId = prevScope(scopeId);
     }
-    return *addrptr;
+    return addrptr;
+}
+
+Address findAddress(char_t* name){
+    return findVarAddress(name)->addr;
+}
+
+Type findAddressType(char_t* name){
+    return findVarAddress(name)->type;
 }
\ No newline at end of file
@@ -3,77 +3,258 @@
 #include "io/file.h"
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
-#define TYPE AsmInstruction
-#include "generics/gen_array.h"
-#include "generics/gen_array.c"
-#undef TYPE
-Array(AsmInstruction) instructionBuffer;
+// Instructions live in fixed-size chunks that never move, linked in program order so that any of them can be taken out
+// or have another put in front of it in constant time
+typedef struct InstrNode {
+    AsmInstruction ins;     //First, so that a pointer to the instruction is one to its node
+    struct InstrNode* prev;
+    struct InstrNode* next;
+} InstrNode;
 
-size_t appendInstr(AsmInstruction ins){
-    if (!arrPush(AsmInstruction)(&instructionBuffer, ins)) exit(1);
-    return instructionBuffer.size - 1;
+#define CHUNK_SIZE 256
+typedef struct InstrChunk {
+    struct InstrChunk* next;
+    InstrNode nodes[CHUNK_SIZE];
+} InstrChunk;
+
+// Circular list through a sentinel, so the first and last instructions need no special cases
+static InstrNode instrList;
+static size_t instrTotal;
+// Chunks of the current program, newest first, and how many nodes of the newest are handed out
+static InstrChunk* chunks;
+static size_t chunkUsed;
+// Nodes of removed instructions, which are used again before the chunks are
+static InstrNode* freeNodes;
+// Chunks of programs that have been disposed, kept for the next one up to a limit
+#define MAX_SPARE_CHUNKS 64
+static InstrChunk* spareChunks;
+static size_t spareCount;
+
+static InstrNode* newNode(){
+    if (freeNodes != NULL){
+        InstrNode* node = freeNodes;
+        freeNodes = node->next;
+        return node;
+    }
+    if (chunks == NULL || chunkUsed == CHUNK_SIZE){
+        InstrChunk* chunk = spareChunks;
+        if (chunk != NULL){
+            spareChunks = chunk->next;
+            spareCount--;
+        }
+        else{
+            chunk = malloc(sizeof(InstrChunk));
+            if (chunk == NULL) exit(1);
+        }
+        chunk->next = chunks;
+        chunks = chunk;
+        chunkUsed = 0;
+    }
+    return &chunks->nodes[chunkUsed++];
+}
+
+AsmInstruction* insertInstr(AsmInstruction ins, AsmInstruction* before){
+    InstrNode* next = before == NULL ? &instrList : (InstrNode*)before;
+    InstrNode* node = newNode();
+    node->ins = ins;
+    node->prev = next->prev;
+    node->next = next;
+    next->prev->next = node;
+    next->prev = node;
+    instrTotal++;
+    return &node->ins;
+}
+
+AsmInstruction* appendInstr(AsmInstruction ins){
+    return insertInstr(ins, NULL);
 }
 
-AsmInstruction* getInstrPtr(size_t i){
-    return &instructionBuffer.elem[i];
+void removeInstr(AsmInstruction* ins){
+    InstrNode* node = (InstrNode*)ins;
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->next = freeNodes;
+    freeNodes = node;
+    instrTotal--;
+}
+
+AsmInstruction* firstInstr(){
+    return instrList.next == &instrList ? NULL : &instrList.next->ins;
+}
+
+AsmInstruction* nextInstr(const AsmInstruction* ins){
+    InstrNode* next = ((const InstrNode*)ins)->next;
+    return next == &instrList ? NULL : &next->ins;
+}
+
+size_t instrCount(){
+    return instrTotal;
 }
 
 void initAsm(){
-    if(!arrInit(AsmInstruction)(&instructionBuffer, 10, NULL, NULL)) exit(1);
+    instrList.prev = instrList.next = &instrList;
+    instrTotal = 0;
+    chunks = NULL;
+    chunkUsed = 0;
+    freeNodes = NULL;
 }
 void disposeAsm(){
-    arrDispose(AsmInstruction)(&instructionBuffer);
+    while (chunks != NULL){
+        InstrChunk* chunk = chunks;
+        chunks = chunk->next;
+        if (spareCount < MAX_SPARE_CHUNKS){
+            chunk->next = spareChunks;
+            spareChunks = chunk;
+            spareCount++;
+        }
+        else free(chunk);
+    }
 }
 
 //Below code has to do with emiting instructions
 
+// Names of the registers as they're written, with their lengths so they can be copied straight out
+typedef struct {
+    const char_t* str;
+    size_t length;
+} RegisterName;
+// The size of the name counts its terminator, which makes up for the %
+#define REG(name) [$##name] = {"%" #name, sizeof(#name)}
+static const RegisterName registerNames[] = {
+    REG(rbp), REG(rsp),
+    REG(al), REG(r10b), REG(r11b),
+    REG(rax), REG(rcx), REG(rdx), REG(r8), REG(r9), REG(r10), REG(r11),
+    REG(rbx), REG(rsi), REG(rdi), REG(r12), REG(r13), REG(r14), REG(r15),
+    REG(eax), REG(ecx), REG(edx), REG(r8d), REG(r9d), REG(r10d), REG(r11d),
+    REG(ebx), REG(esi), REG(edi), REG(r12d), REG(r13d), REG(r14d), REG(r15d),
+    REG(ax), REG(cx), REG(dx), REG(r8w), REG(r9w), REG(r10w), REG(r11w),
+    REG(bx), REG(si), REG(di), REG(r12w), REG(r13w), REG(r14w), REG(r15w),
+    REG(cl), REG(dl), REG(r8b), REG(r9b), REG(bl), REG(sil), REG(dil), REG(r12b), REG(r13b), REG(r14b), REG(r15b),
+    REG(xmm0), REG(xmm1), REG(xmm2), REG(xmm3), REG(xmm4), REG(xmm5)
+};
+#undef REG
+
 // Never use this as a format string
 const char_t* registerStr(Register reg){
-    switch (reg){
-        case $rax:
-            return "%rax";
-        case $al:
-            return "%al";
-        case $r10b:
-            return "%r10b";
-        case $r11b:
-            return "%r11b";
-        case $rbp:
-            return "%rbp";
-        case $rsp:
-            return "%rsp";
-        case $rcx:
-            return "%rcx";
-        case $rdx:
-            return "%rdx";
-        case $r8:
-            return "%r8";
-        case $r9:
-            return "%r9";
-        case $r10:
-            return "%r10";
-        case $r11:
-            return "%r11";
+    assert(reg < sizeof(registerNames) / sizeof(RegisterName) && registerNames[reg].str && "Unsupported register type");
+    return registerNames[reg].str;
+}
+
+// Same order as the 64-bit registers from rax to r15
+static const Register dwordRegisters[] = {$eax, $ecx, $edx, $r8d, $r9d, $r10d, $r11d, $ebx, $esi, $edi, $r12d, $r13d, $r14d, $r15d};
+static const Register wordRegisters[] = {$ax, $cx, $dx, $r8w, $r9w, $r10w, $r11w, $bx, $si, $di, $r12w, $r13w, $r14w, $r15w};
+static const Register byteRegisters[] = {$al, $cl, $dl, $r8b, $r9b, $r10b, $r11b, $bl, $sil, $dil, $r12b, $r13b, $r14b, $r15b};
+
+// Part of a 64-bit register holding the lowest size bytes. rbp and rsp only ever hold pointers and SSE registers aren't
+// split up by size, so they stay as is
+Register sizedRegister(Register reg, size_t size){
+    if (reg < $rax || reg > $r15) return reg;
+    switch (size){
+        case 1:
+            return byteRegisters[reg - $rax];
+        case 2:
+            return wordRegisters[reg - $rax];
+        case 4:
+            return dwordRegisters[reg - $rax];
+        case 8:
+            return reg;
         default:
-            assert(0 && "Unsupported register type");
+            assert(0 && "Registers only come in 1, 2, 4 and 8 bytes");
+    }
+}
+
+// Each instruction's line is put together here and handed to the output whole, without going through printf.
+// Names too long to fit go out on their own
+#define LINE_SIZE 128
+static char_t line[LINE_SIZE];
+static size_t lineLength;
+
+static void flushLine(){
+    emitBytes(line, lineLength);
+    lineLength = 0;
+}
+
+static void appendStr(const char_t* str, size_t length){
+    if (lineLength + length > LINE_SIZE){
+        flushLine();
+        if (length > LINE_SIZE){
+            emitBytes(str, length);
+            return;
+        }
+    }
+    memcpy(line + lineLength, str, length);
+    lineLength += length;
+}
+
+#define appendLiteral(str) appendStr(str, sizeof(str) - 1)
+
+static void appendName(const char_t* name){
+    appendStr(name, strlen(name));
+}
+
+static void appendUnsigned(uint64_t num){
+    char_t digits[20];
+    size_t start = sizeof(digits);
+    do {
+        digits[--start] = '0' + num % 10;
+        num /= 10;
+    } while (num);
+    appendStr(digits + start, sizeof(digits) - start);
+}
+
+static void appendSigned(int64_t num){
+    if (num < 0){
+        appendLiteral("-");
+        appendUnsigned(-(uint64_t)num);
+    }
+    else{
+        appendUnsigned(num);
     }
 }
 
+static void appendRegister(Register reg){
+    const char_t* name = registerStr(reg);
+    appendStr(name, registerNames[reg].length);
+}
+
+static void appendNumLabel(labelnum_t label){
+    appendLiteral(".L");
+    appendUnsigned(label);
+}
+
 static void emitAddr(const Address* addr){
     switch (addr->mode){
         case registerMode:
-            emitOut("%s", registerStr(addr->val.reg));
+            appendRegister(addr->reg);
             break;
         case symbolMode:
-            emitOut(addr->val.symbol);
+            appendName(addr->val.symbol);
             break;
         case numberMode:
-            emitOut("$%llu", addr->val.num);
+            appendLiteral("$");
+            appendUnsigned(addr->val.num);
             break;
         case indirectMode:
-            emitOut("%lld(%s)", addr->val.indirect.offset, registerStr(addr->val.indirect.reg));
+            appendSigned(addr->val.offset);
+            appendLiteral("(");
+            appendRegister(addr->reg);
+            appendLiteral(")");
+            break;
+        case indexedMode:
+            appendLiteral("(");
+            appendRegister(addr->reg);
+            appendLiteral(",");
+            appendRegister(addr->index);
+            appendLiteral(",");
+            appendUnsigned(addr->scale);
+            appendLiteral(")");
+            break;
+        case labelMode:
+            appendNumLabel(addr->val.label);
+            appendLiteral("(%rip)");
             break;
         default:
             assert(0 && "Unsupported addressing mode");
@@ -83,47 +264,139 @@ static void emitAddr(const Address* addr){
 static void emitLabel(const Label* label){
     switch(label->type){
         case lblNum:
-            emitOut(".L%llu", label->data.num);
+            appendNumLabel(label->data.num);
             break;
         case lblStr:
-            emitOut("%s", label->data.str);
+            appendName(label->data.str);
             break;
         default:
             assert(0 && "Unsupported label type");
     }
 }
 
+typedef enum {
+    sufNone,
+    sufSize,        //b, w, l or q
+    sufFloat,       //ss or sd
+    sufPacked,      //ps or pd
+    sufCond,
+    sufNumber       //The width itself, after a space
+} SuffixKind;
+
+typedef struct {
+    const char_t* name;
+    SuffixKind suffix;
+} OpcodeName;
+
+static const OpcodeName opcodeNames[OPCODE_COUNT] = {
+    [opAdd] = {"add", sufSize}, [opOr] = {"or", sufSize}, [opAnd] = {"and", sufSize}, [opSub] = {"sub", sufSize},
+    [opXor] = {"xor", sufSize}, [opCmp] = {"cmp", sufSize},
+    [opMov] = {"mov", sufSize}, [opTest] = {"test", sufSize}, [opLea] = {"lea", sufSize}, [opImul] = {"imul", sufSize},
+    [opNot] = {"not", sufSize}, [opNeg] = {"neg", sufSize}, [opMul] = {"mul", sufSize}, [opDiv] = {"div", sufSize},
+    [opIdiv] = {"idiv", sufSize},
+    [opInc] = {"inc", sufSize}, [opDec] = {"dec", sufSize},
+    [opSal] = {"sal", sufSize}, [opShr] = {"shr", sufSize}, [opSar] = {"sar", sufSize},
+    [opBt] = {"bt", sufSize}, [opBts] = {"bts", sufSize}, [opBtr] = {"btr", sufSize}, [opBtc] = {"btc", sufSize},
+    [opPush] = {"push", sufSize}, [opPop] = {"pop", sufSize},
+    [opMovzb] = {"movzb", sufSize}, [opMovzw] = {"movzw", sufSize}, [opMovsb] = {"movsb", sufSize},
+    [opMovsw] = {"movsw", sufSize}, [opMovsl] = {"movsl", sufSize},
+    [opSet] = {"set", sufCond}, [opCmov] = {"cmov", sufCond}, [opJcc] = {"j", sufCond},
+    [opMovF] = {"mov", sufFloat}, [opAddF] = {"add", sufFloat}, [opSubF] = {"sub", sufFloat}, [opMulF] = {"mul", sufFloat},
+    [opDivF] = {"div", sufFloat}, [opUcomiF] = {"ucomi", sufFloat}, [opXorF] = {"xor", sufPacked},
+    [opCvtss2sd] = {"cvtss2sd"}, [opCvtsd2ss] = {"cvtsd2ss"},
+    [opCvtsi2ss] = {"cvtsi2ss", sufSize}, [opCvtsi2sd] = {"cvtsi2sd", sufSize},
+    [opCvttss2si] = {"cvttss2si"}, [opCvttsd2si] = {"cvttsd2si"},
+    [opCall] = {"call"}, [opJmp] = {"jmp"}, [opJmpIndirect] = {"jmp *"},
+    [opRet] = {"ret"}, [opLeave] = {"leave"}, [opCltd] = {"cltd"}, [opCqto] = {"cqto"}, [opCltq] = {"cltq"},
+    [opText] = {".text"}, [opRodata] = {".section .rodata"}, [opAlign] = {".align", sufNumber}, [opGlobl] = {".globl"},
+    [opData] = {".", sufSize}
+};
+
+static const char_t* const condNames[] = {"e", "ne", "l", "le", "g", "ge", "b", "be", "a", "ae", "p", "np", "s", "c"};
+
+// Data directives are named after their size rather than suffixed
+static const char_t* const dataNames[] = {"byte", "short", "", "long", "", "", "", "quad"};
+// Size suffix of each width, by the width minus 1
+static const char_t sizeSuffixes[] = "bw?l???q";
+
+static void appendOpcode(AsmOp op){
+    assert(op.code < OPCODE_COUNT && opcodeNames[op.code].name && "Unsupported opcode");
+    const OpcodeName* name = &opcodeNames[op.code];
+    appendName(name->name);
+    switch (name->suffix){
+        case sufSize:
+            if (op.code == opData) appendName(dataNames[op.width - 1]);
+            else if (op.width) appendStr(&sizeSuffixes[op.width - 1], 1);
+            break;
+        case sufFloat:
+            appendLiteral("s");
+            appendStr(op.width == 4 ? "s" : "d", 1);
+            break;
+        case sufPacked:
+            appendLiteral("p");
+            appendStr(op.width == 4 ? "s" : "d", 1);
+            break;
+        case sufCond:
+            appendName(condNames[op.cond]);
+            break;
+        case sufNumber:
+            appendLiteral(" ");
+            appendUnsigned(op.width);
+            break;
+        default:
+            break;
+    }
+}
+
+// Tab, then the opcode, then a space if operands follow
+static void emitOpcode(AsmOp op, char hasOperands){
+    appendLiteral("\t");
+    appendOpcode(op);
+    if (hasOperands && op.code != opJmpIndirect) appendLiteral(" ");
+}
+
 void emitInstr(const AsmInstruction* ins){
     switch(ins->type){
         case ins0Op:
-            emitOut("\t%s", ins->opcode);
+            emitOpcode(ins->op, 0);
             break;
         case ins1Op:
-            emitOut("\t%s ", ins->opcode);
+            emitOpcode(ins->op, 1);
             emitAddr(&ins->args.operands[0]);
             break;
         case ins2Op:
-            emitOut("\t%s ", ins->opcode);
+            emitOpcode(ins->op, 1);
             emitAddr(&ins->args.operands[0]);
-            emitOut(", ");
+            appendLiteral(", ");
             emitAddr(&ins->args.operands[1]);
             break;
         case insLbl:
-            emitOut("\t%s ", ins->opcode);
+            emitOpcode(ins->op, 1);
             emitLabel(&ins->args.label);
             break;
         case insLblDecl:
             emitLabel(&ins->args.label);
-            emitOut(":");
+            appendLiteral(":");
+            break;
+        case insData:
+            emitOpcode(ins->op, 1);
+            appendUnsigned(ins->args.data);
+            break;
+        case insLblDiff:
+            emitOpcode(ins->op, 1);
+            appendNumLabel(ins->args.labels[0]);
+            appendLiteral("-");
+            appendNumLabel(ins->args.labels[1]);
             break;
         default:
             assert(0 && "Unsupported instruction type");
     }
-    emitOut("\n");
+    appendLiteral("\n");
+    flushLine();
 }
 
 void emitAllAsm(){
-    for (size_t i=0; i<instructionBuffer.size; i++){
-        emitInstr(&instructionBuffer.elem[i]);
+    for (const AsmInstruction* ins = firstInstr(); ins != NULL; ins = nextInstr(ins)){
+        emitInstr(ins);
     }
-}
\ No newline at end of file
+}
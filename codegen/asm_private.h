@@ -1,36 +1,54 @@
 // Private headers for codegen
 #pragma once
 #include "utils.h"
+#include "ast/type.h"
 #include <stdint.h>
 
 typedef enum {
     $rbp, $rsp,
     $al, $r10b, $r11b,
-    $rax, $rcx, $rdx, $r8, $r9, $r10, $r11
-    // ,$rbx, $rdi, $rsi, $r12, $r13, $r14, $r15
+    $rax, $rcx, $rdx, $r8, $r9, $r10, $r11,
+    //Callee saved, so values kept in them survive calls
+    $rbx, $rsi, $rdi, $r12, $r13, $r14, $r15,
+    //Lower 32, 16 and 8 bits of the registers above, for operands narrower than 64 bits
+    $eax, $ecx, $edx, $r8d, $r9d, $r10d, $r11d, $ebx, $esi, $edi, $r12d, $r13d, $r14d, $r15d,
+    $ax, $cx, $dx, $r8w, $r9w, $r10w, $r11w, $bx, $si, $di, $r12w, $r13w, $r14w, $r15w,
+    $cl, $dl, $r8b, $r9b, $bl, $sil, $dil, $r12b, $r13b, $r14b, $r15b,
+    //SSE registers hold float and double values in their low 32 or 64 bits
+    $xmm0, $xmm1, $xmm2, $xmm3, $xmm4, $xmm5
 } Register;
 
 typedef int64_t offset_t;
 typedef uint64_t labelnum_t;
+typedef enum {
+    registerMode,
+    symbolMode,
+    numberMode,
+    indirectMode,
+    indexedMode,
+    labelMode       //Data under a numbered label, addressed relative to rip
+} AddressMode;
+
+// Registers and the mode take a byte each, in front of whichever 64-bit value the mode needs
 typedef struct {
-    enum {
-        registerMode, 
-        symbolMode, 
-        numberMode, 
-        indirectMode
-    } mode;
+    uint8_t mode;
+    uint8_t reg;        //Register, or the base register of indirect and indexed addresses
+    uint8_t index;      //Index register of indexed addresses
+    uint8_t scale;
     union {
-        Register reg;
         uint64_t num;
         const char_t* symbol;
-        struct {Register reg; offset_t offset;} indirect;
+        offset_t offset;    //Of indirect addresses
+        labelnum_t label;
     } val;
 } Address;
 
-#define registerAddress(regst) (Address){registerMode, {.reg = regst}}
-#define symbolAddress(sym) (Address){symbolMode, {.symbol = sym}}
-#define numberAddress(number) (Address){numberMode, {.num = number}}
-#define indirectAddress(off, regst) (Address){indirectMode, {.indirect = {.offset = off, .reg = regst}}}
+#define registerAddress(regst) (Address){registerMode, regst}
+#define symbolAddress(sym) (Address){symbolMode, .val = {.symbol = sym}}
+#define numberAddress(number) (Address){numberMode, .val = {.num = number}}
+#define indirectAddress(off, regst) (Address){indirectMode, regst, .val = {.offset = off}}
+#define indexedAddress(baseReg, indexReg, scl) (Address){indexedMode, baseReg, indexReg, scl}
+#define labelAddress(lbl) (Address){labelMode, .val = {.label = lbl}}
 
 typedef struct {
     enum {
@@ -46,35 +64,183 @@ typedef struct {
 #define numLabel(number) (Label){lblNum, {.num = number}}
 #define strLabel(string) (Label){lblStr, {.str = string}}
 
+// Mnemonics without their suffixes. The suffix comes from the width or condition code an instruction has with it
+typedef enum {
+    //Integer operations, suffixed with b, w, l or q for their width unless it comes from their registers
+    opAdd, opOr, opAnd, opSub, opXor, opCmp,
+    opMov, opTest, opLea, opImul,
+    opNot, opNeg, opMul, opDiv, opIdiv,
+    opInc, opDec,
+    opSal, opShr, opSar,
+    opBt, opBts, opBtr, opBtc,
+    opPush, opPop,
+    //Extensions from a byte, word or long to the width
+    opMovzb, opMovzw, opMovsb, opMovsw, opMovsl,
+    //Suffixed with their condition code
+    opSet, opCmov, opJcc,
+    //SSE operations, suffixed with ss or sd for a width of 4 or 8
+    opMovF, opAddF, opSubF, opMulF, opDivF, opUcomiF,
+    opXorF,         //Suffixed with ps or pd instead
+    opCvtss2sd, opCvtsd2ss,
+    opCvtsi2ss, opCvtsi2sd,     //Suffixed with l or q for the width of the integer
+    opCvttss2si, opCvttsd2si,
+    opCall, opJmp,
+    opJmpIndirect,  //Jump to the address in the operand
+    opRet, opLeave, opCltd, opCqto, opCltq,
+    //Directives, which come last
+    opText, opRodata,
+    opAlign,        //Aligns to the width
+    opGlobl,
+    opData,         //Number or label difference as big as the width
+    OPCODE_COUNT
+} Opcode;
+#define isDirective(op) ((op).code >= opText)
+
+// Condition codes of setcc, cmovcc and jcc instructions
+typedef enum {
+    condE, condNE,
+    condL, condLE, condG, condGE,
+    condB, condBE, condA, condAE,
+    condP, condNP, condS, condC
+} CondCode;
+
 typedef struct {
-    enum {
-        ins0Op,
-        ins1Op,
-        ins2Op,
-        insLbl,
-        insLblDecl
-    } type;
-    const char_t* opcode;
+    uint8_t code;       //Opcode
+    uint8_t width;      //Operand size in bytes, or 0 if it has no suffix
+    uint8_t cond;       //CondCode, for instructions suffixed with one
+} AsmOp;
+
+#define plainOp(opcode) (AsmOp){opcode}
+#define widthOp(opcode, size) (AsmOp){opcode, size}
+#define condOp(opcode, condition) (AsmOp){opcode, 0, condition}
+
+typedef struct {
+    uint8_t type;
+    AsmOp op;
     union {
         Address operands[2];
         Label label;
+        uint64_t data;
+        labelnum_t labels[2];
     } args;
 } AsmInstruction;
 
-#define op0Instruction(opcode) (AsmInstruction){ins0Op, opcode}
-#define op1Instruction(opcode, op1) (AsmInstruction){ins1Op, opcode, {.operands = {op1}}}
-#define op2Instruction(opcode, op1, op2) (AsmInstruction){ins2Op, opcode, {.operands = {op1, op2}}}
-#define labelInstruction(opcode, lbl) (AsmInstruction){insLbl, opcode, {.label = lbl}}
-#define labelDeclInstruction(lbl) (AsmInstruction){insLblDecl, NULL, {.label = lbl}}
+enum {
+    ins0Op,
+    ins1Op,
+    ins2Op,
+    insLbl,
+    insLblDecl,
+    insData,        //Data directive followed by a number
+    insLblDiff      //Data directive followed by the distance from the second numbered label to the first
+};
+
+#define op0Instruction(op) (AsmInstruction){ins0Op, op}
+#define op1Instruction(op, op1) (AsmInstruction){ins1Op, op, {.operands = {op1}}}
+#define op2Instruction(op, op1, op2) (AsmInstruction){ins2Op, op, {.operands = {op1, op2}}}
+#define labelInstruction(op, lbl) (AsmInstruction){insLbl, op, {.label = lbl}}
+#define labelDeclInstruction(lbl) (AsmInstruction){insLblDecl, {0}, {.label = lbl}}
+#define dataInstruction(size, num) (AsmInstruction){insData, widthOp(opData, size), {.data = num}}
+#define labelDiffInstruction(size, to, from) (AsmInstruction){insLblDiff, widthOp(opData, size), {.labels = {to, from}}}
 
-size_t appendInstr(AsmInstruction ins);
-AsmInstruction* getInstrPtr(size_t i);
+// Instructions keep their addresses until they're removed
+AsmInstruction* appendInstr(AsmInstruction ins);
+// Puts an instruction in front of another, or at the end if that's NULL
+AsmInstruction* insertInstr(AsmInstruction ins, AsmInstruction* before);
+void removeInstr(AsmInstruction* ins);
+// First instruction in program order, or NULL if there are none
+AsmInstruction* firstInstr();
+// Instruction after another, or NULL after the last one
+AsmInstruction* nextInstr(const AsmInstruction* ins);
+size_t instrCount();
 
 void initAddrTable();
 void disposeAddrTable();
 
-void insertAddress(char_t* name, Address addr);
+void insertAddress(char_t* name, Address addr, Type type);
 Address findAddress(char_t* name);
+Type findAddressType(char_t* name);
 
 const char_t* registerStr(Register);
-void emitInstr(const AsmInstruction*);
\ No newline at end of file
+Register sizedRegister(Register reg, size_t size);
+void emitInstr(const AsmInstruction*);
+
+// Shared by the AST walker and the IR lowering
+
+extern const Register paramRegisters[];
+
+// Version of an opcode for operands the size of the type
+#define sizedOpcode(opcode, type) widthOp(opcode, typeSize(type))
+// Instructions whose operands are all the size of the type
+#define sizedOp1Instruction(op, type, op1) op1Instruction(sizedOpcode(op, type), sizedAddress(op1, type))
+#define sizedOp2Instruction(op, type, op1, op2) op2Instruction(sizedOpcode(op, type), sizedAddress(op1, type), sizedAddress(op2, type))
+// Picks the scalar single or double precision version of an SSE opcode
+#define floatOpcode(opcode, type) widthOp(opcode, typeSize(type))
+
+labelnum_t newLabel();
+// Offset of a slot for the type just below the offset, at the type's natural alignment
+offset_t slotBelow(offset_t offset, Type type);
+unsigned log2Floor(uint64_t num);
+char fitsImm32(uint64_t num);
+char needsImm64(Address addr, Type type);
+Address sizedAddress(Address addr, Type type);
+void cmplMov(Address from, Address to, Type type);
+Address cmplConvert(Address value, Type from, Type to, Register reg);
+char cmplMultiConst(uint64_t num, Type type);
+char cmplDivConst(Address left, uint64_t divisor, Type type);
+
+typedef struct {
+    uint64_t num;       //Sign or zero extended to 64 bits according to the type of the switch value
+    labelnum_t label;
+} SwitchCase;
+void cmplSwitch(Address value, Type type, SwitchCase* cases, size_t count, labelnum_t defaultLabel);
+
+struct IrFunction;
+void cmplIrFunction(struct IrFunction* func);
+
+// Machine code for the instruction buffer, along with what the encoder couldn't resolve by itself
+
+typedef enum {
+    secText,
+    secRodata,
+    SECTION_COUNT
+} Section;
+
+typedef struct {
+    const char_t* name;     //NULL for the symbol standing for a whole section
+    Section section;
+    size_t offset;
+    char global;
+    char defined;           //Undefined symbols are functions from other files
+} ObjSymbol;
+
+typedef struct {
+    enum {
+        relPc32,            //32-bit distance from the patched bytes to the symbol plus the addend
+        relPlt32            //Same as relPc32, but for calls and jumps, which the linker can send through the PLT
+    } type;
+    Section section;
+    size_t offset;
+    size_t symbol;          //Index into the object's symbols
+    int64_t addend;
+} Relocation;
+
+#define TYPE uint8_t
+#include "generics/gen_array.h"
+#undef TYPE
+#define TYPE ObjSymbol
+#include "generics/gen_array.h"
+#undef TYPE
+#define TYPE Relocation
+#include "generics/gen_array.h"
+#undef TYPE
+
+typedef struct {
+    Array(uint8_t) sections[SECTION_COUNT];
+    Array(ObjSymbol) symbols;       //Starts with the symbol of each section, in the same order as the sections
+    Array(Relocation) relocations;
+} ObjectCode;
+
+void encodeAllAsm(ObjectCode* object);
+void disposeObjectCode(ObjectCode* object);
+void writeElfObject(const ObjectCode* object);
@@ -1,42 +1,260 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdint.h>
+#include <string.h>
 #include "lexer/lexer.h"
 #include "utils.h"
 #include "ast/ast.h"
 #include "scope/scope.h"
 #include "semantics/symtable.h"
+#include "semantics/fold.h"
 #include "codegen/asm_private.h"
 #include "codegen/codegen.h"
+#include "ir/ir.h"
 
-//IMPORTANT Right now everything is in 64-bit mode, including constants. 
-//This means upper bits will always be extended out so no danger for now. Type conversion will need to be handled when this ends
+//Values are only valid in the low bits that their type covers, and whatever is above them is garbage.
+//Arithmetic happens in 32 or 64 bits, so char and short values only get narrower than that when they are stored into variables.
+//Widening conversions have to extend the value explicitly, while narrowing ones just stop reading the upper bits.
+//Floats and doubles live in the low 32 or 64 bits of SSE registers and go through scalar SSE2 instructions
+
+CodegenOptions codegenOptions = {.optLevel = 0, .inlineLimit = 16};
 
 // # of labels used so far
 static labelnum_t maxLabelNum = 0;
 // Registers used as params in the MS x64 calling convention
-static const Register paramRegisters[] = {$rcx, $rdx, $r8, $r9};
+const Register paramRegisters[] = {$rcx, $rdx, $r8, $r9};
 // r11 will be used as intermediate for all mov operations
 static const Register movIntermediate = $r11;
 // r10 will be used as intermediate for all binop operations
 static const Register binopIntermediate = $r10;
 // rax will be used as intermediate for all unop operations
 static const Register unopIntermediate = $r10;
-static const Register unopByteIntermediate = $r10b;
+// Float params take the SSE register of their position instead of the general purpose one
+static const Register floatParamRegisters[] = {$xmm0, $xmm1, $xmm2, $xmm3};
+// SSE counterparts of the intermediates above. Float results go in xmm0 like integer results go in rax
+static const Register floatMovIntermediate = $xmm5;
+static const Register floatBinopIntermediate = $xmm4;
+static const Register floatResult = $xmm0;
+
+typedef struct {
+    uint64_t bits;
+    Type type;
+    labelnum_t label;
+} FloatConst;
+#define TYPE FloatConst
+#include "generics/gen_array.h"
+#include "generics/gen_array.c"
+#undef TYPE
+// Float constants can't be immediates, so they are loaded from read-only data emitted after the code
+static Array(FloatConst) floatPool;
+
+labelnum_t newLabel(){
+    return maxLabelNum++;
+}
+
+offset_t slotBelow(offset_t offset, Type type){
+    offset_t size = typeSize(type);
+    return -((size - offset + size - 1) / size * size);
+}
+
+unsigned log2Floor(uint64_t num){
+    unsigned log = 0;
+    while (num >>= 1) log++;
+    return log;
+}
+
+char fitsImm32(uint64_t num){
+    return (int64_t)num >= INT32_MIN && (int64_t)num <= INT32_MAX;
+}
+
+//Only movs into registers can take 64-bit immediates. Narrower instructions take immediates of their own size
+char needsImm64(Address addr, Type type){
+    return typeSize(type) == 8 && addr.mode == numberMode && !fitsImm32(addr.val.num);
+}
+
+//Names the part of a register that is as wide as the type and drops the bits of immediates above it.
+//Memory operands are left alone, since their width comes from the opcode
+Address sizedAddress(Address addr, Type type){
+    size_t size = typeSize(type);
+    if (addr.mode == registerMode){
+        addr.reg = sizedRegister(addr.reg, size);
+    }
+    else if (addr.mode == numberMode && size < 8){
+        addr.val.num &= ((uint64_t)1 << size * 8) - 1;
+    }
+    return addr;
+}
+
+static char isFloatRegister(Address addr){
+    return addr.mode == registerMode && addr.reg >= $xmm0 && addr.reg <= $xmm5;
+}
+
+//Returns address of a float constant with the value, stored once per file
+static Address floatConstant(double num, Type type){
+    uint64_t bits = 0;
+    if (type == typFloat32){
+        float single = num;
+        memcpy(&bits, &single, sizeof(single));
+    }
+    else{
+        memcpy(&bits, &num, sizeof(num));
+    }
+    for (size_t i=0; i<floatPool.size; i++){
+        if (floatPool.elem[i].bits == bits && floatPool.elem[i].type == type){
+            return labelAddress(floatPool.elem[i].label);
+        }
+    }
+    FloatConst constant = {bits, type, newLabel()};
+    if (!arrPush(FloatConst)(&floatPool, constant)) exit(1);
+    return labelAddress(constant.label);
+}
 
-static void cmplMov(Address from, Address to){
-    if (from.mode == indirectMode && to.mode == indirectMode){
-        appendInstr(op2Instruction("movq", from, registerAddress(movIntermediate)));
-        appendInstr(op2Instruction("movq", registerAddress(movIntermediate), to));
+//Registers get at least 32 bits so that there are no partial register writes, while memory only gets the bytes of the type
+void cmplMov(Address from, Address to, Type type){
+    if (to.mode == registerMode){
+        //Nothing reads the upper bits, so a register never needs to be moved into itself
+        if (from.mode == registerMode && from.reg == to.reg) return;
+        if (!isFloatType(type)) type = argTypePromotion(type);
+    }
+    if (isFloatType(type)){
+        if (isFloatRegister(from) || isFloatRegister(to)){
+            appendInstr(op2Instruction(floatOpcode(opMovF, type), from, to));
+            return;
+        }
+        //Memory to memory copies only need the bits, which general purpose registers can carry
+        type = typeSize(type) == 4 ? typUInt32 : typUInt64;
+    }
+    if ((from.mode == indirectMode || from.mode == labelMode || needsImm64(from, type)) && to.mode == indirectMode){
+        appendInstr(sizedOp2Instruction(opMov, argTypePromotion(type), from, registerAddress(movIntermediate)));
+        appendInstr(sizedOp2Instruction(opMov, type, registerAddress(movIntermediate), to));
     }
     else{
-        appendInstr(op2Instruction("movq", from, to));
+        appendInstr(sizedOp2Instruction(opMov, type, from, to));
+    }
+}
+
+//Converts between floats and integers, truncating towards 0. Integer results go in reg and float results in the float intermediate
+static Address cmplFloatConvert(Address value, Type from, Type to, Register reg){
+    Address result = registerAddress(isFloatType(to) ? floatMovIntermediate : reg);
+    if (isFloatType(from) && isFloatType(to)){
+        appendInstr(op2Instruction(plainOp(from == typFloat32 ? opCvtss2sd : opCvtsd2ss), value, result));
+        return result;
+    }
+    if (isFloatType(to)){
+        //Only 32 and 64-bit signed integers convert directly, so everything else is extended to one of them first
+        Type width = typeSize(from) < 4 || from == typInt32 ? typInt32 : typInt64;
+        AsmOp opcode = widthOp(to == typFloat32 ? opCvtsi2ss : opCvtsi2sd, typeSize(width));
+        if (from != typUInt64){
+            value = cmplConvert(value, from, width, reg);
+        }
+        if (value.mode == numberMode){
+            cmplMov(value, registerAddress(reg), width);
+            value = registerAddress(reg);
+        }
+        value = sizedAddress(value, width);
+        if (from != typUInt64){
+            appendInstr(op2Instruction(opcode, value, result));
+            return result;
+        }
+        //Unsigned values with the top bit set are halved, keeping the lowest bit so that rounding is unaffected, then doubled back
+        labelnum_t big = newLabel();
+        labelnum_t done = newLabel();
+        Address halved = registerAddress(binopIntermediate);
+        assert(reg != binopIntermediate && "Needs two registers for the conversion");
+        cmplMov(value, registerAddress(reg), typUInt64);
+        appendInstr(op2Instruction(widthOp(opTest, 8), registerAddress(reg), registerAddress(reg)));
+        appendInstr(labelInstruction(condOp(opJcc, condS), numLabel(big)));
+        appendInstr(op2Instruction(opcode, registerAddress(reg), result));
+        appendInstr(labelInstruction(plainOp(opJmp), numLabel(done)));
+        appendInstr(labelDeclInstruction(numLabel(big)));
+        cmplMov(registerAddress(reg), halved, typUInt64);
+        appendInstr(op2Instruction(widthOp(opShr, 8), numberAddress(1), halved));
+        appendInstr(op2Instruction(widthOp(opAnd, 4), numberAddress(1), sizedAddress(registerAddress(reg), typUInt32)));
+        appendInstr(op2Instruction(widthOp(opOr, 8), registerAddress(reg), halved));
+        appendInstr(op2Instruction(opcode, halved, result));
+        appendInstr(op2Instruction(floatOpcode(opAddF, to), result, result));
+        appendInstr(labelDeclInstruction(numLabel(done)));
+        return result;
+    }
+    AsmOp opcode = plainOp(from == typFloat32 ? opCvttss2si : opCvttsd2si);
+    //Unsigned 32-bit results come out of a 64-bit conversion, which covers their whole range
+    if (typeSize(to) < 4 || to == typInt32){
+        appendInstr(op2Instruction(opcode, value, sizedAddress(result, typInt32)));
+        return result;
+    }
+    if (to != typUInt64){
+        appendInstr(op2Instruction(opcode, value, result));
+        return result;
+    }
+    //Values of 2^63 and up don't fit in a signed conversion, so 2^63 is taken off before and put back in the top bit after
+    labelnum_t big = newLabel();
+    labelnum_t done = newLabel();
+    Address floatValue = registerAddress(floatMovIntermediate);
+    Address limit = registerAddress(floatBinopIntermediate);
+    cmplMov(value, floatValue, from);
+    cmplMov(floatConstant(9223372036854775808.0, from), limit, from);
+    appendInstr(op2Instruction(floatOpcode(opUcomiF, from), limit, floatValue));
+    appendInstr(labelInstruction(condOp(opJcc, condAE), numLabel(big)));
+    appendInstr(op2Instruction(opcode, floatValue, result));
+    appendInstr(labelInstruction(plainOp(opJmp), numLabel(done)));
+    appendInstr(labelDeclInstruction(numLabel(big)));
+    appendInstr(op2Instruction(floatOpcode(opSubF, from), limit, floatValue));
+    appendInstr(op2Instruction(opcode, floatValue, result));
+    appendInstr(op2Instruction(widthOp(opBtc, 8), numberAddress(63), result));
+    appendInstr(labelDeclInstruction(numLabel(done)));
+    return result;
+}
+
+//Converts a value to another type, putting it in reg if it has to be extended. Constants are already extended according to their
+//own type, which leaves the right low bits for any wider type
+Address cmplConvert(Address value, Type from, Type to, Register reg){
+    if (from == to){
+        return value;
+    }
+    if (isFloatType(from) || isFloatType(to)){
+        return cmplFloatConvert(value, from, to, reg);
+    }
+    if (value.mode == numberMode || typeSize(to) <= typeSize(from)){
+        return value;
+    }
+    //Writing the lower 32 bits of a register clears its upper half, so zero extension never needs a 64-bit destination
+    char toQuad = typeSize(to) == 8 && isSignedType(from);
+    AsmOp opcode = widthOp(opMov, toQuad ? 8 : 4);
+    switch (typeSize(from)){
+        case 1:
+            opcode.code = isSignedType(from) ? opMovsb : opMovzb;
+            break;
+        case 2:
+            opcode.code = isSignedType(from) ? opMovsw : opMovzw;
+            break;
+        default:
+            if (isSignedType(from)) opcode = widthOp(opMovsl, 8);
+            break;
     }
+    appendInstr(op2Instruction(opcode, sizedAddress(value, from), sizedAddress(registerAddress(reg), toQuad ? typInt64 : typInt32)));
+    return registerAddress(reg);
 }
 
-static void cmplStackPush(Address val, offset_t* frameOffset){
-    *frameOffset -= 8;
-    cmplMov(val, indirectAddress(*frameOffset, $rbp));
+// Lowest the frame offset has gone in the current function, which decides the size of the frame.
+// Slots below the current offset belong to temporaries and scopes that are done, so they get reused
+static offset_t frameLow;
+// Return type of the function being compiled
+static Type returnType;
+
+static Address allocSlot(Type type, offset_t* frameOffset){
+    *frameOffset = slotBelow(*frameOffset, type);
+    if (*frameOffset < frameLow) frameLow = *frameOffset;
+    return indirectAddress(*frameOffset, $rbp);
+}
+
+// Moves a value into a new temporary. A value already in the slot being handed out was left there by a finished
+// temporary, so it's claimed without a move
+static Address cmplStackPush(Address val, Type type, offset_t* frameOffset){
+    Address slot = allocSlot(type, frameOffset);
+    if (val.mode != indirectMode || val.reg != $rbp || val.val.offset != *frameOffset){
+        cmplMov(val, slot, type);
+    }
+    return slot;
 }
 
 static Address cmplExpr(ExprBase* ast, offset_t* frameOffset, offset_t* maxCallSpace);
@@ -45,18 +263,37 @@ static Address cmplExpr(ExprBase* ast, offset_t* frameOffset, offset_t* maxCallS
 static void cmplCall(char_t* name, Array(vptr) *args, offset_t* frameOffset, offset_t* maxCallSpace){
     offset_t callSpace;
     if (args != NULL){
+        offset_t start = *frameOffset;
+        // Args are converted to the types of the params they are passed as
+        const Array(vptr)* params = &findFunc(name)->params;
+        New(Address, values, args->size + 1);
         // Process each argument from right to left
         for (int i=args->size-1; i>=0; i--){
-            Address arg = cmplExpr((ExprBase*)args->elem[i], frameOffset, maxCallSpace);
+            ExprBase* argExpr = args->elem[i];
+            Type paramType = ((StmtVar*)params->elem[i])->type;
+            Address arg = cmplConvert(cmplExpr(argExpr, frameOffset, maxCallSpace), argExpr->type, paramType, movIntermediate);
+            // Evaluating the args after this one can clobber registers, temporaries and the outgoing arg area
+            // with their own calls and divisions, so results outside of variables are kept in new temporaries until the call
+            char isTemp = arg.mode == indirectMode && arg.reg == $rbp && arg.val.offset < start;
+            if (i > 0 && (arg.mode == registerMode || isTemp)){
+                arg = cmplStackPush(arg, paramType, frameOffset);
+            }
+            values[i] = arg;
+        }
+        for (size_t i=0; i<args->size; i++){
+            Type paramType = ((StmtVar*)params->elem[i])->type;
             // Put the first 4 into registers
             if (i < 4){
-                cmplMov(arg, registerAddress(paramRegisters[i]));
+                cmplMov(values[i], registerAddress(isFloatType(paramType) ? floatParamRegisters[i] : paramRegisters[i]), paramType);
             }
             // The rest go onto stack right before the 32-bit shadow call space
             else{
-                cmplMov(arg, indirectAddress(i * 8, $rsp));
+                cmplMov(values[i], indirectAddress(i * 8, $rsp), paramType);
             }
         }
+        free(values);
+        // Temporaries are done once the args are in place
+        *frameOffset = start;
         callSpace = args->size < 4 ? 32 : (args->size * 8);
     }
     else{
@@ -64,39 +301,78 @@ static void cmplCall(char_t* name, Array(vptr) *args, offset_t* frameOffset, off
     }
     // Update max call space of function
     if (callSpace > *maxCallSpace) *maxCallSpace = callSpace; 
-    appendInstr(op1Instruction("call", symbolAddress(name)));
+    appendInstr(op1Instruction(plainOp(opCall), symbolAddress(name)));
 }
 
-static Address cmplUnop(ExprUnop* unop, offset_t* frameOffset, offset_t* maxCallSpace){
+// SSE has no increment or negation, so floats add 1 or flip their sign bit instead
+static Address cmplFloatUnop(ExprUnop* unop, offset_t* frameOffset, offset_t* maxCallSpace){
+    Type type = unop->operand->type;
+    Address temp = registerAddress(floatBinopIntermediate);
+    Address result = registerAddress(floatResult);
+    if (unop->op == tokInc || unop->op == tokDec){
+        Address var = findAddress(((ExprIdent*)unop->operand)->name);
+        cmplMov(var, temp, type);
+        if (!unop->leftside){
+            cmplMov(temp, result, type);
+        }
+        AsmOp opcode = unop->op == tokInc ? floatOpcode(opAddF, type) : floatOpcode(opSubF, type);
+        appendInstr(op2Instruction(opcode, floatConstant(1, type), temp));
+        cmplMov(temp, var, type);
+        return unop->leftside ? var : result;
+    }
     Address addr = cmplExpr(unop->operand, frameOffset, maxCallSpace);
-    // If it's a leftside increment/decrement, then just update and return the operand without a temp value
-    if (unop->leftside){
-        switch(unop->op){
-            case tokInc:
-                appendInstr(op1Instruction("incq", addr));
-                return addr;
-            case tokDec:
-                appendInstr(op1Instruction("decq", addr));
-                return addr;
+    if (unop->op == tokMinus){
+        cmplMov(addr, result, type);
+        cmplMov(floatConstant(-0.0, type), temp, type);
+        appendInstr(op2Instruction(widthOp(opXorF, 4), temp, result));
+        return result;
+    }
+    // Not is true only for operands that are equal to 0 and not NaN, which leaves the parity flag clear
+    assert(unop->op == tokNot && "Not a token unary operator");
+    Address flag = registerAddress(unopIntermediate);
+    appendInstr(op2Instruction(widthOp(opXorF, 4), temp, temp));
+    appendInstr(op2Instruction(floatOpcode(opUcomiF, type), addr, temp));
+    appendInstr(op1Instruction(condOp(opSet, condE), sizedAddress(flag, typInt8)));
+    appendInstr(op1Instruction(condOp(opSet, condNP), registerAddress($r11b)));
+    appendInstr(op2Instruction(widthOp(opAnd, 1), registerAddress($r11b), sizedAddress(flag, typInt8)));
+    appendInstr(op2Instruction(widthOp(opMovzb, 4), sizedAddress(flag, typInt8), sizedAddress(flag, typInt32)));
+    return flag;
+}
+
+static Address cmplUnop(ExprUnop* unop, offset_t* frameOffset, offset_t* maxCallSpace){
+    Type type = unop->operand->type;
+    if (isFloatType(type)){
+        return cmplFloatUnop(unop, frameOffset, maxCallSpace);
+    }
+    if (unop->op == tokInc || unop->op == tokDec){
+        assert(unop->operand->ast.label == astExprIdent && "Only variables can be incremented");
+        Address var = findAddress(((ExprIdent*)unop->operand)->name);
+        // Rightside increment and decrement return the old value, so it's copied out first
+        Address result = var;
+        if (!unop->leftside){
+            result = registerAddress(unopIntermediate);
+            cmplMov(var, result, type);
         }
+        if (unop->op == tokInc){
+            appendInstr(sizedOp1Instruction(opInc, type, var));
+        }
+        else{
+            appendInstr(sizedOp1Instruction(opDec, type, var));
+        }
+        return result;
     }
+    Address addr = cmplExpr(unop->operand, frameOffset, maxCallSpace);
     Address temp = registerAddress(unopIntermediate);
-    cmplMov(addr, temp);
+    cmplMov(addr, temp, type);
     switch(unop->op){
         case tokMinus:
-            appendInstr(op1Instruction("negq", temp));
+            appendInstr(sizedOp1Instruction(opNeg, argTypePromotion(type), temp));
             break;
         case tokNot:
-            appendInstr(op2Instruction("cmpq", numberAddress(0), temp));
-            appendInstr(op1Instruction("sete", registerAddress(unopByteIntermediate)));
-            appendInstr(op2Instruction("movzbq", registerAddress(unopByteIntermediate), registerAddress(unopIntermediate)));
-            break;
-        // Rightside increment and decrement
-        case tokInc:
-            appendInstr(op1Instruction("incq", addr));
-            break;
-        case tokDec:
-            appendInstr(op1Instruction("decq", addr));
+            // Only the bits of the operand's own type count, so the comparison is exactly that wide
+            appendInstr(sizedOp2Instruction(opCmp, type, numberAddress(0), temp));
+            appendInstr(op1Instruction(condOp(opSet, condE), sizedAddress(temp, typInt8)));
+            appendInstr(op2Instruction(widthOp(opMovzb, 4), sizedAddress(temp, typInt8), sizedAddress(temp, typInt32)));
             break;
         default:
             assert(0 && "Not a token unary operator");
@@ -104,165 +380,925 @@ static Address cmplUnop(ExprUnop* unop, offset_t* frameOffset, offset_t* maxCall
     return temp;
 }
 
-//Multiply left by right and store in rax. Promotes result to type
+static char isPowerOfTwo(uint64_t num){
+    return num != 0 && (num & (num - 1)) == 0;
+}
+
+//Multiply rax by a constant using shifts and lea instead of imul. Returns whether the constant was simple enough
+char cmplMultiConst(uint64_t num, Type type){
+    type = argTypePromotion(type);
+    Address rax = registerAddress($rax);
+    //Only the lower half of the constant matters to a 32-bit product, so it can be treated as signed
+    if (typeSize(type) == 4){
+        num = (int64_t)(int32_t)num;
+    }
+    //Multiplying by a negated power of two is a shift followed by a negate
+    char negate = !isPowerOfTwo(num) && isPowerOfTwo(-num);
+    if (negate) num = -num;
+    //Strip off power of two factors so that they can be done as a shift at the end
+    unsigned shift = 0;
+    while (num != 0 && num % 2 == 0){
+        num /= 2;
+        shift++;
+    }
+    switch (num){
+        case 0:
+            cmplMov(numberAddress(0), rax, type);
+            return 1;
+        case 1:
+            break;
+        //lea can multiply by 3, 5, or 9 by adding a register to its scaled self
+        case 3:
+        case 5:
+        case 9:
+            appendInstr(op2Instruction(sizedOpcode(opLea, type), indexedAddress($rax, $rax, num - 1), sizedAddress(rax, type)));
+            break;
+        default:
+            return 0;
+    }
+    if (shift){
+        appendInstr(sizedOp2Instruction(opSal, type, numberAddress(shift), rax));
+    }
+    if (negate){
+        appendInstr(sizedOp1Instruction(opNeg, type, rax));
+    }
+    return 1;
+}
+
+//Multiply left by right and store in rax. The lower half of the product is the same whether or not the operands are signed
 static void cmplMulti(Address left, Address right, Type type){
     assert(left.mode == indirectMode && "Left operand must be on stack");
+    Address rax = registerAddress($rax);
+    if (right.mode == numberMode){
+        cmplMov(left, rax, type);
+        if (cmplMultiConst(right.val.num, type)){
+            return;
+        }
+        if (!needsImm64(right, type)){
+            appendInstr(sizedOp2Instruction(opImul, type, right, rax));
+            return;
+        }
+        cmplMov(right, registerAddress(binopIntermediate), type);
+        appendInstr(sizedOp2Instruction(opImul, type, registerAddress(binopIntermediate), rax));
+        return;
+    }
     //Put right operand on rax if its not already there
-    if (right.mode != registerMode || right.val.reg != $rax){
-        cmplMov(right, registerAddress($rax));
-        right = registerAddress($rax);
+    if (right.mode != registerMode || right.reg != $rax){
+        cmplMov(right, rax, type);
     }
-    if (isSignedType(type)){
-        appendInstr(op1Instruction("imulq", left));
+    appendInstr(sizedOp2Instruction(opImul, type, left, rax));
+}
+
+//Magic numbers for replacing division by a constant with multiplication by its fixed point reciprocal, from Hacker's Delight
+typedef struct {
+    uint64_t magic;
+    unsigned shift;
+    char add;   //Only used for unsigned division, when the magic number needs 65 bits
+} DivMagic;
+
+//Divisor must not be 0 or a power of two
+static DivMagic unsignedDivMagic(uint64_t divisor){
+    const uint64_t maxSigned = INT64_MAX;
+    DivMagic mag = {0, 0, 0};
+    unsigned p = 63;
+    uint64_t pow = 0;   //2^(p-64)
+    uint64_t q = maxSigned / divisor;
+    uint64_t r = maxSigned - q * divisor;
+    uint64_t delta;
+    do {
+        p++;
+        pow = p == 64 ? 1 : pow * 2;
+        if (r + 1 >= divisor - r){
+            if (q >= maxSigned) mag.add = 1;
+            q = 2 * q + 1;
+            r = 2 * r + 1 - divisor;
+        }
+        else{
+            if (q >= (uint64_t)INT64_MIN) mag.add = 1;
+            q = 2 * q;
+            r = 2 * r + 1;
+        }
+        delta = divisor - 1 - r;
+    } while (p < 128 && pow < delta);
+    mag.magic = q + 1;
+    mag.shift = p - 64;
+    return mag;
+}
+
+//Divisor must not be -1, 0, 1 or a power of two in absolute value
+static DivMagic signedDivMagic(int64_t divisor){
+    const uint64_t two63 = (uint64_t)INT64_MIN;
+    uint64_t ad = divisor < 0 ? -(uint64_t)divisor : (uint64_t)divisor;
+    uint64_t t = two63 + ((uint64_t)divisor >> 63);
+    uint64_t anc = t - 1 - t % ad;
+    unsigned p = 63;
+    uint64_t q1 = two63 / anc, r1 = two63 - q1 * anc;
+    uint64_t q2 = two63 / ad, r2 = two63 - q2 * ad;
+    uint64_t delta;
+    do {
+        p++;
+        q1 = 2 * q1;
+        r1 = 2 * r1;
+        if (r1 >= anc){
+            q1++;
+            r1 -= anc;
+        }
+        q2 = 2 * q2;
+        r2 = 2 * r2;
+        if (r2 >= ad){
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    DivMagic mag = {q2 + 1, p - 64, 0};
+    if (divisor < 0) mag.magic = -mag.magic;
+    return mag;
+}
+
+//Divide left by a constant without using div. Result is stored in rax. Returns whether the constant could be handled
+char cmplDivConst(Address left, uint64_t divisor, Type type){
+    if (divisor == 0){
+        return 0;
     }
-    else{
-        appendInstr(op1Instruction("mulq", left));
+    //32-bit dividends are extended so that the 64-bit sequences below work on them. The divisor is already extended
+    if (typeSize(type) == 4){
+        type = isSignedType(type) ? typInt64 : typUInt64;
+        left = cmplConvert(left, isSignedType(type) ? typInt32 : typUInt32, type, movIntermediate);
+    }
+    Address rax = registerAddress($rax);
+    Address rdx = registerAddress($rdx);
+    cmplMov(left, rax, type);
+    if (!isSignedType(type)){
+        if (isPowerOfTwo(divisor)){
+            if (divisor > 1){
+                appendInstr(op2Instruction(widthOp(opShr, 8), numberAddress(log2Floor(divisor)), rax));
+            }
+            return 1;
+        }
+        //Take the upper half of the product with the magic number
+        DivMagic mag = unsignedDivMagic(divisor);
+        cmplMov(numberAddress(mag.magic), registerAddress(binopIntermediate), type);
+        appendInstr(op1Instruction(widthOp(opMul, 8), registerAddress(binopIntermediate)));
+        if (mag.add){
+            //The magic number overflowed 64 bits, so add the dividend back in without overflowing: ((n - hi) / 2 + hi)
+            cmplMov(left, rax, type);
+            appendInstr(op2Instruction(widthOp(opSub, 8), rdx, rax));
+            appendInstr(op2Instruction(widthOp(opShr, 8), numberAddress(1), rax));
+            appendInstr(op2Instruction(widthOp(opAdd, 8), rdx, rax));
+            if (mag.shift > 1){
+                appendInstr(op2Instruction(widthOp(opShr, 8), numberAddress(mag.shift - 1), rax));
+            }
+        }
+        else{
+            if (mag.shift){
+                appendInstr(op2Instruction(widthOp(opShr, 8), numberAddress(mag.shift), rdx));
+            }
+            cmplMov(rdx, rax, type);
+        }
+        return 1;
+    }
+    int64_t sdivisor = divisor;
+    uint64_t absDivisor = sdivisor < 0 ? -divisor : divisor;
+    if (isPowerOfTwo(absDivisor)){
+        unsigned log = log2Floor(absDivisor);
+        if (log){
+            //Negative dividends need 2^k - 1 added before shifting so that the quotient rounds towards 0
+            cmplMov(rax, rdx, type);
+            appendInstr(op2Instruction(widthOp(opSar, 8), numberAddress(63), rdx));
+            appendInstr(op2Instruction(widthOp(opShr, 8), numberAddress(64 - log), rdx));
+            appendInstr(op2Instruction(widthOp(opAdd, 8), rdx, rax));
+            appendInstr(op2Instruction(widthOp(opSar, 8), numberAddress(log), rax));
+        }
+        if (sdivisor < 0){
+            appendInstr(op1Instruction(widthOp(opNeg, 8), rax));
+        }
+        return 1;
+    }
+    DivMagic mag = signedDivMagic(sdivisor);
+    cmplMov(numberAddress(mag.magic), registerAddress(binopIntermediate), type);
+    appendInstr(op1Instruction(widthOp(opImul, 8), registerAddress(binopIntermediate)));
+    //Correct the high half when the magic number's sign doesn't match the divisor's
+    if (sdivisor > 0 && (int64_t)mag.magic < 0){
+        appendInstr(op2Instruction(widthOp(opAdd, 8), left, rdx));
     }
+    else if (sdivisor < 0 && (int64_t)mag.magic > 0){
+        appendInstr(op2Instruction(widthOp(opSub, 8), left, rdx));
+    }
+    if (mag.shift){
+        appendInstr(op2Instruction(widthOp(opSar, 8), numberAddress(mag.shift), rdx));
+    }
+    //Add 1 to negative quotients so that they round towards 0
+    cmplMov(rdx, rax, type);
+    appendInstr(op2Instruction(widthOp(opShr, 8), numberAddress(63), rax));
+    appendInstr(op2Instruction(widthOp(opAdd, 8), rdx, rax));
+    return 1;
 }
+
 static void cmplDiv(Address left, Address right, Type type){
     assert(left.mode == indirectMode && "Left operand must be on stack");
+    if (right.mode == numberMode && cmplDivConst(left, right.val.num, type)){
+        return;
+    }
     //Can't run div instruction on a number. Also must have left operand on rax, so right operand can't be on rax
-    if (right.mode == numberMode || (right.mode == registerMode && right.val.reg == $rax)){
-        cmplMov(right, registerAddress(binopIntermediate));
+    if (right.mode == numberMode || (right.mode == registerMode && right.reg == $rax)){
+        cmplMov(right, registerAddress(binopIntermediate), type);
         right = registerAddress(binopIntermediate);
     }
-    cmplMov(left, registerAddress($rax));
+    cmplMov(left, registerAddress($rax), type);
     if (isSignedType(type)){
-        appendInstr(op0Instruction("cqto"));
-        appendInstr(op1Instruction("idivq", right));
+        appendInstr(op0Instruction(typeSize(type) == 8 ? plainOp(opCqto) : plainOp(opCltd)));
+        appendInstr(sizedOp1Instruction(opIdiv, type, right));
     }
     else{
-        cmplMov(numberAddress(0), registerAddress($rdx));
-        appendInstr(op1Instruction("divq", right));
+        cmplMov(numberAddress(0), registerAddress($rdx), type);
+        appendInstr(sizedOp1Instruction(opDiv, type, right));
     }
 }
-// Perform specified arithemtic operation on operands and store value in left operand
-static void cmplArith(const char_t* op, Address left, Address right, Type type){
-    // Can't have both operands on stack, so move second one to intermediate register. 
-    if (right.mode == indirectMode){
-        cmplMov(right, registerAddress(binopIntermediate));
+// Perform specified arithemtic operation on operands of the type and store value in left operand
+static void cmplArith(AsmOp opcode, Address left, Address right, Type type){
+    // Can't have both operands on stack, so move second one to intermediate register. Same goes for 64-bit constants
+    if (right.mode == indirectMode || needsImm64(right, type)){
+        cmplMov(right, registerAddress(binopIntermediate), type);
         right = registerAddress(binopIntermediate);
     }
-    appendInstr(op2Instruction(op, right, left));
+    appendInstr(op2Instruction(opcode, sizedAddress(right, type), sizedAddress(left, type)));
 }
-// Do relational comparison and store result in rax
-static Address cmplRel(Token relOp, Address left, Address right, Type type){
-    const char_t* opcode;
-    switch(relOp){
-        case tokEquals:
-            opcode = "sete";
-            break;
-        case tokNotEquals:
-            opcode = "setne";
-            break;
-        case tokGreaterEquals:
-            if (isSignedType(type)) opcode = "setge";
-            else opcode = "setae";
-            break;
-        case tokLessEquals:
-            if (isSignedType(type)) opcode = "setle";
-            else opcode = "setbe";
-            break;
-        case tokGreater:
-            if (isSignedType(type)) opcode = "setg";
-            else opcode = "seta";
-            break;
-        case tokLess:
-            if (isSignedType(type)) opcode = "setl";
-            else opcode = "setb";
-            break;
+
+// Perform a scalar SSE operation on left and right, leaving the result in the float result register
+static Address cmplFloatArith(AsmOp opcode, Address left, Address right, Type type){
+    Address result = registerAddress(floatResult);
+    // Loading the left operand would overwrite a right operand that is already in the result register
+    if (right.mode == registerMode && right.reg == floatResult){
+        cmplMov(right, registerAddress(floatBinopIntermediate), type);
+        right = registerAddress(floatBinopIntermediate);
     }
-    cmplArith("cmpq", left, right, type);
-    appendInstr(op1Instruction(opcode, registerAddress($al)));
-    appendInstr(op2Instruction("movzbq", registerAddress($al), registerAddress($rax)));
-    return registerAddress($rax);
+    cmplMov(left, result, type);
+    appendInstr(op2Instruction(opcode, right, result));
+    return result;
 }
 
-// Move left operand onto stack and destructively operate on it
-static Address cmplBinop(ExprBinop* binop, offset_t* frameOffset, offset_t* maxCallSpace){    
-    Address left = cmplExpr(binop->left, frameOffset, maxCallSpace);
-    // Move left operand onto the stack unless we're assigning to it directly
-    if (!isAssignmentOp(binop->op)){
-        cmplStackPush(left, frameOffset);
-        left = indirectAddress(*frameOffset, $rbp);
+// Perform the arithmetic operator on left, which must be on the stack, and right. Returns where the result ends up
+static Address cmplArithOp(Token op, Address left, Address right, Type type){
+    if (isFloatType(type)){
+        switch(op){
+            case tokPlus:
+                return cmplFloatArith(floatOpcode(opAddF, type), left, right, type);
+            case tokMinus:
+                return cmplFloatArith(floatOpcode(opSubF, type), left, right, type);
+            case tokMulti:
+                return cmplFloatArith(floatOpcode(opMulF, type), left, right, type);
+            case tokDiv:
+                return cmplFloatArith(floatOpcode(opDivF, type), left, right, type);
+            default:
+                assert(0 && "Unhandled arithmetic operator.");
+        }
     }
-    Address right = cmplExpr(binop->right, frameOffset, maxCallSpace);
-    
-    // Left operand will always be the destination operand that is mutated
-    switch(binop->op){
-        case tokAssign:
-            cmplArith("movq", left, right, binop->right->type);
-            return left;
-        case tokPlusAssign:
+    switch(op){
         case tokPlus:
-            cmplArith("addq", left, right, binop->right->type);
+            cmplArith(sizedOpcode(opAdd, type), left, right, type);
             return left;
-        case tokMinusAssign:
         case tokMinus:
-            cmplArith("subq", left, right, binop->right->type);
+            cmplArith(sizedOpcode(opSub, type), left, right, type);
             return left;
         case tokMulti:
-            cmplMulti(left, right, binop->base.type);
+            cmplMulti(left, right, type);
             return registerAddress($rax);
-        case tokMultiAssign:
-            cmplMulti(left, right, binop->right->type);
-            cmplMov(registerAddress($rax), left);
-            return left;
         case tokDiv:
-            cmplDiv(left, right, binop->base.type);
+            cmplDiv(left, right, type);
             return registerAddress($rax);
-        case tokDivAssign:
-            cmplDiv(left, right, binop->right->type);
-            cmplMov(registerAddress($rax), left);
-            return left;
+        default:
+            assert(0 && "Unhandled arithmetic operator.");
+    }
+}
+
+static CondCode negateCond(CondCode cond){
+    switch(cond){
+        case condE: return condNE;
+        case condNE: return condE;
+        case condL: return condGE;
+        case condLE: return condG;
+        case condG: return condLE;
+        case condGE: return condL;
+        case condB: return condAE;
+        case condBE: return condA;
+        case condA: return condBE;
+        case condAE: return condB;
+        default:
+            assert(0 && "Not a condition code");
+    }
+}
 
+// Condition code that is set when the comparison of left against right is true
+static CondCode relCondCode(Token relOp, Type type){
+    switch(relOp){
         case tokEquals:
+            return condE;
         case tokNotEquals:
+            return condNE;
         case tokGreaterEquals:
+            return isSignedType(type) ? condGE : condAE;
         case tokLessEquals:
+            return isSignedType(type) ? condLE : condBE;
         case tokGreater:
+            return isSignedType(type) ? condG : condA;
         case tokLess:
-            return cmplRel(binop->op, left, right, binop->right->type);
+            return isSignedType(type) ? condL : condB;
+        default:
+            assert(0 && "Not a relational operator");
+    }
+}
 
+// Float comparisons set the flags like unsigned ones, except that NaN operands set the carry, zero and parity flags all at once.
+// Less than is tested as greater than with the operands swapped so that NaN makes every ordering false
+static CondCode cmplFloatCompare(Token relOp, Address left, Address right, Type type){
+    Address temp = registerAddress(floatBinopIntermediate);
+    if (relOp == tokLess || relOp == tokLessEquals){
+        if (!isFloatRegister(right)){
+            cmplMov(right, temp, type);
+            right = temp;
+        }
+        appendInstr(op2Instruction(floatOpcode(opUcomiF, type), left, right));
+        return relOp == tokLess ? condA : condAE;
+    }
+    cmplMov(left, temp, type);
+    appendInstr(op2Instruction(floatOpcode(opUcomiF, type), right, temp));
+    switch(relOp){
+        case tokGreater:
+            return condA;
+        case tokGreaterEquals:
+            return condAE;
         default:
-            assert(0 && "Unhandled binop.");
+            return relCondCode(relOp, type);
+    }
+}
+
+// Float equality also depends on the parity flag, since NaN operands compare as unequal
+static char isFloatEquality(const ExprBinop* binop){
+    return isFloatType(binop->left->type) && (binop->op == tokEquals || binop->op == tokNotEquals);
+}
+
+// Jumps to target if the last float comparison found its operands equal and jumpIfEqual is set, or if it didn't and it isn't
+static void cmplFloatEqualJump(char jumpIfEqual, labelnum_t target){
+    if (jumpIfEqual){
+        labelnum_t skip = newLabel();
+        appendInstr(labelInstruction(condOp(opJcc, condP), numLabel(skip)));
+        appendInstr(labelInstruction(condOp(opJcc, condE), numLabel(target)));
+        appendInstr(labelDeclInstruction(numLabel(skip)));
+    }
+    else{
+        appendInstr(labelInstruction(condOp(opJcc, condP), numLabel(target)));
+        appendInstr(labelInstruction(condOp(opJcc, condNE), numLabel(target)));
+    }
+}
+
+// Evaluate both operands of a relational binop and compare them, leaving the result in the flags.
+// Returns the condition code that is set when the comparison is true
+static CondCode cmplCompare(ExprBinop* binop, offset_t* frameOffset, offset_t* maxCallSpace){
+    offset_t start = *frameOffset;
+    Address left = cmplExpr(binop->left, frameOffset, maxCallSpace);
+    *frameOffset = start;
+    // Both operands were promoted to the same type
+    Type type = binop->left->type;
+    left = cmplStackPush(left, type, frameOffset);
+    Address right = cmplExpr(binop->right, frameOffset, maxCallSpace);
+    CondCode cond;
+    if (isFloatType(type)){
+        cond = cmplFloatCompare(binop->op, left, right, type);
+    }
+    else{
+        cmplArith(sizedOpcode(opCmp, type), left, right, type);
+        cond = relCondCode(binop->op, type);
     }
+    // The result is in the flags, so every temporary is done
+    *frameOffset = start;
+    return cond;
 }
 
-// Returns address of the result of the processed expression
+static char isRelationalOp(Token op){
+    switch(op){
+        case tokEquals:
+        case tokNotEquals:
+        case tokGreaterEquals:
+        case tokLessEquals:
+        case tokGreater:
+        case tokLess:
+            return 1;
+    }
+    return 0;
+}
+
+// Do relational comparison and store result in rax
+static Address cmplRel(ExprBinop* binop, offset_t* frameOffset, offset_t* maxCallSpace){
+    CondCode cond = cmplCompare(binop, frameOffset, maxCallSpace);
+    appendInstr(op1Instruction(condOp(opSet, cond), registerAddress($al)));
+    if (isFloatEquality(binop)){
+        appendInstr(op1Instruction(cond == condE ? condOp(opSet, condNP) : condOp(opSet, condP), registerAddress($r10b)));
+        appendInstr(op2Instruction(cond == condE ? widthOp(opAnd, 1) : widthOp(opOr, 1), registerAddress($r10b), registerAddress($al)));
+    }
+    appendInstr(op2Instruction(widthOp(opMovzb, 4), registerAddress($al), registerAddress($eax)));
+    return registerAddress($rax);
+}
+
+// Evaluates expression as a condition and jumps to target if its truth value equals jumpIfTrue, falling through otherwise.
+// Logical and relational operators branch directly on the flags instead of materializing a boolean
+static void cmplCondJump(ExprBase* expr, char jumpIfTrue, labelnum_t target, offset_t* frameOffset, offset_t* maxCallSpace){
+    if (expr->ast.label == astExprBinop){
+        ExprBinop* binop = (ExprBinop*)expr;
+        if (binop->op == tokAnd || binop->op == tokOr){
+            // && is decided early by a false left operand and || by a true one
+            char decidedOn = binop->op == tokOr;
+            if (jumpIfTrue == decidedOn){
+                cmplCondJump(binop->left, jumpIfTrue, target, frameOffset, maxCallSpace);
+                cmplCondJump(binop->right, jumpIfTrue, target, frameOffset, maxCallSpace);
+            }
+            else{
+                // Left operand deciding the result means the right operand must be skipped without taking the jump
+                labelnum_t skip = maxLabelNum++;
+                cmplCondJump(binop->left, decidedOn, skip, frameOffset, maxCallSpace);
+                cmplCondJump(binop->right, jumpIfTrue, target, frameOffset, maxCallSpace);
+                appendInstr(labelDeclInstruction(numLabel(skip)));
+            }
+            return;
+        }
+        if (isRelationalOp(binop->op)){
+            CondCode cond = cmplCompare(binop, frameOffset, maxCallSpace);
+            if (isFloatEquality(binop)){
+                cmplFloatEqualJump((cond == condE) == jumpIfTrue, target);
+                return;
+            }
+            appendInstr(labelInstruction(condOp(opJcc, jumpIfTrue ? cond : negateCond(cond)), numLabel(target)));
+            return;
+        }
+    }
+    else if (expr->ast.label == astExprUnop && ((ExprUnop*)expr)->op == tokNot){
+        cmplCondJump(((ExprUnop*)expr)->operand, !jumpIfTrue, target, frameOffset, maxCallSpace);
+        return;
+    }
+    Address cond = cmplExpr(expr, frameOffset, maxCallSpace);
+    // Constant conditions either always jump or never jump
+    if (cond.mode == numberMode){
+        if ((cond.val.num != 0) == jumpIfTrue){
+            appendInstr(labelInstruction(plainOp(opJmp), numLabel(target)));
+        }
+        return;
+    }
+    if (isFloatType(expr->type)){
+        Address zero = registerAddress(floatBinopIntermediate);
+        appendInstr(op2Instruction(widthOp(opXorF, 4), zero, zero));
+        appendInstr(op2Instruction(floatOpcode(opUcomiF, expr->type), cond, zero));
+        cmplFloatEqualJump(!jumpIfTrue, target);
+        return;
+    }
+    appendInstr(sizedOp2Instruction(opCmp, expr->type, numberAddress(0), cond));
+    appendInstr(labelInstruction(jumpIfTrue ? condOp(opJcc, condNE) : condOp(opJcc, condE), numLabel(target)));
+}
+
+static char isFalseConstant(ExprBase* expr){
+    switch(expr->ast.label){
+        case astExprInt:
+            return ((ExprInt*)expr)->num == 0;
+        case astExprLong:
+            return ((ExprLong*)expr)->num == 0;
+    }
+    return 0;
+}
+
+// Logical operators used as values produce 0 or 1 in rax, with the branches doing the short-circuiting
+static Address cmplLogical(ExprBinop* binop, offset_t* frameOffset, offset_t* maxCallSpace){
+    labelnum_t falseLbl = maxLabelNum++;
+    labelnum_t endLbl = maxLabelNum++;
+    cmplCondJump((ExprBase*)binop, 0, falseLbl, frameOffset, maxCallSpace);
+    cmplMov(numberAddress(1), registerAddress($rax), typInt32);
+    appendInstr(labelInstruction(plainOp(opJmp), numLabel(endLbl)));
+    appendInstr(labelDeclInstruction(numLabel(falseLbl)));
+    cmplMov(numberAddress(0), registerAddress($rax), typInt32);
+    appendInstr(labelDeclInstruction(numLabel(endLbl)));
+    return registerAddress($rax);
+}
+
+// Assignments store into the variable's own type. Compound ones do their arithmetic in the type both sides were promoted to
+static Address cmplAssign(ExprBinop* binop, offset_t* frameOffset, offset_t* maxCallSpace){
+    assert(binop->left->ast.label == astExprIdent && "Can only assign to variables");
+    char_t* name = ((ExprIdent*)binop->left)->name;
+    Address var = findAddress(name);
+    Type varType = findAddressType(name);
+    Address right = cmplExpr(binop->right, frameOffset, maxCallSpace);
+    if (binop->op == tokAssign){
+        cmplMov(cmplConvert(right, binop->right->type, varType, movIntermediate), var, varType);
+        return var;
+    }
+    Type type = binop->left->type;
+    Address left = var;
+    // A variable narrower than the arithmetic is extended into a temporary first. The right operand goes to a temporary
+    // before that if it's in a register, since extending can overwrite it
+    if (varType != type){
+        if (right.mode == registerMode){
+            right = cmplStackPush(right, type, frameOffset);
+        }
+        left = cmplStackPush(cmplConvert(var, varType, type, movIntermediate), type, frameOffset);
+    }
+    Token op;
+    switch(binop->op){
+        case tokPlusAssign:
+            op = tokPlus;
+            break;
+        case tokMinusAssign:
+            op = tokMinus;
+            break;
+        case tokMultiAssign:
+            op = tokMulti;
+            break;
+        case tokDivAssign:
+            op = tokDiv;
+            break;
+        default:
+            assert(0 && "Unhandled assignment.");
+    }
+    Address result = cmplArithOp(op, left, right, type);
+    if (result.mode != indirectMode || result.val.offset != var.val.offset){
+        cmplMov(cmplConvert(result, type, varType, movIntermediate), var, varType);
+    }
+    return var;
+}
+
+// Move left operand onto stack and destructively operate on it
+static Address cmplBinop(ExprBinop* binop, offset_t* frameOffset, offset_t* maxCallSpace){    
+    // Comparisons and logical operators evaluate their operands on their own
+    if (binop->op == tokAnd || binop->op == tokOr){
+        return cmplLogical(binop, frameOffset, maxCallSpace);
+    }
+    if (isRelationalOp(binop->op)){
+        return cmplRel(binop, frameOffset, maxCallSpace);
+    }
+    if (isAssignmentOp(binop->op)){
+        return cmplAssign(binop, frameOffset, maxCallSpace);
+    }
+    // Both operands were promoted to the same type
+    Type type = binop->left->type;
+    offset_t start = *frameOffset;
+    Address left = cmplExpr(binop->left, frameOffset, maxCallSpace);
+    *frameOffset = start;
+    left = cmplStackPush(left, type, frameOffset);
+    offset_t afterLeft = *frameOffset;
+    Address right = cmplExpr(binop->right, frameOffset, maxCallSpace);
+    // Nothing below is allocated before the right operand is used, so its temporaries can be released now.
+    // The left operand's slot stays taken, since it may hold the result
+    *frameOffset = afterLeft;
+    
+    return cmplArithOp(binop->op, left, right, type);
+}
+
+// Type of the value an expression produces, before it's converted into the type its parent wants
+static Type valueType(const ExprBase* expr){
+    switch(expr->ast.label){
+        case astExprCall:
+            return findFunc(((const ExprCall*)expr)->name)->type;
+        case astExprIdent:
+            return findAddressType(((const ExprIdent*)expr)->name);
+        case astExprBinop: {
+            const ExprBinop* binop = (const ExprBinop*)expr;
+            if (binop->op == tokAnd || binop->op == tokOr || isRelationalOp(binop->op)){
+                return typInt32;
+            }
+            if (isAssignmentOp(binop->op)){
+                return findAddressType(((const ExprIdent*)binop->left)->name);
+            }
+            return binop->left->type;
+        }
+        case astExprUnop: {
+            const ExprUnop* unop = (const ExprUnop*)expr;
+            return unop->op == tokNot ? typInt32 : unop->operand->type;
+        }
+    }
+    return expr->type;
+}
+
+// Returns address of the result of the processed expression, converted to the expression's type
 static Address cmplExpr(ExprBase* expr, offset_t* frameOffset, offset_t* maxCallSpace){
     assert(
         (expr->ast.label == astExprCall || expr->type != typVoid) && 
         "Other than calls, void expressions can't exist."
     );
     assert(expr->type != typNone && "None expressions can't exist at all.");
+    Address value;
     switch(expr->ast.label){
+        //Constants are already of their expression's type
         case astExprInt:
+            //Signed constants get sign extended to 64 bits so that they read the same in every width
+            if (isSignedType(expr->type)){
+                return numberAddress((int64_t)(int32_t)((ExprInt*)expr)->num);
+            }
             return numberAddress(((ExprInt*)expr)->num);
         case astExprLong:
             return numberAddress(((ExprLong*)expr)->num);
+        case astExprFloat:
+            return floatConstant(((ExprFloat*)expr)->num, typFloat32);
+        case astExprDouble:
+            return floatConstant(((ExprDouble*)expr)->num, typFloat64);
         case astExprCall:
             cmplCall(((ExprCall*)expr)->name, &((ExprCall*)expr)->args, frameOffset, maxCallSpace);
-            return registerAddress($rax);
+            value = registerAddress(isFloatType(valueType(expr)) ? floatResult : $rax);
+            break;
         case astExprIdent:
-            return findAddress(((ExprIdent*)expr)->name);
-        case astExprBinop: {
-            return cmplBinop((ExprBinop*)expr, frameOffset, maxCallSpace);
-        }
+            value = findAddress(((ExprIdent*)expr)->name);
+            break;
+        case astExprBinop:
+            value = cmplBinop((ExprBinop*)expr, frameOffset, maxCallSpace);
+            break;
         case astExprUnop: 
-            return cmplUnop((ExprUnop*)expr, frameOffset, maxCallSpace);
+            value = cmplUnop((ExprUnop*)expr, frameOffset, maxCallSpace);
+            break;
         default:
             assert(0 && "Unsupported AST for expr");
     }
+    return cmplConvert(value, valueType(expr), expr->type, movIntermediate);
+}
+
+// Switches dispatch each range of cases on its own. Dense ranges index a table of jump offsets in read-only data,
+// ranges with only a few targets test the value's bit in a mask of each target's cases, and anything else is split
+// in half by a comparison until few enough cases are left to compare one by one
+
+// Fewest cases worth a table, and how many table entries each case can pay for
+#define MIN_TABLE_CASES 4
+#define TABLE_ENTRIES_PER_CASE 3
+// Most targets worth testing bits for. Fewer targets than cases means the masks save compares
+#define MAX_BIT_TEST_TARGETS 3
+#define MIN_BIT_TEST_CASES 3
+#define MAX_LINEAR_CASES 3
+
+// Whether the cases being sorted compare as signed
+static char signedCases;
+
+static int compareCases(const void* a, const void* b){
+    uint64_t left = ((const SwitchCase*)a)->num;
+    uint64_t right = ((const SwitchCase*)b)->num;
+    if (signedCases) return (int64_t)left < (int64_t)right ? -1 : (int64_t)left > (int64_t)right;
+    return left < right ? -1 : left > right;
+}
+
+// Distance of num above min, wrapped to the width of the type
+static uint64_t caseOffset(uint64_t num, uint64_t min, Type type){
+    uint64_t offset = num - min;
+    return typeSize(type) == 8 ? offset : offset & UINT32_MAX;
+}
+
+static size_t countTargets(const SwitchCase* cases, size_t count){
+    size_t targets = 0;
+    for (size_t i=0; i<count; i++){
+        size_t j = 0;
+        while (cases[j].label != cases[i].label) j++;
+        if (j == i) targets++;
+    }
+    return targets;
+}
+
+// Compares the value in rax against num
+static void cmplCaseCompare(uint64_t num, Type type){
+    Address right = numberAddress(num);
+    if (needsImm64(right, type)){
+        cmplMov(right, registerAddress($r10), type);
+        right = registerAddress($r10);
+    }
+    appendInstr(sizedOp2Instruction(opCmp, type, right, registerAddress($rax)));
+}
+
+// Moves the value in rax down by the smallest case and goes to the default if that leaves it above span.
+// Narrower values are zero extended by the subtraction, so rax can index with all 64 bits afterwards
+static void cmplRangeCheck(uint64_t min, uint64_t span, Type type, labelnum_t defaultLabel){
+    if (min != 0){
+        Address low = numberAddress(min);
+        if (needsImm64(low, type)){
+            cmplMov(low, registerAddress($r10), type);
+            low = registerAddress($r10);
+        }
+        appendInstr(sizedOp2Instruction(opSub, type, low, registerAddress($rax)));
+    }
+    cmplCaseCompare(span, type);
+    appendInstr(labelInstruction(condOp(opJcc, condA), numLabel(defaultLabel)));
+}
+
+// Entries are offsets from the table itself, so they're the same wherever the code is loaded
+static void cmplJumpTable(const SwitchCase* cases, size_t count, uint64_t span, Type type, labelnum_t defaultLabel){
+    cmplRangeCheck(cases[0].num, span, type, defaultLabel);
+    labelnum_t table = newLabel();
+    appendInstr(op2Instruction(widthOp(opLea, 8), labelAddress(table), registerAddress($r11)));
+    appendInstr(op2Instruction(widthOp(opMovsl, 8), indexedAddress($r11, $rax, 4), registerAddress($rax)));
+    appendInstr(op2Instruction(widthOp(opAdd, 8), registerAddress($r11), registerAddress($rax)));
+    appendInstr(op1Instruction(plainOp(opJmpIndirect), registerAddress($rax)));
+    appendInstr(op0Instruction(plainOp(opRodata)));
+    appendInstr(op0Instruction(widthOp(opAlign, 4)));
+    appendInstr(labelDeclInstruction(numLabel(table)));
+    size_t next = 0;
+    for (uint64_t i=0; i<=span; i++){
+        labelnum_t target = defaultLabel;
+        if (next < count && caseOffset(cases[next].num, cases[0].num, type) == i) target = cases[next++].label;
+        appendInstr(labelDiffInstruction(4, target, table));
+    }
+    appendInstr(op0Instruction(plainOp(opText)));
+}
+
+// Each target gets a mask with the bits of its cases set, counted from the smallest case
+static void cmplBitTests(const SwitchCase* cases, size_t count, uint64_t span, Type type, labelnum_t defaultLabel){
+    cmplRangeCheck(cases[0].num, span, type, defaultLabel);
+    for (size_t i=0; i<count; i++){
+        size_t first = 0;
+        while (cases[first].label != cases[i].label) first++;
+        if (first != i) continue;
+        uint64_t mask = 0;
+        for (size_t j=i; j<count; j++){
+            if (cases[j].label == cases[i].label) mask |= (uint64_t)1 << caseOffset(cases[j].num, cases[0].num, type);
+        }
+        cmplMov(numberAddress(mask), registerAddress($r11), typUInt64);
+        appendInstr(op2Instruction(widthOp(opBt, 8), registerAddress($rax), registerAddress($r11)));
+        appendInstr(labelInstruction(condOp(opJcc, condC), numLabel(cases[i].label)));
+    }
+    appendInstr(labelInstruction(plainOp(opJmp), numLabel(defaultLabel)));
+}
+
+// Cases are sorted, and every strategy ends by going to the default if none of them match
+static void cmplCaseRange(const SwitchCase* cases, size_t count, Type type, labelnum_t defaultLabel){
+    uint64_t span = caseOffset(cases[count - 1].num, cases[0].num, type);
+    if (count >= MIN_TABLE_CASES && span < count * TABLE_ENTRIES_PER_CASE){
+        cmplJumpTable(cases, count, span, type, defaultLabel);
+        return;
+    }
+    size_t targets = countTargets(cases, count);
+    if (span < 64 && count >= MIN_BIT_TEST_CASES && targets < count && targets <= MAX_BIT_TEST_TARGETS){
+        cmplBitTests(cases, count, span, type, defaultLabel);
+        return;
+    }
+    if (count <= MAX_LINEAR_CASES){
+        for (size_t i=0; i<count; i++){
+            cmplCaseCompare(cases[i].num, type);
+            appendInstr(labelInstruction(condOp(opJcc, condE), numLabel(cases[i].label)));
+        }
+        appendInstr(labelInstruction(plainOp(opJmp), numLabel(defaultLabel)));
+        return;
+    }
+    // The middle case is checked on the way, leaving the cases below it and the ones above it
+    size_t mid = count / 2;
+    labelnum_t upper = newLabel();
+    cmplCaseCompare(cases[mid].num, type);
+    appendInstr(labelInstruction(condOp(opJcc, condE), numLabel(cases[mid].label)));
+    appendInstr(labelInstruction(signedCases ? condOp(opJcc, condG) : condOp(opJcc, condA), numLabel(upper)));
+    cmplCaseRange(cases, mid, type, defaultLabel);
+    appendInstr(labelDeclInstruction(numLabel(upper)));
+    cmplCaseRange(cases + mid + 1, count - mid - 1, type, defaultLabel);
+}
+
+// Jumps to the label of the case equal to the value, or to the default label if there's none. The cases get sorted
+void cmplSwitch(Address value, Type type, SwitchCase* cases, size_t count, labelnum_t defaultLabel){
+    if (value.mode == numberMode || count == 0){
+        labelnum_t target = defaultLabel;
+        for (size_t i=0; i<count; i++){
+            if (caseOffset(cases[i].num, value.val.num, type) == 0) target = cases[i].label;
+        }
+        appendInstr(labelInstruction(plainOp(opJmp), numLabel(target)));
+        return;
+    }
+    signedCases = isSignedType(type);
+    qsort(cases, count, sizeof(SwitchCase), &compareCases);
+    cmplMov(value, registerAddress($rax), type);
+    cmplCaseRange(cases, count, type, defaultLabel);
 }
 
 typedef struct
 {
-    labelnum_t ret;
     labelnum_t brk;
     labelnum_t cont;
+    labelnum_t cases;   //Label of the first case of the switch the statement is in. The others follow in order
+    labelnum_t dflt;
 } LabelContext;
 
+// Case labels right after each other mark the same statement, so they all get the label of the last one
+static labelnum_t caseLabel(const StmtCase* label, const LabelContext* labels){
+    while (label->stmt->label == astStmtCase || label->stmt->label == astStmtDefault){
+        label = (const StmtCase*)label->stmt;
+    }
+    return label->ast.label == astStmtDefault ? labels->dflt : labels->cases + label->index;
+}
+
+// Whether a case label of the enclosing switch is somewhere in the statement, making it reachable from the switch
+static char containsCaseLabel(const Ast* ast){
+    if (ast == NULL) return 0;
+    switch (ast->label){
+        case astStmtCase:
+        case astStmtDefault:
+            return 1;
+        case astStmtBlock: {
+            const StmtBlock* blk = (const StmtBlock*)ast;
+            for (size_t i=0; i<blk->stmts.size; i++){
+                if (containsCaseLabel(blk->stmts.elem[i])) return 1;
+            }
+            return 0;
+        }
+        case astStmtWhile:
+        case astStmtDoWhile:
+            return containsCaseLabel(((const StmtWhileLoop*)ast)->stmt);
+        case astStmtIf: {
+            const StmtIf* ifelse = (const StmtIf*)ast;
+            return containsCaseLabel(ifelse->ifStmt) || containsCaseLabel(ifelse->elseStmt);
+        }
+    }
+    return 0;
+}
+
+// Whether a statement after the one at index can be jumped to by a switch
+static char labelFollows(const StmtBlock* blk, size_t index){
+    for (size_t i=index+1; i<blk->stmts.size; i++){
+        if (containsCaseLabel(blk->stmts.elem[i])) return 1;
+    }
+    return 0;
+}
+
+// Whether the statement always leaves through a jump, which makes everything after it in the same block unreachable
+static char alwaysJumps(const Ast* ast){
+    switch (ast->label){
+        case astStmtReturn:
+        case astStmtBreak:
+        case astStmtContinue:
+            return 1;
+        case astStmtBlock: {
+            // Going backwards keeps track of whether a case label comes after each statement
+            const StmtBlock* blk = (const StmtBlock*)ast;
+            char labelled = 0;
+            for (size_t i=blk->stmts.size; i-- > 0;){
+                if (!labelled && alwaysJumps(blk->stmts.elem[i])) return 1;
+                labelled |= containsCaseLabel(blk->stmts.elem[i]);
+            }
+            return 0;
+        }
+        case astStmtIf: {
+            const StmtIf* ifelse = (const StmtIf*)ast;
+            return ifelse->elseStmt && alwaysJumps(ifelse->ifStmt) && alwaysJumps(ifelse->elseStmt);
+        }
+        case astStmtCase:
+        case astStmtDefault:
+            return alwaysJumps(((const StmtCase*)ast)->stmt);
+    }
+    return 0;
+}
+
+// Whether an identifier with the name appears anywhere in the AST. Shadowing isn't considered, so this can only give false positives
+static char mentionsName(const Ast* ast, const char_t* name){
+    if (ast == NULL) return 0;
+    switch (ast->label){
+        case astExprIdent:
+            return !strcmp(((const ExprIdent*)ast)->name, name);
+        case astExprBinop:
+            return mentionsName((Ast*)((const ExprBinop*)ast)->left, name) || mentionsName((Ast*)((const ExprBinop*)ast)->right, name);
+        case astExprUnop:
+            return mentionsName((Ast*)((const ExprUnop*)ast)->operand, name);
+        case astExprCall: {
+            const ExprCall* call = (const ExprCall*)ast;
+            for (size_t i=0; i<call->args.size; i++){
+                if (mentionsName(call->args.elem[i], name)) return 1;
+            }
+            return 0;
+        }
+        case astStmtExpr:
+            return mentionsName((Ast*)((const StmtExpr*)ast)->expr, name);
+        case astStmtReturn:
+            return mentionsName((Ast*)((const StmtReturn*)ast)->expr, name);
+        case astStmtDef:
+            return mentionsName((Ast*)((const StmtVar*)ast)->rhs, name);
+        case astStmtBlock: {
+            const StmtBlock* blk = (const StmtBlock*)ast;
+            for (size_t i=0; i<blk->stmts.size; i++){
+                if (mentionsName(blk->stmts.elem[i], name)) return 1;
+            }
+            return 0;
+        }
+        case astStmtWhile:
+        case astStmtDoWhile: {
+            const StmtWhileLoop* loop = (const StmtWhileLoop*)ast;
+            return mentionsName((Ast*)loop->condition, name) || mentionsName(loop->stmt, name);
+        }
+        case astStmtIf: {
+            const StmtIf* ifelse = (const StmtIf*)ast;
+            return mentionsName((Ast*)ifelse->condition, name) || mentionsName(ifelse->ifStmt, name) || mentionsName(ifelse->elseStmt, name);
+        }
+        case astStmtSwitch: {
+            const StmtSwitch* stmt = (const StmtSwitch*)ast;
+            return mentionsName((Ast*)stmt->expr, name) || mentionsName(stmt->stmt, name);
+        }
+        case astStmtCase:
+        case astStmtDefault:
+            return mentionsName((Ast*)((const StmtCase*)ast)->expr, name) || mentionsName(((const StmtCase*)ast)->stmt, name);
+    }
+    return 0;
+}
+
+// A local is only visible to the statements after it in its block, so it's unused if none of them mention its name
+static char isUnusedLocal(const StmtBlock* blk, size_t defIndex){
+    const StmtVar* def = blk->stmts.elem[defIndex];
+    for (size_t i=defIndex+1; i<blk->stmts.size; i++){
+        if (mentionsName(blk->stmts.elem[i], def->name)) return 0;
+    }
+    return 1;
+}
+
 static void cmplStmt(Ast* ast, offset_t* frameOffset, offset_t* maxCallSpace, const LabelContext* labels){
     switch(ast->label){
         case astStmtEmpty:
@@ -272,51 +1308,66 @@ static void cmplStmt(Ast* ast, offset_t* frameOffset, offset_t* maxCallSpace, co
             break;
         case astStmtReturn: {
             if (hasRetExpr((StmtReturn*)ast)){
-                Address expaddr = cmplExpr((ExprBase*)((StmtReturn*)ast)->expr, frameOffset, maxCallSpace);
-                cmplMov(expaddr, registerAddress($rax));
+                ExprBase* expr = ((StmtReturn*)ast)->expr;
+                Address expaddr = cmplExpr(expr, frameOffset, maxCallSpace);
+                Address retReg = registerAddress(isFloatType(returnType) ? floatResult : $rax);
+                cmplMov(cmplConvert(expaddr, expr->type, returnType, movIntermediate), retReg, returnType);
             }
-            appendInstr(labelInstruction("jmp", numLabel(labels->ret)));
+            //The epilogue is smaller than a jump to a shared one, so every return gets its own copy
+            appendInstr(op0Instruction(plainOp(opLeave)));
+            appendInstr(op0Instruction(plainOp(opRet)));
             break;
         }
         case astStmtBlock: {
             StmtBlock* blk = (StmtBlock*)ast;
             curScope = blk->scopeId;
+            // Locals only live until the end of the block, so sibling blocks share their storage
+            offset_t blockStart = *frameOffset;
             for (size_t i=0; i<blk->stmts.size; i++){
-                cmplStmt(blk->stmts.elem[i], frameOffset, maxCallSpace, labels);
+                Ast* stmt = blk->stmts.elem[i];
+                // Unused locals get no slot. Their initializers are only evaluated for side effects
+                if (stmt->label == astStmtDef && isUnusedLocal(blk, i)){
+                    ExprBase* rhs = ((StmtVar*)stmt)->rhs;
+                    if (rhs && hasSideEffects(rhs)) cmplExpr(rhs, frameOffset, maxCallSpace);
+                    continue;
+                }
+                offset_t stmtStart = *frameOffset;
+                cmplStmt(stmt, frameOffset, maxCallSpace, labels);
+                // Temporaries are done once the statement is, but locals stay for the rest of the block
+                if (stmt->label != astStmtDef) *frameOffset = stmtStart;
+                // Nothing after a return, break or continue can run, unless a switch can jump past it
+                if (alwaysJumps(stmt) && !labelFollows(blk, i)) break;
             }
+            *frameOffset = blockStart;
             toPrevScope();
             break;
         }
         case astStmtDef: {
             StmtVar* def = (StmtVar*)ast;
-            *frameOffset -= 8;
+            Address slot = allocSlot(def->type, frameOffset);
+            offset_t afterSlot = *frameOffset;
             if (def->rhs){
-                cmplMov(cmplExpr(def->rhs, frameOffset, maxCallSpace), indirectAddress(*frameOffset, $rbp));
+                Address value = cmplExpr(def->rhs, frameOffset, maxCallSpace);
+                cmplMov(cmplConvert(value, def->rhs->type, def->type, movIntermediate), slot, def->type);
+                *frameOffset = afterSlot;
             }
-            insertAddress(def->name, indirectAddress(*frameOffset, $rbp));
+            insertAddress(def->name, slot, def->type);
             break;
         }
         case astStmtWhile: {
             StmtWhileLoop* loop = (StmtWhileLoop*)ast;
-            const LabelContext loopCtx = (LabelContext){.ret=labels->ret, .brk=maxLabelNum++, .cont=maxLabelNum++};
-
-            //Evaluate condition after start label
-            appendInstr(labelDeclInstruction(numLabel(loopCtx.cont)));
-            Address cond = cmplExpr(loop->condition, frameOffset, maxCallSpace);
-            if (cond.mode == numberMode){
-                //If cond is 0 then skip everything, otherwise just loop back to start label infinitely
-                if (cond.val.num != 0){
-                    cmplStmt(loop->stmt, frameOffset, maxCallSpace, &loopCtx);
-                    appendInstr(labelInstruction("jmp", numLabel(loopCtx.cont)));
-                }
-            }
-            else{
-                //If condition evaluates to 0 then exit loop via jump
-                appendInstr(op2Instruction("cmpq", numberAddress(0), cond));
-                appendInstr(labelInstruction("je", numLabel(loopCtx.brk)));
-                //Otherwise evaluate inner statement then go back up
+            size_t loopStart = maxLabelNum++;
+            const LabelContext loopCtx = (LabelContext){.brk=maxLabelNum++, .cont=maxLabelNum++, .cases=labels->cases, .dflt=labels->dflt};
+
+            //A constant 0 condition skips everything
+            if (!isFalseConstant(loop->condition)){
+                //The loop is rotated into a guarded do-while, so each iteration only takes the conditional jump at the bottom.
+                //The guard skips the loop if the condition starts out 0. Constant true conditions emit no check at all
+                cmplCondJump(loop->condition, 0, loopCtx.brk, frameOffset, maxCallSpace);
+                appendInstr(labelDeclInstruction(numLabel(loopStart)));
                 cmplStmt(loop->stmt, frameOffset, maxCallSpace, &loopCtx);
-                appendInstr(labelInstruction("jmp", numLabel(loopCtx.cont)));
+                appendInstr(labelDeclInstruction(numLabel(loopCtx.cont)));
+                cmplCondJump(loop->condition, 1, loopStart, frameOffset, maxCallSpace);
             }
             appendInstr(labelDeclInstruction(numLabel(loopCtx.brk)));
             break;
@@ -324,32 +1375,22 @@ static void cmplStmt(Ast* ast, offset_t* frameOffset, offset_t* maxCallSpace, co
         case astStmtDoWhile: {
             StmtWhileLoop* loop = (StmtWhileLoop*)ast;
             size_t doStart = maxLabelNum++;
-            const LabelContext doCtx = (LabelContext){.ret=labels->ret, .brk=maxLabelNum++, .cont=maxLabelNum++};
+            const LabelContext doCtx = (LabelContext){.brk=maxLabelNum++, .cont=maxLabelNum++, .cases=labels->cases, .dflt=labels->dflt};
 
             //Evaluate statement then condition
             appendInstr(labelDeclInstruction(numLabel(doStart)));
             cmplStmt(loop->stmt, frameOffset, maxCallSpace, &doCtx);
             appendInstr(labelDeclInstruction(numLabel(doCtx.cont)));
-            Address cond = cmplExpr(loop->condition, frameOffset, maxCallSpace);
-            //Special treatment for const conditions
-            if (cond.mode == numberMode){
-                if (cond.val.num != 0){
-                    appendInstr(labelInstruction("jmp", numLabel(doStart)));
-                }
-            }
             //If cond is not 0 jump back up and loop again
-            else{
-                appendInstr(op2Instruction("cmpq", numberAddress(0), cond));
-                appendInstr(labelInstruction("jne", numLabel(doStart)));
-            }
+            cmplCondJump(loop->condition, 1, doStart, frameOffset, maxCallSpace);
             appendInstr(labelDeclInstruction(numLabel(doCtx.brk)));
             break;
         }
         case astStmtContinue:
-            appendInstr(labelInstruction("jmp", numLabel(labels->cont)));
+            appendInstr(labelInstruction(plainOp(opJmp), numLabel(labels->cont)));
             break;
         case astStmtBreak:
-            appendInstr(labelInstruction("jmp", numLabel(labels->brk)));
+            appendInstr(labelInstruction(plainOp(opJmp), numLabel(labels->brk)));
             break;
         case astStmtIf: {
             StmtIf* ifelse = (StmtIf*)ast;
@@ -358,20 +1399,44 @@ static void cmplStmt(Ast* ast, offset_t* frameOffset, offset_t* maxCallSpace, co
             size_t elseLbl = ifelse->elseStmt ? maxLabelNum++ : endLbl;
             
             // If condition evaluates to 0 then jump to else branch (or end label if there's no else)
-            Address cond = cmplExpr(ifelse->condition, frameOffset, maxCallSpace);
-            appendInstr(op2Instruction("cmpq", numberAddress(0), cond));
-            appendInstr(labelInstruction("je", numLabel(elseLbl)));
+            cmplCondJump(ifelse->condition, 0, elseLbl, frameOffset, maxCallSpace);
             // Otherwise execute the conditonal code
             cmplStmt(ifelse->ifStmt, frameOffset, maxCallSpace, labels);
             // If there is an else branch, the conditional code also needs to skip it and jmp to the end
             if (ifelse->elseStmt){
-                appendInstr(labelInstruction("jmp", numLabel(endLbl)));
+                appendInstr(labelInstruction(plainOp(opJmp), numLabel(endLbl)));
                 appendInstr(labelDeclInstruction(numLabel(elseLbl)));
                 cmplStmt(ifelse->elseStmt, frameOffset, maxCallSpace, labels);
             }
             appendInstr(labelDeclInstruction(numLabel(endLbl)));
             break;
         }
+        case astStmtSwitch: {
+            StmtSwitch* stmt = (StmtSwitch*)ast;
+            Address value = cmplExpr(stmt->expr, frameOffset, maxCallSpace);
+            // Break leaves the switch, while continue still belongs to the loop around it
+            LabelContext switchCtx = (LabelContext){.brk=maxLabelNum++, .cont=labels->cont, .dflt=maxLabelNum++};
+            switchCtx.cases = maxLabelNum;
+            maxLabelNum += stmt->cases.size;
+            New(SwitchCase, cases, stmt->cases.size + 1);
+            for (size_t i=0; i<stmt->cases.size; i++){
+                StmtCase* label = stmt->cases.elem[i];
+                cases[i] = (SwitchCase){label->num, caseLabel(label, &switchCtx)};
+            }
+            cmplSwitch(value, stmt->expr->type, cases, stmt->cases.size, stmt->defaultCase ? caseLabel(stmt->defaultCase, &switchCtx) : switchCtx.brk);
+            free(cases);
+            cmplStmt(stmt->stmt, frameOffset, maxCallSpace, &switchCtx);
+            appendInstr(labelDeclInstruction(numLabel(switchCtx.brk)));
+            break;
+        }
+        case astStmtCase:
+        case astStmtDefault: {
+            StmtCase* label = (StmtCase*)ast;
+            labelnum_t lbl = ast->label == astStmtDefault ? labels->dflt : labels->cases + label->index;
+            appendInstr(labelDeclInstruction(numLabel(lbl)));
+            cmplStmt(label->stmt, frameOffset, maxCallSpace, labels);
+            break;
+        }
         default:
             assert(0 && "Unsupported AST for stmt");
     }
@@ -384,9 +1449,9 @@ static void cmplParams(Array(vptr) *params){
         Address location = indirectAddress(16 + i*8, $rbp);
         // Right now dumps all param registers into shadow space. Safe but inefficient
         if (i < 4){
-            cmplMov(registerAddress(paramRegisters[i]), location);
+            cmplMov(registerAddress(isFloatType(param->type) ? floatParamRegisters[i] : paramRegisters[i]), location, param->type);
         }
-        insertAddress(param->name, location);
+        insertAddress(param->name, location, param->type);
     }
 }
 
@@ -398,34 +1463,50 @@ static void cmplGlobal(Ast* ast){
             if (isFuncDecl(func)){
                 return;
             }
-            appendInstr(labelInstruction(".globl", strLabel(func->name)));
+            if (codegenOptions.optLevel > 0){
+                IrFunction* ir = irBuildFunction(func);
+                // Functions the IR can't express still go through the AST walker
+                if (ir != NULL){
+                    irOptimize(ir, codegenOptions.optLevel);
+                    // Later functions can inline this one, so it's offered before lowering changes it
+                    irOfferInlinee(ir);
+                    cmplIrFunction(ir);
+                    disposeIrFunction(ir);
+                    return;
+                }
+            }
+            appendInstr(labelInstruction(plainOp(opGlobl), strLabel(func->name)));
             appendInstr(labelDeclInstruction(strLabel(func->name)));
-            appendInstr(op1Instruction("pushq", registerAddress($rbp)));
-            cmplMov(registerAddress($rsp), registerAddress($rbp));
+            appendInstr(op1Instruction(widthOp(opPush, 8), registerAddress($rbp)));
+            cmplMov(registerAddress($rsp), registerAddress($rbp), typUInt64);
 
-            // Create a new label for the return location
-            const LabelContext lblctx = (LabelContext){.ret=maxLabelNum++, .brk=0, .cont=0};
+            const LabelContext lblctx = (LabelContext){.brk=0, .cont=0, .cases=0, .dflt=0};
             // Stack space needed for variables
             offset_t frameOffset = 0;
+            frameLow = 0;
             // Stack space needed for function calls
             offset_t maxCallSpace = 0;
 
             // Set global scope variable so that symbol table can be used
             curScope = func->scopeId;
+            returnType = func->type;
             cmplParams(&func->params);
             // Allocate space on stack for variables and calls. Amount allocated will be known later
-            size_t rspInsIndex = appendInstr(op2Instruction("subq", numberAddress(0), registerAddress($rsp)));
+            AsmInstruction* rspIns = appendInstr(op2Instruction(widthOp(opSub, 8), numberAddress(0), registerAddress($rsp)));
             if (!strcmp(func->name, "main")){
                 cmplCall("__main", NULL, &frameOffset, &maxCallSpace);
             }
             cmplStmt((Ast*)func->stmt, &frameOffset, &maxCallSpace, &lblctx);
-            // Decide amount to allocate on stack
-            assert(maxCallSpace >= 0 && frameOffset <= 0 && "Offset signs are wrong");
-            getInstrPtr(rspInsIndex)->args.operands[0] = numberAddress(maxCallSpace - frameOffset);
-            // Return routine
-            appendInstr(labelDeclInstruction(numLabel(lblctx.ret)));
-            appendInstr(op0Instruction("leave"));
-            appendInstr(op0Instruction("ret"));
+            // Decide amount to allocate on stack, keeping rsp 16 byte aligned for calls. An empty frame needs no subq
+            assert(maxCallSpace >= 0 && frameLow <= 0 && "Offset signs are wrong");
+            offset_t frameSize = (maxCallSpace - frameLow + 15) / 16 * 16;
+            if (frameSize) rspIns->args.operands[0] = numberAddress(frameSize);
+            else removeInstr(rspIns);
+            // Return routine for falling off the end
+            if (!alwaysJumps((Ast*)func->stmt)){
+                appendInstr(op0Instruction(plainOp(opLeave)));
+                appendInstr(op0Instruction(plainOp(opRet)));
+            }
             // Reset scope back to global
             curScope = GLOBAL_SCOPE;
             break;
@@ -435,12 +1516,30 @@ static void cmplGlobal(Ast* ast){
     }
 }
 
+// Every float constant gets 8 bytes so that they all stay aligned
+static void cmplFloatPool(){
+    if (floatPool.size == 0) return;
+    appendInstr(op0Instruction(plainOp(opRodata)));
+    appendInstr(op0Instruction(widthOp(opAlign, 8)));
+    for (size_t i=0; i<floatPool.size; i++){
+        appendInstr(labelDeclInstruction(numLabel(floatPool.elem[i].label)));
+        appendInstr(dataInstruction(8, floatPool.elem[i].bits));
+    }
+}
+
 void cmplTopLevel(TopLevel* top){
     initAddrTable();
+    irInlineLimit = codegenOptions.inlineLimit;
+    irInlineReport = codegenOptions.reportInlining;
+    irInitInlining();
+    if (!arrInit(FloatConst)(&floatPool, 4, NULL, NULL)) exit(1);
     maxLabelNum = 0;
-    appendInstr(op0Instruction(".text"));
+    appendInstr(op0Instruction(plainOp(opText)));
     for (size_t i=0; i<top->globals.size; i++){
         cmplGlobal(top->globals.elem[i]);
     }
+    cmplFloatPool();
+    arrDispose(FloatConst)(&floatPool);
+    irDisposeInlining();
     disposeAddrTable();
 }
\ No newline at end of file
@@ -2,9 +2,21 @@
 #include "utils.h"
 #include "ast/ast.h"
 
+typedef struct {
+    int optLevel;   //0 compiles straight from the AST. Anything higher goes through the SSA IR and its passes
+    char omitFramePointer;  //Address the frame from rsp and leave rbp alone. Only the IR backend does this
+    int inlineLimit;        //Biggest function that gets inlined at -O2, in IR instructions. 0 turns inlining off
+    char reportInlining;    //Print why each call was inlined or not
+} CodegenOptions;
+extern CodegenOptions codegenOptions;
+
 void cmplTopLevel(TopLevel* ast);
 
 void initAsm();
 void disposeAsm();
 
 void emitAllAsm();
+// Encodes the instructions and writes them as an ELF object file
+void emitAllObject();
+// Encodes the instructions into memory and runs main in this process, returning its exit code
+int runAllObject();
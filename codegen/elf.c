@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "utils.h"
+#include "array.h"
+#include "io/file.h"
+#include "codegen/asm_private.h"
+#include "codegen/codegen.h"
+// Writes encoded code as an ELF64 relocatable object for x86-64, which the linker takes like any .o an assembler made.
+// The file is the header, then the contents of every section, then the table of section headers
+
+typedef struct {
+    uint8_t ident[16];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version;
+    uint64_t entry;
+    uint64_t phoff;
+    uint64_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+} ElfHeader;
+
+typedef struct {
+    uint32_t name;
+    uint32_t type;
+    uint64_t flags;
+    uint64_t addr;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t link;
+    uint32_t info;
+    uint64_t addralign;
+    uint64_t entsize;
+} ElfSectionHeader;
+
+typedef struct {
+    uint32_t name;
+    uint8_t info;
+    uint8_t other;
+    uint16_t shndx;
+    uint64_t value;
+    uint64_t size;
+} ElfSymbol;
+
+typedef struct {
+    uint64_t offset;
+    uint64_t info;
+    int64_t addend;
+} ElfRela;
+
+#define SHT_PROGBITS 1
+#define SHT_SYMTAB 2
+#define SHT_STRTAB 3
+#define SHT_RELA 4
+#define SHF_ALLOC 2
+#define SHF_EXECINSTR 4
+#define SHF_INFO_LINK 0x40
+#define STB_GLOBAL 1
+#define STT_FUNC 2
+#define STT_SECTION 3
+#define R_X86_64_PC32 2
+#define R_X86_64_PLT32 4
+
+// Each section of the object gets its contents, then its relocations, followed by the tables
+enum {
+    shNull,
+    shSymtab = 1 + 2 * SECTION_COUNT,
+    shStrtab,
+    shShstrtab,
+    shNoteStack,        //Empty section telling the linker the stack doesn't need to be executable
+    SH_COUNT
+};
+#define contentIndex(section) (1 + (section))
+#define relaIndex(section) (1 + SECTION_COUNT + (section))
+
+static const char_t* const sectionNames[SECTION_COUNT] = {".text", ".rodata"};
+static const uint64_t sectionFlags[SECTION_COUNT] = {SHF_ALLOC | SHF_EXECINSTR, SHF_ALLOC};
+#define SECTION_ALIGN 16
+
+// Adds a name to a string table, returning where it starts
+static uint32_t addString(Array(char_t)* table, const char_t* str){
+    uint32_t start = table->size;
+    do {
+        if (!arrPush(char_t)(table, *str)) exit(1);
+    } while (*str++);
+    return start;
+}
+
+static void writeZeroes(size_t count){
+    static const uint8_t zeroes[SECTION_ALIGN] = {0};
+    for (; count > SECTION_ALIGN; count -= SECTION_ALIGN){
+        emitBytes(zeroes, SECTION_ALIGN);
+    }
+    emitBytes(zeroes, count);
+}
+
+void writeElfObject(const ObjectCode* object){
+    const Array(ObjSymbol)* symbols = &object->symbols;
+    Array(char_t) strtab;
+    if (!arrInit(char_t)(&strtab, 64, NULL, NULL)) exit(1);
+    addString(&strtab, "");
+
+    //Local symbols have to come before global ones, so the object's symbols get new indices
+    New(ElfSymbol, elfSymbols, symbols->size + 1);
+    New(size_t, elfIndices, symbols->size + 1);
+    size_t elfCount = 0;
+    size_t firstGlobal = 0;
+    elfSymbols[elfCount++] = (ElfSymbol){0};
+    for (int global=0; global<2; global++){
+        if (global) firstGlobal = elfCount;
+        for (size_t i=0; i<symbols->size; i++){
+            const ObjSymbol* symbol = &symbols->elem[i];
+            //Functions from other files have to be global for the linker to find them
+            if ((symbol->global || !symbol->defined) != global) continue;
+            ElfSymbol elfSymbol = {0};
+            if (symbol->name == NULL){
+                elfSymbol.info = STT_SECTION;
+            }
+            else{
+                elfSymbol.name = addString(&strtab, symbol->name);
+                elfSymbol.info = (global ? STB_GLOBAL << 4 : 0) | (symbol->defined && symbol->section == secText ? STT_FUNC : 0);
+            }
+            elfSymbol.shndx = symbol->defined ? contentIndex(symbol->section) : 0;
+            elfSymbol.value = symbol->offset;
+            elfIndices[i] = elfCount;
+            elfSymbols[elfCount++] = elfSymbol;
+        }
+    }
+
+    //Relocations are grouped by the section they patch
+    New(ElfRela, relas, object->relocations.size + 1);
+    size_t relaStarts[SECTION_COUNT + 1];
+    size_t relaCount = 0;
+    for (int section=0; section<SECTION_COUNT; section++){
+        relaStarts[section] = relaCount;
+        for (size_t i=0; i<object->relocations.size; i++){
+            const Relocation* relocation = &object->relocations.elem[i];
+            if (relocation->section != section) continue;
+            uint64_t type = relocation->type == relPlt32 ? R_X86_64_PLT32 : R_X86_64_PC32;
+            relas[relaCount++] = (ElfRela){relocation->offset, (uint64_t)elfIndices[relocation->symbol] << 32 | type, relocation->addend};
+        }
+    }
+    relaStarts[SECTION_COUNT] = relaCount;
+
+    Array(char_t) shstrtab;
+    if (!arrInit(char_t)(&shstrtab, 128, NULL, NULL)) exit(1);
+    addString(&shstrtab, "");
+    ElfSectionHeader headers[SH_COUNT] = {{0}};
+    const void* contents[SH_COUNT] = {NULL};
+    for (int section=0; section<SECTION_COUNT; section++){
+        //A section's name is the end of the name of its relocations
+        char_t relaName[32];
+        sprintf(relaName, ".rela%s", sectionNames[section]);
+        uint32_t name = addString(&shstrtab, relaName);
+        headers[contentIndex(section)] = (ElfSectionHeader){name + 5, SHT_PROGBITS, sectionFlags[section],
+            .size = object->sections[section].size, .addralign = SECTION_ALIGN};
+        contents[contentIndex(section)] = object->sections[section].elem;
+        headers[relaIndex(section)] = (ElfSectionHeader){name, SHT_RELA, SHF_INFO_LINK,
+            .size = (relaStarts[section + 1] - relaStarts[section]) * sizeof(ElfRela),
+            .link = shSymtab, .info = contentIndex(section), .addralign = 8, .entsize = sizeof(ElfRela)};
+        contents[relaIndex(section)] = relas + relaStarts[section];
+    }
+    headers[shSymtab] = (ElfSectionHeader){addString(&shstrtab, ".symtab"), SHT_SYMTAB, .size = elfCount * sizeof(ElfSymbol),
+        .link = shStrtab, .info = firstGlobal, .addralign = 8, .entsize = sizeof(ElfSymbol)};
+    contents[shSymtab] = elfSymbols;
+    headers[shStrtab] = (ElfSectionHeader){addString(&shstrtab, ".strtab"), SHT_STRTAB, .size = strtab.size, .addralign = 1};
+    contents[shStrtab] = strtab.elem;
+    headers[shNoteStack] = (ElfSectionHeader){addString(&shstrtab, ".note.GNU-stack"), SHT_PROGBITS, .addralign = 1};
+    headers[shShstrtab] = (ElfSectionHeader){addString(&shstrtab, ".shstrtab"), SHT_STRTAB, .size = shstrtab.size, .addralign = 1};
+    contents[shShstrtab] = shstrtab.elem;
+
+    //Everything's place has to be in the header, so the file is laid out before any of it is written
+    size_t pos = sizeof(ElfHeader);
+    for (int i=1; i<SH_COUNT; i++){
+        pos += (headers[i].addralign - pos % headers[i].addralign) % headers[i].addralign;
+        headers[i].offset = pos;
+        pos += headers[i].size;
+    }
+    ElfHeader header = {
+        .ident = {0x7F, 'E', 'L', 'F', 2, 1, 1},    //64-bit, little endian, current version
+        .type = 1,          //Relocatable
+        .machine = 62,      //x86-64
+        .version = 1,
+        .shoff = (pos + 7) / 8 * 8,
+        .ehsize = sizeof(ElfHeader),
+        .shentsize = sizeof(ElfSectionHeader),
+        .shnum = SH_COUNT,
+        .shstrndx = shShstrtab
+    };
+
+    emitBytes(&header, sizeof(ElfHeader));
+    pos = sizeof(ElfHeader);
+    for (int i=1; i<SH_COUNT; i++){
+        writeZeroes(headers[i].offset - pos);
+        if (headers[i].size) emitBytes(contents[i], headers[i].size);
+        pos = headers[i].offset + headers[i].size;
+    }
+    writeZeroes(header.shoff - pos);
+    emitBytes(headers, sizeof(headers));
+
+    arrDispose(char_t)(&strtab);
+    arrDispose(char_t)(&shstrtab);
+    free(elfSymbols);
+    free(elfIndices);
+    free(relas);
+}
+
+void emitAllObject(){
+    ObjectCode object;
+    encodeAllAsm(&object);
+    writeElfObject(&object);
+    disposeObjectCode(&object);
+}
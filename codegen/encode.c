@@ -0,0 +1,823 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+#include "codegen/asm_private.h"
+// Encodes the instruction buffer straight into x86-64 machine code, so that no assembler has to parse it back from text.
+// Jumps to labels start out with 8-bit displacements and only grow to 32 bits once their target turns out to be too far,
+// which is repeated until every jump fits, since growing one jump can push others out of reach.
+// References to other sections and to functions are left as relocations for the linker
+
+#define TYPE uint8_t
+#include "generics/gen_array.c"
+#undef TYPE
+#define TYPE ObjSymbol
+#include "generics/gen_array.c"
+#undef TYPE
+#define TYPE Relocation
+#include "generics/gen_array.c"
+#undef TYPE
+
+typedef const char_t* SymbolName;
+#define KEY SymbolName
+#define VAL size_t
+#include "generics/gen_map.h"
+#include "generics/gen_map.c"
+#undef KEY
+#undef VAL
+// Index of each named symbol in the object
+static Map(SymbolName, size_t) symbolIndices;
+// Functions defined in the file get labels numbered after the numbered ones, so that jumps to them can be short
+static Map(SymbolName, size_t) functionLabels;
+
+// Longest an x86-64 instruction can be
+#define MAX_INSTR_BYTES 15
+#define SHORT_JUMP_SIZE 2
+#define LONG_JMP_SIZE 5
+#define LONG_JCC_SIZE 6
+
+// Where each instruction and label ends up, worked out before anything is written
+static size_t* instrOffsets;
+static uint8_t* instrSizes;
+static size_t* labelOffsets;
+static Section* labelSections;
+
+// Hardware numbers of the registers from rax to r15, in the order Register has them
+static const uint8_t gprNumbers[] = {0, 1, 2, 8, 9, 10, 11, 3, 6, 7, 12, 13, 14, 15};
+// Same for the byte registers from cl to r15b
+static const uint8_t byteNumbers[] = {1, 2, 8, 9, 3, 6, 7, 12, 13, 14, 15};
+
+static uint8_t regNumber(Register reg){
+    switch (reg){
+        case $rbp:
+            return 5;
+        case $rsp:
+            return 4;
+        case $al:
+            return 0;
+        case $r10b:
+            return 10;
+        case $r11b:
+            return 11;
+        default:
+            break;
+    }
+    if (reg >= $rax && reg <= $r15) return gprNumbers[reg - $rax];
+    if (reg >= $eax && reg <= $r15d) return gprNumbers[reg - $eax];
+    if (reg >= $ax && reg <= $r15w) return gprNumbers[reg - $ax];
+    if (reg >= $cl && reg <= $r15b) return byteNumbers[reg - $cl];
+    assert(reg >= $xmm0 && reg <= $xmm5 && "Unsupported register");
+    return reg - $xmm0;
+}
+
+// Size of a general purpose register in bytes, or 0 for SSE registers
+static size_t regSize(Register reg){
+    if (reg == $rbp || reg == $rsp || (reg >= $rax && reg <= $r15)) return 8;
+    if (reg >= $eax && reg <= $r15d) return 4;
+    if (reg >= $ax && reg <= $r15w) return 2;
+    if (reg >= $xmm0) return 0;
+    return 1;
+}
+
+static char isRegister(const Address* addr){
+    return addr->mode == registerMode;
+}
+
+// Value of the lowest size bytes of the number as a signed integer
+static int64_t signExtend(uint64_t num, size_t size){
+    if (size == 8) return num;
+    uint64_t sign = 1ull << (size * 8 - 1);
+    num &= (sign << 1) - 1;
+    return (num ^ sign) - sign;
+}
+
+static char fitsSigned(int64_t num, size_t size){
+    int64_t limit = 1ll << (size * 8 - 1);
+    return num >= -limit && num < limit;
+}
+
+static size_t putBytes(uint8_t* bytes, size_t n, uint64_t value, size_t size){
+    for (size_t i=0; i<size; i++){
+        bytes[n++] = value >> (8 * i);
+    }
+    return n;
+}
+
+// Reference an instruction makes that can only be filled in once everything is laid out
+typedef struct {
+    enum {
+        fixNone,
+        fixLabel,       //rip relative 32-bit displacement of a numbered label
+        fixSymbol       //32-bit distance to a function
+    } kind;
+    uint8_t pos;        //Where the 32-bit field is in the instruction
+    union {
+        labelnum_t label;
+        const char_t* symbol;
+    } target;
+} Fixup;
+
+// Parts of an instruction with a ModRM byte, which layOut puts together
+typedef struct {
+    uint8_t prefix;         //Mandatory prefix of SSE instructions, or 0
+    char word;              //16-bit operands need the operand size prefix
+    char wide;              //REX.W, for 64-bit operands
+    char rex;               //sil and dil can only be reached with a REX prefix, even an empty one
+    uint8_t opcode[2];
+    uint8_t opcodeSize;
+    uint8_t reg;            //Register number or opcode extension that goes in the reg field
+    const Address* rm;      //Operand in the rm field. NULL when reg is added to the last opcode byte instead
+    uint8_t immSize;
+    uint64_t imm;
+} Encoding;
+
+static size_t layOutModRM(uint8_t reg, const Address* rm, uint8_t* bytes, size_t n, Fixup* fixup){
+    reg = (reg & 7) << 3;
+    switch (rm->mode){
+        case registerMode:
+            bytes[n++] = 0xC0 | reg | (regNumber(rm->reg) & 7);
+            break;
+        case indirectMode: {
+            uint8_t base = regNumber(rm->reg) & 7;
+            offset_t offset = rm->val.offset;
+            //rbp and r13 as a base with no displacement mean something else, so they get a displacement of 0
+            uint8_t mod = offset == 0 && base != 5 ? 0 : fitsSigned(offset, 1) ? 0x40 : 0x80;
+            bytes[n++] = mod | reg | base;
+            //rsp and r12 as a base mean a SIB byte follows
+            if (base == 4) bytes[n++] = 0x24;
+            if (mod == 0x40) bytes[n++] = offset;
+            else if (mod == 0x80) n = putBytes(bytes, n, offset, 4);
+            break;
+        }
+        case indexedMode: {
+            uint8_t base = regNumber(rm->reg) & 7;
+            uint8_t index = regNumber(rm->index);
+            uint8_t scale = rm->scale;
+            assert(index != 4 && "rsp can't be an index");
+            uint8_t mod = base == 5 ? 0x40 : 0;
+            bytes[n++] = mod | reg | 4;
+            bytes[n++] = (scale == 1 ? 0 : scale == 2 ? 1 : scale == 4 ? 2 : 3) << 6 | (index & 7) << 3 | base;
+            if (mod) bytes[n++] = 0;
+            break;
+        }
+        case labelMode:
+            bytes[n++] = reg | 5;
+            fixup->kind = fixLabel;
+            fixup->pos = n;
+            fixup->target.label = rm->val.label;
+            n = putBytes(bytes, n, 0, 4);
+            break;
+        default:
+            assert(0 && "Operand can't be encoded");
+    }
+    return n;
+}
+
+static size_t layOut(const Encoding* enc, uint8_t* bytes, Fixup* fixup){
+    size_t n = 0;
+    if (enc->word) bytes[n++] = 0x66;
+    if (enc->prefix) bytes[n++] = enc->prefix;
+    const Address* rm = enc->rm;
+    uint8_t rex = enc->wide ? 0x48 : 0x40;
+    if (rm == NULL){
+        rex |= enc->reg >> 3;
+    }
+    else{
+        rex |= (enc->reg >> 3) << 2;
+        if (rm->mode == registerMode) rex |= regNumber(rm->reg) >> 3;
+        else if (rm->mode == indirectMode) rex |= regNumber(rm->reg) >> 3;
+        else if (rm->mode == indexedMode) rex |= (regNumber(rm->index) >> 3) << 1 | regNumber(rm->reg) >> 3;
+    }
+    if (rex != 0x40 || enc->rex) bytes[n++] = rex;
+    memcpy(bytes + n, enc->opcode, enc->opcodeSize);
+    n += enc->opcodeSize;
+    if (rm == NULL) bytes[n - 1] += enc->reg & 7;
+    else n = layOutModRM(enc->reg, rm, bytes, n, fixup);
+    return putBytes(bytes, n, enc->imm, enc->immSize);
+}
+
+typedef enum {
+    formNone,       //Not an instruction that's encoded on its own
+    formAlu,        //add, or, and, sub, xor and cmp, with the opcode extension of their immediate forms
+    formMov,
+    formTest,
+    formLea,
+    formImul,
+    formUnary,      //Group of not, neg, mul, div and others, by opcode extension
+    formIncDec,
+    formShift,
+    formBitTest,
+    formExtend,     //movz and movs, by the byte after 0F, or 63 for movslq
+    formSet,
+    formCmov,
+    formSse,        //Destination in reg and source in rm, by the byte after 0F
+    formSseInt,     //Same, for conversions to and from integers, whose size sets REX.W
+    formSseMov,
+    formPush,
+    formPop,
+    formBranch,     //call and jmp to a function, by opcode
+    formJmpIndirect,
+    formFixed       //Opcode with no operands, after the first prefix if there is one
+} Form;
+
+typedef struct {
+    Form form;
+    uint8_t code;           //Opcode or opcode extension, depending on the form
+    uint8_t prefixes[2];    //Mandatory prefix for single and double precision, or for any width if they're the same
+} Mnemonic;
+
+#define scalarPrefixes {0xF3, 0xF2}
+#define packedPrefixes {0, 0x66}
+
+// Directives and jumps to labels don't go through here
+static const Mnemonic mnemonics[OPCODE_COUNT] = {
+    [opAdd] = {formAlu, 0}, [opOr] = {formAlu, 1}, [opAnd] = {formAlu, 4}, [opSub] = {formAlu, 5}, [opXor] = {formAlu, 6},
+    [opCmp] = {formAlu, 7},
+    [opMov] = {formMov}, [opTest] = {formTest}, [opLea] = {formLea}, [opImul] = {formImul},
+    [opNot] = {formUnary, 2}, [opNeg] = {formUnary, 3}, [opMul] = {formUnary, 4}, [opDiv] = {formUnary, 6},
+    [opIdiv] = {formUnary, 7},
+    [opInc] = {formIncDec, 0}, [opDec] = {formIncDec, 1},
+    [opSal] = {formShift, 4}, [opShr] = {formShift, 5}, [opSar] = {formShift, 7},
+    [opBt] = {formBitTest, 4}, [opBts] = {formBitTest, 5}, [opBtr] = {formBitTest, 6}, [opBtc] = {formBitTest, 7},
+    [opPush] = {formPush}, [opPop] = {formPop},
+    [opMovzb] = {formExtend, 0xB6}, [opMovzw] = {formExtend, 0xB7}, [opMovsb] = {formExtend, 0xBE},
+    [opMovsw] = {formExtend, 0xBF}, [opMovsl] = {formExtend, 0x63},
+    [opSet] = {formSet}, [opCmov] = {formCmov},
+    [opMovF] = {formSseMov, 0, scalarPrefixes},
+    [opAddF] = {formSse, 0x58, scalarPrefixes}, [opMulF] = {formSse, 0x59, scalarPrefixes},
+    [opSubF] = {formSse, 0x5C, scalarPrefixes}, [opDivF] = {formSse, 0x5E, scalarPrefixes},
+    [opUcomiF] = {formSse, 0x2E, packedPrefixes}, [opXorF] = {formSse, 0x57, packedPrefixes},
+    [opCvtss2sd] = {formSse, 0x5A, {0xF3}}, [opCvtsd2ss] = {formSse, 0x5A, {0xF2}},
+    [opCvtsi2ss] = {formSseInt, 0x2A, {0xF3}}, [opCvtsi2sd] = {formSseInt, 0x2A, {0xF2}},
+    [opCvttss2si] = {formSseInt, 0x2C, {0xF3}}, [opCvttsd2si] = {formSseInt, 0x2C, {0xF2}},
+    [opCall] = {formBranch, 0xE8}, [opJmp] = {formBranch, 0xE9}, [opJmpIndirect] = {formJmpIndirect},
+    [opRet] = {formFixed, 0xC3}, [opLeave] = {formFixed, 0xC9}, [opCltd] = {formFixed, 0x99},
+    [opCqto] = {formFixed, 0x99, {0x48}}, [opCltq] = {formFixed, 0x98, {0x48}}
+};
+
+// Numbers the processor gives each condition code
+static const uint8_t condNumbers[] = {4, 5, 12, 14, 15, 13, 2, 6, 7, 3, 10, 11, 8, 2};
+
+// Bytes an immediate takes for an operand size. 64-bit operands take 32-bit immediates that get sign extended
+static uint8_t immSize(size_t size){
+    return size > 4 ? 4 : size;
+}
+
+// Value has to be sign extended from the operand size already
+static void setImm(Encoding* enc, int64_t value, size_t size){
+    assert(fitsSigned(value, size) && "64-bit immediates only fit in mov");
+    enc->imm = value;
+    enc->immSize = size;
+}
+
+static void setOpcode(Encoding* enc, uint8_t first, uint8_t second, uint8_t opcodeSize){
+    enc->opcode[0] = first;
+    enc->opcode[1] = second;
+    enc->opcodeSize = opcodeSize;
+}
+
+// Operands in AT&T order, so the last one is the destination
+static size_t encodeOperation(AsmOp op, const Address* ops, size_t count, uint8_t* bytes, Fixup* fixup){
+    const Mnemonic* m = &mnemonics[op.code];
+    const Address* src = &ops[0];
+    const Address* dst = &ops[count - 1];
+    //The width of SSE arithmetic is its precision, which has nothing to do with the registers
+    size_t size = m->form == formSse || m->form == formSseMov ? 0 : op.width;
+    if (size == 0){
+        for (size_t i=count; i>0 && size == 0; i--){
+            if (isRegister(&ops[i - 1])) size = regSize(ops[i - 1].reg);
+        }
+    }
+    Encoding enc = {.word = size == 2, .wide = size == 8};
+    for (size_t i=0; i<count; i++){
+        if (isRegister(&ops[i]) && (ops[i].reg == $sil || ops[i].reg == $dil)) enc.rex = 1;
+    }
+    uint8_t byteForm = size == 1 ? 0 : 1;
+    switch (m->form){
+        case formAlu:
+            if (src->mode == numberMode){
+                int64_t value = signExtend(src->val.num, size);
+                //The accumulator has a form without a ModRM byte, which is shorter unless the immediate fits in a byte
+                if (isRegister(dst) && regNumber(dst->reg) == 0 && (size == 1 || !fitsSigned(value, 1))){
+                    setOpcode(&enc, (m->code << 3) + 4 + byteForm, 0, 1);
+                    setImm(&enc, value, immSize(size));
+                    break;
+                }
+                enc.reg = m->code;
+                enc.rm = dst;
+                if (size != 1 && fitsSigned(value, 1)){
+                    setOpcode(&enc, 0x83, 0, 1);
+                    setImm(&enc, value, 1);
+                }
+                else{
+                    setOpcode(&enc, 0x80 + byteForm, 0, 1);
+                    setImm(&enc, value, immSize(size));
+                }
+            }
+            else if (isRegister(src)){
+                setOpcode(&enc, (m->code << 3) + byteForm, 0, 1);
+                enc.reg = regNumber(src->reg);
+                enc.rm = dst;
+            }
+            else{
+                setOpcode(&enc, (m->code << 3) + 2 + byteForm, 0, 1);
+                enc.reg = regNumber(dst->reg);
+                enc.rm = src;
+            }
+            break;
+        case formMov:
+            if (src->mode == numberMode && isRegister(dst)){
+                int64_t value = signExtend(src->val.num, size);
+                enc.reg = regNumber(dst->reg);
+                if (size == 8 && fitsSigned(value, 4)){
+                    setOpcode(&enc, 0xC7, 0, 1);
+                    enc.rm = dst;
+                    enc.reg = 0;
+                    setImm(&enc, value, 4);
+                }
+                else{
+                    setOpcode(&enc, size == 1 ? 0xB0 : 0xB8, 0, 1);
+                    enc.imm = value;
+                    enc.immSize = size;
+                }
+            }
+            else if (src->mode == numberMode){
+                setOpcode(&enc, 0xC6 + byteForm, 0, 1);
+                enc.rm = dst;
+                setImm(&enc, signExtend(src->val.num, size), immSize(size));
+            }
+            else if (isRegister(src)){
+                setOpcode(&enc, 0x88 + byteForm, 0, 1);
+                enc.reg = regNumber(src->reg);
+                enc.rm = dst;
+            }
+            else{
+                setOpcode(&enc, 0x8A + byteForm, 0, 1);
+                enc.reg = regNumber(dst->reg);
+                enc.rm = src;
+            }
+            break;
+        case formTest:
+            if (src->mode == numberMode){
+                if (isRegister(dst) && regNumber(dst->reg) == 0){
+                    setOpcode(&enc, 0xA8 + byteForm, 0, 1);
+                }
+                else{
+                    setOpcode(&enc, 0xF6 + byteForm, 0, 1);
+                    enc.rm = dst;
+                }
+                setImm(&enc, signExtend(src->val.num, size), immSize(size));
+            }
+            else{
+                //Both operands are only read, so whichever one is a register can go in reg
+                const Address* reg = isRegister(src) ? src : dst;
+                setOpcode(&enc, 0x84 + byteForm, 0, 1);
+                enc.reg = regNumber(reg->reg);
+                enc.rm = reg == src ? dst : src;
+            }
+            break;
+        case formLea:
+            setOpcode(&enc, 0x8D, 0, 1);
+            enc.reg = regNumber(dst->reg);
+            enc.rm = src;
+            break;
+        case formImul:
+            if (count == 1){
+                setOpcode(&enc, 0xF6 + byteForm, 0, 1);
+                enc.reg = 5;
+                enc.rm = src;
+                break;
+            }
+            assert(size != 1 && "No 8-bit form of imul with two operands");
+            enc.reg = regNumber(dst->reg);
+            if (src->mode == numberMode){
+                int64_t value = signExtend(src->val.num, size);
+                enc.rm = dst;
+                setOpcode(&enc, fitsSigned(value, 1) ? 0x6B : 0x69, 0, 1);
+                setImm(&enc, value, fitsSigned(value, 1) ? 1 : immSize(size));
+            }
+            else{
+                setOpcode(&enc, 0x0F, 0xAF, 2);
+                enc.rm = src;
+            }
+            break;
+        case formUnary:
+            setOpcode(&enc, 0xF6 + byteForm, 0, 1);
+            enc.reg = m->code;
+            enc.rm = dst;
+            break;
+        case formIncDec:
+            setOpcode(&enc, 0xFE + byteForm, 0, 1);
+            enc.reg = m->code;
+            enc.rm = dst;
+            break;
+        case formShift:
+            enc.reg = m->code;
+            enc.rm = dst;
+            if (count == 1 || (src->mode == numberMode && src->val.num == 1)){
+                setOpcode(&enc, 0xD0 + byteForm, 0, 1);
+            }
+            else if (src->mode == numberMode){
+                setOpcode(&enc, 0xC0 + byteForm, 0, 1);
+                enc.imm = src->val.num & 0xFF;
+                enc.immSize = 1;
+            }
+            else{
+                assert(isRegister(src) && src->reg == $cl && "Shifts by a register take cl");
+                setOpcode(&enc, 0xD2 + byteForm, 0, 1);
+            }
+            break;
+        case formBitTest:
+            enc.rm = dst;
+            if (src->mode == numberMode){
+                setOpcode(&enc, 0x0F, 0xBA, 2);
+                enc.reg = m->code;
+                enc.imm = src->val.num & 0xFF;
+                enc.immSize = 1;
+            }
+            else{
+                setOpcode(&enc, 0x0F, 0xA3 + ((m->code - 4) << 3), 2);
+                enc.reg = regNumber(src->reg);
+            }
+            break;
+        case formExtend:
+            if (m->code == 0x63) setOpcode(&enc, 0x63, 0, 1);
+            else setOpcode(&enc, 0x0F, m->code, 2);
+            enc.reg = regNumber(dst->reg);
+            enc.rm = src;
+            break;
+        case formSet:
+            setOpcode(&enc, 0x0F, 0x90 + condNumbers[op.cond], 2);
+            enc.rm = dst;
+            break;
+        case formCmov:
+            setOpcode(&enc, 0x0F, 0x40 + condNumbers[op.cond], 2);
+            enc.reg = regNumber(dst->reg);
+            enc.rm = src;
+            break;
+        case formSse:
+        case formSseInt:
+            //Conversions to integers take their size from the destination, and those from integers from the width
+            enc.word = 0;
+            enc.wide = m->form == formSseInt && size == 8;
+            enc.prefix = m->prefixes[op.width == 8 && m->form == formSse];
+            setOpcode(&enc, 0x0F, m->code, 2);
+            enc.reg = regNumber(dst->reg);
+            enc.rm = src;
+            break;
+        case formSseMov:
+            enc.word = enc.wide = 0;
+            enc.prefix = m->prefixes[op.width == 8];
+            if (isRegister(dst)){
+                setOpcode(&enc, 0x0F, 0x10, 2);
+                enc.reg = regNumber(dst->reg);
+                enc.rm = src;
+            }
+            else{
+                setOpcode(&enc, 0x0F, 0x11, 2);
+                enc.reg = regNumber(src->reg);
+                enc.rm = dst;
+            }
+            break;
+        case formPush:
+        case formPop:
+            //Pushes and pops are 64-bit without REX.W
+            enc.wide = 0;
+            if (isRegister(src)){
+                setOpcode(&enc, m->form == formPush ? 0x50 : 0x58, 0, 1);
+                enc.reg = regNumber(src->reg);
+            }
+            else if (src->mode == numberMode){
+                assert(m->form == formPush && "Can't pop into a number");
+                int64_t value = signExtend(src->val.num, 8);
+                setOpcode(&enc, fitsSigned(value, 1) ? 0x6A : 0x68, 0, 1);
+                setImm(&enc, value, fitsSigned(value, 1) ? 1 : 4);
+            }
+            else{
+                setOpcode(&enc, m->form == formPush ? 0xFF : 0x8F, 0, 1);
+                enc.reg = m->form == formPush ? 6 : 0;
+                enc.rm = src;
+            }
+            break;
+        case formBranch:
+            assert(src->mode == symbolMode && "Only functions are called or jumped to by name");
+            bytes[0] = m->code;
+            fixup->kind = fixSymbol;
+            fixup->pos = 1;
+            fixup->target.symbol = src->val.symbol;
+            return putBytes(bytes, 1, 0, 4);
+        case formJmpIndirect:
+            //Jumps are to 64-bit addresses without REX.W
+            enc.wide = 0;
+            setOpcode(&enc, 0xFF, 0, 1);
+            enc.reg = 4;
+            enc.rm = src;
+            break;
+        default:
+            assert(0 && "Unsupported form");
+    }
+    return layOut(&enc, bytes, fixup);
+}
+
+// Encodes an instruction that doesn't jump to a label, leaving whatever the fixup points to as zeroes
+static size_t encodeInstr(const AsmInstruction* ins, uint8_t* bytes, Fixup* fixup){
+    fixup->kind = fixNone;
+    assert(ins->op.code < OPCODE_COUNT && mnemonics[ins->op.code].form != formNone && "Opcode can't be encoded");
+    if (ins->type == ins0Op){
+        const Mnemonic* m = &mnemonics[ins->op.code];
+        size_t n = 0;
+        assert(m->form == formFixed && "Instruction needs operands");
+        if (m->prefixes[0]) bytes[n++] = m->prefixes[0];
+        bytes[n++] = m->code;
+        return n;
+    }
+    return encodeOperation(ins->op, ins->args.operands, ins->type == ins1Op ? 1 : 2, bytes, fixup);
+}
+
+// Label a jump goes to, or SIZE_MAX if the instruction isn't a jump that can be short. Tail calls to functions in the
+// file are jumps like any other, while calls always get a relocation so that the linker can still redirect them
+static size_t jumpLabel(const AsmInstruction* ins){
+    if (ins->type == insLbl && !isDirective(ins->op)) return ins->args.label.data.num;
+    if (ins->type != ins1Op || ins->args.operands[0].mode != symbolMode || ins->op.code != opJmp) return SIZE_MAX;
+    size_t* label = mapFind(SymbolName, size_t)(&functionLabels, ins->args.operands[0].val.symbol);
+    return label ? *label : SIZE_MAX;
+}
+
+static size_t declaredLabel(const AsmInstruction* ins){
+    if (ins->args.label.type == lblNum) return ins->args.label.data.num;
+    return *mapFind(SymbolName, size_t)(&functionLabels, ins->args.label.data.str);
+}
+
+// Alignment a directive asks for, or 0 if it isn't .align
+static size_t directiveAlignment(AsmOp op){
+    return op.code == opAlign ? op.width : 0;
+}
+
+static Section directiveSection(AsmOp op){
+    assert((op.code == opText || op.code == opRodata) && "Unsupported section");
+    return op.code == opText ? secText : secRodata;
+}
+
+// Every instruction gets its size, with jumps assumed short and alignment left to the layout
+static void sizeInstrs(size_t count){
+    uint8_t bytes[MAX_INSTR_BYTES];
+    Fixup fixup;
+    const AsmInstruction* ins = firstInstr();
+    for (size_t i=0; i<count; i++, ins = nextInstr(ins)){
+        if (jumpLabel(ins) != SIZE_MAX){
+            instrSizes[i] = SHORT_JUMP_SIZE;
+            continue;
+        }
+        switch (ins->type){
+            case ins0Op:
+                instrSizes[i] = isDirective(ins->op) ? 0 : encodeInstr(ins, bytes, &fixup);
+                break;
+            case ins1Op:
+            case ins2Op:
+                instrSizes[i] = encodeInstr(ins, bytes, &fixup);
+                break;
+            case insData:
+            case insLblDiff:
+                instrSizes[i] = ins->op.width;
+                break;
+            default:
+                instrSizes[i] = 0;
+                break;
+        }
+    }
+}
+
+static void layOutInstrs(size_t count){
+    size_t offsets[SECTION_COUNT] = {0};
+    Section section = secText;
+    const AsmInstruction* ins = firstInstr();
+    for (size_t i=0; i<count; i++, ins = nextInstr(ins)){
+        char directive = ins->type == ins0Op && isDirective(ins->op);
+        if (directive && directiveAlignment(ins->op)){
+            size_t align = directiveAlignment(ins->op);
+            instrSizes[i] = (align - offsets[section] % align) % align;
+        }
+        else if (ins->type == insLblDecl){
+            labelOffsets[declaredLabel(ins)] = offsets[section];
+            labelSections[declaredLabel(ins)] = section;
+        }
+        instrOffsets[i] = offsets[section];
+        offsets[section] += instrSizes[i];
+        if (directive && !directiveAlignment(ins->op)) section = directiveSection(ins->op);
+    }
+}
+
+// Turns short jumps whose targets are out of reach into long ones. Returns whether any grew
+static char growJumps(size_t count){
+    char grown = 0;
+    const AsmInstruction* ins = firstInstr();
+    for (size_t i=0; i<count; i++, ins = nextInstr(ins)){
+        size_t label = jumpLabel(ins);
+        if (label == SIZE_MAX || instrSizes[i] != SHORT_JUMP_SIZE) continue;
+        int64_t distance = labelOffsets[label] - (instrOffsets[i] + SHORT_JUMP_SIZE);
+        if (!fitsSigned(distance, 1)){
+            instrSizes[i] = ins->op.code == opJmp ? LONG_JMP_SIZE : LONG_JCC_SIZE;
+            grown = 1;
+        }
+    }
+    return grown;
+}
+
+static size_t hashName(SymbolName name){
+    size_t hash = 5381;
+    for (; *name; name++){
+        hash = hash * 33 + *name;
+    }
+    return hash;
+}
+
+static char eqName(SymbolName a, SymbolName b){
+    return !strcmp(a, b);
+}
+
+static size_t findSymbol(ObjectCode* object, const char_t* name){
+    size_t* index = mapFind(SymbolName, size_t)(&symbolIndices, name);
+    if (index != NULL) return *index;
+    if (!arrPush(ObjSymbol)(&object->symbols, (ObjSymbol){name, secText, 0, 0, 0})) exit(1);
+    if (!mapInsert(SymbolName, size_t)(&symbolIndices, name, object->symbols.size - 1)) exit(1);
+    return object->symbols.size - 1;
+}
+
+static void addRelocation(ObjectCode* object, Relocation relocation){
+    if (!arrPush(Relocation)(&object->relocations, relocation)) exit(1);
+}
+
+static void putSection(Array(uint8_t)* section, const uint8_t* bytes, size_t size){
+    for (size_t i=0; i<size; i++){
+        if (!arrPush(uint8_t)(section, bytes[i])) exit(1);
+    }
+}
+
+static void putNumber(Array(uint8_t)* section, uint64_t value, size_t size){
+    uint8_t bytes[8];
+    putBytes(bytes, 0, value, size);
+    putSection(section, bytes, size);
+}
+
+// Fills in a reference now if it's within the section, or leaves a relocation for it
+static void applyFixup(ObjectCode* object, const Fixup* fixup, Section section, size_t offset, size_t size, uint8_t* bytes){
+    size_t pos = offset + fixup->pos;
+    if (fixup->kind == fixSymbol){
+        addRelocation(object, (Relocation){relPlt32, section, pos, findSymbol(object, fixup->target.symbol), -(int64_t)(size - fixup->pos)});
+        return;
+    }
+    labelnum_t label = fixup->target.label;
+    if (labelSections[label] == section){
+        putBytes(bytes, fixup->pos, labelOffsets[label] - (offset + size), 4);
+        return;
+    }
+    //rip points past the end of the instruction, which is past the field by however many bytes follow it
+    addRelocation(object, (Relocation){relPc32, section, pos, labelSections[label], labelOffsets[label] - (size - fixup->pos)});
+}
+
+static void encodeJump(const AsmInstruction* ins, size_t label, size_t offset, size_t size, Array(uint8_t)* out){
+    uint8_t bytes[LONG_JCC_SIZE];
+    char jmp = ins->op.code == opJmp;
+    assert((jmp || ins->op.code == opJcc) && "Unknown jump");
+    uint8_t cond = condNumbers[ins->op.cond];
+    int64_t distance = labelOffsets[label] - (offset + size);
+    size_t n = 0;
+    if (size == SHORT_JUMP_SIZE){
+        bytes[n++] = jmp ? 0xEB : 0x70 + cond;
+        bytes[n++] = distance;
+    }
+    else{
+        if (!jmp) bytes[n++] = 0x0F;
+        bytes[n++] = jmp ? 0xE9 : 0x80 + cond;
+        n = putBytes(bytes, n, distance, 4);
+    }
+    putSection(out, bytes, n);
+}
+
+// Distance between two labels. If they're in different sections, the second one has to be where the data goes
+static void encodeLabelDiff(ObjectCode* object, const AsmInstruction* ins, Section section, size_t offset){
+    labelnum_t to = ins->args.labels[0];
+    labelnum_t from = ins->args.labels[1];
+    size_t size = ins->op.width;
+    if (labelSections[to] == labelSections[from]){
+        putNumber(&object->sections[section], labelOffsets[to] - labelOffsets[from], size);
+        return;
+    }
+    assert(labelSections[from] == section && size == 4 && "Can't relocate label difference");
+    addRelocation(object, (Relocation){relPc32, section, offset, labelSections[to], labelOffsets[to] + offset - labelOffsets[from]});
+    putNumber(&object->sections[section], 0, size);
+}
+
+static void encodeSections(ObjectCode* object, size_t count){
+    uint8_t bytes[MAX_INSTR_BYTES];
+    Fixup fixup;
+    Section section = secText;
+    const AsmInstruction* ins = firstInstr();
+    for (size_t i=0; i<count; i++, ins = nextInstr(ins)){
+        Array(uint8_t)* out = &object->sections[section];
+        assert(out->size == instrOffsets[i] && "Layout is out of date");
+        size_t label = jumpLabel(ins);
+        if (label != SIZE_MAX){
+            encodeJump(ins, label, instrOffsets[i], instrSizes[i], out);
+            continue;
+        }
+        switch (ins->type){
+            case ins0Op:
+                if (isDirective(ins->op)){
+                    if (!directiveAlignment(ins->op)){
+                        section = directiveSection(ins->op);
+                        break;
+                    }
+                    //Code is padded with nops in case it runs into the padding
+                    for (size_t j=0; j<instrSizes[i]; j++){
+                        if (!arrPush(uint8_t)(out, section == secText ? 0x90 : 0)) exit(1);
+                    }
+                    break;
+                }
+                //Other instructions without operands are encoded like the rest
+            case ins1Op:
+            case ins2Op: {
+                size_t size = encodeInstr(ins, bytes, &fixup);
+                if (fixup.kind != fixNone) applyFixup(object, &fixup, section, instrOffsets[i], size, bytes);
+                putSection(out, bytes, size);
+                break;
+            }
+            case insLbl:
+                if (ins->op.code == opGlobl){
+                    size_t index = findSymbol(object, ins->args.label.data.str);
+                    object->symbols.elem[index].global = 1;
+                }
+                break;
+            case insLblDecl:
+                if (ins->args.label.type == lblStr){
+                    size_t index = findSymbol(object, ins->args.label.data.str);
+                    ObjSymbol* symbol = &object->symbols.elem[index];
+                    symbol->section = section;
+                    symbol->offset = instrOffsets[i];
+                    symbol->defined = 1;
+                }
+                break;
+            case insData:
+                putNumber(out, ins->args.data, ins->op.width);
+                break;
+            case insLblDiff:
+                encodeLabelDiff(object, ins, section, instrOffsets[i]);
+                break;
+            default:
+                assert(0 && "Unsupported instruction type");
+        }
+    }
+}
+
+void encodeAllAsm(ObjectCode* object){
+    size_t count = instrCount();
+    labelnum_t labelCount = 0;
+    for (const AsmInstruction* ins = firstInstr(); ins != NULL; ins = nextInstr(ins)){
+        if (ins->type == insLblDecl && ins->args.label.type == lblNum && ins->args.label.data.num >= labelCount){
+            labelCount = ins->args.label.data.num + 1;
+        }
+    }
+    if (!mapInit(SymbolName, size_t)(&functionLabels, 16, &hashName, &eqName, NULL, NULL)) exit(1);
+    for (const AsmInstruction* ins = firstInstr(); ins != NULL; ins = nextInstr(ins)){
+        if (ins->type == insLblDecl && ins->args.label.type == lblStr){
+            if (!mapInsert(SymbolName, size_t)(&functionLabels, ins->args.label.data.str, labelCount++)) exit(1);
+        }
+    }
+    instrOffsets = malloc(sizeof(size_t) * (count + 1));
+    instrSizes = malloc(count + 1);
+    labelOffsets = malloc(sizeof(size_t) * (labelCount + 1));
+    labelSections = malloc(sizeof(Section) * (labelCount + 1));
+    if (instrOffsets == NULL || instrSizes == NULL || labelOffsets == NULL || labelSections == NULL) exit(1);
+
+    for (int i=0; i<SECTION_COUNT; i++){
+        if (!arrInit(uint8_t)(&object->sections[i], 64, NULL, NULL)) exit(1);
+    }
+    if (!arrInit(ObjSymbol)(&object->symbols, 8, NULL, NULL)) exit(1);
+    if (!arrInit(Relocation)(&object->relocations, 8, NULL, NULL)) exit(1);
+    for (int i=0; i<SECTION_COUNT; i++){
+        if (!arrPush(ObjSymbol)(&object->symbols, (ObjSymbol){NULL, i, 0, 0, 1})) exit(1);
+    }
+    if (!mapInit(SymbolName, size_t)(&symbolIndices, 16, &hashName, &eqName, NULL, NULL)) exit(1);
+
+    sizeInstrs(count);
+    do {
+        layOutInstrs(count);
+    } while (growJumps(count));
+    encodeSections(object, count);
+
+    mapDispose(SymbolName, size_t)(&symbolIndices);
+    mapDispose(SymbolName, size_t)(&functionLabels);
+    free(instrOffsets);
+    free(instrSizes);
+    free(labelOffsets);
+    free(labelSections);
+}
+
+void disposeObjectCode(ObjectCode* object){
+    for (int i=0; i<SECTION_COUNT; i++){
+        arrDispose(uint8_t)(&object->sections[i]);
+    }
+    arrDispose(ObjSymbol)(&object->symbols);
+    arrDispose(Relocation)(&object->relocations);
+}
@@ -0,0 +1,900 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "utils.h"
+#include "ast/type.h"
+#include "ir/ir.h"
+#include "codegen/asm_private.h"
+#include "codegen/codegen.h"
+// Lowers optimized IR into the same instruction stream as the AST walker.
+// Values live in registers, or in stack slots once those run out. Both are shared between values whose live ranges
+// don't overlap. Constants are used as immediates, and params that no call or division can clobber stay in the
+// registers they were passed in. Without a frame pointer the frame is addressed from rsp, and functions that make no
+// calls and keep everything in caller saved registers get no frame at all
+
+// Where each value lives, indexed by value id
+static Address* valueAddrs;
+static size_t* useCounts;
+static Address* localAddrs;
+// Registers that values can be kept in, in order of preference. Caller saved ones come first since they don't have to
+// be saved, but they only hold values that no call clobbers. The lowering itself only uses rax, r10, r11 and rdx
+static const Register valueRegisters[] = {$rcx, $r8, $r9, $rdx, $rbx, $rsi, $rdi, $r12, $r13, $r14, $r15};
+#define valueRegisterCount 11
+// Callee saved registers the function uses, indexed by their distance from rbx in Register
+#define savedRegisterCount 7
+static char savedRegisters[savedRegisterCount];
+// Slots the saved registers go in when there's a frame pointer. Without one they're pushed instead
+static Address saveSlots[savedRegisterCount];
+static offset_t frameOffset;
+static offset_t maxCallSpace;
+static labelnum_t retLabel;
+// Frame layout, known before anything is lowered. frameSize is what's allocated below the saves
+static char omitFramePointer;
+static offset_t frameSize;
+static size_t pushCount;
+// Whether returns get their own copy of the epilogue instead of jumping to a shared one
+static char inlineEpilogue;
+// Comparison that only set the flags for the branch or selects after it
+static const IrInstr* fusedCompare;
+// Call that was lowered to a jump, leaving nothing for the return after it to do
+static const IrInstr* tailCall;
+
+static Address argAddr(const IrInstr* instr, size_t i){
+    return valueAddrs[((IrInstr*)instr->args.elem[i])->id];
+}
+
+// Slots are first laid out relative to where rbp would point, then moved onto rsp by rebaseFrame if rbp isn't kept
+static Address stackSlot(Type type){
+    frameOffset = slotBelow(frameOffset, type);
+    return indirectAddress(frameOffset, $rbp);
+}
+
+// Below the entry rsp are the return address, the pushed registers, then the frame. Slots sit at the top of the
+// frame, while params passed on the stack are above the return address
+static Address rebaseFrame(Address addr){
+    if (!omitFramePointer || addr.mode != indirectMode || addr.reg != $rbp) return addr;
+    offset_t offset = addr.val.offset;
+    if (offset < 0) return indirectAddress(frameSize + offset, $rsp);
+    return indirectAddress(frameSize + pushCount*8 + offset - 8, $rsp);
+}
+
+static char isCalleeSaved(Register reg){
+    return reg >= $rbx && reg <= $r15;
+}
+
+static char needsLocation(const IrInstr* instr){
+    return irHasValue(instr) && instr->op != irConst;
+}
+
+// A call whose value is returned right away can reuse the caller's return address, as long as its args all go in
+// registers. The stack args would overwrite the caller's own, and the shadow space the caller got is big enough
+static char isTailCall(const IrInstr* call, const IrInstr* next){
+    if (next == NULL || next->op != irRet || call->args.size > 4) return 0;
+    if (next->args.size == 0) return 1;
+    return next->args.elem[0] == call && useCounts[call->id] == 1;
+}
+
+// Stretch of the laid out code where a value must keep its slot. Values whose intervals don't overlap share a slot
+typedef struct {
+    size_t start;
+    size_t end;
+} Interval;
+
+static Interval* intervals;     //Indexed by value id
+static size_t* blockStarts;     //Position of each block's label, indexed by block id. Its instructions come right after
+// Positions of the instructions that clobber param registers. Calls clobber all of them and divisions clobber rdx
+static Array(vptr) callPositions;
+static Array(vptr) divPositions;
+
+static void extendInterval(size_t id, size_t pos){
+    Interval* interval = &intervals[id];
+    if (pos < interval->start) interval->start = pos;
+    if (pos > interval->end) interval->end = pos;
+}
+
+// Phi copies for an edge are made where lowerBlock puts them
+static size_t copyPosition(const IrBlock* from, const IrBlock* to){
+    if (irSuccCount(from) == 1) return blockStarts[from->id] + from->instrs.size;
+    return blockStarts[to->id];
+}
+
+#define BIT_SET(set, i) ((set)[(i) / 64] |= (uint64_t)1 << ((i) % 64))
+#define BIT_CLEAR(set, i) ((set)[(i) / 64] &= ~((uint64_t)1 << ((i) % 64)))
+#define BIT_TEST(set, i) (((set)[(i) / 64] >> ((i) % 64)) & 1)
+
+// Backwards liveness over the blocks, with phi args live out of the pred they come from
+static void computeIntervals(IrFunction* func){
+    size_t words = func->valueCount / 64 + 1;
+    size_t blockCount = func->blocks.size;
+    New(uint64_t, liveIn, blockCount * words);
+    New(uint64_t, liveOut, blockCount * words);
+    New(uint64_t, live, words);
+    memset(liveIn, 0, sizeof(uint64_t) * blockCount * words);
+    memset(liveOut, 0, sizeof(uint64_t) * blockCount * words);
+    char changed = 1;
+    while (changed){
+        changed = 0;
+        for (size_t i=blockCount; i-- > 0;){
+            IrBlock* block = func->blocks.elem[i];
+            uint64_t* out = &liveOut[block->id * words];
+            for (size_t j=0; j<irSuccCount(block); j++){
+                IrBlock* succ = irSucc(block, j);
+                size_t index = irPredIndex(succ, block);
+                for (size_t k=0; k<words; k++){
+                    out[k] |= liveIn[succ->id * words + k];
+                }
+                for (size_t k=0; k<succ->instrs.size; k++){
+                    IrInstr* phi = succ->instrs.elem[k];
+                    if (phi->op != irPhi) break;
+                    IrInstr* arg = phi->args.elem[index];
+                    if (needsLocation(arg)) BIT_SET(out, arg->id);
+                }
+            }
+            memcpy(live, out, sizeof(uint64_t) * words);
+            for (size_t j=block->instrs.size; j-- > 0;){
+                IrInstr* instr = block->instrs.elem[j];
+                if (irHasValue(instr)) BIT_CLEAR(live, instr->id);
+                if (instr->op == irPhi) continue;
+                for (size_t k=0; k<instr->args.size; k++){
+                    IrInstr* arg = instr->args.elem[k];
+                    if (needsLocation(arg)) BIT_SET(live, arg->id);
+                }
+            }
+            uint64_t* in = &liveIn[block->id * words];
+            if (memcmp(in, live, sizeof(uint64_t) * words)){
+                memcpy(in, live, sizeof(uint64_t) * words);
+                changed = 1;
+            }
+        }
+    }
+
+    for (size_t i=0; i<func->valueCount; i++){
+        intervals[i] = (Interval){SIZE_MAX, 0};
+    }
+    for (size_t i=0; i<blockCount; i++){
+        IrBlock* block = func->blocks.elem[i];
+        size_t start = blockStarts[block->id];
+        size_t end = start + block->instrs.size;
+        for (size_t j=0; j<func->valueCount; j++){
+            if (BIT_TEST(&liveIn[block->id * words], j)) extendInterval(j, start);
+            if (BIT_TEST(&liveOut[block->id * words], j)) extendInterval(j, end);
+        }
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            if (needsLocation(instr)) extendInterval(instr->id, start + 1 + j);
+            for (size_t k=0; k<instr->args.size; k++){
+                IrInstr* arg = instr->args.elem[k];
+                if (!needsLocation(arg)) continue;
+                //Phis are written and their args read by the copies on each incoming edge
+                if (instr->op == irPhi){
+                    size_t copy = copyPosition(block->preds.elem[k], block);
+                    extendInterval(arg->id, copy);
+                    extendInterval(instr->id, copy);
+                }
+                else{
+                    extendInterval(arg->id, start + 1 + j);
+                }
+            }
+        }
+    }
+    free(liveIn);
+    free(liveOut);
+    free(live);
+}
+
+static int compareIntervals(const void* a, const void* b){
+    const Interval* left = &intervals[*(const size_t*)a];
+    const Interval* right = &intervals[*(const size_t*)b];
+    if (left->start != right->start) return left->start < right->start ? -1 : 1;
+    return *(const size_t*)a < *(const size_t*)b ? -1 : 1;
+}
+
+static char clobberedWithin(const Array(vptr)* positions, Interval interval){
+    for (size_t i=0; i<positions->size; i++){
+        size_t pos = (size_t)positions->elem[i];
+        if (pos >= interval.start && pos <= interval.end) return 1;
+    }
+    return 0;
+}
+
+// Main calls __main before anything else, so its params can't stay in the registers they came in
+static char keepsParamRegister(const IrFunction* func, const IrInstr* param){
+    size_t index = param->data.index;
+    if (index >= 4 || !strcmp(func->name, "main")) return 0;
+    Interval interval = intervals[param->id];
+    return !clobberedWithin(&callPositions, interval) && (paramRegisters[index] != $rdx || !clobberedWithin(&divPositions, interval));
+}
+
+// Caller saved registers can't hold anything live across a call, and rdx can't hold anything live across a division.
+// Params only get callee saved registers, besides the one they were passed in, so that lowerParams can move them in
+// any order
+static char canHold(const IrInstr* value, Register reg){
+    if (isCalleeSaved(reg)) return 1;
+    if (value->op == irParam) return 0;
+    Interval interval = intervals[value->id];
+    return !clobberedWithin(&callPositions, interval) && (reg != $rdx || !clobberedWithin(&divPositions, interval));
+}
+
+// Freed slots are kept apart by size, 1 to 8 bytes, so that a reused slot fits the value and keeps its alignment
+#define SLOT_SIZES 4
+
+// Params that don't get a register just use their home slot in the caller's frame
+static Address spillSlot(const IrInstr* value, Address* freeSlots[], size_t freeCounts[]){
+    if (value->op == irParam) return indirectAddress(16 + value->data.index*8, $rbp);
+    unsigned size = log2Floor(typeSize(value->type));
+    return freeCounts[size] ? freeSlots[size][--freeCounts[size]] : stackSlot(value->type);
+}
+
+// Linear scan over the intervals in order of their start. Values take the first free register that can hold them.
+// Otherwise, whichever of the value and the values holding registers it could take stays live the longest is spilled
+// to a stack slot. Registers and slots are reused once the value in them is dead. Intervals touching at the same
+// position don't share a location, since operands are read and results written by the same instruction
+static void assignLocations(IrFunction* func, IrInstr** values){
+    New(size_t, order, func->valueCount + 1);
+    New(size_t, active, func->valueCount + 1);
+    Address* freeSlots[SLOT_SIZES];
+    size_t freeCounts[SLOT_SIZES] = {0};
+    for (int i=0; i<SLOT_SIZES; i++){
+        New(Address, slots, func->valueCount + 1);
+        freeSlots[i] = slots;
+    }
+    char freeRegisters[$r15 + 1];   //Indexed by Register
+    size_t count = 0, activeCount = 0;
+    memset(freeRegisters, 0, sizeof(freeRegisters));
+    for (size_t i=0; i<valueRegisterCount; i++){
+        freeRegisters[valueRegisters[i]] = 1;
+    }
+    for (size_t i=0; i<func->valueCount; i++){
+        if (values[i] != NULL && needsLocation(values[i])) order[count++] = i;
+    }
+    qsort(order, count, sizeof(size_t), &compareIntervals);
+    for (size_t i=0; i<count; i++){
+        size_t id = order[i];
+        size_t kept = 0;
+        for (size_t j=0; j<activeCount; j++){
+            if (intervals[active[j]].end >= intervals[id].start){
+                active[kept++] = active[j];
+                continue;
+            }
+            Address addr = valueAddrs[active[j]];
+            if (addr.mode == registerMode){
+                freeRegisters[addr.reg] = 1;
+            }
+            else if (addr.val.offset < 0){
+                unsigned size = log2Floor(typeSize(values[active[j]]->type));
+                freeSlots[size][freeCounts[size]++] = addr;
+            }
+        }
+        activeCount = kept;
+        IrInstr* value = values[id];
+        if (value->op == irParam && keepsParamRegister(func, value)){
+            Register reg = paramRegisters[value->data.index];
+            valueAddrs[id] = registerAddress(reg);
+            freeRegisters[reg] = 0;
+            active[activeCount++] = id;
+            continue;
+        }
+        size_t choice = 0;
+        while (choice < valueRegisterCount && !(freeRegisters[valueRegisters[choice]] && canHold(value, valueRegisters[choice]))){
+            choice++;
+        }
+        if (choice < valueRegisterCount){
+            Register reg = valueRegisters[choice];
+            valueAddrs[id] = registerAddress(reg);
+            freeRegisters[reg] = 0;
+        }
+        else{
+            size_t victim = SIZE_MAX;
+            for (size_t j=0; j<activeCount; j++){
+                Address addr = valueAddrs[active[j]];
+                if (addr.mode != registerMode || !canHold(value, addr.reg)) continue;
+                if (victim == SIZE_MAX || intervals[active[j]].end > intervals[victim].end) victim = active[j];
+            }
+            if (victim != SIZE_MAX && intervals[victim].end > intervals[id].end){
+                valueAddrs[id] = valueAddrs[victim];
+                valueAddrs[victim] = spillSlot(values[victim], freeSlots, freeCounts);
+            }
+            else{
+                valueAddrs[id] = spillSlot(value, freeSlots, freeCounts);
+            }
+        }
+        active[activeCount++] = id;
+    }
+    free(order);
+    free(active);
+    for (int i=0; i<SLOT_SIZES; i++){
+        free(freeSlots[i]);
+    }
+}
+
+// With a frame pointer the saves get slots and the frame is rounded up to keep rsp aligned after rbp is pushed.
+// Without one the saves are pushed and the frame is padded only if calls need the alignment. Main calls __main
+static void layoutFrame(IrFunction* func){
+    if (!strcmp(func->name, "main") && maxCallSpace < 32) maxCallSpace = 32;
+    pushCount = 0;
+    for (size_t i=0; i<savedRegisterCount; i++){
+        if (!savedRegisters[i]) continue;
+        if (omitFramePointer) pushCount++;
+        else saveSlots[i] = stackSlot(typInt64);
+    }
+    if (omitFramePointer){
+        //Slots are aligned relative to the top of the frame, so it's kept a multiple of 8 like rsp
+        frameSize = maxCallSpace + (7 - frameOffset) / 8 * 8;
+        if (maxCallSpace && (8 + pushCount*8 + frameSize) % 16) frameSize += 8;
+    }
+    else{
+        frameSize = (maxCallSpace - frameOffset + 15) / 16 * 16;
+    }
+}
+
+static void assignAddresses(IrFunction* func){
+    New(IrInstr*, values, func->valueCount + 1);
+    New(Interval, ranges, func->valueCount + 1);
+    New(size_t, starts, func->blocks.size);
+    intervals = ranges;
+    blockStarts = starts;
+    size_t pos = 0;
+    if (!arrInit(vptr)(&callPositions, 4, NULL, NULL)) exit(1);
+    if (!arrInit(vptr)(&divPositions, 4, NULL, NULL)) exit(1);
+    for (size_t i=0; i<func->valueCount; i++){
+        values[i] = NULL;
+    }
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        blockStarts[block->id] = pos;
+        pos += block->instrs.size + 1;
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            for (size_t k=0; k<instr->args.size; k++){
+                useCounts[((IrInstr*)instr->args.elem[k])->id]++;
+            }
+            if (irHasValue(instr)) values[instr->id] = instr;
+            switch (instr->op){
+                case irConst:
+                    valueAddrs[instr->id] = numberAddress(instr->data.num);
+                    break;
+                case irDiv:
+                    if (!arrPush(vptr)(&divPositions, (void*)(blockStarts[block->id] + 1 + j))) exit(1);
+                    break;
+            }
+        }
+    }
+    // Tail calls happen once the frame is gone and nothing is live anymore, so they clobber nothing and need no space
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            IrInstr* next = j + 1 < block->instrs.size ? block->instrs.elem[j+1] : NULL;
+            if (instr->op != irCall || isTailCall(instr, next)) continue;
+            if (!arrPush(vptr)(&callPositions, (void*)(blockStarts[block->id] + 1 + j))) exit(1);
+            offset_t callSpace = instr->args.size < 4 ? 32 : instr->args.size * 8;
+            if (callSpace > maxCallSpace) maxCallSpace = callSpace;
+        }
+    }
+    computeIntervals(func);
+    // Params are all written on entry, before anything else runs
+    for (size_t i=0; i<func->valueCount; i++){
+        if (values[i] != NULL && values[i]->op == irParam) extendInterval(i, 0);
+    }
+    assignLocations(func, values);
+    // The caller's values in the callee saved registers that got used have to be saved
+    for (size_t i=0; i<savedRegisterCount; i++){
+        savedRegisters[i] = 0;
+    }
+    for (size_t i=0; i<func->valueCount; i++){
+        if (values[i] == NULL || !needsLocation(values[i])) continue;
+        Address addr = valueAddrs[i];
+        if (addr.mode == registerMode && isCalleeSaved(addr.reg)) savedRegisters[addr.reg - $rbx] = 1;
+    }
+    free(intervals);
+    free(blockStarts);
+    arrDispose(vptr)(&callPositions);
+    arrDispose(vptr)(&divPositions);
+
+    // Locals only need slots if mem2reg didn't get rid of them
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            if ((instr->op == irLoad || instr->op == irStore) && localAddrs[instr->data.index].mode == numberMode){
+                localAddrs[instr->data.index] = stackSlot(((IrLocal*)func->locals.elem[instr->data.index])->type);
+            }
+        }
+    }
+    layoutFrame(func);
+    for (size_t i=0; i<func->valueCount; i++){
+        if (values[i] != NULL && needsLocation(values[i])) valueAddrs[i] = rebaseFrame(valueAddrs[i]);
+    }
+    for (size_t i=0; i<func->locals.size; i++){
+        localAddrs[i] = rebaseFrame(localAddrs[i]);
+    }
+    free(values);
+}
+
+static char sameAddress(Address a, Address b){
+    if (a.mode != b.mode) return 0;
+    switch (a.mode){
+        case registerMode:
+            return a.reg == b.reg;
+        case indirectMode:
+            return a.reg == b.reg && a.val.offset == b.val.offset;
+        default:
+            return 0;
+    }
+}
+
+// Moves params from where they were passed to where they were allocated. None of them is allocated to where
+// another one was passed, so the moves can go in any order
+static void lowerParams(IrFunction* func){
+    IrBlock* entry = func->blocks.elem[0];
+    for (size_t i=0; i<entry->instrs.size; i++){
+        IrInstr* param = entry->instrs.elem[i];
+        if (param->op != irParam) continue;
+        size_t index = param->data.index;
+        Address passed = index < 4 ? registerAddress(paramRegisters[index]) : rebaseFrame(indirectAddress(16 + index*8, $rbp));
+        if (!sameAddress(passed, valueAddrs[param->id])){
+            cmplMov(passed, valueAddrs[param->id], param->type);
+        }
+    }
+}
+
+static void lowerPrologue(){
+    if (!omitFramePointer){
+        appendInstr(op1Instruction(widthOp(opPush, 8), registerAddress($rbp)));
+        cmplMov(registerAddress($rsp), registerAddress($rbp), typUInt64);
+    }
+    for (size_t i=0; i<savedRegisterCount; i++){
+        if (savedRegisters[i] && omitFramePointer) appendInstr(op1Instruction(widthOp(opPush, 8), registerAddress($rbx + i)));
+    }
+    if (frameSize) appendInstr(op2Instruction(widthOp(opSub, 8), numberAddress(frameSize), registerAddress($rsp)));
+    for (size_t i=0; i<savedRegisterCount; i++){
+        if (savedRegisters[i] && !omitFramePointer) cmplMov(registerAddress($rbx + i), saveSlots[i], typUInt64);
+    }
+}
+
+// Tail calls leave through a jump to the callee instead of a ret
+static void lowerEpilogue(const char_t* tailCallee){
+    if (omitFramePointer){
+        if (frameSize) appendInstr(op2Instruction(widthOp(opAdd, 8), numberAddress(frameSize), registerAddress($rsp)));
+        for (size_t i=savedRegisterCount; i-- > 0;){
+            if (savedRegisters[i]) appendInstr(op1Instruction(widthOp(opPop, 8), registerAddress($rbx + i)));
+        }
+    }
+    else{
+        for (size_t i=0; i<savedRegisterCount; i++){
+            if (savedRegisters[i]) cmplMov(saveSlots[i], registerAddress($rbx + i), typUInt64);
+        }
+        appendInstr(op0Instruction(plainOp(opLeave)));
+    }
+    if (tailCallee) appendInstr(op1Instruction(plainOp(opJmp), symbolAddress(tailCallee)));
+    else appendInstr(op0Instruction(plainOp(opRet)));
+}
+
+// Encoded size of the epilogue in bytes. Registers past rdi need a REX prefix, and so do all 64-bit movs and adds
+static size_t epilogueSize(){
+    size_t size = 1;
+    for (size_t i=0; i<savedRegisterCount; i++){
+        if (!savedRegisters[i]) continue;
+        if (omitFramePointer) size += $rbx + i >= $r12 ? 2 : 1;
+        else size += saveSlots[i].val.offset >= -128 ? 4 : 7;
+    }
+    if (!omitFramePointer) size += 1;
+    else if (frameSize) size += frameSize < 128 ? 4 : 7;
+    return size;
+}
+
+typedef struct {
+    Address from;
+    Address to;
+    Type type;
+} Move;
+
+// Performs all moves as if at once. Moves are done once nothing else still needs to read their destination,
+// and cycles are broken by saving one destination in r10
+static void lowerParallelMoves(Move* moves, size_t count){
+    New(char, done, count);
+    size_t pending = 0;
+    for (size_t i=0; i<count; i++){
+        done[i] = sameAddress(moves[i].from, moves[i].to);
+        pending += !done[i];
+    }
+    while (pending){
+        char progress = 0;
+        for (size_t i=0; i<count; i++){
+            if (done[i]) continue;
+            char blocked = 0;
+            for (size_t j=0; j<count && !blocked; j++){
+                blocked = j != i && !done[j] && sameAddress(moves[j].from, moves[i].to);
+            }
+            if (!blocked){
+                cmplMov(moves[i].from, moves[i].to, moves[i].type);
+                done[i] = 1;
+                pending--;
+                progress = 1;
+            }
+        }
+        if (!progress){
+            size_t first = 0;
+            while (done[first]) first++;
+            Address saved = moves[first].to;
+            cmplMov(saved, registerAddress($r10), typUInt64);
+            for (size_t j=0; j<count; j++){
+                if (!done[j] && sameAddress(moves[j].from, saved)) moves[j].from = registerAddress($r10);
+            }
+        }
+    }
+    free(done);
+}
+
+// Copies the values that the phis of to receive from the edge coming out of from
+static void lowerPhiCopies(IrBlock* from, IrBlock* to){
+    size_t index = irPredIndex(to, from);
+    New(Move, moves, to->instrs.size);
+    size_t count = 0;
+    for (size_t i=0; i<to->instrs.size; i++){
+        IrInstr* phi = to->instrs.elem[i];
+        if (phi->op != irPhi) break;
+        moves[count++] = (Move){argAddr(phi, index), valueAddrs[phi->id], phi->type};
+    }
+    lowerParallelMoves(moves, count);
+    free(moves);
+}
+
+static void lowerJump(IrBlock* target, IrBlock* next){
+    if (target != next){
+        appendInstr(labelInstruction(plainOp(opJmp), numLabel(target->mark)));
+    }
+}
+
+static Type argType(const IrInstr* instr, size_t i){
+    return ((IrInstr*)instr->args.elem[i])->type;
+}
+
+static void lowerCompare(const IrInstr* cmp){
+    Type type = argType(cmp, 0);
+    Address right = argAddr(cmp, 1);
+    cmplMov(argAddr(cmp, 0), registerAddress($rax), type);
+    if (needsImm64(right, type)){
+        cmplMov(right, registerAddress($r10), type);
+        right = registerAddress($r10);
+    }
+    appendInstr(sizedOp2Instruction(opCmp, type, right, registerAddress($rax)));
+}
+
+// A comparison only used by the selects and branch right after it sets the flags for them instead of producing a
+// boolean. Nothing they emit before using the flags changes them
+static char isFusedCompare(const IrBlock* block, size_t pos){
+    const IrInstr* cmp = block->instrs.elem[pos];
+    if (cmp->op != irCmp) return 0;
+    size_t users = 0;
+    for (size_t i=pos+1; i<block->instrs.size; i++){
+        const IrInstr* user = block->instrs.elem[i];
+        if ((user->op != irSelect && user->op != irBranch) || user->args.elem[0] != cmp) break;
+        users++;
+    }
+    return users > 0 && users == useCounts[cmp->id];
+}
+
+static void lowerBranch(const IrInstr* branch, char fused, IrBlock* next){
+    IrBlock* ifTrue = branch->targets[0];
+    IrBlock* ifFalse = branch->targets[1];
+    Address value = argAddr(branch, 0);
+    IrCond cond;
+    if (fused){
+        cond = fusedCompare->cond;
+    }
+    else if (value.mode == numberMode){
+        lowerJump(value.val.num ? ifTrue : ifFalse, next);
+        return;
+    }
+    else{
+        appendInstr(sizedOp2Instruction(opCmp, argType(branch, 0), numberAddress(0), value));
+        cond = irCondNE;
+    }
+    if (ifFalse == next){
+        appendInstr(labelInstruction(condOp(opJcc, cond), numLabel(ifTrue->mark)));
+    }
+    else if (ifTrue == next){
+        appendInstr(labelInstruction(condOp(opJcc, irNegateCond(cond)), numLabel(ifFalse->mark)));
+    }
+    else{
+        appendInstr(labelInstruction(condOp(opJcc, cond), numLabel(ifTrue->mark)));
+        appendInstr(labelInstruction(plainOp(opJmp), numLabel(ifFalse->mark)));
+    }
+}
+
+// Most empty blocks followed to find where a switch target really goes, which also stops at empty infinite loops
+#define MAX_SKIPPED_BLOCKS 8
+
+// Cases with nothing between them, like case 1: case 2:, leave blocks that only jump on. The switch can go straight to
+// where they end up and see them as one target, as long as no phi copies are made on the way
+static labelnum_t switchLabel(const IrBlock* target){
+    for (int i=0; i<MAX_SKIPPED_BLOCKS; i++){
+        const IrInstr* jmp = irTerminator(target);
+        if (target->instrs.size != 1 || jmp->op != irJmp) break;
+        const IrBlock* next = jmp->targets[0];
+        if (((IrInstr*)next->instrs.elem[0])->op == irPhi) break;
+        target = next;
+    }
+    return target->mark;
+}
+
+static void lowerSwitch(const IrInstr* instr){
+    New(SwitchCase, cases, instr->caseCount);
+    for (size_t i=0; i<instr->caseCount; i++){
+        cases[i] = (SwitchCase){instr->cases[i].num, switchLabel(instr->cases[i].target)};
+    }
+    cmplSwitch(argAddr(instr, 0), argType(instr, 0), cases, instr->caseCount, switchLabel(instr->targets[0]));
+    free(cases);
+}
+
+static void lowerCall(const IrInstr* call, const IrInstr* next){
+    size_t argCount = call->args.size;
+    // Args are already evaluated and converted to their param types. The args of tail calls can be in param registers,
+    // so those are all moved at once
+    Move moves[4];
+    for (size_t i=0; i<argCount; i++){
+        if (i < 4){
+            moves[i] = (Move){argAddr(call, i), registerAddress(paramRegisters[i]), argType(call, i)};
+        }
+        else{
+            cmplMov(argAddr(call, i), indirectAddress(i * 8, $rsp), argType(call, i));
+        }
+    }
+    lowerParallelMoves(moves, argCount < 4 ? argCount : 4);
+    // Args are read from the frame and saved registers before the epilogue gives them back
+    if (isTailCall(call, next)){
+        lowerEpilogue(call->data.name);
+        tailCall = call;
+        return;
+    }
+    appendInstr(op1Instruction(plainOp(opCall), symbolAddress(call->data.name)));
+    if (irHasValue(call)){
+        cmplMov(registerAddress($rax), valueAddrs[call->id], call->type);
+    }
+}
+
+// Binary arithmetic goes through rax, with the right operand used directly unless it's a 64-bit immediate
+static void lowerArith(AsmOp opcode, const IrInstr* instr){
+    Type type = instr->type;
+    Address right = argAddr(instr, 1);
+    cmplMov(argAddr(instr, 0), registerAddress($rax), type);
+    if (needsImm64(right, type)){
+        cmplMov(right, registerAddress($r10), type);
+        right = registerAddress($r10);
+    }
+    appendInstr(op2Instruction(opcode, sizedAddress(right, type), sizedAddress(registerAddress($rax), type)));
+}
+
+static void lowerMul(const IrInstr* instr){
+    Type type = instr->type;
+    Address left = argAddr(instr, 0);
+    Address right = argAddr(instr, 1);
+    // Constants go on the right so that they can be strength reduced
+    if (left.mode == numberMode){
+        Address temp = left;
+        left = right;
+        right = temp;
+    }
+    cmplMov(left, registerAddress($rax), type);
+    if (right.mode != numberMode){
+        appendInstr(sizedOp2Instruction(opImul, type, right, registerAddress($rax)));
+    }
+    else if (!cmplMultiConst(right.val.num, type)){
+        if (needsImm64(right, type)){
+            cmplMov(right, registerAddress($r10), type);
+            right = registerAddress($r10);
+        }
+        appendInstr(sizedOp2Instruction(opImul, type, right, registerAddress($rax)));
+    }
+}
+
+static void lowerDiv(const IrInstr* instr){
+    Type type = instr->type;
+    Address left = argAddr(instr, 0);
+    Address right = argAddr(instr, 1);
+    // Constant division may read the dividend more than once, which can't be done with a 64-bit immediate
+    if (left.mode == numberMode){
+        cmplMov(left, registerAddress($r11), type);
+        left = registerAddress($r11);
+    }
+    if (right.mode == numberMode && cmplDivConst(left, right.val.num, type)){
+        return;
+    }
+    if (right.mode == numberMode){
+        cmplMov(right, registerAddress($r10), type);
+        right = registerAddress($r10);
+    }
+    cmplMov(left, registerAddress($rax), type);
+    if (isSignedType(type)){
+        appendInstr(op0Instruction(typeSize(type) == 8 ? plainOp(opCqto) : plainOp(opCltd)));
+        appendInstr(sizedOp1Instruction(opIdiv, type, right));
+    }
+    else{
+        cmplMov(numberAddress(0), registerAddress($rdx), type);
+        appendInstr(sizedOp1Instruction(opDiv, type, right));
+    }
+}
+
+// Both values are moved without touching the flags, then the one the condition picks is left in rax
+static void lowerSelect(const IrInstr* select){
+    Address rax = registerAddress($rax);
+    Address value = argAddr(select, 0);
+    Address ifTrue = argAddr(select, 1);
+    IrCond cond = irCondNE;
+    if (select->args.elem[0] == fusedCompare){
+        cond = fusedCompare->cond;
+    }
+    else if (value.mode == numberMode){
+        cmplMov(value.val.num ? ifTrue : argAddr(select, 2), rax, select->type);
+        return;
+    }
+    else{
+        appendInstr(sizedOp2Instruction(opCmp, argType(select, 0), numberAddress(0), value));
+    }
+    cmplMov(argAddr(select, 2), rax, select->type);
+    //cmov has no immediate form
+    if (ifTrue.mode == numberMode){
+        cmplMov(ifTrue, registerAddress($r11), select->type);
+        ifTrue = registerAddress($r11);
+    }
+    Type type = argTypePromotion(select->type);
+    appendInstr(op2Instruction(condOp(opCmov, cond), sizedAddress(ifTrue, type), sizedAddress(rax, type)));
+}
+
+static void lowerInstr(IrInstr* instr, IrInstr* nextInstr, IrBlock* next){
+    Address rax = registerAddress($rax);
+    switch (instr->op){
+        case irConst:
+        case irParam:
+        case irPhi:
+            return;
+        case irLoad:
+            cmplMov(localAddrs[instr->data.index], valueAddrs[instr->id], instr->type);
+            return;
+        case irStore:
+            cmplMov(argAddr(instr, 0), localAddrs[instr->data.index], argType(instr, 0));
+            return;
+        case irCopy:
+            cmplMov(argAddr(instr, 0), valueAddrs[instr->id], instr->type);
+            return;
+        case irConv:
+            cmplMov(cmplConvert(argAddr(instr, 0), argType(instr, 0), instr->type, $rax), valueAddrs[instr->id], instr->type);
+            return;
+        case irNeg:
+            cmplMov(argAddr(instr, 0), rax, instr->type);
+            appendInstr(sizedOp1Instruction(opNeg, argTypePromotion(instr->type), rax));
+            break;
+        case irNot:
+            // Only the bits of the operand's own type count, so the comparison is exactly that wide
+            cmplMov(argAddr(instr, 0), rax, argType(instr, 0));
+            appendInstr(sizedOp2Instruction(opCmp, argType(instr, 0), numberAddress(0), rax));
+            appendInstr(op1Instruction(condOp(opSet, condE), registerAddress($al)));
+            appendInstr(op2Instruction(widthOp(opMovzb, 4), registerAddress($al), registerAddress($eax)));
+            break;
+        case irAdd:
+            lowerArith(sizedOpcode(opAdd, instr->type), instr);
+            break;
+        case irSub:
+            lowerArith(sizedOpcode(opSub, instr->type), instr);
+            break;
+        case irMul:
+            lowerMul(instr);
+            break;
+        case irDiv:
+            lowerDiv(instr);
+            break;
+        case irCmp:
+            lowerCompare(instr);
+            appendInstr(op1Instruction(condOp(opSet, instr->cond), registerAddress($al)));
+            appendInstr(op2Instruction(widthOp(opMovzb, 4), registerAddress($al), registerAddress($eax)));
+            break;
+        case irSelect:
+            lowerSelect(instr);
+            break;
+        case irCall:
+            lowerCall(instr, nextInstr);
+            return;
+        case irJmp:
+            lowerJump(instr->targets[0], next);
+            return;
+        case irBranch:
+            if (instr->targets[0] == instr->targets[1]){
+                lowerJump(instr->targets[0], next);
+            }
+            else{
+                lowerBranch(instr, instr->args.elem[0] == fusedCompare, next);
+            }
+            return;
+        case irSwitch:
+            lowerSwitch(instr);
+            return;
+        case irRet:
+            if (tailCall != NULL) return;
+            if (instr->args.size){
+                cmplMov(argAddr(instr, 0), rax, argType(instr, 0));
+            }
+            if (inlineEpilogue){
+                lowerEpilogue(NULL);
+            }
+            // The last block falls through into the return routine
+            else if (next != NULL){
+                appendInstr(labelInstruction(plainOp(opJmp), numLabel(retLabel)));
+            }
+            return;
+        default:
+            assert(0 && "Unsupported IR instruction");
+    }
+    cmplMov(rax, valueAddrs[instr->id], instr->type);
+}
+
+static void lowerBlock(IrBlock* block, IrBlock* next){
+    appendInstr(labelDeclInstruction(numLabel(block->mark)));
+    fusedCompare = NULL;
+    tailCall = NULL;
+    // Critical edges are split, so a block with phis either has a single pred or is its preds' only successor
+    if (block->preds.size == 1 && irSuccCount(block->preds.elem[0]) > 1){
+        lowerPhiCopies(block->preds.elem[0], block);
+    }
+    for (size_t i=0; i<block->instrs.size; i++){
+        IrInstr* instr = block->instrs.elem[i];
+        IrInstr* nextInstr = i + 1 < block->instrs.size ? block->instrs.elem[i+1] : NULL;
+        if (irIsTerminator(instr->op) && irSuccCount(block) == 1){
+            lowerPhiCopies(block, irSucc(block, 0));
+        }
+        if (isFusedCompare(block, i)){
+            lowerCompare(instr);
+            fusedCompare = instr;
+            continue;
+        }
+        lowerInstr(instr, nextInstr, next);
+    }
+}
+
+void cmplIrFunction(IrFunction* func){
+    irSplitCriticalEdges(func);
+    irLayoutBlocks(func);
+    irNumberValues(func);
+    New(Address, addrs, func->valueCount);
+    New(size_t, uses, func->valueCount);
+    New(Address, locals, func->locals.size + 1);
+    valueAddrs = addrs;
+    useCounts = uses;
+    localAddrs = locals;
+    memset(useCounts, 0, sizeof(size_t) * func->valueCount);
+    for (size_t i=0; i<func->locals.size; i++){
+        localAddrs[i] = numberAddress(0);
+    }
+    frameOffset = 0;
+    maxCallSpace = 0;
+    omitFramePointer = codegenOptions.omitFramePointer;
+    assignAddresses(func);
+    // Returns copy the epilogue if it's no bigger than the 5 byte jump to a shared one
+    inlineEpilogue = epilogueSize() <= 5;
+
+    appendInstr(labelInstruction(plainOp(opGlobl), strLabel(func->name)));
+    appendInstr(labelDeclInstruction(strLabel(func->name)));
+    lowerPrologue();
+    lowerParams(func);
+    if (!strcmp(func->name, "main")){
+        appendInstr(op1Instruction(plainOp(opCall), symbolAddress("__main")));
+    }
+
+    retLabel = newLabel();
+    for (size_t i=0; i<func->blocks.size; i++){
+        ((IrBlock*)func->blocks.elem[i])->mark = newLabel();
+    }
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* next = i + 1 < func->blocks.size ? func->blocks.elem[i+1] : NULL;
+        lowerBlock(func->blocks.elem[i], next);
+    }
+    if (!inlineEpilogue){
+        appendInstr(labelDeclInstruction(numLabel(retLabel)));
+        lowerEpilogue(NULL);
+    }
+
+    free(valueAddrs);
+    free(useCounts);
+    free(localAddrs);
+}
@@ -0,0 +1,200 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "utils.h"
+#include "codegen/asm_private.h"
+#include "codegen/codegen.h"
+#include "semantics/symtable.h"
+// Loads encoded code straight into memory and runs it, doing the linker's job for the one object.
+// The code comes first, then a stub for every function from another file, then the read-only data on its own pages
+
+// Functions from other files can be anywhere in the address space, too far for a 32-bit call, so calls go through a stub
+// that calls the full address stored right after it. The host's functions follow the System V convention rather than the
+// target's, so each stub is built from the function's params to move the args where the host expects them, and keeps rsi
+// and rdi, which the target expects to survive calls. The host counts integer and float args apart, so an arg only ever
+// moves down to a lower register and moving them in order never overwrites one that's still to be read
+#define STUB_SIZE 160
+#define TARGET_REG_ARGS 4
+#define HOST_INT_ARGS 6
+#define HOST_FLOAT_ARGS 8
+static const uint8_t targetIntRegs[TARGET_REG_ARGS] = {1, 2, 8, 9};       //rcx, rdx, r8, r9
+static const uint8_t hostIntRegs[HOST_INT_ARGS] = {7, 6, 2, 1, 8, 9};     //rdi, rsi, rdx, rcx, r8, r9
+static const uint8_t stubStart[] = {
+    0x56,                               //push %rsi
+    0x57,                               //push %rdi
+    0x48, 0x83, 0xEC, 0x08              //sub $8, %rsp
+};
+static const uint8_t stubEnd[] = {
+    0xFF, 0x15, 0x07, 0, 0, 0,          //call *7(%rip)
+    0x48, 0x83, 0xC4, 0x08,             //add $8, %rsp
+    0x5F,                               //pop %rdi
+    0x5E,                               //pop %rsi
+    0xC3                                //ret
+};
+
+// Offset from rsp inside the stub of an arg the target passed on the stack, past the stub's own 24 bytes, the return
+// address and the shadow space that stands in for the first four args
+static uint8_t* stackArgOffset(uint8_t* pos, size_t arg){
+    int32_t offset = 24 + 8 + 8 * arg;
+    memcpy(pos, &offset, sizeof(offset));
+    return pos + sizeof(offset);
+}
+
+static uint8_t* moveIntArg(uint8_t* pos, size_t arg, uint8_t reg){
+    if (arg < TARGET_REG_ARGS){
+        uint8_t source = targetIntRegs[arg];
+        if (source == reg) return pos;
+        *pos++ = 0x48 | (source >> 3) << 2 | reg >> 3;  //mov %source, %reg
+        *pos++ = 0x89;
+        *pos++ = 0xC0 | (source & 7) << 3 | (reg & 7);
+        return pos;
+    }
+    *pos++ = 0x48 | (reg >> 3) << 2;                    //mov offset(%rsp), %reg
+    *pos++ = 0x8B;
+    *pos++ = 0x84 | (reg & 7) << 3;
+    *pos++ = 0x24;
+    return stackArgOffset(pos, arg);
+}
+
+// The whole 8 bytes are moved whatever the width, since only the low bytes are read
+static uint8_t* moveFloatArg(uint8_t* pos, size_t arg, uint8_t reg){
+    if (arg < TARGET_REG_ARGS){
+        if (arg == reg) return pos;
+        *pos++ = 0x0F;                                  //movaps %xmm<arg>, %xmm<reg>
+        *pos++ = 0x28;
+        *pos++ = 0xC0 | reg << 3 | arg;
+        return pos;
+    }
+    *pos++ = 0xF3;                                      //movq offset(%rsp), %xmm<reg>
+    *pos++ = 0x0F;
+    *pos++ = 0x7E;
+    *pos++ = 0x84 | reg << 3;
+    *pos++ = 0x24;
+    return stackArgOffset(pos, arg);
+}
+
+// Returns 0 if some args would go on the host's stack, which isn't supported. A null decl takes no args
+static char buildStub(uint8_t* stub, const Function* decl, void* target){
+    size_t argCount = decl == NULL ? 0 : decl->params.size;
+    size_t intCount = 0, floatCount = 0;
+    for (size_t i=0; i<argCount; i++){
+        if (isFloatType(((StmtVar*)decl->params.elem[i])->type)) floatCount++;
+        else intCount++;
+    }
+    if (intCount > HOST_INT_ARGS || floatCount > HOST_FLOAT_ARGS) return 0;
+
+    uint8_t* pos = stub;
+    memcpy(pos, stubStart, sizeof(stubStart));
+    pos += sizeof(stubStart);
+    intCount = floatCount = 0;
+    for (size_t i=0; i<argCount; i++){
+        if (isFloatType(((StmtVar*)decl->params.elem[i])->type)) pos = moveFloatArg(pos, i, floatCount++);
+        else pos = moveIntArg(pos, i, hostIntRegs[intCount++]);
+    }
+    *pos++ = 0xB8;                                      //mov $floatCount, %eax     Vector registers used, for variadic functions
+    uint32_t vectorCount = floatCount;
+    memcpy(pos, &vectorCount, sizeof(vectorCount));
+    pos += sizeof(vectorCount);
+    memcpy(pos, stubEnd, sizeof(stubEnd));
+    pos += sizeof(stubEnd);
+    memcpy(pos, &target, sizeof(target));
+    assert(pos + sizeof(target) <= stub + STUB_SIZE && "Stub too big for its slot");
+    return 1;
+}
+
+// main follows the target's calling convention, which reserves space above the return address for the callee
+typedef int (__attribute__((ms_abi)) *MainFunction)(void);
+
+// The C runtime was set up when the compiler started, so there's nothing left for main's call to it to do
+static void runtimeReady(){}
+
+static size_t roundToPage(size_t size, size_t pageSize){
+    return (size + pageSize - 1) / pageSize * pageSize;
+}
+
+// Address a symbol ends up at, or NULL if it can't be found or called
+static uint8_t* symbolLocation(const ObjSymbol* symbol, uint8_t* const bases[], uint8_t* stub){
+    if (symbol->defined) return bases[symbol->section] + symbol->offset;
+    if (!strcmp(symbol->name, "__main")){
+        buildStub(stub, NULL, (void*)&runtimeReady);
+        return stub;
+    }
+    void* target = dlsym(RTLD_DEFAULT, symbol->name);
+    if (target == NULL){
+        fprintf(stderr, "Error: Undefined reference to %s.\n", symbol->name);
+        return NULL;
+    }
+    if (!buildStub(stub, findFunc((char_t*)symbol->name), target)){
+        fprintf(stderr, "Error: Too many args in calls to %s to run.\n", symbol->name);
+        return NULL;
+    }
+    return stub;
+}
+
+static int runObject(const ObjectCode* object){
+    const Array(ObjSymbol)* symbols = &object->symbols;
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t stubsStart = object->sections[secText].size;
+    size_t codeSize = roundToPage(stubsStart + symbols->size * STUB_SIZE, pageSize);
+    size_t dataSize = roundToPage(object->sections[secRodata].size, pageSize);
+    uint8_t* memory = mmap(NULL, codeSize + dataSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED){
+        fprintf(stderr, "Error: Couldn't map memory for the code.\n");
+        return 1;
+    }
+    uint8_t* const bases[SECTION_COUNT] = {memory, memory + codeSize};
+    for (int section=0; section<SECTION_COUNT; section++){
+        if (object->sections[section].size) memcpy(bases[section], object->sections[section].elem, object->sections[section].size);
+    }
+
+    //Each symbol gets its own stub slot, though only the undefined ones use theirs
+    int code = 0;
+    New(uint8_t*, addresses, symbols->size + 1);
+    MainFunction entry = NULL;
+    for (size_t i=0; i<symbols->size; i++){
+        const ObjSymbol* symbol = &symbols->elem[i];
+        addresses[i] = symbol->name == NULL ? bases[symbol->section] : symbolLocation(symbol, bases, memory + stubsStart + i * STUB_SIZE);
+        if (addresses[i] == NULL) code = 1;
+        else if (symbol->defined && symbol->name != NULL && !strcmp(symbol->name, "main")) entry = (MainFunction)addresses[i];
+    }
+    for (size_t i=0; i<object->relocations.size && code == 0; i++){
+        const Relocation* relocation = &object->relocations.elem[i];
+        uint8_t* pos = bases[relocation->section] + relocation->offset;
+        int64_t value = (int64_t)(addresses[relocation->symbol] - pos) + relocation->addend;
+        assert(value >= INT32_MIN && value <= INT32_MAX && "Relocation out of range");
+        int32_t field = value;
+        memcpy(pos, &field, sizeof(field));
+    }
+    free(addresses);
+    if (code == 0 && entry == NULL){
+        fprintf(stderr, "Error: No main function to run.\n");
+        code = 1;
+    }
+
+    if (code == 0){
+        if (mprotect(memory, codeSize, PROT_READ | PROT_EXEC) || (dataSize && mprotect(memory + codeSize, dataSize, PROT_READ))){
+            fprintf(stderr, "Error: Couldn't make the code executable.\n");
+            code = 1;
+        }
+        else{
+            fflush(NULL);
+            code = entry();
+            fflush(NULL);
+        }
+    }
+    munmap(memory, codeSize + dataSize);
+    return code;
+}
+
+int runAllObject(){
+    ObjectCode object;
+    encodeAllAsm(&object);
+    int code = runObject(&object);
+    disposeObjectCode(&object);
+    return code;
+}
@@ -1,11 +1,13 @@
 #include "utils.h"
 #include "io/file.h"
 #include "io/error.h"
+#include "io/cache.h"
 #include "ast/ast.h"
 #include "lexer/lexer.h"
 #include "parser/parser.h"
 #include "semantics/semantics.h"
 #include "codegen/codegen.h"
+#include "interp/interp.h"
 #include "semantics/symtable.h"
 
 #include <stdio.h>
@@ -24,16 +26,92 @@ static void changeExtension(char_t* dest, const char_t* src, const char_t* ext){
     sprintf(pDot, ext);
 }
 
-int driver(int argc, char_t const *argv[])
-{
-    if (argc < 2){
+// Whether the code is encoded into an object file here, rather than written as assembly for gcc to assemble
+static char integratedAssembler;
+// Whether the program is run in memory as soon as it's compiled, instead of being built into an executable
+static char runInMemory;
+// Whether the program is interpreted from the AST without generating any code, which starts faster but runs slower
+static char interpret;
+// Directory of the compilation cache, or NULL to always compile. Only output files are cached, not programs that are run
+static const char_t* cacheDir;
+static uint64_t cacheSize;
+static char showCacheStats;
+#define DEFAULT_CACHE_MB 64
+
+// Flags can go anywhere. Anything that isn't a flag is the input file
+static const char_t* parseArgs(int argc, char_t const *argv[]){
+    const char_t* infilename = NULL;
+    codegenOptions = (CodegenOptions){.optLevel = 0, .inlineLimit = 16};
+    integratedAssembler = 1;
+    runInMemory = 0;
+    interpret = 0;
+    cacheDir = NULL;
+    cacheSize = (uint64_t)DEFAULT_CACHE_MB << 20;
+    showCacheStats = 0;
+    // Frame pointers are omitted by default once optimizing, unless a flag says otherwise
+    int omitFramePointer = -1;
+    for (int i=1; i<argc; i++){
+        const char_t* arg = argv[i];
+        if (arg[0] != '-'){
+            infilename = arg;
+        }
+        else if (arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '9' && arg[3] == 0){
+            codegenOptions.optLevel = arg[2] - '0';
+        }
+        else if (!strcmp(arg, "-fomit-frame-pointer")){
+            omitFramePointer = 1;
+        }
+        else if (!strcmp(arg, "-fno-omit-frame-pointer")){
+            omitFramePointer = 0;
+        }
+        else if (!strncmp(arg, "-finline-limit=", 15) && arg[15] >= '0' && arg[15] <= '9'){
+            codegenOptions.inlineLimit = atoi(arg + 15);
+        }
+        else if (!strcmp(arg, "-fopt-info-inline")){
+            codegenOptions.reportInlining = 1;
+        }
+        else if (!strcmp(arg, "-fintegrated-as")){
+            integratedAssembler = 1;
+        }
+        else if (!strcmp(arg, "-fno-integrated-as")){
+            integratedAssembler = 0;
+        }
+        else if (!strcmp(arg, "--run")){
+            runInMemory = 1;
+        }
+        else if (!strcmp(arg, "--interpret")){
+            interpret = 1;
+        }
+        else if (!strncmp(arg, "--cache=", 8) && arg[8] != 0){
+            cacheDir = arg + 8;
+        }
+        else if (!strncmp(arg, "--cache-size=", 13) && arg[13] >= '0' && arg[13] <= '9'){
+            cacheSize = (uint64_t)atoi(arg + 13) << 20;
+        }
+        else if (!strcmp(arg, "--cache-stats")){
+            showCacheStats = 1;
+        }
+        else{
+            fprintf(stderr, "Error: Unknown option %s.\n", arg);
+            return NULL;
+        }
+    }
+    codegenOptions.omitFramePointer = omitFramePointer < 0 ? codegenOptions.optLevel > 0 : omitFramePointer;
+    if (infilename == NULL && !(showCacheStats && cacheDir != NULL)){
         fprintf(stderr, "Error: Need an input file.\n");
-        return 2;
     }
-    const char_t* infilename = argv[1];
-    char_t outfilename[100];
-    changeExtension(outfilename, infilename, "s");
-    openFiles(infilename, outfilename);
+    return infilename;
+}
+
+// Everything besides the source that changes the output file
+static void cacheOptions(char_t* options){
+    sprintf(options, "-O%d -finline-limit=%d %d %d %d", codegenOptions.optLevel, codegenOptions.inlineLimit,
+        codegenOptions.omitFramePointer, codegenOptions.reportInlining, integratedAssembler);
+}
+
+// Returns 3 if the program has errors. A program that's run or interpreted gives its exit code back through exitCode
+static int compileFile(const char_t* infilename, const char_t* outfilename, int* exitCode){
+    openFiles(infilename, outfilename, integratedAssembler);
 
     initLexer();
     initParser();
@@ -42,10 +120,17 @@ int driver(int argc, char_t const *argv[])
     TopLevel* ast = parseTopLevel();
     if (ast != NULL){
         if (checkSemantics() && checkSyntax()){
-            initAsm();
-            cmplTopLevel(ast);
-            emitAllAsm();
-            disposeAsm();
+            if (interpret){
+                *exitCode = interpretTopLevel(ast);
+            }
+            else{
+                initAsm();
+                cmplTopLevel(ast);
+                if (runInMemory) *exitCode = runAllObject();
+                else if (integratedAssembler) emitAllObject();
+                else emitAllAsm();
+                disposeAsm();
+            }
         }
         else{
             code = 3;   
@@ -58,7 +143,47 @@ int driver(int argc, char_t const *argv[])
     disposeSymbolTable();
     disposeLexer();
     closeFiles(infilename, outfilename);
+    return code;
+}
 
+int driver(int argc, char_t const *argv[])
+{
+    const char_t* infilename = parseArgs(argc, argv);
+    if (infilename == NULL){
+        if (showCacheStats && cacheDir != NULL && openCache(cacheDir, cacheSize)){
+            printCacheStats();
+            return 0;
+        }
+        return 2;
+    }
+    char_t outfilename[100];
+    changeExtension(outfilename, infilename, integratedAssembler ? "o" : "s");
+    char noOutput = runInMemory || interpret;
+    char cached = cacheDir != NULL && !noOutput;
+    if (cached && !openCache(cacheDir, cacheSize)){
+        fprintf(stderr, "Warning: Cache directory %s can't be used.\n", cacheDir);
+        cached = 0;
+    }
+    CacheKey key;
+    if (cached){
+        char_t options[100];
+        cacheOptions(options);
+        cached = cacheKey(infilename, options, &key);
+    }
+    int code = 0;
+    int exitCode = 0;
+    if (!cached || !cacheFetch(&key, outfilename, &code)){
+        captureDiagnostics(cached);
+        code = compileFile(infilename, noOutput ? NULL : outfilename, &exitCode);
+        if (cached) cacheStore(&key, outfilename, code);
+        captureDiagnostics(0);
+    }
+    if (showCacheStats) printCacheStats();
+
+    // A program that ran gives back its own exit code
+    if (code == 0 && noOutput){
+        return exitCode;
+    }
     if (code == 0){
         char_t exefilename[100];
         changeExtension(exefilename, infilename, "exe");
@@ -0,0 +1,120 @@
+// Private headers for the interpreter
+#pragma once
+#include <stdint.h>
+#include "utils.h"
+#include "array.h"
+#include "ast/ast.h"
+#include "ast/type.h"
+// Register-based bytecode. Every function has a frame of 64-bit registers holding its params, then its variables, then
+// its temporaries, and each instruction names the registers it reads and writes. Integer values are kept sign or zero
+// extended to 64 bits according to their type, so that any width compares and converts the same way. Floats keep their bits
+// in the low end of the register
+
+typedef enum {
+    bcConst,        //dst = data.num
+    bcMov,          //dst = left
+    //Integer conversions. The low bits of left that fit in the type, extended to 64 bits again
+    bcExtI8, bcExtU8, bcExtI16, bcExtU16, bcExtI32, bcExtU32,
+    //Arithmetic on dst = left op right. 64-bit results are the same whatever the signedness, except for division
+    bcAddI32, bcAddU32, bcAdd64, bcAddF32, bcAddF64,
+    bcSubI32, bcSubU32, bcSub64, bcSubF32, bcSubF64,
+    bcMulI32, bcMulU32, bcMul64, bcMulF32, bcMulF64,
+    bcDivI32, bcDivU32, bcDivI64, bcDivU64, bcDivF32, bcDivF64,
+    bcNegI32, bcNegU32, bcNeg64, bcNegF32, bcNegF64,    //dst = -left
+    bcNot, bcNotF32, bcNotF64,                          //dst = 1 if left is 0, otherwise 0
+    //dst = 1 if left cond right, otherwise 0. Greater than is less than with the operands swapped
+    bcEq, bcNe, bcLtS, bcLeS, bcLtU, bcLeU,
+    bcEqF32, bcNeF32, bcLtF32, bcLeF32,
+    bcEqF64, bcNeF64, bcLtF64, bcLeF64,
+    //Conversions between integers and floats, truncating towards 0. Integers go through 64 bits, except that signed results
+    //narrower than that go through 32 bits, giving INT32_MIN when out of range like the native conversion does
+    bcI64ToF32, bcU64ToF32, bcI64ToF64, bcU64ToF64,
+    bcF32ToI32, bcF64ToI32, bcF32ToI64, bcF32ToU64, bcF64ToI64, bcF64ToU64,
+    bcF32ToF64, bcF64ToF32,
+    //Jumps to data.target, the last ones only if left cond right
+    bcJmp, bcJz, bcJnz,
+    bcJEq, bcJNe, bcJLtS, bcJLeS, bcJLtU, bcJLeU,
+    bcSwitch,       //Jump on left through the function's switch table data.table
+    bcCall,         //dst = function data.callee called with the right registers starting at left
+    bcCallExtern,   //Same, but for a function from outside the program
+    bcRet,          //Return left
+    bcRetVoid,
+    BC_OPCODE_COUNT
+} BcOpcode;
+
+typedef uint16_t bcreg_t;
+#define BC_MAX_REGISTERS UINT16_MAX
+
+typedef struct {
+    const void* handler;    //Code that runs the instruction, filled in once the program is threaded
+    uint8_t op;
+    bcreg_t dst;
+    bcreg_t left;
+    bcreg_t right;
+    union {
+        uint64_t num;       //Constants, with floats as their bits
+        size_t target;      //Instruction a jump goes to. Label number until the function is finished
+        size_t callee;      //Index into the program's functions or externs
+        size_t table;       //Index into the function's switch tables
+    } data;
+} BcInstr;
+
+// Dense cases index a table of targets. Sparse ones are searched for by their value
+typedef struct {
+    uint64_t min;
+    size_t span;            //Number of targets in the table, or 0 if the cases are searched
+    size_t count;
+    uint64_t* nums;         //Sorted case values if they're searched
+    size_t* targets;        //Target for each value from min on, or for each of nums
+    size_t dflt;
+} BcSwitch;
+
+#define TYPE BcInstr
+#include "generics/gen_array.h"
+#undef TYPE
+#define TYPE BcSwitch
+#include "generics/gen_array.h"
+#undef TYPE
+
+typedef struct {
+    const char_t* name;
+    size_t paramCount;
+    size_t frameSize;       //Registers the function uses, including its params
+    Array(BcInstr) code;
+    Array(BcSwitch) switches;
+} BcFunction;
+
+// Function declared but not defined in the program, found in the running process
+typedef struct {
+    const Function* decl;
+    void* address;
+} BcExtern;
+
+#define TYPE BcFunction
+#include "generics/gen_array.h"
+#undef TYPE
+#define TYPE BcExtern
+#include "generics/gen_array.h"
+#undef TYPE
+
+typedef struct {
+    Array(BcFunction) functions;
+    Array(BcExtern) externs;
+    char threaded;
+} BcProgram;
+
+typedef union {
+    uint64_t num;
+    float f32;
+    double f64;
+} BcValue;
+
+// Lowers every function of a verified AST. Returns 0 if the program uses something that can't be run
+char bcLowerProgram(TopLevel* ast, BcProgram* program);
+void bcDisposeProgram(BcProgram* program);
+// Index of a function defined in the program, or SIZE_MAX if there's none by that name
+size_t bcFindFunction(const BcProgram* program, const char_t* name);
+// Runs a function with its args and puts what it returns in result. Returns 0 if it couldn't finish
+char bcRun(BcProgram* program, size_t func, const BcValue* args, BcValue* result);
+// Calls a function from outside the program with args already converted to its param types
+BcValue bcInvokeExtern(const BcExtern* ext, const BcValue* args);
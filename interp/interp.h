@@ -0,0 +1,5 @@
+#pragma once
+#include "ast/ast.h"
+
+// Lowers a verified AST to bytecode and interprets its main function, returning main's exit code
+int interpretTopLevel(TopLevel* ast);
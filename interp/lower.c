@@ -0,0 +1,843 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include "utils.h"
+#include "array.h"
+#include "lexer/lexer.h"
+#include "ast/ast.h"
+#include "ast/type.h"
+#include "scope/scope.h"
+#include "semantics/symtable.h"
+#include "interp/bytecode.h"
+// Lowers a verified AST to bytecode. Variables get a register each for as long as their scope lasts, and temporaries are
+// handed out above them for the statement being lowered. Jumps go to labels until the function is finished, when the labels
+// are replaced by the instructions they ended up at
+
+#define TYPE BcInstr
+#include "generics/gen_array.c"
+#undef TYPE
+#define TYPE BcSwitch
+#include "generics/gen_array.c"
+#undef TYPE
+#define TYPE BcFunction
+#include "generics/gen_array.c"
+#undef TYPE
+#define TYPE BcExtern
+#include "generics/gen_array.c"
+#undef TYPE
+
+// Variables keep their declared type next to their register, since the type of an identifier is overwritten when it gets converted
+typedef struct {
+    bcreg_t reg;
+    Type type;
+} BcVariable;
+
+#define KEY Symbol
+#define VAL BcVariable
+#include "generics/gen_map.h"
+#include "generics/gen_map.c"
+#undef KEY
+#undef VAL
+static Map(Symbol, BcVariable) variables;
+
+typedef const char_t* BcName;
+#define KEY BcName
+#define VAL size_t
+#include "generics/gen_map.h"
+#include "generics/gen_map.c"
+#undef KEY
+#undef VAL
+// Index of each function defined in the program, and of each extern called so far
+static Map(BcName, size_t) functionIndices;
+static Map(BcName, size_t) externIndices;
+
+static BcProgram* curProgram;
+static BcFunction* curFunc;
+static Type returnType;
+// Registers below localTop belong to variables. Temporaries go from there up to nextReg
+static size_t localTop;
+static size_t nextReg;
+// Instruction each label is at, and where the last one was placed, since instructions before it can't be changed
+static Array(size_t) labels;
+static size_t lastLabelPos;
+// Cleared when something can't be run
+static char supported;
+
+typedef struct {
+    size_t brk;
+    size_t cont;
+    size_t* cases;      //Label of each case of the switch the statement is in, in the order of its cases
+    size_t dflt;
+} LabelContext;
+
+#define NO_LABEL SIZE_MAX
+
+static size_t hashName(BcName name){
+    size_t hash = 5381;
+    for (; *name; name++){
+        hash = hash * 33 + *name;
+    }
+    return hash;
+}
+
+static char eqName(BcName a, BcName b){
+    return !strcmp(a, b);
+}
+
+static void emit(uint8_t op, size_t dst, size_t left, size_t right, uint64_t data){
+    BcInstr instr = {NULL, op, dst, left, right, {.num = data}};
+    if (!arrPush(BcInstr)(&curFunc->code, instr)) exit(1);
+}
+
+static BcInstr* lastInstr(){
+    return &curFunc->code.elem[curFunc->code.size - 1];
+}
+
+static size_t newTemp(){
+    if (nextReg == BC_MAX_REGISTERS){
+        fprintf(stderr, "Error: Function %s needs too many registers to be interpreted.\n", curFunc->name);
+        supported = 0;
+        return 0;
+    }
+    if (nextReg + 1 > curFunc->frameSize) curFunc->frameSize = nextReg + 1;
+    return nextReg++;
+}
+
+static size_t newLabel(){
+    if (!arrPush(size_t)(&labels, NO_LABEL)) exit(1);
+    return labels.size - 1;
+}
+
+static void placeLabel(size_t label){
+    labels.elem[label] = curFunc->code.size;
+    lastLabelPos = curFunc->code.size;
+}
+
+static char writesDst(uint8_t op){
+    return op < bcJmp || op == bcCall || op == bcCallExtern;
+}
+
+static char isJump(uint8_t op){
+    return op >= bcJmp && op <= bcJLeU;
+}
+
+// Puts a value in a register. A temporary that was just computed gets computed straight into the register instead
+static void moveInto(size_t dst, size_t src){
+    if (dst == src) return;
+    if (src >= localTop && curFunc->code.size > lastLabelPos){
+        BcInstr* last = lastInstr();
+        if (writesDst(last->op) && last->dst == src){
+            last->dst = dst;
+            return;
+        }
+    }
+    emit(bcMov, dst, src, 0, 0);
+}
+
+static size_t emitConst(uint64_t num){
+    size_t reg = newTemp();
+    emit(bcConst, reg, 0, 0, num);
+    return reg;
+}
+
+static size_t emitUnary(uint8_t op, size_t value){
+    size_t reg = newTemp();
+    emit(op, reg, value, 0, 0);
+    return reg;
+}
+
+static size_t emitBinary(uint8_t op, size_t left, size_t right){
+    size_t reg = newTemp();
+    emit(op, reg, left, right, 0);
+    return reg;
+}
+
+static void emitJump(uint8_t op, size_t left, size_t right, size_t label){
+    emit(op, 0, left, right, label);
+}
+
+static void insertVariable(char_t* name, size_t reg, Type type){
+    if (!mapInsert(Symbol, BcVariable)(&variables, (Symbol){name, curScope}, (BcVariable){reg, type})){
+        exit(1);
+    }
+}
+
+static BcVariable findVariable(char_t* name){
+    size_t scopeId = curScope;
+    BcVariable* varptr = NULL;
+    while (varptr == NULL){
+        varptr = mapFind(Symbol, BcVariable)(&variables, (Symbol){name, scopeId});
+        if (scopeId == GLOBAL_SCOPE) break;
+        scopeId = prevScope(scopeId);
+    }
+    assert(varptr && "Variable should have been verified");
+    return *varptr;
+}
+
+// Position of a type among the ones arithmetic is done in, which is also its column in the opcode tables
+typedef enum {
+    kindI32, kindU32, kindI64, kindU64, kindF32, kindF64
+} ArithKind;
+
+static ArithKind arithKind(Type type){
+    switch (type){
+        case typInt32: return kindI32;
+        case typUInt32: return kindU32;
+        case typInt64: return kindI64;
+        case typUInt64: return kindU64;
+        case typFloat32: return kindF32;
+        case typFloat64: return kindF64;
+        default:
+            assert(0 && "Arithmetic is only done on promoted types");
+    }
+}
+
+static const uint8_t addOpcodes[] = {bcAddI32, bcAddU32, bcAdd64, bcAdd64, bcAddF32, bcAddF64};
+static const uint8_t subOpcodes[] = {bcSubI32, bcSubU32, bcSub64, bcSub64, bcSubF32, bcSubF64};
+static const uint8_t mulOpcodes[] = {bcMulI32, bcMulU32, bcMul64, bcMul64, bcMulF32, bcMulF64};
+static const uint8_t divOpcodes[] = {bcDivI32, bcDivU32, bcDivI64, bcDivU64, bcDivF32, bcDivF64};
+static const uint8_t negOpcodes[] = {bcNegI32, bcNegU32, bcNeg64, bcNeg64, bcNegF32, bcNegF64};
+
+static uint8_t arithOpcode(Token op, Type type){
+    switch (op){
+        case tokPlus:
+        case tokPlusAssign:
+            return addOpcodes[arithKind(type)];
+        case tokMinus:
+        case tokMinusAssign:
+            return subOpcodes[arithKind(type)];
+        case tokMulti:
+        case tokMultiAssign:
+            return mulOpcodes[arithKind(type)];
+        case tokDiv:
+        case tokDivAssign:
+            return divOpcodes[arithKind(type)];
+        default:
+            assert(0 && "Not an arithmetic operator");
+    }
+}
+
+static uint8_t extOpcode(Type type){
+    switch (type){
+        case typInt8: return bcExtI8;
+        case typUInt8: return bcExtU8;
+        case typInt16: return bcExtI16;
+        case typUInt16: return bcExtU16;
+        case typInt32: return bcExtI32;
+        case typUInt32: return bcExtU32;
+        default:
+            assert(0 && "64-bit values need no extending");
+    }
+}
+
+static uint64_t floatBits(double num, Type type){
+    BcValue value = {0};
+    if (type == typFloat32) value.f32 = num;
+    else value.f64 = num;
+    return value.num;
+}
+
+// Converts a value to another type. Integers that are already extended the right way for the new type are left alone
+static size_t lowerConv(size_t value, Type from, Type to){
+    if (from == to || !supported) return value;
+    if (isFloatType(from) && isFloatType(to)){
+        return emitUnary(from == typFloat32 ? bcF32ToF64 : bcF64ToF32, value);
+    }
+    if (isFloatType(to)){
+        if (from == typUInt64) return emitUnary(to == typFloat32 ? bcU64ToF32 : bcU64ToF64, value);
+        return emitUnary(to == typFloat32 ? bcI64ToF32 : bcI64ToF64, value);
+    }
+    if (isFloatType(from)){
+        if (to == typUInt64) return emitUnary(from == typFloat32 ? bcF32ToU64 : bcF64ToU64, value);
+        if (typeSize(to) < 4 || to == typInt32){
+            value = emitUnary(from == typFloat32 ? bcF32ToI32 : bcF64ToI32, value);
+            return to == typInt32 ? value : emitUnary(extOpcode(to), value);
+        }
+        value = emitUnary(from == typFloat32 ? bcF32ToI64 : bcF64ToI64, value);
+        return typeSize(to) == 8 ? value : emitUnary(extOpcode(to), value);
+    }
+    //Widening keeps the value, unless a negative one has to become unsigned
+    if (typeSize(to) == 8 || (typeSize(to) > typeSize(from) && (!isSignedType(from) || isSignedType(to)))){
+        return value;
+    }
+    return emitUnary(extOpcode(to), value);
+}
+
+static size_t lowerExpr(ExprBase* expr);
+static void lowerCondJump(ExprBase* expr, char jumpIfTrue, size_t label);
+
+static char isRelOp(Token op){
+    switch (op){
+        case tokEquals:
+        case tokNotEquals:
+        case tokGreaterEquals:
+        case tokLessEquals:
+        case tokGreater:
+        case tokLess:
+            return 1;
+    }
+    return 0;
+}
+
+// Type of the value an expression produces, before it's converted into the type its parent wants
+static Type valueType(const ExprBase* expr){
+    switch (expr->ast.label){
+        case astExprCall:
+            return findFunc(((const ExprCall*)expr)->name)->type;
+        case astExprIdent:
+            return findVariable(((const ExprIdent*)expr)->name).type;
+        case astExprBinop: {
+            const ExprBinop* binop = (const ExprBinop*)expr;
+            if (binop->op == tokAnd || binop->op == tokOr || isRelOp(binop->op)){
+                return typInt32;
+            }
+            if (isAssignmentOp(binop->op)){
+                return findVariable(((const ExprIdent*)binop->left)->name).type;
+            }
+            return binop->left->type;
+        }
+        case astExprUnop: {
+            const ExprUnop* unop = (const ExprUnop*)expr;
+            return unop->op == tokNot ? typInt32 : unop->operand->type;
+        }
+    }
+    return expr->type;
+}
+
+// Whether evaluating the expression can change a variable
+static char assigns(const ExprBase* expr){
+    switch (expr->ast.label){
+        case astExprCall: {
+            const ExprCall* call = (const ExprCall*)expr;
+            for (size_t i=0; i<call->args.size; i++){
+                if (assigns(call->args.elem[i])) return 1;
+            }
+            return 0;
+        }
+        case astExprBinop: {
+            const ExprBinop* binop = (const ExprBinop*)expr;
+            return isAssignmentOp(binop->op) || assigns(binop->left) || assigns(binop->right);
+        }
+        case astExprUnop: {
+            const ExprUnop* unop = (const ExprUnop*)expr;
+            return unop->op == tokInc || unop->op == tokDec || assigns(unop->operand);
+        }
+    }
+    return 0;
+}
+
+// Index of the function or extern a call goes to. Externs are looked up in the running process the first time they're called
+static uint8_t findCallee(const char_t* name, size_t* index){
+    size_t* found = mapFind(BcName, size_t)(&functionIndices, name);
+    if (found != NULL){
+        *index = *found;
+        return bcCall;
+    }
+    found = mapFind(BcName, size_t)(&externIndices, name);
+    if (found != NULL){
+        *index = *found;
+        return bcCallExtern;
+    }
+    const Function* decl = findFunc((char_t*)name);
+    //Integer and float args each get registers of their own, and nothing is passed on the stack
+    size_t intCount = 0;
+    for (size_t i=0; i<decl->params.size; i++){
+        if (!isFloatType(((StmtVar*)decl->params.elem[i])->type)) intCount++;
+    }
+    void* address = dlsym(RTLD_DEFAULT, name);
+    if (address == NULL){
+        fprintf(stderr, "Error: Undefined reference to %s.\n", name);
+        supported = 0;
+    }
+    else if (intCount > 6 || decl->params.size - intCount > 8){
+        fprintf(stderr, "Error: Too many args in calls to %s to interpret.\n", name);
+        supported = 0;
+    }
+    if (!arrPush(BcExtern)(&curProgram->externs, (BcExtern){decl, address})) exit(1);
+    *index = curProgram->externs.size - 1;
+    if (!mapInsert(BcName, size_t)(&externIndices, name, *index)) exit(1);
+    return bcCallExtern;
+}
+
+// Args are evaluated right to left, same as the compiled code, into consecutive registers for the callee's params
+static size_t lowerCall(ExprCall* call){
+    const Function* func = findFunc(call->name);
+    size_t first = nextReg;
+    for (size_t i=0; i<call->args.size; i++){
+        newTemp();
+    }
+    for (size_t i=call->args.size; i>0; i--){
+        ExprBase* arg = call->args.elem[i-1];
+        Type paramType = ((StmtVar*)func->params.elem[i-1])->type;
+        moveInto(first + i - 1, lowerConv(lowerExpr(arg), arg->type, paramType));
+    }
+    size_t callee;
+    uint8_t op = findCallee(call->name, &callee);
+    size_t reg = newTemp();
+    emit(op, reg, first, call->args.size, callee);
+    return reg;
+}
+
+static size_t lowerUnop(ExprUnop* unop){
+    Type type = unop->operand->type;
+    if (unop->op == tokInc || unop->op == tokDec){
+        assert(unop->operand->ast.label == astExprIdent && "Only variables can be incremented");
+        BcVariable var = findVariable(((ExprIdent*)unop->operand)->name);
+        // Postfix operators return the old value, so it's copied out first
+        size_t old = var.reg;
+        if (!unop->leftside){
+            old = newTemp();
+            emit(bcMov, old, var.reg, 0, 0);
+        }
+        // Narrow variables are incremented like ints, then wrapped around to their own width
+        Type arithType = isFloatType(var.type) ? var.type : argTypePromotion(var.type);
+        size_t one = emitConst(isFloatType(var.type) ? floatBits(1, var.type) : 1);
+        uint8_t op = unop->op == tokInc ? addOpcodes[arithKind(arithType)] : subOpcodes[arithKind(arithType)];
+        emit(op, var.reg, var.reg, one, 0);
+        if (!isFloatType(var.type) && typeSize(var.type) < 4){
+            emit(extOpcode(var.type), var.reg, var.reg, 0, 0);
+        }
+        return unop->leftside ? var.reg : old;
+    }
+    size_t value = lowerExpr(unop->operand);
+    switch (unop->op){
+        case tokMinus:
+            return emitUnary(negOpcodes[arithKind(type)], value);
+        case tokNot:
+            return emitUnary(type == typFloat32 ? bcNotF32 : type == typFloat64 ? bcNotF64 : bcNot, value);
+        default:
+            assert(0 && "Not a token unary operator");
+    }
+}
+
+// Comparisons that only need less than and equality, with the operands swapped for greater than
+static uint8_t compareOpcode(Token op, Type type, char* swap){
+    static const uint8_t intOpcodes[2][4] = {{bcEq, bcNe, bcLtU, bcLeU}, {bcEq, bcNe, bcLtS, bcLeS}};
+    static const uint8_t floatOpcodes[2][4] = {{bcEqF32, bcNeF32, bcLtF32, bcLeF32}, {bcEqF64, bcNeF64, bcLtF64, bcLeF64}};
+    const uint8_t* opcodes = isFloatType(type) ? floatOpcodes[type == typFloat64] : intOpcodes[isSignedType(type)];
+    *swap = op == tokGreater || op == tokGreaterEquals;
+    switch (op){
+        case tokEquals:
+            return opcodes[0];
+        case tokNotEquals:
+            return opcodes[1];
+        case tokLess:
+        case tokGreater:
+            return opcodes[2];
+        case tokLessEquals:
+        case tokGreaterEquals:
+            return opcodes[3];
+        default:
+            assert(0 && "Not a relational operator");
+    }
+}
+
+// Logical operators used as values produce 0 or 1, with the jumps doing the short-circuiting
+static size_t lowerLogical(ExprBinop* binop){
+    size_t falseLabel = newLabel();
+    size_t endLabel = newLabel();
+    size_t reg = newTemp();
+    lowerCondJump((ExprBase*)binop, 0, falseLabel);
+    emit(bcConst, reg, 0, 0, 1);
+    emitJump(bcJmp, 0, 0, endLabel);
+    placeLabel(falseLabel);
+    emit(bcConst, reg, 0, 0, 0);
+    placeLabel(endLabel);
+    return reg;
+}
+
+// Assignments store into the variable's own type. Compound ones do their arithmetic in the type both sides were promoted to,
+// reading the variable after the right side
+static size_t lowerAssign(ExprBinop* binop){
+    assert(binop->left->ast.label == astExprIdent && "Can only assign to variables");
+    BcVariable var = findVariable(((ExprIdent*)binop->left)->name);
+    size_t right = lowerExpr(binop->right);
+    if (binop->op == tokAssign){
+        moveInto(var.reg, lowerConv(right, binop->right->type, var.type));
+        return var.reg;
+    }
+    Type type = binop->left->type;
+    size_t old = lowerConv(var.reg, var.type, type);
+    size_t updated = emitBinary(arithOpcode(binop->op, type), old, right);
+    moveInto(var.reg, lowerConv(updated, type, var.type));
+    return var.reg;
+}
+
+static size_t lowerBinop(ExprBinop* binop){
+    if (binop->op == tokAnd || binop->op == tokOr){
+        return lowerLogical(binop);
+    }
+    if (isAssignmentOp(binop->op)){
+        return lowerAssign(binop);
+    }
+    // Both operands were promoted to the same type. A variable on the left is copied if the right side can change it
+    Type type = binop->left->type;
+    size_t left = lowerExpr(binop->left);
+    if (left < localTop && assigns(binop->right)){
+        size_t copy = newTemp();
+        emit(bcMov, copy, left, 0, 0);
+        left = copy;
+    }
+    size_t right = lowerExpr(binop->right);
+    if (isRelOp(binop->op)){
+        char swap;
+        uint8_t op = compareOpcode(binop->op, type, &swap);
+        return swap ? emitBinary(op, right, left) : emitBinary(op, left, right);
+    }
+    return emitBinary(arithOpcode(binop->op, type), left, right);
+}
+
+// Register holding the value of an expression in the type it's produced in, which can differ from the type its parent wants
+static size_t lowerValue(ExprBase* expr){
+    switch (expr->ast.label){
+        case astExprInt:
+            //Signed constants get sign extended to 64 bits like everything else
+            if (isSignedType(expr->type)){
+                return emitConst((int64_t)(int32_t)((ExprInt*)expr)->num);
+            }
+            return emitConst(((ExprInt*)expr)->num);
+        case astExprLong:
+            return emitConst(((ExprLong*)expr)->num);
+        case astExprFloat:
+            return emitConst(floatBits(((ExprFloat*)expr)->num, typFloat32));
+        case astExprDouble:
+            return emitConst(floatBits(((ExprDouble*)expr)->num, typFloat64));
+        case astExprCall:
+            return lowerCall((ExprCall*)expr);
+        case astExprIdent:
+            return findVariable(((ExprIdent*)expr)->name).reg;
+        case astExprBinop:
+            return lowerBinop((ExprBinop*)expr);
+        case astExprUnop:
+            return lowerUnop((ExprUnop*)expr);
+        default:
+            fprintf(stderr, "Error: Line %d: Expression can't be interpreted.\n", expr->ast.lineNumber);
+            supported = 0;
+            return 0;
+    }
+}
+
+static size_t lowerExpr(ExprBase* expr){
+    size_t value = lowerValue(expr);
+    // Calls to void functions have nothing to convert
+    return expr->type == typVoid ? value : lowerConv(value, valueType(expr), expr->type);
+}
+
+// Jumps to label if the condition is jumpIfTrue, otherwise falls through. Integer comparisons jump on their own
+static void lowerCondJump(ExprBase* expr, char jumpIfTrue, size_t label){
+    if (expr->ast.label == astExprBinop){
+        ExprBinop* binop = (ExprBinop*)expr;
+        if (binop->op == tokAnd || binop->op == tokOr){
+            // Jumping when the left side alone decides it goes straight to the label, otherwise it skips the right side
+            if ((binop->op == tokOr) == jumpIfTrue){
+                lowerCondJump(binop->left, jumpIfTrue, label);
+                lowerCondJump(binop->right, jumpIfTrue, label);
+            }
+            else{
+                size_t skip = newLabel();
+                lowerCondJump(binop->left, !jumpIfTrue, skip);
+                lowerCondJump(binop->right, jumpIfTrue, label);
+                placeLabel(skip);
+            }
+            return;
+        }
+        if (isRelOp(binop->op) && !isFloatType(binop->left->type)){
+            // Without NaNs the opposite of a comparison is the reverse one with the operands swapped
+            static const uint8_t jumpOpcodes[] = {[bcEq] = bcJEq, [bcNe] = bcJNe, [bcLtS] = bcJLtS, [bcLeS] = bcJLeS, [bcLtU] = bcJLtU, [bcLeU] = bcJLeU};
+            static const uint8_t oppositeOpcodes[] = {[bcEq] = bcJNe, [bcNe] = bcJEq, [bcLtS] = bcJLeS, [bcLeS] = bcJLtS, [bcLtU] = bcJLeU, [bcLeU] = bcJLtU};
+            size_t left = lowerExpr(binop->left);
+            if (left < localTop && assigns(binop->right)){
+                size_t copy = newTemp();
+                emit(bcMov, copy, left, 0, 0);
+                left = copy;
+            }
+            size_t right = lowerExpr(binop->right);
+            char swap;
+            uint8_t op = compareOpcode(binop->op, binop->left->type, &swap);
+            if (!jumpIfTrue && op != bcEq && op != bcNe) swap = !swap;
+            op = jumpIfTrue ? jumpOpcodes[op] : oppositeOpcodes[op];
+            if (swap) emitJump(op, right, left, label);
+            else emitJump(op, left, right, label);
+            return;
+        }
+    }
+    else if (expr->ast.label == astExprUnop && ((ExprUnop*)expr)->op == tokNot){
+        lowerCondJump(((ExprUnop*)expr)->operand, !jumpIfTrue, label);
+        return;
+    }
+    size_t value = lowerExpr(expr);
+    // Floats are true when they aren't 0, which NaNs aren't either
+    if (isFloatType(expr->type)){
+        value = emitUnary(expr->type == typFloat32 ? bcNotF32 : bcNotF64, value);
+        jumpIfTrue = !jumpIfTrue;
+    }
+    emitJump(jumpIfTrue ? bcJnz : bcJz, value, 0, label);
+}
+
+static int compareCases(const void* a, const void* b){
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Fewest cases worth a table, and how many entries each case can pay for
+#define MIN_TABLE_CASES 4
+#define TABLE_ENTRIES_PER_CASE 3
+
+// Cases are searched by their bits, since only equality matters. Dense ones get a table instead
+static size_t lowerSwitchTable(const StmtSwitch* stmt, const size_t* caseLabels, size_t dflt){
+    BcSwitch table = {.count = stmt->cases.size, .dflt = dflt};
+    New(uint64_t, nums, stmt->cases.size + 1);
+    for (size_t i=0; i<stmt->cases.size; i++){
+        nums[i] = ((StmtCase*)stmt->cases.elem[i])->num;
+    }
+    qsort(nums, stmt->cases.size, sizeof(uint64_t), &compareCases);
+    uint64_t span = nums[stmt->cases.size - 1] - nums[0];
+    if (stmt->cases.size >= MIN_TABLE_CASES && span < stmt->cases.size * TABLE_ENTRIES_PER_CASE){
+        table.min = nums[0];
+        table.span = span + 1;
+        free(nums);
+        table.targets = malloc(sizeof(size_t) * table.span);
+        if (table.targets == NULL) exit(1);
+        for (size_t i=0; i<table.span; i++){
+            table.targets[i] = dflt;
+        }
+        for (size_t i=0; i<stmt->cases.size; i++){
+            table.targets[((StmtCase*)stmt->cases.elem[i])->num - table.min] = caseLabels[i];
+        }
+    }
+    else{
+        table.nums = nums;
+        table.targets = malloc(sizeof(size_t) * stmt->cases.size);
+        if (table.targets == NULL) exit(1);
+        for (size_t i=0; i<stmt->cases.size; i++){
+            const StmtCase* label = stmt->cases.elem[i];
+            uint64_t* pos = bsearch(&label->num, nums, stmt->cases.size, sizeof(uint64_t), &compareCases);
+            table.targets[pos - nums] = caseLabels[i];
+        }
+    }
+    if (!arrPush(BcSwitch)(&curFunc->switches, table)) exit(1);
+    return curFunc->switches.size - 1;
+}
+
+static void lowerStmt(Ast* ast, const LabelContext* ctx){
+    switch (ast->label){
+        case astStmtEmpty:
+            break;
+        case astStmtExpr:
+            lowerExpr(((StmtExpr*)ast)->expr);
+            break;
+        case astStmtReturn: {
+            StmtReturn* ret = (StmtReturn*)ast;
+            if (hasRetExpr(ret)){
+                emit(bcRet, 0, lowerConv(lowerExpr(ret->expr), ret->expr->type, returnType), 0, 0);
+            }
+            else{
+                emit(bcRetVoid, 0, 0, 0, 0);
+            }
+            break;
+        }
+        case astStmtBlock: {
+            // Variables of the block are gone at its end, so their registers are free again
+            StmtBlock* blk = (StmtBlock*)ast;
+            size_t blockStart = localTop;
+            curScope = blk->scopeId;
+            for (size_t i=0; i<blk->stmts.size; i++){
+                lowerStmt(blk->stmts.elem[i], ctx);
+            }
+            toPrevScope();
+            localTop = blockStart;
+            break;
+        }
+        case astStmtDef: {
+            // The initializer is lowered before the variable exists, so it still sees any variable it shadows
+            StmtVar* def = (StmtVar*)ast;
+            size_t value = def->rhs ? lowerConv(lowerExpr(def->rhs), def->rhs->type, def->type) : 0;
+            size_t reg = localTop;
+            if (reg == curFunc->frameSize) curFunc->frameSize++;
+            if (def->rhs) moveInto(reg, value);
+            localTop++;
+            insertVariable(def->name, reg, def->type);
+            break;
+        }
+        case astStmtWhile: {
+            // The condition goes after the body, so each time around takes one jump
+            StmtWhileLoop* loop = (StmtWhileLoop*)ast;
+            size_t body = newLabel();
+            const LabelContext loopCtx = {.brk = newLabel(), .cont = newLabel(), .cases = ctx->cases, .dflt = ctx->dflt};
+            emitJump(bcJmp, 0, 0, loopCtx.cont);
+            placeLabel(body);
+            lowerStmt(loop->stmt, &loopCtx);
+            placeLabel(loopCtx.cont);
+            lowerCondJump(loop->condition, 1, body);
+            placeLabel(loopCtx.brk);
+            break;
+        }
+        case astStmtDoWhile: {
+            StmtWhileLoop* loop = (StmtWhileLoop*)ast;
+            size_t body = newLabel();
+            const LabelContext doCtx = {.brk = newLabel(), .cont = newLabel(), .cases = ctx->cases, .dflt = ctx->dflt};
+            placeLabel(body);
+            lowerStmt(loop->stmt, &doCtx);
+            placeLabel(doCtx.cont);
+            lowerCondJump(loop->condition, 1, body);
+            placeLabel(doCtx.brk);
+            break;
+        }
+        case astStmtContinue:
+            emitJump(bcJmp, 0, 0, ctx->cont);
+            break;
+        case astStmtBreak:
+            emitJump(bcJmp, 0, 0, ctx->brk);
+            break;
+        case astStmtIf: {
+            StmtIf* ifelse = (StmtIf*)ast;
+            size_t end = newLabel();
+            size_t otherwise = ifelse->elseStmt ? newLabel() : end;
+            lowerCondJump(ifelse->condition, 0, otherwise);
+            nextReg = localTop;
+            lowerStmt(ifelse->ifStmt, ctx);
+            if (ifelse->elseStmt){
+                emitJump(bcJmp, 0, 0, end);
+                placeLabel(otherwise);
+                lowerStmt(ifelse->elseStmt, ctx);
+            }
+            placeLabel(end);
+            break;
+        }
+        case astStmtSwitch: {
+            StmtSwitch* stmt = (StmtSwitch*)ast;
+            size_t value = lowerExpr(stmt->expr);
+            New(size_t, cases, stmt->cases.size + 1);
+            for (size_t i=0; i<stmt->cases.size; i++){
+                cases[i] = newLabel();
+            }
+            const LabelContext switchCtx = {
+                .brk = newLabel(), .cont = ctx->cont, .cases = cases, .dflt = stmt->defaultCase ? newLabel() : NO_LABEL
+            };
+            size_t dflt = stmt->defaultCase ? switchCtx.dflt : switchCtx.brk;
+            if (stmt->cases.size){
+                emit(bcSwitch, 0, value, 0, lowerSwitchTable(stmt, cases, dflt));
+            }
+            else{
+                emitJump(bcJmp, 0, 0, dflt);
+            }
+            nextReg = localTop;
+            lowerStmt(stmt->stmt, &switchCtx);
+            placeLabel(switchCtx.brk);
+            free(cases);
+            break;
+        }
+        case astStmtCase:
+        case astStmtDefault: {
+            StmtCase* label = (StmtCase*)ast;
+            placeLabel(ast->label == astStmtDefault ? ctx->dflt : ctx->cases[label->index]);
+            lowerStmt(label->stmt, ctx);
+            break;
+        }
+        default:
+            assert(0 && "Unsupported AST for stmt");
+    }
+    // Temporaries only last for the statement
+    nextReg = localTop;
+}
+
+// Labels become the instructions they're at
+static void resolveLabels(){
+    for (size_t i=0; i<curFunc->code.size; i++){
+        BcInstr* instr = &curFunc->code.elem[i];
+        if (isJump(instr->op)) instr->data.target = labels.elem[instr->data.target];
+    }
+    for (size_t i=0; i<curFunc->switches.size; i++){
+        BcSwitch* table = &curFunc->switches.elem[i];
+        size_t count = table->span ? table->span : table->count;
+        for (size_t j=0; j<count; j++){
+            table->targets[j] = labels.elem[table->targets[j]];
+        }
+        table->dflt = labels.elem[table->dflt];
+    }
+}
+
+static void lowerFunction(Function* func, BcFunction* out){
+    *out = (BcFunction){.name = func->name, .paramCount = func->params.size, .frameSize = func->params.size};
+    if (!arrInit(BcInstr)(&out->code, 64, NULL, NULL)) exit(1);
+    if (!arrInit(BcSwitch)(&out->switches, 0, NULL, NULL)) exit(1);
+    curFunc = out;
+    returnType = func->type;
+    if (!arrInit(size_t)(&labels, 16, NULL, NULL)) exit(1);
+    lastLabelPos = 0;
+    mapInit(Symbol, BcVariable)(&variables, 4, &hashSymbol, &eqSymbol, NULL, NULL);
+
+    // Params come in the first registers
+    curScope = func->scopeId;
+    for (size_t i=0; i<func->params.size; i++){
+        StmtVar* param = func->params.elem[i];
+        insertVariable(param->name, i, param->type);
+    }
+    localTop = nextReg = func->params.size;
+    const LabelContext ctx = {NO_LABEL, NO_LABEL, NULL, NO_LABEL};
+    lowerStmt(func->stmt, &ctx);
+    // Falling off the end returns 0 from non-void functions
+    if (func->type == typVoid){
+        emit(bcRetVoid, 0, 0, 0, 0);
+    }
+    else{
+        emit(bcRet, 0, emitConst(0), 0, 0);
+    }
+    resolveLabels();
+    curScope = GLOBAL_SCOPE;
+    mapDispose(Symbol, BcVariable)(&variables);
+    arrDispose(size_t)(&labels);
+}
+
+char bcLowerProgram(TopLevel* ast, BcProgram* program){
+    curProgram = program;
+    supported = 1;
+    program->threaded = 0;
+    if (!arrInit(BcFunction)(&program->functions, 8, NULL, NULL)) exit(1);
+    if (!arrInit(BcExtern)(&program->externs, 4, NULL, NULL)) exit(1);
+    mapInit(BcName, size_t)(&functionIndices, 16, &hashName, &eqName, NULL, NULL);
+    mapInit(BcName, size_t)(&externIndices, 4, &hashName, &eqName, NULL, NULL);
+
+    // Functions can be called before they're defined, so they're all numbered first
+    for (size_t i=0; i<ast->globals.size; i++){
+        Function* func = ast->globals.elem[i];
+        if (isFuncDecl(func)) continue;
+        if (!mapInsert(BcName, size_t)(&functionIndices, func->name, program->functions.size)) exit(1);
+        if (!arrPush(BcFunction)(&program->functions, (BcFunction){0})) exit(1);
+    }
+    for (size_t i=0; i<ast->globals.size && supported; i++){
+        Function* func = ast->globals.elem[i];
+        if (isFuncDecl(func)) continue;
+        lowerFunction(func, &program->functions.elem[*mapFind(BcName, size_t)(&functionIndices, func->name)]);
+    }
+
+    mapDispose(BcName, size_t)(&functionIndices);
+    mapDispose(BcName, size_t)(&externIndices);
+    return supported;
+}
+
+size_t bcFindFunction(const BcProgram* program, const char_t* name){
+    for (size_t i=0; i<program->functions.size; i++){
+        if (program->functions.elem[i].name != NULL && !strcmp(program->functions.elem[i].name, name)) return i;
+    }
+    return SIZE_MAX;
+}
+
+void bcDisposeProgram(BcProgram* program){
+    for (size_t i=0; i<program->functions.size; i++){
+        BcFunction* func = &program->functions.elem[i];
+        //Functions after one that couldn't be lowered were never started
+        if (func->name == NULL) continue;
+        for (size_t j=0; j<func->switches.size; j++){
+            free(func->switches.elem[j].nums);
+            free(func->switches.elem[j].targets);
+        }
+        arrDispose(BcInstr)(&func->code);
+        arrDispose(BcSwitch)(&func->switches);
+    }
+    arrDispose(BcFunction)(&program->functions);
+    arrDispose(BcExtern)(&program->externs);
+}
@@ -0,0 +1,294 @@
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#include "utils.h"
+#include "ast/ast.h"
+#include "ast/type.h"
+#include "interp/bytecode.h"
+#include "interp/interp.h"
+// Runs bytecode with a direct-threaded loop. Before a program first runs, every instruction gets the address of the code
+// handling its opcode, so that each handler ends by jumping straight to the next one's.
+// Calls don't recurse in C. Each function's registers sit right above its caller's on one stack of values
+
+// Registers across all frames, and how deep calls can go
+#define STACK_SIZE (1 << 20)
+#define MAX_CALL_DEPTH (1 << 16)
+
+typedef struct {
+    const BcInstr* ret;     //Call instruction to go back to
+    const BcFunction* func;
+    BcValue* regs;
+} BcFrame;
+
+// Dense cases are looked up directly, and others by a binary search
+static size_t switchTarget(const BcSwitch* table, uint64_t num){
+    if (table->span){
+        return num - table->min < table->span ? table->targets[num - table->min] : table->dflt;
+    }
+    size_t low = 0;
+    size_t high = table->count;
+    while (low < high){
+        size_t mid = (low + high) / 2;
+        if (table->nums[mid] == num) return table->targets[mid];
+        if (table->nums[mid] < num) low = mid + 1;
+        else high = mid;
+    }
+    return table->dflt;
+}
+
+char bcRun(BcProgram* program, size_t func, const BcValue* args, BcValue* result){
+    static const void* const handlers[BC_OPCODE_COUNT] = {
+        [bcConst] = &&doConst, [bcMov] = &&doMov,
+        [bcExtI8] = &&doExtI8, [bcExtU8] = &&doExtU8, [bcExtI16] = &&doExtI16, [bcExtU16] = &&doExtU16,
+        [bcExtI32] = &&doExtI32, [bcExtU32] = &&doExtU32,
+        [bcAddI32] = &&doAddI32, [bcAddU32] = &&doAddU32, [bcAdd64] = &&doAdd64, [bcAddF32] = &&doAddF32, [bcAddF64] = &&doAddF64,
+        [bcSubI32] = &&doSubI32, [bcSubU32] = &&doSubU32, [bcSub64] = &&doSub64, [bcSubF32] = &&doSubF32, [bcSubF64] = &&doSubF64,
+        [bcMulI32] = &&doMulI32, [bcMulU32] = &&doMulU32, [bcMul64] = &&doMul64, [bcMulF32] = &&doMulF32, [bcMulF64] = &&doMulF64,
+        [bcDivI32] = &&doDivI32, [bcDivU32] = &&doDivU32, [bcDivI64] = &&doDivI64, [bcDivU64] = &&doDivU64,
+        [bcDivF32] = &&doDivF32, [bcDivF64] = &&doDivF64,
+        [bcNegI32] = &&doNegI32, [bcNegU32] = &&doNegU32, [bcNeg64] = &&doNeg64, [bcNegF32] = &&doNegF32, [bcNegF64] = &&doNegF64,
+        [bcNot] = &&doNot, [bcNotF32] = &&doNotF32, [bcNotF64] = &&doNotF64,
+        [bcEq] = &&doEq, [bcNe] = &&doNe, [bcLtS] = &&doLtS, [bcLeS] = &&doLeS, [bcLtU] = &&doLtU, [bcLeU] = &&doLeU,
+        [bcEqF32] = &&doEqF32, [bcNeF32] = &&doNeF32, [bcLtF32] = &&doLtF32, [bcLeF32] = &&doLeF32,
+        [bcEqF64] = &&doEqF64, [bcNeF64] = &&doNeF64, [bcLtF64] = &&doLtF64, [bcLeF64] = &&doLeF64,
+        [bcI64ToF32] = &&doI64ToF32, [bcU64ToF32] = &&doU64ToF32, [bcI64ToF64] = &&doI64ToF64, [bcU64ToF64] = &&doU64ToF64,
+        [bcF32ToI32] = &&doF32ToI32, [bcF64ToI32] = &&doF64ToI32,
+        [bcF32ToI64] = &&doF32ToI64, [bcF32ToU64] = &&doF32ToU64, [bcF64ToI64] = &&doF64ToI64, [bcF64ToU64] = &&doF64ToU64,
+        [bcF32ToF64] = &&doF32ToF64, [bcF64ToF32] = &&doF64ToF32,
+        [bcJmp] = &&doJmp, [bcJz] = &&doJz, [bcJnz] = &&doJnz,
+        [bcJEq] = &&doJEq, [bcJNe] = &&doJNe, [bcJLtS] = &&doJLtS, [bcJLeS] = &&doJLeS, [bcJLtU] = &&doJLtU, [bcJLeU] = &&doJLeU,
+        [bcSwitch] = &&doSwitch, [bcCall] = &&doCall, [bcCallExtern] = &&doCallExtern, [bcRet] = &&doRet, [bcRetVoid] = &&doRetVoid
+    };
+    if (!program->threaded){
+        for (size_t i=0; i<program->functions.size; i++){
+            Array(BcInstr)* code = &program->functions.elem[i].code;
+            for (size_t j=0; j<code->size; j++){
+                code->elem[j].handler = handlers[code->elem[j].op];
+            }
+        }
+        program->threaded = 1;
+    }
+
+    New(BcValue, stack, STACK_SIZE);
+    New(BcFrame, frames, MAX_CALL_DEPTH);
+    size_t depth = 0;
+    char finished = 0;
+    const BcFunction* curFunc = &program->functions.elem[func];
+    BcValue* regs = stack;
+    const BcInstr* code = curFunc->code.elem;
+    const BcInstr* pc = code;
+    if (curFunc->frameSize > STACK_SIZE) goto overflow;
+    memcpy(regs, args, sizeof(BcValue) * curFunc->paramCount);
+
+#define NEXT() do { pc++; goto *pc->handler; } while (0)
+#define JUMP(target) do { pc = code + (target); goto *pc->handler; } while (0)
+#define DST regs[pc->dst]
+#define LEFT regs[pc->left]
+#define RIGHT regs[pc->right]
+#define UNARY(label, expr) label: DST.num = (expr); NEXT();
+#define UNARY_F32(label, expr) label: DST.f32 = (expr); NEXT();
+#define UNARY_F64(label, expr) label: DST.f64 = (expr); NEXT();
+// Integer results of each width are extended back to 64 bits the way their type says
+#define BINARY_INT(name, op) \
+    name##I32: DST.num = (int64_t)(int32_t)(LEFT.num op RIGHT.num); NEXT(); \
+    name##U32: DST.num = (uint32_t)(LEFT.num op RIGHT.num); NEXT();
+#define BINARY_FLOAT(name, op) \
+    name##F32: DST.f32 = LEFT.f32 op RIGHT.f32; NEXT(); \
+    name##F64: DST.f64 = LEFT.f64 op RIGHT.f64; NEXT();
+#define COMPARE(label, type, field, op) label: DST.num = (type)LEFT.field op (type)RIGHT.field; NEXT();
+#define JUMP_IF(label, type, op) label: if ((type)LEFT.num op (type)RIGHT.num) JUMP(pc->data.target); NEXT();
+
+    goto *pc->handler;
+    doConst: DST.num = pc->data.num; NEXT();
+    doMov: DST = LEFT; NEXT();
+    UNARY(doExtI8, (int64_t)(int8_t)LEFT.num)
+    UNARY(doExtU8, (uint8_t)LEFT.num)
+    UNARY(doExtI16, (int64_t)(int16_t)LEFT.num)
+    UNARY(doExtU16, (uint16_t)LEFT.num)
+    UNARY(doExtI32, (int64_t)(int32_t)LEFT.num)
+    UNARY(doExtU32, (uint32_t)LEFT.num)
+    BINARY_INT(doAdd, +)
+    doAdd64: DST.num = LEFT.num + RIGHT.num; NEXT();
+    BINARY_FLOAT(doAdd, +)
+    BINARY_INT(doSub, -)
+    doSub64: DST.num = LEFT.num - RIGHT.num; NEXT();
+    BINARY_FLOAT(doSub, -)
+    BINARY_INT(doMul, *)
+    doMul64: DST.num = LEFT.num * RIGHT.num; NEXT();
+    BINARY_FLOAT(doMul, *)
+    doDivI32: DST.num = (int64_t)((int32_t)LEFT.num / (int32_t)RIGHT.num); NEXT();
+    doDivU32: DST.num = (uint32_t)LEFT.num / (uint32_t)RIGHT.num; NEXT();
+    doDivI64: DST.num = (int64_t)LEFT.num / (int64_t)RIGHT.num; NEXT();
+    doDivU64: DST.num = LEFT.num / RIGHT.num; NEXT();
+    BINARY_FLOAT(doDiv, /)
+    UNARY(doNegI32, (int64_t)(int32_t)-LEFT.num)
+    UNARY(doNegU32, (uint32_t)-LEFT.num)
+    UNARY(doNeg64, -LEFT.num)
+    UNARY_F32(doNegF32, -LEFT.f32)
+    UNARY_F64(doNegF64, -LEFT.f64)
+    UNARY(doNot, LEFT.num == 0)
+    UNARY(doNotF32, LEFT.f32 == 0)
+    UNARY(doNotF64, LEFT.f64 == 0)
+    COMPARE(doEq, uint64_t, num, ==)
+    COMPARE(doNe, uint64_t, num, !=)
+    COMPARE(doLtS, int64_t, num, <)
+    COMPARE(doLeS, int64_t, num, <=)
+    COMPARE(doLtU, uint64_t, num, <)
+    COMPARE(doLeU, uint64_t, num, <=)
+    COMPARE(doEqF32, float, f32, ==)
+    COMPARE(doNeF32, float, f32, !=)
+    COMPARE(doLtF32, float, f32, <)
+    COMPARE(doLeF32, float, f32, <=)
+    COMPARE(doEqF64, double, f64, ==)
+    COMPARE(doNeF64, double, f64, !=)
+    COMPARE(doLtF64, double, f64, <)
+    COMPARE(doLeF64, double, f64, <=)
+    UNARY_F32(doI64ToF32, (int64_t)LEFT.num)
+    UNARY_F32(doU64ToF32, LEFT.num)
+    UNARY_F64(doI64ToF64, (int64_t)LEFT.num)
+    UNARY_F64(doU64ToF64, LEFT.num)
+    UNARY(doF32ToI32, LEFT.f32 > -2147483649.0 && LEFT.f32 < 2147483648.0 ? (int64_t)LEFT.f32 : INT32_MIN)
+    UNARY(doF64ToI32, LEFT.f64 > -2147483649.0 && LEFT.f64 < 2147483648.0 ? (int64_t)LEFT.f64 : INT32_MIN)
+    UNARY(doF32ToI64, (int64_t)LEFT.f32)
+    UNARY(doF32ToU64, (uint64_t)LEFT.f32)
+    UNARY(doF64ToI64, (int64_t)LEFT.f64)
+    UNARY(doF64ToU64, (uint64_t)LEFT.f64)
+    UNARY_F64(doF32ToF64, LEFT.f32)
+    UNARY_F32(doF64ToF32, LEFT.f64)
+    doJmp: JUMP(pc->data.target);
+    doJz: if (LEFT.num == 0) JUMP(pc->data.target); NEXT();
+    doJnz: if (LEFT.num != 0) JUMP(pc->data.target); NEXT();
+    JUMP_IF(doJEq, uint64_t, ==)
+    JUMP_IF(doJNe, uint64_t, !=)
+    JUMP_IF(doJLtS, int64_t, <)
+    JUMP_IF(doJLeS, int64_t, <=)
+    JUMP_IF(doJLtU, uint64_t, <)
+    JUMP_IF(doJLeU, uint64_t, <=)
+    doSwitch: JUMP(switchTarget(&curFunc->switches.elem[pc->data.table], LEFT.num));
+    doCall: {
+        const BcFunction* callee = &program->functions.elem[pc->data.callee];
+        BcValue* calleeRegs = regs + curFunc->frameSize;
+        if (depth == MAX_CALL_DEPTH || calleeRegs + callee->frameSize > stack + STACK_SIZE) goto overflow;
+        memcpy(calleeRegs, &LEFT, sizeof(BcValue) * pc->right);
+        frames[depth++] = (BcFrame){pc, curFunc, regs};
+        curFunc = callee;
+        regs = calleeRegs;
+        code = pc = callee->code.elem;
+        goto *pc->handler;
+    }
+    doCallExtern: DST = bcInvokeExtern(&program->externs.elem[pc->data.callee], &LEFT); NEXT();
+    doRet: {
+        BcValue value = LEFT;
+        if (depth == 0){
+            *result = value;
+            finished = 1;
+            goto done;
+        }
+        BcFrame* frame = &frames[--depth];
+        curFunc = frame->func;
+        regs = frame->regs;
+        code = curFunc->code.elem;
+        pc = frame->ret;
+        DST = value;
+        NEXT();
+    }
+    doRetVoid: {
+        if (depth == 0){
+            result->num = 0;
+            finished = 1;
+            goto done;
+        }
+        BcFrame* frame = &frames[--depth];
+        curFunc = frame->func;
+        regs = frame->regs;
+        code = curFunc->code.elem;
+        pc = frame->ret;
+        NEXT();
+    }
+
+overflow:
+    fprintf(stderr, "Error: Stack overflow in %s.\n", curFunc->name);
+done:
+    free(stack);
+    free(frames);
+    return finished;
+
+#undef NEXT
+#undef JUMP
+#undef DST
+#undef LEFT
+#undef RIGHT
+#undef UNARY
+#undef UNARY_F32
+#undef UNARY_F64
+#undef BINARY_INT
+#undef BINARY_FLOAT
+#undef COMPARE
+#undef JUMP_IF
+}
+
+// The host passes integer and float args in registers of their own kind, each kind in order, so any function taking up to
+// six integers and eight floats can be called with every one of those registers filled in. Floats sit in the low end of
+// their slot, which is all a float param reads. Going through varargs sets the count of float registers for variadic functions
+typedef uint64_t (*IntShim)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, ...);
+typedef float (*Float32Shim)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, ...);
+typedef double (*Float64Shim)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, ...);
+
+BcValue bcInvokeExtern(const BcExtern* ext, const BcValue* args){
+    uint64_t ints[6] = {0};
+    double floats[8] = {0};
+    size_t intCount = 0;
+    size_t floatCount = 0;
+    for (size_t i=0; i<ext->decl->params.size; i++){
+        if (isFloatType(((StmtVar*)ext->decl->params.elem[i])->type)) memcpy(&floats[floatCount++], &args[i], sizeof(double));
+        else ints[intCount++] = args[i].num;
+    }
+#define SHIM_ARGS ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], \
+    floats[0], floats[1], floats[2], floats[3], floats[4], floats[5], floats[6], floats[7]
+    BcValue result = {0};
+    Type type = ext->decl->type;
+    if (type == typFloat32){
+        result.f32 = ((Float32Shim)ext->address)(SHIM_ARGS);
+        return result;
+    }
+    if (type == typFloat64){
+        result.f64 = ((Float64Shim)ext->address)(SHIM_ARGS);
+        return result;
+    }
+    result.num = ((IntShim)ext->address)(SHIM_ARGS);
+#undef SHIM_ARGS
+    //Only the bits of the return type are set by the callee, so they get extended here
+    switch (type){
+        case typInt8: result.num = (int8_t)result.num; break;
+        case typUInt8: result.num = (uint8_t)result.num; break;
+        case typInt16: result.num = (int16_t)result.num; break;
+        case typUInt16: result.num = (uint16_t)result.num; break;
+        case typInt32: result.num = (int32_t)result.num; break;
+        case typUInt32: result.num = (uint32_t)result.num; break;
+        default: break;
+    }
+    return result;
+}
+
+int interpretTopLevel(TopLevel* ast){
+    BcProgram program;
+    int code = 1;
+    if (bcLowerProgram(ast, &program)){
+        size_t main = bcFindFunction(&program, "main");
+        if (main == SIZE_MAX){
+            fprintf(stderr, "Error: No main function to run.\n");
+        }
+        else{
+            //main gets 0 for any params it takes
+            New(BcValue, args, program.functions.elem[main].paramCount + 1);
+            memset(args, 0, sizeof(BcValue) * (program.functions.elem[main].paramCount + 1));
+            BcValue result;
+            fflush(NULL);
+            if (bcRun(&program, main, args, &result)) code = (int)result.num;
+            fflush(NULL);
+            free(args);
+        }
+    }
+    bcDisposeProgram(&program);
+    return code;
+}
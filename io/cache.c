@@ -0,0 +1,320 @@
+#include "io/cache.h"
+#include "io/error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+// Changes every time the compiler is built, so that output from an older compiler is never reused
+#define COMPILER_VERSION "CCompiler " __DATE__ " " __TIME__
+#define ENTRY_MAGIC 0x31454343      //"CCE1"
+#define PATH_SIZE 300
+#define HASH_CHARS 16
+
+typedef struct {
+    uint32_t magic;
+    int32_t code;
+    uint64_t hash;
+    uint64_t sourceSize;
+    uint64_t diagSize;
+    uint64_t outSize;
+} EntryHeader;
+
+static char_t cacheDir[PATH_SIZE];
+static uint64_t cacheLimit;
+
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+#define PRIME4 0x85EBCA77C2B2AE63ULL
+#define PRIME5 0x27D4EB2F165667C5ULL
+
+static uint64_t rotl(uint64_t x, int bits){
+    return (x << bits) | (x >> (64 - bits));
+}
+
+static uint64_t read64(const uint8_t* p){
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static uint32_t read32(const uint8_t* p){
+    uint32_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static uint64_t hashRound(uint64_t acc, uint64_t input){
+    return rotl(acc + input * PRIME2, 31) * PRIME1;
+}
+
+static uint64_t mergeRound(uint64_t acc, uint64_t value){
+    return (acc ^ hashRound(0, value)) * PRIME1 + PRIME4;
+}
+
+// Four lanes take 32 bytes a round, then the tail is mixed in 8, 4 and 1 bytes at a time
+uint64_t hash64(const void* data, size_t size, uint64_t seed){
+    const uint8_t* p = data;
+    const uint8_t* end = p + size;
+    uint64_t hash;
+    if (size >= 32){
+        uint64_t lanes[4] = {seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1};
+        for (; end - p >= 32; p += 32){
+            for (int i=0; i<4; i++){
+                lanes[i] = hashRound(lanes[i], read64(p + i * 8));
+            }
+        }
+        hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+        for (int i=0; i<4; i++){
+            hash = mergeRound(hash, lanes[i]);
+        }
+    }
+    else hash = seed + PRIME5;
+    hash += size;
+    for (; end - p >= 8; p += 8){
+        hash = rotl(hash ^ hashRound(0, read64(p)), 27) * PRIME1 + PRIME4;
+    }
+    if (end - p >= 4){
+        hash = rotl(hash ^ read32(p) * PRIME1, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++){
+        hash = rotl(hash ^ *p * PRIME5, 11) * PRIME1;
+    }
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    return hash ^ (hash >> 32);
+}
+
+static void entryPath(char_t* path, uint64_t hash){
+    snprintf(path, PATH_SIZE, "%s/%016llx", cacheDir, (unsigned long long)hash);
+}
+
+static char isEntryName(const char_t* name){
+    size_t i = 0;
+    for (; name[i]; i++){
+        if (!((name[i] >= '0' && name[i] <= '9') || (name[i] >= 'a' && name[i] <= 'f'))) return 0;
+    }
+    return i == HASH_CHARS;
+}
+
+// Maps a whole file read-only. Empty files map to NULL with a size of 0. Returns 0 if the file can't be read
+static char mapFile(const char_t* filename, const uint8_t** data, size_t* size){
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat info;
+    if (fstat(fd, &info) != 0){
+        close(fd);
+        return 0;
+    }
+    *size = info.st_size;
+    *data = NULL;
+    if (*size > 0){
+        void* map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED){
+            close(fd);
+            return 0;
+        }
+        *data = map;
+    }
+    close(fd);
+    return 1;
+}
+
+static void unmapFile(const uint8_t* data, size_t size){
+    if (data != NULL) munmap((void*)data, size);
+}
+
+static char writeAll(int fd, const void* data, size_t size){
+    const uint8_t* p = data;
+    while (size > 0){
+        ssize_t written = write(fd, p, size);
+        if (written < 0){
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        p += written;
+        size -= written;
+    }
+    return 1;
+}
+
+// Stats are replaced through a rename like the entries are. Concurrent compiles can lose each other's counts, which only
+// makes them approximate
+static void writeCacheStats(const CacheStats* stats){
+    char_t path[PATH_SIZE];
+    char_t tempPath[PATH_SIZE];
+    snprintf(path, PATH_SIZE, "%s/stats", cacheDir);
+    snprintf(tempPath, PATH_SIZE, "%s/stats.%d", cacheDir, (int)getpid());
+    FILE* file = fopen(tempPath, "w");
+    if (file == NULL) return;
+    fprintf(file, "%llu %llu %llu %llu\n", (unsigned long long)stats->hits, (unsigned long long)stats->misses,
+        (unsigned long long)stats->evictions, (unsigned long long)stats->bytes);
+    if (fclose(file) != 0 || rename(tempPath, path) != 0) unlink(tempPath);
+}
+
+void readCacheStats(CacheStats* stats){
+    char_t path[PATH_SIZE];
+    snprintf(path, PATH_SIZE, "%s/stats", cacheDir);
+    *stats = (CacheStats){0};
+    FILE* file = fopen(path, "r");
+    if (file == NULL) return;
+    unsigned long long hits, misses, evictions, bytes;
+    if (fscanf(file, "%llu %llu %llu %llu", &hits, &misses, &evictions, &bytes) == 4){
+        *stats = (CacheStats){hits, misses, evictions, bytes};
+    }
+    fclose(file);
+}
+
+typedef struct {
+    char_t name[HASH_CHARS + 1];
+    time_t used;
+    uint64_t size;
+} EntryInfo;
+
+#define TYPE EntryInfo
+#include "generics/gen_array.h"
+#include "generics/gen_array.c"
+#undef TYPE
+
+static int compareUse(const void* a, const void* b){
+    time_t left = ((const EntryInfo*)a)->used;
+    time_t right = ((const EntryInfo*)b)->used;
+    return (left > right) - (left < right);
+}
+
+// Deletes the entries used longest ago until the rest take up 3/4 of the limit, so that the directory isn't scanned on
+// every store once it's full. The total is recounted from what's left
+static void evictEntries(CacheStats* stats){
+    DIR* dir = opendir(cacheDir);
+    if (dir == NULL) return;
+    Array(EntryInfo) entries;
+    if (!arrInit(EntryInfo)(&entries, 64, NULL, NULL)) exit(1);
+    uint64_t total = 0;
+    for (struct dirent* dirEntry = readdir(dir); dirEntry != NULL; dirEntry = readdir(dir)){
+        if (!isEntryName(dirEntry->d_name)) continue;
+        char_t path[PATH_SIZE];
+        struct stat info;
+        snprintf(path, PATH_SIZE, "%s/%s", cacheDir, dirEntry->d_name);
+        if (stat(path, &info) != 0) continue;
+        EntryInfo entry = {.used = info.st_mtime, .size = info.st_size};
+        strcpy(entry.name, dirEntry->d_name);
+        if (!arrPush(EntryInfo)(&entries, entry)) exit(1);
+        total += entry.size;
+    }
+    closedir(dir);
+    qsort(entries.elem, entries.size, sizeof(EntryInfo), &compareUse);
+    for (size_t i=0; i<entries.size && total > cacheLimit / 4 * 3; i++){
+        char_t path[PATH_SIZE];
+        snprintf(path, PATH_SIZE, "%s/%s", cacheDir, entries.elem[i].name);
+        if (unlink(path) != 0) continue;
+        total -= entries.elem[i].size;
+        stats->evictions++;
+    }
+    stats->bytes = total;
+    arrDispose(EntryInfo)(&entries);
+}
+
+char openCache(const char_t* dir, uint64_t maxBytes){
+    if (strlen(dir) + HASH_CHARS + 16 >= PATH_SIZE) return 0;
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) return 0;
+    struct stat info;
+    if (stat(dir, &info) != 0 || !S_ISDIR(info.st_mode)) return 0;
+    strcpy(cacheDir, dir);
+    cacheLimit = maxBytes;
+    return 1;
+}
+
+char cacheKey(const char_t* infilename, const char_t* options, CacheKey* key){
+    const uint8_t* source;
+    size_t size;
+    if (!mapFile(infilename, &source, &size)) return 0;
+    uint64_t seed = hash64(COMPILER_VERSION, strlen(COMPILER_VERSION), 0);
+    seed = hash64(options, strlen(options), seed);
+    *key = (CacheKey){hash64(source, size, seed), size};
+    unmapFile(source, size);
+    return 1;
+}
+
+char cacheFetch(const CacheKey* key, const char_t* outfilename, int* code){
+    char_t path[PATH_SIZE];
+    entryPath(path, key->hash);
+    CacheStats stats;
+    readCacheStats(&stats);
+    const uint8_t* entry;
+    size_t size;
+    char hit = mapFile(path, &entry, &size);
+    EntryHeader header;
+    if (hit){
+        hit = size >= sizeof(header);
+        if (hit) memcpy(&header, entry, sizeof(header));
+        hit = hit && header.magic == ENTRY_MAGIC && header.hash == key->hash && header.sourceSize == key->sourceSize
+            && sizeof(header) + header.diagSize + header.outSize == size;
+    }
+    if (hit){
+        int fd = open(outfilename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        hit = fd >= 0 && writeAll(fd, entry + sizeof(header) + header.diagSize, header.outSize);
+        if (fd >= 0) close(fd);
+    }
+    if (hit){
+        fwrite(entry + sizeof(header), 1, header.diagSize, stderr);
+        *code = header.code;
+        //Recently used entries are the last to be evicted
+        utimes(path, NULL);
+        stats.hits++;
+    }
+    else stats.misses++;
+    unmapFile(entry, size);
+    writeCacheStats(&stats);
+    return hit;
+}
+
+// Written under a temporary name and renamed into place, so that other compiles never see half an entry
+void cacheStore(const CacheKey* key, const char_t* outfilename, int code){
+    const uint8_t* output = NULL;
+    size_t outSize = 0;
+    if (code == 0 && !mapFile(outfilename, &output, &outSize)) return;
+    size_t diagSize;
+    const char_t* diagnostics = capturedDiagnostics(&diagSize);
+    EntryHeader header = {ENTRY_MAGIC, code, key->hash, key->sourceSize, diagSize, outSize};
+
+    char_t path[PATH_SIZE];
+    char_t tempPath[PATH_SIZE];
+    entryPath(path, key->hash);
+    snprintf(tempPath, PATH_SIZE, "%s.%d", path, (int)getpid());
+    int fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    char stored = fd >= 0 && writeAll(fd, &header, sizeof(header)) && writeAll(fd, diagnostics, diagSize)
+        && writeAll(fd, output, outSize);
+    if (fd >= 0 && close(fd) != 0) stored = 0;
+    unmapFile(output, outSize);
+    if (!stored || rename(tempPath, path) != 0){
+        unlink(tempPath);
+        return;
+    }
+    CacheStats stats;
+    readCacheStats(&stats);
+    stats.bytes += sizeof(header) + diagSize + outSize;
+    if (stats.bytes > cacheLimit) evictEntries(&stats);
+    writeCacheStats(&stats);
+}
+
+void printCacheStats(){
+    CacheStats stats;
+    readCacheStats(&stats);
+    uint64_t lookups = stats.hits + stats.misses;
+    printf("Cache directory: %s\n", cacheDir);
+    printf("Hits: %llu\n", (unsigned long long)stats.hits);
+    printf("Misses: %llu\n", (unsigned long long)stats.misses);
+    printf("Hit rate: %.1f%%\n", lookups ? stats.hits * 100.0 / lookups : 0.0);
+    printf("Evictions: %llu\n", (unsigned long long)stats.evictions);
+    printf("Size: %.1f KB of %llu KB\n", stats.bytes / 1024.0, (unsigned long long)(cacheLimit >> 10));
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "utils.h"
+// Compiled output kept on disk and found again by hashing everything that goes into it: the source, the compiler itself
+// and the options that change what comes out. Each entry is one file holding the output and the diagnostics printed while
+// compiling, named after the hash. The least recently used entries are evicted once the directory gets too big
+
+typedef struct {
+    uint64_t hash;
+    uint64_t sourceSize;    //Checked along with the hash, so a collision also needs sources of the same size
+} CacheKey;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t bytes;         //Size of all the entries together
+} CacheStats;
+
+// XXH64 of the bytes
+uint64_t hash64(const void* data, size_t size, uint64_t seed);
+
+// Creates the directory if it isn't there. Returns 0 if it can't be used
+char openCache(const char_t* dir, uint64_t maxBytes);
+// Returns 0 if the source can't be read
+char cacheKey(const char_t* infilename, const char_t* options, CacheKey* key);
+// On a hit, writes the output file, prints the diagnostics again and gives back the exit code of the compile
+char cacheFetch(const CacheKey* key, const char_t* outfilename, int* code);
+// Stores the output file along with the diagnostics captured since compiling started. Failed compiles keep no output
+void cacheStore(const CacheKey* key, const char_t* outfilename, int code);
+void readCacheStats(CacheStats* stats);
+void printCacheStats();
@@ -1,12 +1,70 @@
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include "utils.h"
+#include "io/error.h"
+
+static char capturing;
+static char_t* captured;
+static size_t capturedSize;
+static size_t capturedCapacity;
+
+static void captureMessage(const char_t* format, va_list args){
+    va_list copy;
+    va_copy(copy, args);
+    int length = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    if (length <= 0) return;
+    if (capturedSize + length + 1 > capturedCapacity){
+        capturedCapacity = (capturedSize + length + 1) * 2;
+        captured = realloc(captured, capturedCapacity);
+        if (captured == NULL) exit(1);
+    }
+    vsnprintf(captured + capturedSize, length + 1, format, args);
+    capturedSize += length;
+}
+
+static void writeMessage(const char_t* format, va_list args){
+    if (capturing){
+        va_list copy;
+        va_copy(copy, args);
+        captureMessage(format, copy);
+        va_end(copy);
+    }
+    vfprintf(stderr, format, args);
+}
+
+static void writeFormatted(const char_t* format, ...){
+    va_list args;
+    va_start(args, format);
+    writeMessage(format, args);
+    va_end(args);
+}
 
 void writeError(size_t line, size_t pos, char_t* message, ...){
-    fprintf(stderr, "On line %d, position %d, ", line, pos);
+    writeFormatted("On line %d, position %d, ", line, pos);
     va_list args;
     va_start(args, message);
-    vfprintf(stderr, message, args);
+    writeMessage(message, args);
     va_end(args);
-    fprintf(stderr, "\n");
+    writeFormatted("\n");
+}
+
+void writeDiagnostic(const char_t* format, ...){
+    va_list args;
+    va_start(args, format);
+    writeMessage(format, args);
+    va_end(args);
+}
+
+void captureDiagnostics(char capture){
+    capturing = capture;
+    free(captured);
+    captured = NULL;
+    capturedSize = capturedCapacity = 0;
+}
+
+const char_t* capturedDiagnostics(size_t* size){
+    *size = capturedSize;
+    return captured;
 }
\ No newline at end of file
@@ -2,4 +2,9 @@
 #include <stdarg.h>
 #include "utils.h"
 
-void writeError(size_t line, size_t pos, char_t* message, ...);
\ No newline at end of file
+void writeError(size_t line, size_t pos, char_t* message, ...);
+// Message about the file being compiled, such as the inlining report, that's printed to stderr
+void writeDiagnostic(const char_t* format, ...);
+// While capturing, errors and diagnostics are also kept so that they can be stored with the output. Stopping frees them
+void captureDiagnostics(char capture);
+const char_t* capturedDiagnostics(size_t* size);
\ No newline at end of file
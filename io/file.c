@@ -1,18 +1,55 @@
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include "utils.h"
 #include "lexer/lexer.h"
 
 static FILE* infile;
 static FILE* outfile;
 
+// Output piles up here and goes to the file in large writes, so the file itself isn't buffered
+#define OUT_BUFFER_SIZE (1 << 18)
+static char outBuffer[OUT_BUFFER_SIZE];
+static size_t outSize;
+
+static void flushOut(){
+    if (outSize) fwrite(outBuffer, 1, outSize, outfile);
+    outSize = 0;
+}
+
 void emitOut(const char* format, ...) {
     va_list args;
     va_start(args, format);
-    vfprintf(outfile, format, args);
+    int length = vsnprintf(outBuffer + outSize, OUT_BUFFER_SIZE - outSize, format, args);
+    va_end(args);
+    if (length >= 0 && (size_t)length < OUT_BUFFER_SIZE - outSize){
+        outSize += length;
+        return;
+    }
+    //Didn't fit, so it's printed again once what came before is out of the way
+    flushOut();
+    va_start(args, format);
+    if (length >= 0 && length < OUT_BUFFER_SIZE){
+        outSize = vsnprintf(outBuffer, OUT_BUFFER_SIZE, format, args);
+    }
+    else{
+        vfprintf(outfile, format, args);
+    }
     va_end(args);
 }
 
+void emitBytes(const void* bytes, size_t size){
+    if (size > OUT_BUFFER_SIZE - outSize){
+        flushOut();
+        if (size > OUT_BUFFER_SIZE){
+            fwrite(bytes, 1, size, outfile);
+            return;
+        }
+    }
+    memcpy(outBuffer + outSize, bytes, size);
+    outSize += size;
+}
+
 char_t consumeNext(){
     int c = fgetc(infile);
     if (c == EOF){
@@ -29,18 +66,21 @@ static void safeClose(FILE* file, const char* filename){
 }
 
 void closeFiles(const char* infilename, const char* outfilename){
+    if (outfile != NULL) flushOut();
     safeClose(infile, infilename);
     safeClose(outfile, outfilename);
 }
 
-void openFiles(const char* infilename, const char* outfilename){
+void openFiles(const char* infilename, const char* outfilename, char binary){
     infile = fopen(infilename, "r");
-    outfile = fopen(outfilename, "w");
-    if (infile == NULL || outfile == NULL){
+    outfile = outfilename == NULL ? NULL : fopen(outfilename, binary ? "wb" : "w");
+    outSize = 0;
+    if (outfile != NULL) setvbuf(outfile, NULL, _IONBF, 0);
+    if (infile == NULL || (outfilename != NULL && outfile == NULL)){
         if (infile == NULL){
             fprintf(stderr, "Error: Input file %s couldn't be opened.\n", infilename);
         }
-        if (outfile == NULL){
+        if (outfilename != NULL && outfile == NULL){
             fprintf(stderr, "Error: Output file %s couldn't be opened.\n", outfilename);
         }
         closeFiles(infilename, outfilename);
@@ -4,8 +4,11 @@
 
 void emitOut(const char* format, ...);
 
+void emitBytes(const void* bytes, size_t size);
+
 char_t consumeNext();
 
 void closeFiles(const char* infilename, const char* outfilename);
 
-void openFiles(const char* infilename, const char* outfilename);
+// Binary output files are written as is, without any newline translation. Without a name there's no output file
+void openFiles(const char* infilename, const char* outfilename, char binary);
@@ -0,0 +1,499 @@
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#include "utils.h"
+#include "array.h"
+#include "lexer/lexer.h"
+#include "ast/ast.h"
+#include "ast/type.h"
+#include "scope/scope.h"
+#include "semantics/symtable.h"
+#include "ir/ir.h"
+// Translates a verified function AST into IR. Every variable becomes a local that is read and written through loads and stores,
+// which mem2reg later turns into SSA values
+
+#define KEY Symbol
+#define VAL size_t
+#include "generics/gen_map.h"
+#include "generics/gen_map.c"
+#undef KEY
+#undef VAL
+static Map(Symbol, size_t) localTable;
+
+static IrFunction* curFunc;
+static IrBlock* curBlock;
+// Cleared when something the IR can't express is found
+static char supported;
+
+typedef struct {
+    IrBlock* brk;
+    IrBlock* cont;
+    IrBlock** cases;    //Block of each case of the switch the statement is in, in the order of its cases
+    IrBlock* dflt;
+} BlockContext;
+
+static void checkType(Type type){
+    if (isFloatType(type)) supported = 0;
+}
+
+static IrInstr* emit(IrOpcode op, Type type){
+    return irAppend(curBlock, newIrInstr(curFunc, op, type));
+}
+
+static IrInstr* emitConst(uint64_t num, Type type){
+    IrInstr* instr = emit(irConst, type);
+    instr->data.num = num;
+    return instr;
+}
+
+static IrInstr* emitUnary(IrOpcode op, Type type, IrInstr* arg){
+    return irAddArg(emit(op, type), arg);
+}
+
+static IrInstr* emitBinary(IrOpcode op, Type type, IrInstr* left, IrInstr* right){
+    return irAddArg(irAddArg(emit(op, type), left), right);
+}
+
+static IrInstr* emitLoad(size_t local){
+    IrInstr* load = emit(irLoad, ((IrLocal*)curFunc->locals.elem[local])->type);
+    load->data.index = local;
+    return load;
+}
+
+// Converts a value into the type its user expects. Constants are built fresh for each use, so they are converted in place.
+// Functions using floats are thrown away, so nothing is converted once one is found
+static IrInstr* emitConv(IrInstr* value, Type type){
+    if (value->type == type || !supported) return value;
+    if (value->op == irConst){
+        value->type = type;
+        value->data.num = irExtendConst(value->data.num, type);
+        return value;
+    }
+    return emitUnary(irConv, type, value);
+}
+
+static void emitStore(size_t local, IrInstr* value){
+    IrInstr* store = emitUnary(irStore, typNone, value);
+    store->data.index = local;
+}
+
+static void emitJmp(IrBlock* target){
+    IrInstr* jmp = newIrInstr(curFunc, irJmp, typNone);
+    jmp->targets[0] = target;
+    irAppend(curBlock, jmp);
+}
+
+static void emitBranch(IrInstr* cond, IrBlock* ifTrue, IrBlock* ifFalse){
+    IrInstr* branch = newIrInstr(curFunc, irBranch, typNone);
+    irAddArg(branch, cond);
+    branch->targets[0] = ifTrue;
+    branch->targets[1] = ifFalse;
+    irAppend(curBlock, branch);
+}
+
+// Code after a jump is unreachable, but still needs a block to go into. Unreachable blocks are removed later
+static void startDeadBlock(){
+    curBlock = newIrBlock(curFunc);
+}
+
+static void insertLocal(char_t* name, size_t local){
+    if (!mapInsert(Symbol, size_t)(&localTable, (Symbol){name, curScope}, local)){
+        exit(1);
+    }
+}
+
+static size_t findLocal(char_t* name){
+    size_t scopeId = curScope;
+    size_t* localptr = NULL;
+    while (localptr == NULL){
+        localptr = mapFind(Symbol, size_t)(&localTable, (Symbol){name, scopeId});
+        if (scopeId == GLOBAL_SCOPE) break;
+        scopeId = prevScope(scopeId);
+    }
+    assert(localptr && "Variable should have been verified");
+    return *localptr;
+}
+
+static IrInstr* buildExpr(ExprBase* expr);
+static void buildCond(ExprBase* expr, IrBlock* ifTrue, IrBlock* ifFalse);
+
+static IrCond relCond(Token relOp, Type type){
+    switch(relOp){
+        case tokEquals:
+            return irCondE;
+        case tokNotEquals:
+            return irCondNE;
+        case tokGreaterEquals:
+            return isSignedType(type) ? irCondGE : irCondAE;
+        case tokLessEquals:
+            return isSignedType(type) ? irCondLE : irCondBE;
+        case tokGreater:
+            return isSignedType(type) ? irCondG : irCondA;
+        case tokLess:
+            return isSignedType(type) ? irCondL : irCondB;
+        default:
+            assert(0 && "Not a relational operator");
+    }
+}
+
+static char isRelOp(Token op){
+    switch(op){
+        case tokEquals:
+        case tokNotEquals:
+        case tokGreaterEquals:
+        case tokLessEquals:
+        case tokGreater:
+        case tokLess:
+            return 1;
+    }
+    return 0;
+}
+
+static IrOpcode arithOpcode(Token op){
+    switch(op){
+        case tokPlus:
+        case tokPlusAssign:
+            return irAdd;
+        case tokMinus:
+        case tokMinusAssign:
+            return irSub;
+        case tokMulti:
+        case tokMultiAssign:
+            return irMul;
+        case tokDiv:
+        case tokDivAssign:
+            return irDiv;
+        default:
+            assert(0 && "Not an arithmetic operator");
+    }
+}
+
+// Args are evaluated right to left, same as the AST backend, and converted to the types of their params
+static IrInstr* buildCall(ExprCall* call){
+    const Function* func = findFunc(call->name);
+    checkType(func->type);
+    New(IrInstr*, args, call->args.size + 1);
+    for (size_t i=call->args.size; i>0; i--){
+        Type paramType = ((StmtVar*)func->params.elem[i-1])->type;
+        checkType(paramType);
+        args[i-1] = emitConv(buildExpr(call->args.elem[i-1]), paramType);
+    }
+    IrInstr* instr = emit(irCall, func->type == typVoid ? typNone : func->type);
+    instr->data.name = call->name;
+    for (size_t i=0; i<call->args.size; i++){
+        irAddArg(instr, args[i]);
+    }
+    free(args);
+    return instr;
+}
+
+static IrInstr* buildUnop(ExprUnop* unop){
+    switch(unop->op){
+        case tokMinus:
+            return emitUnary(irNeg, unop->operand->type, buildExpr(unop->operand));
+        case tokNot:
+            return emitUnary(irNot, typInt32, buildExpr(unop->operand));
+        case tokInc:
+        case tokDec: {
+            assert(unop->operand->ast.label == astExprIdent && "Only variables can be incremented");
+            size_t local = findLocal(((ExprIdent*)unop->operand)->name);
+            IrInstr* old = emitLoad(local);
+            IrInstr* updated = emitBinary(unop->op == tokInc ? irAdd : irSub, old->type, old, emitConst(1, old->type));
+            emitStore(local, updated);
+            // Prefix operators return the new value and postfix ones return the old value
+            return unop->leftside ? updated : old;
+        }
+        default:
+            assert(0 && "Not a token unary operator");
+    }
+}
+
+// Logical operators used as values go through a temporary, which mem2reg turns into a phi
+static IrInstr* buildLogical(ExprBinop* binop){
+    size_t temp = newIrLocal(curFunc, typInt32, NULL);
+    IrBlock* ifTrue = newIrBlock(curFunc);
+    IrBlock* ifFalse = newIrBlock(curFunc);
+    IrBlock* join = newIrBlock(curFunc);
+    buildCond((ExprBase*)binop, ifTrue, ifFalse);
+    curBlock = ifTrue;
+    emitStore(temp, emitConst(1, typInt32));
+    emitJmp(join);
+    curBlock = ifFalse;
+    emitStore(temp, emitConst(0, typInt32));
+    emitJmp(join);
+    curBlock = join;
+    return emitLoad(temp);
+}
+
+static IrInstr* buildBinop(ExprBinop* binop){
+    if (binop->op == tokAnd || binop->op == tokOr){
+        return buildLogical(binop);
+    }
+    if (isAssignmentOp(binop->op)){
+        assert(binop->left->ast.label == astExprIdent && "Can only assign to variables");
+        size_t local = findLocal(((ExprIdent*)binop->left)->name);
+        Type localType = ((IrLocal*)curFunc->locals.elem[local])->type;
+        if (binop->op == tokAssign){
+            IrInstr* value = emitConv(buildExpr(binop->right), localType);
+            emitStore(local, value);
+            return value;
+        }
+        // The variable is read after the right side, like the AST backend does. The arithmetic is done in the promoted type
+        IrInstr* right = buildExpr(binop->right);
+        IrInstr* old = emitConv(emitLoad(local), binop->left->type);
+        IrInstr* updated = emitBinary(arithOpcode(binop->op), binop->left->type, old, right);
+        IrInstr* value = emitConv(updated, localType);
+        emitStore(local, value);
+        return value;
+    }
+    // Both operands were promoted to the same type
+    IrInstr* left = buildExpr(binop->left);
+    IrInstr* right = buildExpr(binop->right);
+    if (isRelOp(binop->op)){
+        IrInstr* cmp = emitBinary(irCmp, typInt32, left, right);
+        // Float comparisons have no condition code here, but the function gets thrown away anyway
+        if (supported) cmp->cond = relCond(binop->op, binop->left->type);
+        return cmp;
+    }
+    return emitBinary(arithOpcode(binop->op), binop->left->type, left, right);
+}
+
+// Builds the value of an expression in the type it's produced in, which can differ from the type its parent wants
+static IrInstr* buildValue(ExprBase* expr){
+    switch(expr->ast.label){
+        case astExprInt:
+            //Signed constants get sign extended to 64 bits like everything else
+            if (isSignedType(expr->type)){
+                return emitConst((int64_t)(int32_t)((ExprInt*)expr)->num, expr->type);
+            }
+            return emitConst(((ExprInt*)expr)->num, expr->type);
+        case astExprLong:
+            return emitConst(((ExprLong*)expr)->num, expr->type);
+        case astExprCall:
+            return buildCall((ExprCall*)expr);
+        case astExprIdent:
+            return emitLoad(findLocal(((ExprIdent*)expr)->name));
+        case astExprBinop:
+            return buildBinop((ExprBinop*)expr);
+        case astExprUnop:
+            return buildUnop((ExprUnop*)expr);
+        default:
+            supported = 0;
+            return emitConst(0, typInt32);
+    }
+}
+
+static IrInstr* buildExpr(ExprBase* expr){
+    checkType(expr->type);
+    IrInstr* value = buildValue(expr);
+    // Calls to void functions have nothing to convert
+    return expr->type == typVoid ? value : emitConv(value, expr->type);
+}
+
+// Branches to ifTrue or ifFalse depending on the condition. Logical operators become chains of branches
+static void buildCond(ExprBase* expr, IrBlock* ifTrue, IrBlock* ifFalse){
+    if (expr->ast.label == astExprBinop){
+        ExprBinop* binop = (ExprBinop*)expr;
+        if (binop->op == tokAnd || binop->op == tokOr){
+            IrBlock* right = newIrBlock(curFunc);
+            if (binop->op == tokAnd){
+                buildCond(binop->left, right, ifFalse);
+            }
+            else{
+                buildCond(binop->left, ifTrue, right);
+            }
+            curBlock = right;
+            buildCond(binop->right, ifTrue, ifFalse);
+            return;
+        }
+    }
+    else if (expr->ast.label == astExprUnop && ((ExprUnop*)expr)->op == tokNot){
+        buildCond(((ExprUnop*)expr)->operand, ifFalse, ifTrue);
+        return;
+    }
+    IrInstr* cond = buildExpr(expr);
+    if (cond->op == irConst){
+        emitJmp(cond->data.num ? ifTrue : ifFalse);
+        return;
+    }
+    emitBranch(cond, ifTrue, ifFalse);
+}
+
+static void buildStmt(Ast* ast, const BlockContext* ctx){
+    switch(ast->label){
+        case astStmtEmpty:
+            break;
+        case astStmtExpr:
+            buildExpr(((StmtExpr*)ast)->expr);
+            break;
+        case astStmtReturn: {
+            StmtReturn* ret = (StmtReturn*)ast;
+            IrInstr* instr;
+            if (hasRetExpr(ret)){
+                IrInstr* value = emitConv(buildExpr(ret->expr), curFunc->type);
+                instr = irAddArg(newIrInstr(curFunc, irRet, typNone), value);
+            }
+            else{
+                instr = newIrInstr(curFunc, irRet, typNone);
+            }
+            irAppend(curBlock, instr);
+            startDeadBlock();
+            break;
+        }
+        case astStmtBlock: {
+            StmtBlock* blk = (StmtBlock*)ast;
+            curScope = blk->scopeId;
+            for (size_t i=0; i<blk->stmts.size; i++){
+                buildStmt(blk->stmts.elem[i], ctx);
+            }
+            toPrevScope();
+            break;
+        }
+        case astStmtDef: {
+            StmtVar* def = (StmtVar*)ast;
+            checkType(def->type);
+            // The initializer is built before the variable exists, so it still sees any variable it shadows
+            IrInstr* value = def->rhs ? emitConv(buildExpr(def->rhs), def->type) : NULL;
+            size_t local = newIrLocal(curFunc, def->type, def->name);
+            if (value){
+                emitStore(local, value);
+            }
+            insertLocal(def->name, local);
+            break;
+        }
+        case astStmtWhile: {
+            StmtWhileLoop* loop = (StmtWhileLoop*)ast;
+            IrBlock* header = newIrBlock(curFunc);
+            IrBlock* body = newIrBlock(curFunc);
+            const BlockContext loopCtx = {.brk = newIrBlock(curFunc), .cont = header, .cases = ctx->cases, .dflt = ctx->dflt};
+            emitJmp(header);
+            curBlock = header;
+            buildCond(loop->condition, body, loopCtx.brk);
+            curBlock = body;
+            buildStmt(loop->stmt, &loopCtx);
+            emitJmp(header);
+            curBlock = loopCtx.brk;
+            break;
+        }
+        case astStmtDoWhile: {
+            StmtWhileLoop* loop = (StmtWhileLoop*)ast;
+            IrBlock* body = newIrBlock(curFunc);
+            const BlockContext doCtx = {.brk = newIrBlock(curFunc), .cont = newIrBlock(curFunc), .cases = ctx->cases, .dflt = ctx->dflt};
+            emitJmp(body);
+            curBlock = body;
+            buildStmt(loop->stmt, &doCtx);
+            emitJmp(doCtx.cont);
+            curBlock = doCtx.cont;
+            buildCond(loop->condition, body, doCtx.brk);
+            curBlock = doCtx.brk;
+            break;
+        }
+        case astStmtContinue:
+            emitJmp(ctx->cont);
+            startDeadBlock();
+            break;
+        case astStmtBreak:
+            emitJmp(ctx->brk);
+            startDeadBlock();
+            break;
+        case astStmtIf: {
+            StmtIf* ifelse = (StmtIf*)ast;
+            IrBlock* then = newIrBlock(curFunc);
+            IrBlock* end = newIrBlock(curFunc);
+            IrBlock* otherwise = ifelse->elseStmt ? newIrBlock(curFunc) : end;
+            buildCond(ifelse->condition, then, otherwise);
+            curBlock = then;
+            buildStmt(ifelse->ifStmt, ctx);
+            emitJmp(end);
+            if (ifelse->elseStmt){
+                curBlock = otherwise;
+                buildStmt(ifelse->elseStmt, ctx);
+                emitJmp(end);
+            }
+            curBlock = end;
+            break;
+        }
+        case astStmtSwitch: {
+            // Every case gets a block of its own, so the targets of the switch are all different
+            StmtSwitch* stmt = (StmtSwitch*)ast;
+            IrInstr* value = buildExpr(stmt->expr);
+            New(IrBlock*, cases, stmt->cases.size + 1);
+            for (size_t i=0; i<stmt->cases.size; i++){
+                cases[i] = newIrBlock(curFunc);
+            }
+            IrBlock* end = newIrBlock(curFunc);
+            const BlockContext switchCtx = {
+                .brk = end, .cont = ctx->cont, .cases = cases, .dflt = stmt->defaultCase ? newIrBlock(curFunc) : NULL
+            };
+            if (stmt->cases.size){
+                IrInstr* instr = irAddArg(newIrInstr(curFunc, irSwitch, typNone), value);
+                instr->targets[0] = switchCtx.dflt ? switchCtx.dflt : end;
+                for (size_t i=0; i<stmt->cases.size; i++){
+                    irAddCase(instr, ((StmtCase*)stmt->cases.elem[i])->num, cases[i]);
+                }
+                irAppend(curBlock, instr);
+            }
+            else{
+                emitJmp(switchCtx.dflt ? switchCtx.dflt : end);
+            }
+            startDeadBlock();
+            buildStmt(stmt->stmt, &switchCtx);
+            emitJmp(end);
+            curBlock = end;
+            free(cases);
+            break;
+        }
+        case astStmtCase:
+        case astStmtDefault: {
+            // Whatever comes before the label falls through into it
+            StmtCase* label = (StmtCase*)ast;
+            IrBlock* block = ast->label == astStmtDefault ? ctx->dflt : ctx->cases[label->index];
+            emitJmp(block);
+            curBlock = block;
+            buildStmt(label->stmt, ctx);
+            break;
+        }
+        default:
+            assert(0 && "Unsupported AST for stmt");
+    }
+}
+
+IrFunction* irBuildFunction(Function* func){
+    assert(!isFuncDecl(func) && "Can't build IR for a declaration");
+    curFunc = newIrFunction(func->name, func->type, func->params.size);
+    curBlock = newIrBlock(curFunc);
+    supported = 1;
+    checkType(func->type);
+    mapInit(Symbol, size_t)(&localTable, 4, &hashSymbol, &eqSymbol, NULL, NULL);
+
+    // Params are copied into locals so that they can be assigned to like any other variable
+    curScope = func->scopeId;
+    for (size_t i=0; i<func->params.size; i++){
+        StmtVar* param = func->params.elem[i];
+        checkType(param->type);
+        IrInstr* value = emit(irParam, param->type);
+        value->data.index = i;
+        size_t local = newIrLocal(curFunc, param->type, param->name);
+        emitStore(local, value);
+        insertLocal(param->name, local);
+    }
+    const BlockContext ctx = {NULL, NULL, NULL, NULL};
+    buildStmt(func->stmt, &ctx);
+    // Falling off the end returns 0 from non-void functions
+    if (func->type == typVoid){
+        irAppend(curBlock, newIrInstr(curFunc, irRet, typNone));
+    }
+    else{
+        IrInstr* zero = emitConst(0, func->type);
+        irAppend(curBlock, irAddArg(newIrInstr(curFunc, irRet, typNone), zero));
+    }
+    curScope = GLOBAL_SCOPE;
+    mapDispose(Symbol, size_t)(&localTable);
+
+    if (!supported){
+        disposeIrFunction(curFunc);
+        return NULL;
+    }
+    irRemoveUnreachable(curFunc);
+    return curFunc;
+}
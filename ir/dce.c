@@ -0,0 +1,65 @@
+#include <assert.h>
+#include <stdint.h>
+#include "utils.h"
+#include "array.h"
+#include "ir/ir.h"
+// Dead code elimination. Instructions with side effects are live, and so is everything they use, directly or not.
+// Whatever isn't reached that way is erased, which also drops phis and constants left behind by earlier passes.
+// Stores only count as side effects if their local is loaded somewhere
+
+static void markLive(IrInstr* instr, Array(vptr)* worklist){
+    if (instr->id == SIZE_MAX) return;
+    instr->id = SIZE_MAX;
+    if (!arrPush(vptr)(worklist, instr)) exit(1);
+}
+
+char irDce(IrFunction* func){
+    New(char, loaded, func->locals.size + 1);
+    for (size_t i=0; i<func->locals.size; i++){
+        loaded[i] = 0;
+    }
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            if (instr->op == irLoad) loaded[instr->data.index] = 1;
+            //Ids mark liveness for now, so they get renumbered at the end
+            instr->id = 0;
+        }
+    }
+
+    Array(vptr) worklist;
+    if (!arrInit(vptr)(&worklist, 16, NULL, NULL)) exit(1);
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            if (!irHasSideEffects(instr)) continue;
+            if (instr->op == irStore && !loaded[instr->data.index]) continue;
+            markLive(instr, &worklist);
+        }
+    }
+    while (worklist.size){
+        IrInstr* instr = arrPop(vptr)(&worklist);
+        for (size_t i=0; i<instr->args.size; i++){
+            markLive(instr->args.elem[i], &worklist);
+        }
+    }
+    arrDispose(vptr)(&worklist);
+    free(loaded);
+
+    char changed = 0;
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            if (instr->id != SIZE_MAX){
+                irErase(instr);
+                changed = 1;
+            }
+        }
+    }
+    irSweep(func);
+    irNumberValues(func);
+    return changed;
+}
@@ -0,0 +1,97 @@
+#include <assert.h>
+#include <stdint.h>
+#include "utils.h"
+#include "array.h"
+#include "ir/ir.h"
+// Dominator tree and dominance frontiers, using the iterative algorithm from Cooper, Harvey and Kennedy
+
+static void postorder(IrBlock* block, Array(vptr)* order){
+    block->mark = 1;
+    for (size_t i=0; i<irSuccCount(block); i++){
+        IrBlock* succ = irSucc(block, i);
+        if (!succ->mark) postorder(succ, order);
+    }
+    if (!arrPush(vptr)(order, block)) exit(1);
+}
+
+static IrBlock* intersect(IrBlock* a, IrBlock* b){
+    while (a != b){
+        while (a->rpoIndex > b->rpoIndex) a = a->idom;
+        while (b->rpoIndex > a->rpoIndex) b = b->idom;
+    }
+    return a;
+}
+
+void irComputeDominators(IrFunction* func){
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        block->mark = 0;
+        block->rpoIndex = SIZE_MAX;
+        block->idom = NULL;
+        arrClear(vptr)(&block->domChildren);
+        arrClear(vptr)(&block->frontier);
+    }
+    arrClear(vptr)(&func->rpo);
+    postorder(func->blocks.elem[0], &func->rpo);
+    //Reverse postorder puts every block after its dominators
+    for (size_t i=0, j=func->rpo.size-1; i<j; i++, j--){
+        vptr temp = func->rpo.elem[i];
+        func->rpo.elem[i] = func->rpo.elem[j];
+        func->rpo.elem[j] = temp;
+    }
+    for (size_t i=0; i<func->rpo.size; i++){
+        ((IrBlock*)func->rpo.elem[i])->rpoIndex = i;
+    }
+
+    IrBlock* entry = func->rpo.elem[0];
+    entry->idom = entry;
+    char changed = 1;
+    while (changed){
+        changed = 0;
+        for (size_t i=1; i<func->rpo.size; i++){
+            IrBlock* block = func->rpo.elem[i];
+            IrBlock* newIdom = NULL;
+            for (size_t j=0; j<block->preds.size; j++){
+                IrBlock* pred = block->preds.elem[j];
+                if (pred->idom == NULL) continue;
+                newIdom = newIdom ? intersect(pred, newIdom) : pred;
+            }
+            if (newIdom != block->idom){
+                block->idom = newIdom;
+                changed = 1;
+            }
+        }
+    }
+
+    for (size_t i=1; i<func->rpo.size; i++){
+        IrBlock* block = func->rpo.elem[i];
+        if (!arrPush(vptr)(&block->idom->domChildren, block)) exit(1);
+    }
+    //A join point is in the frontier of every block between its preds and its idom
+    for (size_t i=0; i<func->rpo.size; i++){
+        IrBlock* block = func->rpo.elem[i];
+        if (block->preds.size < 2) continue;
+        for (size_t j=0; j<block->preds.size; j++){
+            IrBlock* runner = block->preds.elem[j];
+            if (runner->rpoIndex == SIZE_MAX) continue;
+            while (runner != block->idom){
+                size_t k;
+                for (k=0; k<runner->frontier.size && runner->frontier.elem[k] != block; k++);
+                if (k == runner->frontier.size){
+                    if (!arrPush(vptr)(&runner->frontier, block)) exit(1);
+                }
+                runner = runner->idom;
+            }
+        }
+    }
+    entry->idom = NULL;
+}
+
+//Whether a dominates b. Blocks dominate themselves
+char irDominates(const IrBlock* a, const IrBlock* b){
+    while (b != NULL){
+        if (a == b) return 1;
+        b = b->idom;
+    }
+    return 0;
+}
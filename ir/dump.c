@@ -0,0 +1,110 @@
+#include <assert.h>
+#include <inttypes.h>
+#include "utils.h"
+#include "io/file.h"
+#include "ast/type.h"
+#include "ir/ir.h"
+// Text form of the IR for tests and debugging
+
+static const char_t* const opcodeStrs[] = {
+    "const", "param", "load", "store", "copy", "conv", "neg", "not", "add", "sub", "mul", "div", "cmp", "select", "call", "phi",
+    "jmp", "br", "switch", "ret"
+};
+static const char_t* const condStrs[] = {"e", "ne", "l", "le", "g", "ge", "b", "be", "a", "ae"};
+
+const char_t* irOpcodeStr(IrOpcode op){
+    return opcodeStrs[op];
+}
+
+static void dumpArgs(const IrInstr* instr){
+    for (size_t i=0; i<instr->args.size; i++){
+        emitOut(i ? ", %%%u" : " %%%u", (unsigned)((IrInstr*)instr->args.elem[i])->id);
+    }
+}
+
+static void dumpInstr(const IrInstr* instr){
+    emitOut("    ");
+    if (irHasValue(instr)){
+        emitOut("%%%u = ", (unsigned)instr->id);
+    }
+    emitOut("%s", opcodeStrs[instr->op]);
+    if (instr->op == irCmp){
+        emitOut(".%s", condStrs[instr->cond]);
+    }
+    if (irHasValue(instr)){
+        emitOut(" %s", stringifyType(instr->type));
+    }
+    switch (instr->op){
+        case irConst:
+            if (isSignedType(instr->type)){
+                emitOut(" %" PRId64, (int64_t)instr->data.num);
+            }
+            else{
+                emitOut(" %" PRIu64, instr->data.num);
+            }
+            break;
+        case irParam:
+            emitOut(" %u", (unsigned)instr->data.index);
+            break;
+        case irLoad:
+            emitOut(" $%u", (unsigned)instr->data.index);
+            break;
+        case irStore:
+            emitOut(" $%u,", (unsigned)instr->data.index);
+            dumpArgs(instr);
+            break;
+        case irCall:
+            emitOut(" %s(", instr->data.name);
+            for (size_t i=0; i<instr->args.size; i++){
+                emitOut(i ? ", %%%u" : "%%%u", (unsigned)((IrInstr*)instr->args.elem[i])->id);
+            }
+            emitOut(")");
+            break;
+        case irPhi:
+            for (size_t i=0; i<instr->args.size; i++){
+                const IrBlock* pred = instr->block->preds.elem[i];
+                emitOut("%s[b%u: %%%u]", i ? ", " : " ", (unsigned)pred->id, (unsigned)((IrInstr*)instr->args.elem[i])->id);
+            }
+            break;
+        case irJmp:
+            emitOut(" b%u", (unsigned)instr->targets[0]->id);
+            break;
+        case irBranch:
+            dumpArgs(instr);
+            emitOut(", b%u, b%u", (unsigned)instr->targets[0]->id, (unsigned)instr->targets[1]->id);
+            break;
+        case irSwitch: {
+            dumpArgs(instr);
+            emitOut(", default b%u", (unsigned)instr->targets[0]->id);
+            Type type = ((IrInstr*)instr->args.elem[0])->type;
+            for (size_t i=0; i<instr->caseCount; i++){
+                if (isSignedType(type)){
+                    emitOut(", %" PRId64 " b%u", (int64_t)instr->cases[i].num, (unsigned)instr->cases[i].target->id);
+                }
+                else{
+                    emitOut(", %" PRIu64 " b%u", instr->cases[i].num, (unsigned)instr->cases[i].target->id);
+                }
+            }
+            break;
+        }
+        default:
+            dumpArgs(instr);
+    }
+    emitOut("\n");
+}
+
+void irDump(IrFunction* func){
+    irNumberValues(func);
+    emitOut("function %s\n", func->name);
+    for (size_t i=0; i<func->blocks.size; i++){
+        const IrBlock* block = func->blocks.elem[i];
+        emitOut("b%u:", (unsigned)block->id);
+        for (size_t j=0; j<block->preds.size; j++){
+            emitOut(j ? ", b%u" : " preds b%u", (unsigned)((IrBlock*)block->preds.elem[j])->id);
+        }
+        emitOut("\n");
+        for (size_t j=0; j<block->instrs.size; j++){
+            dumpInstr(block->instrs.elem[j]);
+        }
+    }
+}
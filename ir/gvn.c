@@ -0,0 +1,122 @@
+#include <assert.h>
+#include <stdint.h>
+#include "utils.h"
+#include "array.h"
+#include "ir/ir.h"
+// Dominator based global value numbering. The dominator tree is walked with a scoped table of available expressions,
+// so any pure instruction that matches one computed in a dominating block is replaced by it.
+// Since variables are SSA values by now, an assignment makes a new value instead of changing an operand,
+// so only the operands themselves need to match. Loads, stores and calls are never numbered
+
+typedef struct {
+    IrOpcode op;
+    IrCond cond;
+    Type type;
+    uint64_t num;
+    IrInstr* left;
+    IrInstr* right;
+} Expr;
+
+static size_t hashExpr(Expr expr){
+    size_t hash = expr.op * 31 + expr.cond;
+    hash = hash * 31 + expr.type;
+    hash = hash * 31 + (size_t)expr.num;
+    hash = hash * 31 + (size_t)expr.left / sizeof(IrInstr);
+    return hash * 31 + (size_t)expr.right / sizeof(IrInstr);
+}
+
+static char eqExpr(Expr a, Expr b){
+    return a.op == b.op && a.cond == b.cond && a.type == b.type && a.num == b.num && a.left == b.left && a.right == b.right;
+}
+
+#define KEY Expr
+#define VAL vptr
+#include "generics/gen_map.h"
+#include "generics/gen_map.c"
+#undef KEY
+#undef VAL
+
+#define TYPE Expr
+#include "generics/gen_array.h"
+#include "generics/gen_array.c"
+#undef TYPE
+
+static Map(Expr, vptr) available;
+// Expressions added to the table, so each block can remove what it added once its dominator subtree is done
+static Array(Expr) added;
+static char changed;
+
+static char isNumbered(IrOpcode op){
+    switch (op){
+        case irConst:
+        case irCopy:
+        case irConv:
+        case irNeg:
+        case irNot:
+        case irAdd:
+        case irSub:
+        case irMul:
+        case irDiv:
+        case irCmp:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static Expr makeExpr(const IrInstr* instr){
+    Expr expr = {instr->op, instr->op == irCmp ? instr->cond : 0, instr->type, 0, NULL, NULL};
+    if (instr->op == irConst) expr.num = instr->data.num;
+    if (instr->args.size > 0) expr.left = irResolve(instr->args.elem[0]);
+    if (instr->args.size > 1) expr.right = irResolve(instr->args.elem[1]);
+    //Commutative operands are put in a fixed order so that a+b and b+a match
+    if (expr.left > expr.right && expr.right != NULL){
+        if (instr->op == irAdd || instr->op == irMul || instr->op == irCmp){
+            IrInstr* tmp = expr.left;
+            expr.left = expr.right;
+            expr.right = tmp;
+            if (instr->op == irCmp) expr.cond = irSwapCond(expr.cond);
+        }
+    }
+    return expr;
+}
+
+static void numberBlock(IrBlock* block){
+    size_t addedBefore = added.size;
+    for (size_t i=0; i<block->instrs.size; i++){
+        IrInstr* instr = block->instrs.elem[i];
+        if (!isNumbered(instr->op)) continue;
+        Expr expr = makeExpr(instr);
+        vptr* found = mapFind(Expr, vptr)(&available, expr);
+        if (found != NULL){
+            irReplaceUses(instr, *found);
+            irErase(instr);
+            changed = 1;
+        }
+        else{
+            if (!mapInsert(Expr, vptr)(&available, expr, instr)) exit(1);
+            if (!arrPush(Expr)(&added, expr)) exit(1);
+        }
+    }
+    for (size_t i=0; i<block->domChildren.size; i++){
+        numberBlock(block->domChildren.elem[i]);
+    }
+    while (added.size > addedBefore){
+        mapRemove(Expr, vptr)(&available, arrPop(Expr)(&added));
+    }
+}
+
+char irGvn(IrFunction* func){
+    irComputeDominators(func);
+    if (!mapInit(Expr, vptr)(&available, 16, &hashExpr, &eqExpr, NULL, NULL)) exit(1);
+    if (!arrInit(Expr)(&added, 16, NULL, NULL)) exit(1);
+    changed = 0;
+    numberBlock(func->blocks.elem[0]);
+    mapDispose(Expr, vptr)(&available);
+    arrDispose(Expr)(&added);
+    if (changed){
+        irApplyReplacements(func);
+        irSweep(func);
+    }
+    return changed;
+}
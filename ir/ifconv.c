@@ -0,0 +1,172 @@
+#include <assert.h>
+#include <stdint.h>
+#include "utils.h"
+#include "array.h"
+#include "ir/ir.h"
+// Turns branches around a few cheap assignments into selects, which lower to conditional moves. A branch can be guessed
+// wrong, so computing both sides and picking one afterwards is cheaper as long as the sides are short.
+// Handles diamonds, where each side of the branch is a block that jumps to the same join, and triangles, where one side
+// goes straight to the join. Blocks on the sides run unconditionally afterwards, so they can only hold instructions that
+// can't trap or be seen: no loads, stores, calls or divisions
+
+// Most instructions the sides can hold between them, plus one for each select the join's phis need
+#define MAX_COST 6
+
+static char isSpeculatable(const IrInstr* instr){
+    switch (instr->op){
+        case irConst:
+        case irCopy:
+        case irConv:
+        case irNeg:
+        case irNot:
+        case irAdd:
+        case irSub:
+        case irMul:
+        case irCmp:
+        case irSelect:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Number of instructions a side would add to its pred, or SIZE_MAX if it can't be hoisted. Constants are free
+static size_t sideCost(const IrBlock* side, const IrBlock* pred, const IrBlock* join){
+    const IrInstr* jmp = irTerminator(side);
+    if (side->preds.size != 1 || side->preds.elem[0] != pred || jmp->op != irJmp || jmp->targets[0] != join){
+        return SIZE_MAX;
+    }
+    size_t cost = 0;
+    for (size_t i=0; i+1<side->instrs.size; i++){
+        const IrInstr* instr = side->instrs.elem[i];
+        if (!isSpeculatable(instr)) return SIZE_MAX;
+        if (instr->op != irConst) cost++;
+    }
+    return cost;
+}
+
+// Moves everything but the terminator of side into block at pos
+static size_t hoistSide(IrBlock* block, IrBlock* side, size_t pos){
+    for (size_t i=0; i+1<side->instrs.size; i++){
+        IrInstr* instr = side->instrs.elem[i];
+        instr->block = block;
+        if (!arrInsert(vptr)(&block->instrs, instr, pos++)) exit(1);
+    }
+    side->instrs.elem[0] = irTerminator(side);
+    side->instrs.size = 1;
+    return pos;
+}
+
+// Converts the branch at the end of block if its sides are cheap enough. ifTrue and ifFalse are the blocks on each side,
+// or null if that side goes straight to join
+static char convert(IrFunction* func, IrBlock* block, IrBlock* ifTrue, IrBlock* ifFalse, IrBlock* join){
+    if (join == block || join == func->blocks.elem[0]) return 0;
+    size_t cost = 0;
+    IrBlock* sides[2] = {ifTrue, ifFalse};
+    for (int i=0; i<2; i++){
+        if (sides[i] == NULL) continue;
+        size_t sideCosts = sideCost(sides[i], block, join);
+        if (sideCosts == SIZE_MAX) return 0;
+        cost += sideCosts;
+    }
+    size_t truePred = irPredIndex(join, ifTrue ? ifTrue : block);
+    size_t falsePred = irPredIndex(join, ifFalse ? ifFalse : block);
+    for (size_t i=0; i<join->instrs.size; i++){
+        const IrInstr* phi = join->instrs.elem[i];
+        if (phi->op != irPhi) break;
+        if (phi->args.elem[truePred] != phi->args.elem[falsePred]) cost++;
+    }
+    if (cost > MAX_COST) return 0;
+
+    IrInstr* branch = irTerminator(block);
+    IrInstr* cond = branch->args.elem[0];
+    //The sides go in before a comparison that's only there for the branch, so that its flags can be used by the selects
+    size_t pos = block->instrs.size - 1;
+    if (cond->block == block && cond->op == irCmp && pos > 0 && block->instrs.elem[pos - 1] == cond) pos--;
+    for (int i=0; i<2; i++){
+        if (sides[i] == NULL) continue;
+        for (size_t j=0; j+1<sides[i]->instrs.size; j++){
+            const IrInstr* instr = sides[i]->instrs.elem[j];
+            for (size_t k=0; k<instr->args.size; k++){
+                if (instr->args.elem[k] == cond) pos = block->instrs.size - 1;
+            }
+        }
+    }
+    for (int i=0; i<2; i++){
+        if (sides[i] != NULL) pos = hoistSide(block, sides[i], pos);
+    }
+
+    //Each phi with different incoming values gets a select in block, which becomes its incoming value from block
+    size_t phiCount = 0;
+    while (phiCount < join->instrs.size && ((IrInstr*)join->instrs.elem[phiCount])->op == irPhi) phiCount++;
+    New(IrInstr*, values, phiCount + 1);
+    for (size_t i=0; i<phiCount; i++){
+        IrInstr* phi = join->instrs.elem[i];
+        values[i] = phi->args.elem[truePred];
+        if (values[i] == phi->args.elem[falsePred]) continue;
+        IrInstr* select = irInsertBeforeTerminator(block, newIrInstr(func, irSelect, phi->type));
+        irAddArg(select, cond);
+        irAddArg(select, phi->args.elem[truePred]);
+        irAddArg(select, phi->args.elem[falsePred]);
+        values[i] = select;
+    }
+
+    for (int i=0; i<2; i++){
+        if (sides[i] == NULL) continue;
+        irRemoveEdge(block, sides[i]);
+        irRemoveEdge(sides[i], join);
+    }
+    branch->op = irJmp;
+    branch->args.size = 0;
+    branch->targets[0] = join;
+    branch->targets[1] = NULL;
+    //In a triangle block already comes into join, otherwise it takes the place of the sides
+    size_t pred = irPredIndex(join, block);
+    if (pred == SIZE_MAX){
+        irAddEdge(block, join);
+        for (size_t i=0; i<phiCount; i++){
+            irAddArg(join->instrs.elem[i], values[i]);
+        }
+    }
+    else{
+        for (size_t i=0; i<phiCount; i++){
+            ((IrInstr*)join->instrs.elem[i])->args.elem[pred] = values[i];
+        }
+    }
+    free(values);
+    return 1;
+}
+
+static char convertBranches(IrFunction* func){
+    char changed = 0;
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        IrInstr* branch = irTerminator(block);
+        if (branch->op != irBranch || branch->targets[0] == branch->targets[1]) continue;
+        IrBlock* ifTrue = branch->targets[0];
+        IrBlock* ifFalse = branch->targets[1];
+        IrInstr* trueJmp = irTerminator(ifTrue);
+        IrInstr* falseJmp = irTerminator(ifFalse);
+        if (trueJmp->op == irJmp && trueJmp->targets[0] == ifFalse){
+            changed |= convert(func, block, ifTrue, NULL, ifFalse);
+        }
+        else if (falseJmp->op == irJmp && falseJmp->targets[0] == ifTrue){
+            changed |= convert(func, block, NULL, ifFalse, ifTrue);
+        }
+        else if (trueJmp->op == irJmp && falseJmp->op == irJmp && trueJmp->targets[0] == falseJmp->targets[0]){
+            changed |= convert(func, block, ifTrue, ifFalse, trueJmp->targets[0]);
+        }
+    }
+    if (!changed) return 0;
+    irRemoveUnreachable(func);
+    irMergeBlocks(func);
+    return 1;
+}
+
+// Converting an inner if and merging what's left can make the if around it convertible
+char irIfConvert(IrFunction* func){
+    char changed = 0;
+    while (convertBranches(func)) changed = 1;
+    if (changed) irNumberValues(func);
+    return changed;
+}
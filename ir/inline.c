@@ -0,0 +1,232 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "utils.h"
+#include "array.h"
+#include "ir/ir.h"
+#include "io/error.h"
+// Inlines calls to small functions defined earlier in the file. Functions are offered once they're optimized, so their
+// own calls are already inlined by then. The callee's blocks, values and locals are copied into the caller, which keeps
+// them apart from the caller's own. Params are replaced by the call's args, which are already evaluated right to left
+// and converted to the param types, so the copied body sees exactly what a call would give it. Returns jump to the
+// rest of the caller's block and their values are merged with a phi
+
+size_t irInlineLimit = 16;
+char irInlineReport = 0;
+
+typedef struct {
+    const char_t* name;
+    IrFunction* body;       //Copy of the optimized function, or null if it can't be inlined
+    const char_t* reason;   //Why it can't be inlined
+    size_t size;
+} Inlinee;
+
+static Array(vptr) inlinees;
+
+static void disposeInlinee(vptr inlinee){
+    if (((Inlinee*)inlinee)->body) disposeIrFunction(((Inlinee*)inlinee)->body);
+    free(inlinee);
+}
+
+void irInitInlining(){
+    if (!arrInit(vptr)(&inlinees, 8, NULL, &disposeInlinee)) exit(1);
+}
+
+void irDisposeInlining(){
+    arrDispose(vptr)(&inlinees);
+}
+
+// Params and constants cost nothing once the args are substituted and the constants folded
+static size_t bodySize(const IrFunction* func){
+    size_t size = 0;
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrOpcode op = ((IrInstr*)block->instrs.elem[j])->op;
+            if (op != irParam && op != irConst) size++;
+        }
+    }
+    return size;
+}
+
+static char callsItself(const IrFunction* func){
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            if (instr->op == irCall && !strcmp(instr->data.name, func->name)) return 1;
+        }
+    }
+    return 0;
+}
+
+// Copies the blocks of from to the end of into, giving them new locals. Params become args[index] if there are args,
+// otherwise they're copied too. values and blocks are filled with the copy of each value and block, indexed by id
+static void cloneBody(IrFunction* into, IrFunction* from, IrInstr** args, IrInstr** values, IrBlock** blocks){
+    irNumberValues(from);
+    size_t localBase = into->locals.size;
+    for (size_t i=0; i<from->locals.size; i++){
+        const IrLocal* local = from->locals.elem[i];
+        newIrLocal(into, local->type, local->name);
+    }
+    for (size_t i=0; i<from->blocks.size; i++){
+        IrBlock* block = from->blocks.elem[i];
+        blocks[block->id] = newIrBlock(into);
+    }
+    for (size_t i=0; i<from->blocks.size; i++){
+        IrBlock* block = from->blocks.elem[i];
+        IrBlock* copyBlock = blocks[block->id];
+        for (size_t j=0; j<block->preds.size; j++){
+            if (!arrPush(vptr)(&copyBlock->preds, blocks[((IrBlock*)block->preds.elem[j])->id])) exit(1);
+        }
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            if (instr->op == irParam && args != NULL){
+                values[instr->id] = irResolve(args[instr->data.index]);
+                continue;
+            }
+            IrInstr* copy = newIrInstr(into, instr->op, instr->type);
+            copy->cond = instr->cond;
+            copy->data = instr->data;
+            if (instr->op == irLoad || instr->op == irStore) copy->data.index += localBase;
+            for (int k=0; k<2; k++){
+                if (instr->targets[k]) copy->targets[k] = blocks[instr->targets[k]->id];
+            }
+            for (size_t k=0; k<instr->caseCount; k++){
+                irAddCase(copy, instr->cases[k].num, blocks[instr->cases[k].target->id]);
+            }
+            copy->block = copyBlock;
+            if (!arrPush(vptr)(&copyBlock->instrs, copy)) exit(1);
+            values[instr->id] = copy;
+        }
+    }
+    //Operands can refer to values further down, like phis in loop headers do, so they're mapped once everything exists
+    for (size_t i=0; i<from->blocks.size; i++){
+        IrBlock* block = from->blocks.elem[i];
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            if (instr->op == irParam && args != NULL) continue;
+            for (size_t k=0; k<instr->args.size; k++){
+                irAddArg(values[instr->id], values[((IrInstr*)instr->args.elem[k])->id]);
+            }
+        }
+    }
+}
+
+// Small functions that don't call themselves keep a copy for later callers. The rest are remembered for the report
+void irOfferInlinee(IrFunction* func){
+    New(Inlinee, inlinee, 1);
+    inlinee->name = func->name;
+    inlinee->body = NULL;
+    inlinee->size = bodySize(func);
+    if (inlinee->size > irInlineLimit){
+        inlinee->reason = "too big";
+    }
+    else if (callsItself(func)){
+        inlinee->reason = "recursive";
+    }
+    else{
+        inlinee->reason = NULL;
+        IrFunction* body = newIrFunction(func->name, func->type, func->paramCount);
+        New(IrInstr*, values, func->valueCount + 1);
+        New(IrBlock*, blocks, func->blocks.size + 1);
+        cloneBody(body, func, NULL, values, blocks);
+        free(values);
+        free(blocks);
+        inlinee->body = body;
+    }
+    if (!arrPush(vptr)(&inlinees, inlinee)) exit(1);
+}
+
+static const Inlinee* findInlinee(const char_t* name){
+    for (size_t i=0; i<inlinees.size; i++){
+        const Inlinee* inlinee = inlinees.elem[i];
+        if (!strcmp(inlinee->name, name)) return inlinee;
+    }
+    return NULL;
+}
+
+// Splits the call's block after the call, copies the callee in between and replaces the call's value with what the
+// copy returns. The call is erased and a jump to the copied entry block takes its place
+static void inlineCall(IrFunction* func, IrInstr* call, size_t pos, IrFunction* callee){
+    IrBlock* block = call->block;
+    IrBlock* rest = newIrBlock(func);
+    for (size_t i=pos+1; i<block->instrs.size; i++){
+        IrInstr* instr = block->instrs.elem[i];
+        instr->block = rest;
+        if (!arrPush(vptr)(&rest->instrs, instr)) exit(1);
+    }
+    block->instrs.size = pos + 1;
+    for (size_t i=0; i<irSuccCount(rest); i++){
+        IrBlock* succ = irSucc(rest, i);
+        succ->preds.elem[irPredIndex(succ, block)] = rest;
+    }
+
+    New(IrInstr*, values, callee->valueCount + 1);
+    New(IrBlock*, blocks, callee->blocks.size + 1);
+    cloneBody(func, callee, (IrInstr**)call->args.elem, values, blocks);
+    IrInstr* phi = irHasValue(call) ? newIrInstr(func, irPhi, call->type) : NULL;
+    for (size_t i=0; i<callee->blocks.size; i++){
+        IrBlock* copyBlock = blocks[((IrBlock*)callee->blocks.elem[i])->id];
+        IrInstr* term = irTerminator(copyBlock);
+        if (term->op != irRet) continue;
+        if (phi) irAddArg(phi, term->args.elem[0]);
+        term->op = irJmp;
+        term->args.size = 0;
+        term->targets[0] = rest;
+        irAddEdge(copyBlock, rest);
+    }
+    if (phi){
+        //A callee that never returns leaves rest unreachable, but its uses of the call still need a value
+        if (rest->preds.size == 0){
+            phi->op = irConst;
+            phi->args.size = 0;
+        }
+        irInsertAt(rest, phi, 0);
+        irReplaceUses(call, phi);
+    }
+    IrInstr* jmp = newIrInstr(func, irJmp, typNone);
+    jmp->targets[0] = blocks[((IrBlock*)callee->blocks.elem[0])->id];
+    irErase(call);
+    irAppend(block, jmp);
+    free(values);
+    free(blocks);
+}
+
+// Each caller can only grow by so much, so that chains of small functions don't blow up
+#define GROWTH_FACTOR 16
+
+char irInline(IrFunction* func){
+    char changed = 0;
+    size_t growth = 0;
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* call = block->instrs.elem[j];
+            if (call->op != irCall) continue;
+            const Inlinee* callee = findInlinee(call->data.name);
+            const char_t* reason = NULL;
+            if (callee == NULL) reason = "no earlier definition the IR can express";
+            else if (callee->body == NULL) reason = callee->reason;
+            else if (growth + callee->size > irInlineLimit * GROWTH_FACTOR) reason = "caller grew too much";
+            if (irInlineReport){
+                if (reason) writeDiagnostic("Not inlining '%s' into '%s': %s.\n", call->data.name, func->name, reason);
+                else writeDiagnostic("Inlining '%s' into '%s', size %u.\n", call->data.name, func->name, (unsigned)callee->size);
+            }
+            if (reason) continue;
+            //The rest of the block moves to a new block at the end, which the outer loop gets to later
+            inlineCall(func, call, j, callee->body);
+            growth += callee->size;
+            changed = 1;
+            break;
+        }
+    }
+    if (!changed) return 0;
+    irApplyReplacements(func);
+    irSweep(func);
+    //Calls and returns with nothing else around them leave jumps between blocks that can be joined
+    irMergeBlocks(func);
+    irNumberValues(func);
+    return 1;
+}
@@ -0,0 +1,444 @@
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#include "utils.h"
+#include "array.h"
+#include "ir/ir.h"
+
+IrFunction* newIrFunction(const char_t* name, Type type, size_t paramCount){
+    New(IrFunction, func, 1);
+    func->name = name;
+    func->type = type;
+    func->paramCount = paramCount;
+    func->valueCount = 0;
+    func->blockCount = 0;
+    if (!arrInit(vptr)(&func->blocks, 4, NULL, NULL)) exit(1);
+    if (!arrInit(vptr)(&func->locals, 4, NULL, &free)) exit(1);
+    if (!arrInit(vptr)(&func->rpo, 4, NULL, NULL)) exit(1);
+    return func;
+}
+
+IrBlock* newIrBlock(IrFunction* func){
+    New(IrBlock, block, 1);
+    block->id = func->blockCount++;
+    block->rpoIndex = SIZE_MAX;
+    block->idom = NULL;
+    block->mark = 0;
+    if (!arrInit(vptr)(&block->instrs, 4, NULL, NULL)) exit(1);
+    if (!arrInit(vptr)(&block->preds, 2, NULL, NULL)) exit(1);
+    if (!arrInit(vptr)(&block->domChildren, 2, NULL, NULL)) exit(1);
+    if (!arrInit(vptr)(&block->frontier, 2, NULL, NULL)) exit(1);
+    if (!arrPush(vptr)(&func->blocks, block)) exit(1);
+    return block;
+}
+
+IrInstr* newIrInstr(IrFunction* func, IrOpcode op, Type type){
+    New(IrInstr, instr, 1);
+    instr->op = op;
+    instr->type = type;
+    instr->cond = irCondE;
+    instr->dead = 0;
+    instr->id = func->valueCount++;
+    instr->block = NULL;
+    instr->replacement = NULL;
+    instr->data.num = 0;
+    instr->targets[0] = instr->targets[1] = NULL;
+    instr->cases = NULL;
+    instr->caseCount = 0;
+    if (!arrInit(vptr)(&instr->args, 2, NULL, NULL)) exit(1);
+    return instr;
+}
+
+size_t newIrLocal(IrFunction* func, Type type, const char_t* name){
+    New(IrLocal, local, 1);
+    local->type = type;
+    local->name = name;
+    if (!arrPush(vptr)(&func->locals, local)) exit(1);
+    return func->locals.size - 1;
+}
+
+static void disposeIrInstr(IrInstr* instr){
+    arrDispose(vptr)(&instr->args);
+    free(instr->cases);
+    free(instr);
+}
+
+static void disposeIrBlock(IrBlock* block){
+    for (size_t i=0; i<block->instrs.size; i++){
+        disposeIrInstr(block->instrs.elem[i]);
+    }
+    arrDispose(vptr)(&block->instrs);
+    arrDispose(vptr)(&block->preds);
+    arrDispose(vptr)(&block->domChildren);
+    arrDispose(vptr)(&block->frontier);
+    free(block);
+}
+
+void disposeIrFunction(IrFunction* func){
+    for (size_t i=0; i<func->blocks.size; i++){
+        disposeIrBlock(func->blocks.elem[i]);
+    }
+    arrDispose(vptr)(&func->blocks);
+    arrDispose(vptr)(&func->locals);
+    arrDispose(vptr)(&func->rpo);
+    free(func);
+}
+
+IrInstr* irAppend(IrBlock* block, IrInstr* instr){
+    assert(irTerminator(block) == NULL && "Can't append after a terminator");
+    return irInsertAt(block, instr, block->instrs.size);
+}
+
+IrInstr* irInsertBeforeTerminator(IrBlock* block, IrInstr* instr){
+    size_t pos = block->instrs.size;
+    if (irTerminator(block)) pos--;
+    return irInsertAt(block, instr, pos);
+}
+
+IrInstr* irInsertAt(IrBlock* block, IrInstr* instr, size_t pos){
+    instr->block = block;
+    if (!arrInsert(vptr)(&block->instrs, instr, pos)) exit(1);
+    if (instr->op == irJmp || instr->op == irBranch || instr->op == irSwitch){
+        for (size_t i=0; i<irSuccCount(block); i++){
+            irAddEdge(block, irSucc(block, i));
+        }
+    }
+    return instr;
+}
+
+IrInstr* irAddArg(IrInstr* instr, IrInstr* arg){
+    if (!arrPush(vptr)(&instr->args, arg)) exit(1);
+    return instr;
+}
+
+//The cases grow by doubling, so the room left runs out whenever the count reaches a power of 2
+void irAddCase(IrInstr* instr, uint64_t num, IrBlock* target){
+    size_t count = instr->caseCount;
+    if ((count & (count - 1)) == 0){
+        IrCase* cases = realloc(instr->cases, sizeof(IrCase) * (count ? count * 2 : 1));
+        if (cases == NULL) exit(1);
+        instr->cases = cases;
+    }
+    instr->cases[count] = (IrCase){num, target};
+    instr->caseCount++;
+}
+
+char irIsTerminator(IrOpcode op){
+    return op == irJmp || op == irBranch || op == irSwitch || op == irRet;
+}
+
+IrInstr* irTerminator(const IrBlock* block){
+    if (block->instrs.size == 0) return NULL;
+    IrInstr* last = block->instrs.elem[block->instrs.size - 1];
+    return irIsTerminator(last->op) ? last : NULL;
+}
+
+size_t irSuccCount(const IrBlock* block){
+    IrInstr* term = irTerminator(block);
+    if (term == NULL) return 0;
+    switch (term->op){
+        case irJmp: return 1;
+        //Both sides of a branch going to the same block still counts as one edge
+        case irBranch: return term->targets[0] == term->targets[1] ? 1 : 2;
+        case irSwitch: return term->caseCount + 1;
+        default: return 0;
+    }
+}
+
+IrBlock* irSucc(const IrBlock* block, size_t i){
+    assert(i < irSuccCount(block) && "Successor out of range");
+    IrInstr* term = irTerminator(block);
+    if (term->op == irSwitch && i > 0) return term->cases[i - 1].target;
+    return term->targets[i];
+}
+
+//Points every target of the terminator that's oldTo at newTo
+static void replaceTarget(IrInstr* term, IrBlock* oldTo, IrBlock* newTo){
+    for (int i=0; i<2; i++){
+        if (term->targets[i] == oldTo) term->targets[i] = newTo;
+    }
+    for (size_t i=0; i<term->caseCount; i++){
+        if (term->cases[i].target == oldTo) term->cases[i].target = newTo;
+    }
+}
+
+size_t irPredIndex(const IrBlock* block, const IrBlock* pred){
+    for (size_t i=0; i<block->preds.size; i++){
+        if (block->preds.elem[i] == pred) return i;
+    }
+    return SIZE_MAX;
+}
+
+char irHasValue(const IrInstr* instr){
+    return instr->type != typNone && instr->type != typVoid;
+}
+
+uint64_t irExtendConst(uint64_t num, Type type){
+    size_t bits = typeSize(type) * 8;
+    if (bits == 64) return num;
+    uint64_t mask = ((uint64_t)1 << bits) - 1;
+    num &= mask;
+    if (isSignedType(type) && (num >> (bits - 1))){
+        num |= ~mask;
+    }
+    return num;
+}
+
+char irHasSideEffects(const IrInstr* instr){
+    switch (instr->op){
+        case irStore:
+        case irCall:
+        case irJmp:
+        case irBranch:
+        case irSwitch:
+        case irRet:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+void irNumberValues(IrFunction* func){
+    size_t valueCount = 0;
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        block->id = i;
+        for (size_t j=0; j<block->instrs.size; j++){
+            ((IrInstr*)block->instrs.elem[j])->id = valueCount++;
+        }
+    }
+    func->valueCount = valueCount;
+    func->blockCount = func->blocks.size;
+}
+
+void irAddEdge(IrBlock* from, IrBlock* to){
+    if (irPredIndex(to, from) == SIZE_MAX){
+        if (!arrPush(vptr)(&to->preds, from)) exit(1);
+    }
+}
+
+void irRemoveEdge(IrBlock* from, IrBlock* to){
+    size_t index = irPredIndex(to, from);
+    if (index == SIZE_MAX) return;
+    arrExtract(vptr)(&to->preds, index);
+    for (size_t i=0; i<to->instrs.size; i++){
+        IrInstr* phi = to->instrs.elem[i];
+        if (phi->op != irPhi) break;
+        arrExtract(vptr)(&phi->args, index);
+    }
+}
+
+//Redirect the edge from->oldTo to newTo. The phis in newTo must be given args by the caller
+void irRetarget(IrBlock* from, IrBlock* oldTo, IrBlock* newTo){
+    IrInstr* term = irTerminator(from);
+    assert((term->op != irSwitch || irPredIndex(newTo, from) == SIZE_MAX) && "Switch targets have to stay different");
+    replaceTarget(term, oldTo, newTo);
+    //Both branch targets may now be the same block, in which case the branch becomes a jump
+    if (term->op == irBranch && term->targets[0] == term->targets[1]){
+        term->op = irJmp;
+        term->args.size = 0;
+    }
+    irRemoveEdge(from, oldTo);
+    irAddEdge(from, newTo);
+}
+
+//Put a new block on the edge, keeping the phis in to pointing at the same values
+IrBlock* irSplitEdge(IrFunction* func, IrBlock* from, IrBlock* to){
+    IrBlock* mid = newIrBlock(func);
+    size_t index = irPredIndex(to, from);
+    assert(index != SIZE_MAX && "Splitting an edge that doesn't exist");
+    to->preds.elem[index] = mid;
+    replaceTarget(irTerminator(from), to, mid);
+    if (!arrPush(vptr)(&mid->preds, from)) exit(1);
+    IrInstr* jmp = newIrInstr(func, irJmp, typNone);
+    jmp->targets[0] = to;
+    jmp->block = mid;
+    if (!arrPush(vptr)(&mid->instrs, jmp)) exit(1);
+    return mid;
+}
+
+//Edges from blocks with multiple successors to blocks with multiple predecessors get their own block,
+//so that phi copies can be placed on the edge
+void irSplitCriticalEdges(IrFunction* func){
+    size_t count = func->blocks.size;
+    for (size_t i=0; i<count; i++){
+        IrBlock* block = func->blocks.elem[i];
+        if (irSuccCount(block) < 2) continue;
+        for (size_t j=0; j<irSuccCount(block); j++){
+            IrBlock* succ = irSucc(block, j);
+            if (succ->preds.size > 1){
+                irSplitEdge(func, block, succ);
+            }
+        }
+    }
+}
+
+void irReplaceUses(IrInstr* instr, IrInstr* replacement){
+    assert(instr != replacement && "Replacing value with itself");
+    instr->replacement = replacement;
+}
+
+IrInstr* irResolve(IrInstr* instr){
+    IrInstr* resolved = instr;
+    while (resolved->replacement) resolved = resolved->replacement;
+    //Shorten the chain for later lookups
+    while (instr->replacement && instr->replacement != resolved){
+        IrInstr* next = instr->replacement;
+        instr->replacement = resolved;
+        instr = next;
+    }
+    return resolved;
+}
+
+void irApplyReplacements(IrFunction* func){
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            for (size_t k=0; k<instr->args.size; k++){
+                instr->args.elem[k] = irResolve(instr->args.elem[k]);
+            }
+        }
+    }
+}
+
+void irErase(IrInstr* instr){
+    instr->dead = 1;
+}
+
+//Removes erased instructions. Replacements must have been applied first, since erased instructions are freed
+void irSweep(IrFunction* func){
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        size_t kept = 0;
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            if (instr->dead){
+                disposeIrInstr(instr);
+            }
+            else{
+                block->instrs.elem[kept++] = instr;
+            }
+        }
+        block->instrs.size = kept;
+    }
+}
+
+static void markReachable(IrBlock* block){
+    if (block->mark) return;
+    block->mark = 1;
+    for (size_t i=0; i<irSuccCount(block); i++){
+        markReachable(irSucc(block, i));
+    }
+}
+
+//Deletes blocks that can't be reached from the entry block
+void irRemoveUnreachable(IrFunction* func){
+    for (size_t i=0; i<func->blocks.size; i++){
+        ((IrBlock*)func->blocks.elem[i])->mark = 0;
+    }
+    markReachable(func->blocks.elem[0]);
+    Array(vptr) dead;
+    if (!arrInit(vptr)(&dead, 4, NULL, NULL)) exit(1);
+    size_t kept = 0;
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        if (block->mark){
+            func->blocks.elem[kept++] = block;
+            continue;
+        }
+        for (size_t j=0; j<irSuccCount(block); j++){
+            irRemoveEdge(block, irSucc(block, j));
+        }
+        if (!arrPush(vptr)(&dead, block)) exit(1);
+    }
+    func->blocks.size = kept;
+    //Dead blocks can only be used by other dead blocks, so they can be freed after all edges are gone
+    for (size_t i=0; i<dead.size; i++){
+        disposeIrBlock(dead.elem[i]);
+    }
+    arrDispose(vptr)(&dead);
+}
+
+// Folds a block into its pred when the pred jumps straight to it and nothing else does
+void irMergeBlocks(IrFunction* func){
+    for (size_t i=0; i<func->blocks.size; i++){
+        ((IrBlock*)func->blocks.elem[i])->mark = 0;
+    }
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        if (block->mark) continue;
+        IrInstr* term = irTerminator(block);
+        while (term->op == irJmp){
+            IrBlock* next = term->targets[0];
+            if (next == block || next->preds.size != 1 || next == func->blocks.elem[0]) break;
+            //With only one pred, phis just pass on their only arg. They stay behind to be freed with their block
+            size_t start = 0;
+            while (start < next->instrs.size && ((IrInstr*)next->instrs.elem[start])->op == irPhi){
+                IrInstr* phi = next->instrs.elem[start++];
+                irReplaceUses(phi, phi->args.elem[0]);
+            }
+            block->instrs.size--;
+            disposeIrInstr(term);
+            for (size_t j=start; j<next->instrs.size; j++){
+                IrInstr* instr = next->instrs.elem[j];
+                instr->block = block;
+                if (!arrPush(vptr)(&block->instrs, instr)) exit(1);
+            }
+            next->instrs.size = start;
+            for (size_t j=0; j<irSuccCount(block); j++){
+                IrBlock* succ = irSucc(block, j);
+                succ->preds.elem[irPredIndex(succ, next)] = block;
+            }
+            next->mark = 1;
+            term = irTerminator(block);
+        }
+    }
+    irApplyReplacements(func);
+    size_t kept = 0;
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        if (block->mark && i > 0){
+            disposeIrBlock(block);
+        }
+        else{
+            func->blocks.elem[kept++] = block;
+        }
+    }
+    func->blocks.size = kept;
+}
+
+IrCond irNegateCond(IrCond cond){
+    switch (cond){
+        case irCondE: return irCondNE;
+        case irCondNE: return irCondE;
+        case irCondL: return irCondGE;
+        case irCondLE: return irCondG;
+        case irCondG: return irCondLE;
+        case irCondGE: return irCondL;
+        case irCondB: return irCondAE;
+        case irCondBE: return irCondA;
+        case irCondA: return irCondBE;
+        case irCondAE: return irCondB;
+        default:
+            assert(0 && "Not a condition code");
+    }
+}
+
+//Condition that holds when the operands are swapped
+IrCond irSwapCond(IrCond cond){
+    switch (cond){
+        case irCondE: return irCondE;
+        case irCondNE: return irCondNE;
+        case irCondL: return irCondG;
+        case irCondLE: return irCondGE;
+        case irCondG: return irCondL;
+        case irCondGE: return irCondLE;
+        case irCondB: return irCondA;
+        case irCondBE: return irCondAE;
+        case irCondA: return irCondB;
+        case irCondAE: return irCondBE;
+        default:
+            assert(0 && "Not a condition code");
+    }
+}
@@ -0,0 +1,179 @@
+#pragma once
+#include "utils.h"
+#include "array.h"
+#include "ast/ast.h"
+#include "ast/type.h"
+#include <stdint.h>
+// Mid-level SSA IR. Every function is a CFG of basic blocks holding three-address instructions.
+// Instructions double as the values they produce, so operands are pointers to other instructions
+
+typedef enum {
+    irConst,    //Integer constant in data.num, sign or zero extended to 64 bits according to its type
+    irParam,    //Incoming parameter number data.index. Only found in the entry block
+    irLoad,     //Read local variable data.index. Removed by mem2reg
+    irStore,    //Write args[0] to local variable data.index. Removed by mem2reg
+    irCopy,
+    irConv,     //args[0] converted to the instruction's type, by extending or dropping upper bits
+    irNeg,
+    irNot,      //1 if args[0] is 0, otherwise 0
+    irAdd,
+    irSub,
+    irMul,
+    irDiv,
+    irCmp,      //1 if args[0] cond args[1], otherwise 0
+    irSelect,   //args[1] if args[0] is not 0, otherwise args[2]
+    irCall,     //Call function data.name with args
+    irPhi,      //One arg for each of the block's preds, in the same order
+    //Terminators, which are always the last instruction of a block
+    irJmp,      //Go to targets[0]
+    irBranch,   //Go to targets[0] if args[0] is not 0, otherwise targets[1]
+    irSwitch,   //Go to the target of the case whose num equals args[0], or to targets[0] if none do
+    irRet       //Return args[0], or nothing if there are no args
+} IrOpcode;
+
+//Same order as the condition codes in codegen, so they can index its opcode tables
+typedef enum {
+    irCondE, irCondNE,
+    irCondL, irCondLE, irCondG, irCondGE,
+    irCondB, irCondBE, irCondA, irCondAE
+} IrCond;
+
+typedef struct IrBlock IrBlock;
+typedef struct IrInstr IrInstr;
+
+typedef struct {
+    uint64_t num;   //Extended to 64 bits like a constant of the switch value's type
+    IrBlock* target;
+} IrCase;
+
+struct IrInstr {
+    IrOpcode op;
+    Type type;      //Type of the produced value, typNone if nothing is produced
+    IrCond cond;
+    char dead;      //Set when the instruction is erased. Swept out of its block by irSweep
+    size_t id;      //Value number, only meaningful for dumps
+    IrBlock* block;
+    IrInstr* replacement;   //Set by irReplaceUses. Operands are redirected by irApplyReplacements
+    Array(vptr) args;
+    union {
+        uint64_t num;
+        size_t index;
+        const char_t* name;     //Points into the AST, which outlives the IR and the emitted assembly
+    } data;
+    IrBlock* targets[2];
+    //Cases of an irSwitch. Its successors are targets[0] followed by the case targets, which are all different blocks
+    IrCase* cases;
+    size_t caseCount;
+};
+
+struct IrBlock {
+    size_t id;
+    Array(vptr) instrs; //Phis first, then a terminator at the end
+    Array(vptr) preds;
+    //Filled in by irComputeDominators
+    size_t rpoIndex;    //Position in reverse postorder. Unreachable blocks get SIZE_MAX
+    IrBlock* idom;
+    Array(vptr) domChildren;
+    Array(vptr) frontier;
+    //Scratch field for passes
+    size_t mark;
+};
+
+typedef struct {
+    Type type;
+    const char_t* name;     //Null for temporaries made by the builder
+} IrLocal;
+
+typedef struct IrFunction {
+    const char_t* name;
+    Type type;
+    size_t paramCount;
+    Array(vptr) blocks;     //Entry block comes first
+    Array(vptr) locals;
+    Array(vptr) rpo;        //Reachable blocks in reverse postorder, filled in by irComputeDominators
+    size_t valueCount;
+    size_t blockCount;
+} IrFunction;
+
+//Construction
+IrFunction* newIrFunction(const char_t* name, Type type, size_t paramCount);
+IrBlock* newIrBlock(IrFunction* func);
+IrInstr* newIrInstr(IrFunction* func, IrOpcode op, Type type);
+size_t newIrLocal(IrFunction* func, Type type, const char_t* name);
+void disposeIrFunction(IrFunction* func);
+
+//Instructions are appended to the end of the block, or inserted right before its terminator
+IrInstr* irAppend(IrBlock* block, IrInstr* instr);
+IrInstr* irInsertBeforeTerminator(IrBlock* block, IrInstr* instr);
+IrInstr* irInsertAt(IrBlock* block, IrInstr* instr, size_t pos);
+IrInstr* irAddArg(IrInstr* instr, IrInstr* arg);
+void irAddCase(IrInstr* instr, uint64_t num, IrBlock* target);
+
+IrInstr* irTerminator(const IrBlock* block);
+size_t irSuccCount(const IrBlock* block);
+IrBlock* irSucc(const IrBlock* block, size_t i);
+size_t irPredIndex(const IrBlock* block, const IrBlock* pred);
+char irHasValue(const IrInstr* instr);
+char irIsTerminator(IrOpcode op);
+char irHasSideEffects(const IrInstr* instr);
+//Extends the lower bits of num that fit in the type into a constant of that type
+uint64_t irExtendConst(uint64_t num, Type type);
+//Gives values and blocks consecutive ids in block order
+void irNumberValues(IrFunction* func);
+
+//Edges. Removing an edge also removes the matching phi args
+void irAddEdge(IrBlock* from, IrBlock* to);
+void irRemoveEdge(IrBlock* from, IrBlock* to);
+void irRetarget(IrBlock* from, IrBlock* oldTo, IrBlock* newTo);
+IrBlock* irSplitEdge(IrFunction* func, IrBlock* from, IrBlock* to);
+void irSplitCriticalEdges(IrFunction* func);
+
+//Erasing and replacing are lazy, so that whole passes can be done before operands are patched
+void irReplaceUses(IrInstr* instr, IrInstr* replacement);
+IrInstr* irResolve(IrInstr* instr);
+void irApplyReplacements(IrFunction* func);
+void irErase(IrInstr* instr);
+void irSweep(IrFunction* func);
+void irRemoveUnreachable(IrFunction* func);
+void irMergeBlocks(IrFunction* func);
+
+//Analyses
+void irComputeDominators(IrFunction* func);
+char irDominates(const IrBlock* a, const IrBlock* b);
+
+//Building from a verified AST. Returns null if the function uses something the IR can't express, ie. floats
+IrFunction* irBuildFunction(Function* func);
+
+//Passes
+char irMem2Reg(IrFunction* func);
+char irSccp(IrFunction* func);
+char irGvn(IrFunction* func);
+char irLicm(IrFunction* func);
+char irDce(IrFunction* func);
+char irInline(IrFunction* func);
+char irTailRecursion(IrFunction* func);
+char irIfConvert(IrFunction* func);
+//Orders blocks for fallthrough. Not a pass, since lowering runs it after splitting critical edges
+void irLayoutBlocks(IrFunction* func);
+
+typedef struct {
+    const char_t* name;
+    char (*run)(IrFunction* func);  //Returns whether anything changed
+    int minOptLevel;
+} IrPass;
+void irOptimize(IrFunction* func, int optLevel);
+extern char irVerifyEachPass;
+
+//Inlining. Optimized functions are offered as callees for the functions after them
+void irInitInlining();
+void irDisposeInlining();
+void irOfferInlinee(IrFunction* func);
+extern size_t irInlineLimit;    //Biggest callee that gets inlined, in instructions. 0 turns inlining off
+extern char irInlineReport;     //Whether each call's inlining decision is printed to stderr
+
+//Testing and debugging
+char irVerify(IrFunction* func);
+void irDump(IrFunction* func);
+const char_t* irOpcodeStr(IrOpcode op);
+IrCond irNegateCond(IrCond cond);
+IrCond irSwapCond(IrCond cond);
@@ -0,0 +1,163 @@
+#include <assert.h>
+#include <stdint.h>
+#include "utils.h"
+#include "array.h"
+#include "ir/ir.h"
+// Orders blocks so that the likely successor of each block comes right after it, letting the jump to it fall through.
+// Loops whose header tests the condition are rotated: the body goes first and the header right after the latch,
+// so each iteration only takes the conditional branch back to the top of the body.
+// Returns that come before the last one are assumed to be early exits and are moved out of line to the end
+
+typedef enum {
+    layUnplaced,
+    layPlaced,
+    layDeferred     //Rotated loop header, placed once a latch reaches it
+} LayoutState;
+
+static IrBlock** loopOf;    //Innermost loop header of each block, indexed by block id
+static IrBlock** outerOf;   //Header of the loop around each loop header, indexed by block id
+static char* cold;          //Indexed by block id
+static Array(vptr) order;
+
+static char inLoop(const IrBlock* block, const IrBlock* header){
+    for (IrBlock* loop = loopOf[block->id]; loop != NULL; loop = outerOf[loop->id]){
+        if (loop == header) return 1;
+    }
+    return 0;
+}
+
+// Natural loops are found by walking back from each latch to the header. Headers come before the loops inside them in
+// reverse postorder, so the innermost loop is the last to claim a block
+static void findLoops(IrFunction* func, Array(vptr)* worklist){
+    for (size_t i=0; i<func->rpo.size; i++){
+        IrBlock* header = func->rpo.elem[i];
+        size_t stamp = i + 1;
+        for (size_t j=0; j<header->preds.size; j++){
+            IrBlock* latch = header->preds.elem[j];
+            if (latch->rpoIndex == SIZE_MAX || !irDominates(header, latch)) continue;
+            if (header->mark != stamp){
+                header->mark = stamp;
+                outerOf[header->id] = loopOf[header->id];
+                loopOf[header->id] = header;
+            }
+            if (latch->mark == stamp) continue;
+            latch->mark = stamp;
+            if (!arrPush(vptr)(worklist, latch)) exit(1);
+        }
+        while (worklist->size){
+            IrBlock* block = arrPop(vptr)(worklist);
+            loopOf[block->id] = header;
+            for (size_t j=0; j<block->preds.size; j++){
+                IrBlock* pred = block->preds.elem[j];
+                if (pred->mark == stamp || pred->rpoIndex == SIZE_MAX) continue;
+                pred->mark = stamp;
+                if (!arrPush(vptr)(worklist, pred)) exit(1);
+            }
+        }
+    }
+}
+
+// A header is rotated if it branches into the loop or out of it and a latch can fall through into it
+static IrBlock* rotatedBody(IrFunction* func, IrBlock* header){
+    if (header == func->blocks.elem[0] || loopOf[header->id] != header) return NULL;
+    IrInstr* term = irTerminator(header);
+    if (term->op != irBranch || term->targets[0] == term->targets[1]) return NULL;
+    char firstIn = inLoop(term->targets[0], header);
+    char secondIn = inLoop(term->targets[1], header);
+    if (firstIn == secondIn) return NULL;
+    IrBlock* body = term->targets[firstIn ? 0 : 1];
+    if (body == header || body->mark != layUnplaced) return NULL;
+    for (size_t i=0; i<header->preds.size; i++){
+        IrBlock* pred = header->preds.elem[i];
+        if (inLoop(pred, header) && irTerminator(pred)->op == irJmp) return body;
+    }
+    return NULL;
+}
+
+// Staying in the loop beats leaving it and anything beats an early return. Otherwise source order is kept
+static char isLikelier(const IrBlock* from, const IrBlock* a, const IrBlock* b){
+    if (cold[a->id] != cold[b->id]) return cold[b->id];
+    IrBlock* loop = loopOf[from->id];
+    if (loop != NULL){
+        char aIn = inLoop(a, loop);
+        char bIn = inLoop(b, loop);
+        if (aIn != bIn) return aIn;
+    }
+    return 0;
+}
+
+static IrBlock* pickSucc(const IrBlock* block){
+    IrBlock* best = NULL;
+    for (size_t i=0; i<irSuccCount(block); i++){
+        IrBlock* succ = irSucc(block, i);
+        if (succ->mark == layPlaced) continue;
+        //Rotated headers go after a latch, not after the block entering the loop
+        if (succ->mark == layDeferred && !inLoop(block, succ)) continue;
+        if (best == NULL || isLikelier(block, succ, best)) best = succ;
+    }
+    return best;
+}
+
+// Places blocks for as long as each one has a successor that can fall through
+static void placeChain(IrFunction* func, IrBlock* block){
+    while (block != NULL){
+        if (block->mark == layUnplaced){
+            IrBlock* body = rotatedBody(func, block);
+            if (body != NULL){
+                block->mark = layDeferred;
+                block = body;
+                continue;
+            }
+        }
+        block->mark = layPlaced;
+        if (!arrPush(vptr)(&order, block)) exit(1);
+        block = pickSucc(block);
+    }
+}
+
+void irLayoutBlocks(IrFunction* func){
+    irNumberValues(func);
+    irComputeDominators(func);
+    size_t count = func->blocks.size;
+    New(IrBlock*, loops, count);
+    New(IrBlock*, outers, count);
+    New(char, coldBlocks, count);
+    loopOf = loops;
+    outerOf = outers;
+    cold = coldBlocks;
+    Array(vptr) worklist;
+    if (!arrInit(vptr)(&worklist, 8, NULL, NULL)) exit(1);
+    if (!arrInit(vptr)(&order, count, NULL, NULL)) exit(1);
+    char laterReturn = 0;
+    for (size_t i=count; i-- > 0;){
+        IrBlock* block = func->blocks.elem[i];
+        loopOf[i] = outerOf[i] = NULL;
+        block->mark = 0;
+        char isReturn = irTerminator(block)->op == irRet;
+        cold[i] = isReturn && laterReturn && i != 0;
+        if (isReturn) laterReturn = 1;
+    }
+    findLoops(func, &worklist);
+
+    for (size_t i=0; i<count; i++){
+        ((IrBlock*)func->blocks.elem[i])->mark = layUnplaced;
+    }
+    placeChain(func, func->blocks.elem[0]);
+    //Whatever isn't reached by falling through is placed in source order, with early returns last
+    for (int pass=0; pass<2; pass++){
+        for (size_t i=0; i<count; i++){
+            IrBlock* block = func->blocks.elem[i];
+            if (block->mark != layPlaced && cold[i] == pass) placeChain(func, block);
+        }
+    }
+    assert(order.size == count && "Every block is placed once");
+    for (size_t i=0; i<count; i++){
+        func->blocks.elem[i] = order.elem[i];
+    }
+
+    arrDispose(vptr)(&order);
+    arrDispose(vptr)(&worklist);
+    free(loopOf);
+    free(outerOf);
+    free(cold);
+}
@@ -0,0 +1,198 @@
+#include <assert.h>
+#include <stdint.h>
+#include "utils.h"
+#include "array.h"
+#include "ir/ir.h"
+// Loop invariant code motion. Natural loops are found from back edges, which go to a block that dominates them,
+// and every loop is given a preheader that runs once before entering it. Pure instructions whose operands all come
+// from outside the loop are moved into the preheader, working from the innermost loops outwards.
+// Variables changed in the loop are phis in its header, so anything using them stays put, and so do calls
+
+typedef struct {
+    IrBlock* header;
+    IrBlock* preheader;
+    Array(vptr) blocks;     //Loop body including the header, in reverse postorder
+} Loop;
+
+static char isBackEdge(const IrBlock* from, const IrBlock* header){
+    return from->rpoIndex != SIZE_MAX && irDominates(header, from);
+}
+
+// Preds of the header that aren't back edges all jump to the preheader instead
+static void makePreheader(IrFunction* func, IrBlock* header){
+    Array(vptr) outside;
+    if (!arrInit(vptr)(&outside, 2, NULL, NULL)) exit(1);
+    for (size_t i=0; i<header->preds.size; i++){
+        IrBlock* pred = header->preds.elem[i];
+        if (!isBackEdge(pred, header)){
+            if (!arrPush(vptr)(&outside, pred)) exit(1);
+        }
+    }
+    if (outside.size == 1){
+        IrBlock* pred = outside.elem[0];
+        //A block that only goes to the header is already a preheader
+        if (irSuccCount(pred) > 1) irSplitEdge(func, pred, header);
+        arrDispose(vptr)(&outside);
+        return;
+    }
+    IrBlock* preheader = newIrBlock(func);
+    for (size_t i=0; i<header->instrs.size; i++){
+        IrInstr* phi = header->instrs.elem[i];
+        if (phi->op != irPhi) break;
+        IrInstr* outer = newIrInstr(func, irPhi, phi->type);
+        outer->data.index = phi->data.index;
+        for (size_t j=0; j<outside.size; j++){
+            irAddArg(outer, phi->args.elem[irPredIndex(header, outside.elem[j])]);
+        }
+        irAppend(preheader, outer);
+    }
+    for (size_t j=0; j<outside.size; j++){
+        irRetarget(outside.elem[j], header, preheader);
+    }
+    IrInstr* jmp = newIrInstr(func, irJmp, typNone);
+    jmp->targets[0] = header;
+    irAppend(preheader, jmp);
+    for (size_t i=0; i<header->instrs.size; i++){
+        IrInstr* phi = header->instrs.elem[i];
+        if (phi->op != irPhi) break;
+        irAddArg(phi, preheader->instrs.elem[i]);
+    }
+    arrDispose(vptr)(&outside);
+}
+
+// Walks back from the latches to the header, marking the body with stamp
+static void findBody(Loop* loop, size_t stamp, Array(vptr)* worklist){
+    IrBlock* header = loop->header;
+    header->mark = stamp;
+    for (size_t i=0; i<header->preds.size; i++){
+        IrBlock* pred = header->preds.elem[i];
+        if (!isBackEdge(pred, header)){
+            loop->preheader = pred;
+        }
+        else if (pred->mark != stamp){
+            pred->mark = stamp;
+            if (!arrPush(vptr)(worklist, pred)) exit(1);
+        }
+    }
+    while (worklist->size){
+        IrBlock* block = arrPop(vptr)(worklist);
+        for (size_t i=0; i<block->preds.size; i++){
+            IrBlock* pred = block->preds.elem[i];
+            if (pred->mark == stamp || pred->rpoIndex == SIZE_MAX) continue;
+            pred->mark = stamp;
+            if (!arrPush(vptr)(worklist, pred)) exit(1);
+        }
+    }
+}
+
+static char isHoistable(const IrInstr* instr){
+    switch (instr->op){
+        case irConst:
+        case irCopy:
+        case irConv:
+        case irNeg:
+        case irNot:
+        case irAdd:
+        case irSub:
+        case irMul:
+        case irCmp:
+        case irSelect:
+            return 1;
+        case irDiv: {
+            //The loop might not run at all, so only divisions that can't trap are moved
+            const IrInstr* divisor = instr->args.elem[1];
+            return divisor->op == irConst && divisor->data.num != 0 && divisor->data.num != UINT64_MAX;
+        }
+        default:
+            return 0;
+    }
+}
+
+static char hoist(Loop* loop, size_t stamp){
+    char changed = 0;
+    for (size_t i=0; i<loop->blocks.size; i++){
+        IrBlock* block = loop->blocks.elem[i];
+        size_t kept = 0;
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            char invariant = isHoistable(instr);
+            for (size_t k=0; k<instr->args.size && invariant; k++){
+                if (((IrInstr*)instr->args.elem[k])->block->mark == stamp) invariant = 0;
+            }
+            if (invariant){
+                irInsertBeforeTerminator(loop->preheader, instr);
+                changed = 1;
+            }
+            else{
+                block->instrs.elem[kept++] = instr;
+            }
+        }
+        block->instrs.size = kept;
+    }
+    return changed;
+}
+
+char irLicm(IrFunction* func){
+    irComputeDominators(func);
+    //New preheaders aren't in rpo until dominators are computed again
+    for (size_t i=0; i<func->rpo.size; i++){
+        IrBlock* header = func->rpo.elem[i];
+        for (size_t j=0; j<header->preds.size; j++){
+            if (isBackEdge(header->preds.elem[j], header)){
+                makePreheader(func, header);
+                break;
+            }
+        }
+    }
+    irComputeDominators(func);
+
+    Array(vptr) loops;
+    Array(vptr) worklist;
+    if (!arrInit(vptr)(&loops, 4, NULL, NULL)) exit(1);
+    if (!arrInit(vptr)(&worklist, 8, NULL, NULL)) exit(1);
+    for (size_t i=0; i<func->blocks.size; i++){
+        ((IrBlock*)func->blocks.elem[i])->mark = 0;
+    }
+    for (size_t i=0; i<func->rpo.size; i++){
+        IrBlock* header = func->rpo.elem[i];
+        char isHeader = 0;
+        for (size_t j=0; j<header->preds.size; j++){
+            if (isBackEdge(header->preds.elem[j], header)) isHeader = 1;
+        }
+        if (!isHeader) continue;
+        New(Loop, loop, 1);
+        loop->header = header;
+        loop->preheader = NULL;
+        if (!arrInit(vptr)(&loop->blocks, 4, NULL, NULL)) exit(1);
+        size_t stamp = loops.size + 1;
+        findBody(loop, stamp, &worklist);
+        for (size_t j=i; j<func->rpo.size; j++){
+            IrBlock* block = func->rpo.elem[j];
+            if (block->mark == stamp){
+                if (!arrPush(vptr)(&loop->blocks, block)) exit(1);
+            }
+        }
+        //Inner loops are smaller than the loops around them, so keeping loops sorted by size puts them first
+        size_t pos = loops.size;
+        while (pos > 0 && ((Loop*)loops.elem[pos - 1])->blocks.size > loop->blocks.size) pos--;
+        if (!arrInsert(vptr)(&loops, loop, pos)) exit(1);
+    }
+
+    char changed = 0;
+    for (size_t i=0; i<loops.size; i++){
+        Loop* loop = loops.elem[i];
+        //Marks get overwritten by other loops, so the body is marked again
+        for (size_t j=0; j<loop->blocks.size; j++){
+            ((IrBlock*)loop->blocks.elem[j])->mark = SIZE_MAX;
+        }
+        if (hoist(loop, SIZE_MAX)) changed = 1;
+        for (size_t j=0; j<loop->blocks.size; j++){
+            ((IrBlock*)loop->blocks.elem[j])->mark = 0;
+        }
+        arrDispose(vptr)(&loop->blocks);
+        free(loop);
+    }
+    arrDispose(vptr)(&loops);
+    arrDispose(vptr)(&worklist);
+    return changed;
+}
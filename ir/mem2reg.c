@@ -0,0 +1,227 @@
+#include <assert.h>
+#include <stdint.h>
+#include "utils.h"
+#include "array.h"
+#include "ir/ir.h"
+// Promotes locals into SSA values. Phis are placed on the iterated dominance frontier of each local's stores,
+// then loads are renamed to the reaching value with a walk down the dominator tree
+
+// Stack of reaching values for each local
+static Array(vptr)* reaching;
+// Locals pushed onto reaching, so each block can pop what it pushed
+static Array(size_t) pushed;
+// Locals read before being written get a 0, which is put in the entry block once renaming is done
+static IrInstr** undefValues;
+static IrFunction* curFunc;
+
+static IrInstr* undefValue(size_t local){
+    if (undefValues[local] == NULL){
+        IrInstr* zero = newIrInstr(curFunc, irConst, ((IrLocal*)curFunc->locals.elem[local])->type);
+        zero->data.num = 0;
+        undefValues[local] = zero;
+    }
+    return undefValues[local];
+}
+
+static IrInstr* currentValue(size_t local){
+    Array(vptr)* stack = &reaching[local];
+    return stack->size ? stack->elem[stack->size - 1] : undefValue(local);
+}
+
+static void pushValue(size_t local, IrInstr* value){
+    if (!arrPush(vptr)(&reaching[local], value)) exit(1);
+    if (!arrPush(size_t)(&pushed, local)) exit(1);
+}
+
+static void placePhis(IrFunction* func, size_t local, Array(vptr)* worklist){
+    IrLocal* var = func->locals.elem[local];
+    // Marks track which blocks have already been given a phi (2) or queued (1) for this local
+    for (size_t i=0; i<func->blocks.size; i++){
+        ((IrBlock*)func->blocks.elem[i])->mark = 0;
+    }
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            if (instr->op == irStore && instr->data.index == local){
+                block->mark = 1;
+                if (!arrPush(vptr)(worklist, block)) exit(1);
+                break;
+            }
+        }
+    }
+    while (worklist->size){
+        IrBlock* block = arrPop(vptr)(worklist);
+        for (size_t i=0; i<block->frontier.size; i++){
+            IrBlock* join = block->frontier.elem[i];
+            if (join->mark == 2) continue;
+            IrInstr* phi = newIrInstr(func, irPhi, var->type);
+            phi->data.index = local;
+            for (size_t j=0; j<join->preds.size; j++){
+                irAddArg(phi, NULL);
+            }
+            irInsertAt(join, phi, 0);
+            // A phi is also a store, so its block's frontier needs phis too
+            if (join->mark == 0){
+                if (!arrPush(vptr)(worklist, join)) exit(1);
+            }
+            join->mark = 2;
+        }
+    }
+}
+
+static void renameBlock(IrBlock* block){
+    size_t pushedBefore = pushed.size;
+    for (size_t i=0; i<block->instrs.size; i++){
+        IrInstr* instr = block->instrs.elem[i];
+        switch (instr->op){
+            case irPhi:
+                pushValue(instr->data.index, instr);
+                break;
+            case irLoad:
+                irReplaceUses(instr, currentValue(instr->data.index));
+                irErase(instr);
+                break;
+            case irStore:
+                pushValue(instr->data.index, irResolve(instr->args.elem[0]));
+                irErase(instr);
+                break;
+        }
+    }
+    for (size_t i=0; i<irSuccCount(block); i++){
+        IrBlock* succ = irSucc(block, i);
+        size_t index = irPredIndex(succ, block);
+        for (size_t j=0; j<succ->instrs.size; j++){
+            IrInstr* phi = succ->instrs.elem[j];
+            if (phi->op != irPhi) break;
+            phi->args.elem[index] = currentValue(phi->data.index);
+        }
+    }
+    for (size_t i=0; i<block->domChildren.size; i++){
+        renameBlock(block->domChildren.elem[i]);
+    }
+    while (pushed.size > pushedBefore){
+        arrPop(vptr)(&reaching[arrPop(size_t)(&pushed)]);
+    }
+}
+
+// Phis whose args are all the same value (or the phi itself) are just that value
+static char removeTrivialPhis(IrFunction* func){
+    char changed = 0;
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* phi = block->instrs.elem[j];
+            if (phi->op != irPhi) break;
+            if (phi->dead) continue;
+            IrInstr* same = NULL;
+            char trivial = 1;
+            for (size_t k=0; k<phi->args.size; k++){
+                IrInstr* arg = irResolve(phi->args.elem[k]);
+                if (arg == phi || arg == same) continue;
+                if (same != NULL){
+                    trivial = 0;
+                    break;
+                }
+                same = arg;
+            }
+            if (trivial && same != NULL){
+                irReplaceUses(phi, same);
+                irErase(phi);
+                changed = 1;
+            }
+        }
+    }
+    return changed;
+}
+
+// Live phis have their id set to SIZE_MAX until the dead ones are erased
+static void markLivePhi(IrInstr* phi){
+    if (phi->op != irPhi || phi->id == SIZE_MAX) return;
+    phi->id = SIZE_MAX;
+    for (size_t i=0; i<phi->args.size; i++){
+        markLivePhi(phi->args.elem[i]);
+    }
+}
+
+// Phis that only feed other phis are dead. Anything used by a real instruction keeps its phis alive
+static void removeDeadPhis(IrFunction* func){
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            if (instr->op == irPhi) instr->id = 0;
+        }
+    }
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            if (instr->op == irPhi || instr->dead) continue;
+            for (size_t k=0; k<instr->args.size; k++){
+                markLivePhi(instr->args.elem[k]);
+            }
+        }
+    }
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            if (instr->op == irPhi && instr->id != SIZE_MAX) irErase(instr);
+        }
+    }
+}
+
+char irMem2Reg(IrFunction* func){
+    char hasLocals = 0;
+    for (size_t i=0; i<func->blocks.size && !hasLocals; i++){
+        IrBlock* block = func->blocks.elem[i];
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrOpcode op = ((IrInstr*)block->instrs.elem[j])->op;
+            assert(op != irPhi && "mem2reg expects a function without phis");
+            if (op == irLoad || op == irStore){
+                hasLocals = 1;
+                break;
+            }
+        }
+    }
+    if (!hasLocals){
+        return 0;
+    }
+    curFunc = func;
+    irRemoveUnreachable(func);
+    irComputeDominators(func);
+
+    Array(vptr) worklist;
+    if (!arrInit(vptr)(&worklist, 4, NULL, NULL)) exit(1);
+    for (size_t i=0; i<func->locals.size; i++){
+        placePhis(func, i, &worklist);
+    }
+    arrDispose(vptr)(&worklist);
+
+    New(Array(vptr), stacks, func->locals.size);
+    reaching = stacks;
+    New(IrInstr*, undefs, func->locals.size);
+    undefValues = undefs;
+    for (size_t i=0; i<func->locals.size; i++){
+        if (!arrInit(vptr)(&reaching[i], 4, NULL, NULL)) exit(1);
+        undefValues[i] = NULL;
+    }
+    if (!arrInit(size_t)(&pushed, 16, NULL, NULL)) exit(1);
+    renameBlock(func->blocks.elem[0]);
+    arrDispose(size_t)(&pushed);
+    for (size_t i=0; i<func->locals.size; i++){
+        if (undefValues[i]) irInsertAt(func->blocks.elem[0], undefValues[i], 0);
+    }
+    for (size_t i=0; i<func->locals.size; i++){
+        arrDispose(vptr)(&reaching[i]);
+    }
+    free(reaching);
+    free(undefValues);
+
+    while (removeTrivialPhis(func));
+    irApplyReplacements(func);
+    removeDeadPhis(func);
+    irSweep(func);
+    return 1;
+}
@@ -0,0 +1,36 @@
+#include <assert.h>
+#include <stdio.h>
+#include "utils.h"
+#include "ir/ir.h"
+// Runs the optimization pipeline over a function
+
+#ifdef NDEBUG
+char irVerifyEachPass = 0;
+#else
+char irVerifyEachPass = 1;
+#endif
+
+// Passes run in order, skipping those above the requested optimization level
+static const IrPass passes[] = {
+    {"mem2reg", &irMem2Reg, 1},
+    {"tailrec", &irTailRecursion, 1},
+    {"inline", &irInline, 2},
+    {"tailrec", &irTailRecursion, 2},   //Again for the calls inlining exposes
+    {"sccp", &irSccp, 1},
+    {"gvn", &irGvn, 1},
+    {"ifconv", &irIfConvert, 1},
+    {"licm", &irLicm, 1},
+    {"dce", &irDce, 1},
+};
+#define PASS_COUNT (sizeof(passes) / sizeof(passes[0]))
+
+void irOptimize(IrFunction* func, int optLevel){
+    for (size_t i=0; i<PASS_COUNT; i++){
+        if (optLevel < passes[i].minOptLevel) continue;
+        passes[i].run(func);
+        if (irVerifyEachPass && !irVerify(func)){
+            fprintf(stderr, "Invalid IR in function '%s' after pass '%s'.\n", func->name, passes[i].name);
+            assert(0 && "IR verification failed");
+        }
+    }
+}
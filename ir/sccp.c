@@ -0,0 +1,331 @@
+#include <assert.h>
+#include <stdint.h>
+#include "utils.h"
+#include "array.h"
+#include "ir/ir.h"
+// Sparse conditional constant propagation, from Wegman and Zadeck.
+// Values start out unknown and only get lowered to constant or varying, while blocks only become executable once an
+// executable edge reaches them. Constants found this way are folded and branches on them become jumps
+
+typedef enum {
+    latUnknown,
+    latConst,
+    latVarying
+} LatticeState;
+
+typedef struct {
+    LatticeState state;
+    uint64_t num;
+} Lattice;
+
+typedef struct {
+    IrBlock* from;
+    IrBlock* to;
+} Edge;
+
+#define TYPE Edge
+#include "generics/gen_array.h"
+#include "generics/gen_array.c"
+#undef TYPE
+
+static Lattice* lattice;       //Indexed by value id
+static Array(vptr)* users;     //Indexed by value id
+static char** execEdges;       //Indexed by block id, then by pred index
+static Array(Edge) edgeWork;
+static Array(vptr) valueWork;
+
+static Lattice latticeOf(const IrInstr* instr){
+    return lattice[instr->id];
+}
+
+static void lower(IrInstr* instr, Lattice value){
+    Lattice* old = &lattice[instr->id];
+    if (value.state <= old->state) return;
+    *old = value;
+    if (!arrPush(vptr)(&valueWork, instr)) exit(1);
+}
+
+static char compare(IrCond cond, uint64_t left, uint64_t right){
+    switch (cond){
+        case irCondE: return left == right;
+        case irCondNE: return left != right;
+        case irCondL: return (int64_t)left < (int64_t)right;
+        case irCondLE: return (int64_t)left <= (int64_t)right;
+        case irCondG: return (int64_t)left > (int64_t)right;
+        case irCondGE: return (int64_t)left >= (int64_t)right;
+        case irCondB: return left < right;
+        case irCondBE: return left <= right;
+        case irCondA: return left > right;
+        case irCondAE: return left >= right;
+        default:
+            assert(0 && "Not a condition code");
+    }
+}
+
+// Constants are kept extended to 64 bits, so results are worked out in 64 bits and then cut down to the instruction's type.
+// Returns whether the result is known
+static char evaluate(const IrInstr* instr, uint64_t* result){
+    uint64_t left = instr->args.size > 0 ? latticeOf(instr->args.elem[0]).num : 0;
+    uint64_t right = instr->args.size > 1 ? latticeOf(instr->args.elem[1]).num : 0;
+    uint64_t value;
+    switch (instr->op){
+        case irCopy:
+        case irConv:
+            value = left;
+            break;
+        case irNeg: value = -left; break;
+        case irNot: value = left == 0; break;
+        case irAdd: value = left + right; break;
+        case irSub: value = left - right; break;
+        case irMul: value = left * right; break;
+        case irDiv:
+            //Division by 0 and overflow are left for runtime
+            if (right == 0) return 0;
+            if (isSignedType(instr->type)){
+                uint64_t minimum = irExtendConst((uint64_t)1 << (typeSize(instr->type) * 8 - 1), instr->type);
+                if (left == minimum && (int64_t)right == -1) return 0;
+                value = (int64_t)left / (int64_t)right;
+            }
+            else{
+                value = left / right;
+            }
+            break;
+        case irCmp: value = compare(instr->cond, left, right); break;
+        case irSelect: value = left ? right : latticeOf(instr->args.elem[2]).num; break;
+        default:
+            return 0;
+    }
+    *result = irExtendConst(value, instr->type);
+    return 1;
+}
+
+static void visitPhi(IrInstr* phi){
+    Lattice result = {latUnknown, 0};
+    IrBlock* block = phi->block;
+    for (size_t i=0; i<phi->args.size; i++){
+        if (!execEdges[block->id][i]) continue;
+        Lattice arg = latticeOf(phi->args.elem[i]);
+        if (arg.state == latUnknown) continue;
+        if (arg.state == latVarying || (result.state == latConst && result.num != arg.num)){
+            result.state = latVarying;
+            break;
+        }
+        result = arg;
+    }
+    lower(phi, result);
+}
+
+static void markEdge(IrBlock* from, IrBlock* to){
+    if (!arrPush(Edge)(&edgeWork, (Edge){from, to})) exit(1);
+}
+
+// Block a switch on a constant goes to
+static IrBlock* switchTarget(const IrInstr* instr, uint64_t num){
+    for (size_t i=0; i<instr->caseCount; i++){
+        if (instr->cases[i].num == num) return instr->cases[i].target;
+    }
+    return instr->targets[0];
+}
+
+static void visitInstr(IrInstr* instr){
+    if (instr->op == irPhi){
+        visitPhi(instr);
+        return;
+    }
+    switch (instr->op){
+        case irJmp:
+            markEdge(instr->block, instr->targets[0]);
+            return;
+        case irBranch: {
+            Lattice cond = latticeOf(instr->args.elem[0]);
+            if (cond.state == latConst){
+                markEdge(instr->block, instr->targets[cond.num ? 0 : 1]);
+            }
+            else if (cond.state == latVarying){
+                markEdge(instr->block, instr->targets[0]);
+                markEdge(instr->block, instr->targets[1]);
+            }
+            return;
+        }
+        case irSwitch: {
+            Lattice value = latticeOf(instr->args.elem[0]);
+            if (value.state == latConst){
+                markEdge(instr->block, switchTarget(instr, value.num));
+            }
+            else if (value.state == latVarying){
+                for (size_t i=0; i<irSuccCount(instr->block); i++){
+                    markEdge(instr->block, irSucc(instr->block, i));
+                }
+            }
+            return;
+        }
+        case irConst:
+            lower(instr, (Lattice){latConst, instr->data.num});
+            return;
+        case irParam:
+        case irLoad:
+        case irCall:
+            if (irHasValue(instr)) lower(instr, (Lattice){latVarying, 0});
+            return;
+        case irStore:
+        case irRet:
+            return;
+    }
+    for (size_t i=0; i<instr->args.size; i++){
+        LatticeState state = latticeOf(instr->args.elem[i]).state;
+        if (state == latVarying){
+            lower(instr, (Lattice){latVarying, 0});
+            return;
+        }
+        if (state == latUnknown) return;
+    }
+    uint64_t result;
+    if (evaluate(instr, &result)){
+        lower(instr, (Lattice){latConst, result});
+    }
+    else{
+        lower(instr, (Lattice){latVarying, 0});
+    }
+}
+
+static void propagate(IrFunction* func){
+    markEdge(NULL, func->blocks.elem[0]);
+    while (edgeWork.size || valueWork.size){
+        while (edgeWork.size){
+            Edge edge = arrPop(Edge)(&edgeWork);
+            IrBlock* block = edge.to;
+            char firstVisit = !block->mark;
+            if (edge.from != NULL){
+                size_t index = irPredIndex(block, edge.from);
+                if (execEdges[block->id][index]) continue;
+                execEdges[block->id][index] = 1;
+            }
+            block->mark = 1;
+            // Phis are revisited for every new edge, but everything else only needs to be visited once
+            for (size_t i=0; i<block->instrs.size; i++){
+                IrInstr* instr = block->instrs.elem[i];
+                if (instr->op != irPhi && !firstVisit) break;
+                visitInstr(instr);
+            }
+        }
+        while (valueWork.size){
+            IrInstr* instr = arrPop(vptr)(&valueWork);
+            Array(vptr)* uses = &users[instr->id];
+            for (size_t i=0; i<uses->size; i++){
+                IrInstr* user = uses->elem[i];
+                if (user->block->mark) visitInstr(user);
+            }
+        }
+    }
+}
+
+// Replace constant values with constants and branches on them with jumps
+static char rewrite(IrFunction* func){
+    char changed = 0;
+    IrBlock* entry = func->blocks.elem[0];
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        if (!block->mark) continue;
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            if (instr->id >= func->valueCount) continue;
+            Lattice value = latticeOf(instr);
+            if (instr->op == irBranch){
+                Lattice cond = latticeOf(instr->args.elem[0]);
+                if (cond.state != latConst) continue;
+                IrBlock* taken = instr->targets[cond.num ? 0 : 1];
+                IrBlock* skipped = instr->targets[cond.num ? 1 : 0];
+                instr->op = irJmp;
+                instr->args.size = 0;
+                instr->targets[0] = taken;
+                instr->targets[1] = NULL;
+                if (skipped != taken) irRemoveEdge(block, skipped);
+                changed = 1;
+                continue;
+            }
+            if (instr->op == irSwitch){
+                Lattice switchValue = latticeOf(instr->args.elem[0]);
+                if (switchValue.state != latConst) continue;
+                IrBlock* taken = switchTarget(instr, switchValue.num);
+                for (size_t k=0; k<irSuccCount(block); k++){
+                    if (irSucc(block, k) != taken) irRemoveEdge(block, irSucc(block, k));
+                }
+                instr->op = irJmp;
+                instr->args.size = 0;
+                instr->targets[0] = taken;
+                instr->caseCount = 0;
+                changed = 1;
+                continue;
+            }
+            if (value.state != latConst || instr->op == irConst) continue;
+            changed = 1;
+            if (instr->op == irPhi){
+                //Phis have to stay at the start of their block, so the constant goes in the entry block instead
+                IrInstr* constant = newIrInstr(func, irConst, instr->type);
+                constant->data.num = value.num;
+                irInsertAt(entry, constant, 0);
+                irReplaceUses(instr, constant);
+                irErase(instr);
+            }
+            else{
+                instr->op = irConst;
+                instr->data.num = value.num;
+                instr->args.size = 0;
+            }
+        }
+    }
+    return changed;
+}
+
+char irSccp(IrFunction* func){
+    irNumberValues(func);
+    size_t valueCount = func->valueCount;
+    New(Lattice, values, valueCount);
+    New(Array(vptr), uses, valueCount);
+    New(char*, edges, func->blocks.size);
+    lattice = values;
+    users = uses;
+    execEdges = edges;
+    for (size_t i=0; i<valueCount; i++){
+        lattice[i] = (Lattice){latUnknown, 0};
+        if (!arrInit(vptr)(&users[i], 2, NULL, NULL)) exit(1);
+    }
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        block->mark = 0;
+        New(char, flags, block->preds.size + 1);
+        for (size_t j=0; j<block->preds.size; j++) flags[j] = 0;
+        execEdges[i] = flags;
+        for (size_t j=0; j<block->instrs.size; j++){
+            IrInstr* instr = block->instrs.elem[j];
+            for (size_t k=0; k<instr->args.size; k++){
+                if (!arrPush(vptr)(&users[((IrInstr*)instr->args.elem[k])->id], instr)) exit(1);
+            }
+        }
+    }
+    if (!arrInit(Edge)(&edgeWork, 8, NULL, NULL)) exit(1);
+    if (!arrInit(vptr)(&valueWork, 8, NULL, NULL)) exit(1);
+
+    propagate(func);
+    char changed = rewrite(func);
+
+    arrDispose(Edge)(&edgeWork);
+    arrDispose(vptr)(&valueWork);
+    for (size_t i=0; i<valueCount; i++){
+        arrDispose(vptr)(&users[i]);
+    }
+    for (size_t i=0; i<func->blocks.size; i++){
+        free(execEdges[i]);
+    }
+    free(lattice);
+    free(users);
+    free(execEdges);
+
+    if (changed){
+        irApplyReplacements(func);
+        irSweep(func);
+        irRemoveUnreachable(func);
+        irMergeBlocks(func);
+    }
+    return changed;
+}
@@ -0,0 +1,134 @@
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#include "utils.h"
+#include "array.h"
+#include "ir/ir.h"
+// Turns calls a function makes to itself right before returning into jumps back to its start.
+// Calls that jump to a block that only returns their value get a return of their own first, which also lets lowering
+// turn calls to other functions into jumps.
+// Everything in the entry block but the params moves to a new loop header, where each param becomes a phi of its
+// incoming value and the args of every tail call. The phis take the new values all at once, which is the parallel
+// move the call would have done
+
+// A call whose value is returned straight away, or whose function returns nothing
+static char isSelfTailCall(const IrFunction* func, const IrBlock* block, size_t pos){
+    const IrInstr* call = block->instrs.elem[pos];
+    if (call->op != irCall || strcmp(call->data.name, func->name) || pos + 2 != block->instrs.size) return 0;
+    const IrInstr* ret = block->instrs.elem[pos + 1];
+    return ret->op == irRet && (ret->args.size == 0 || ret->args.elem[0] == call);
+}
+
+// Whether the block does nothing but return one of its phis, or nothing at all
+static char onlyReturns(const IrBlock* block){
+    const IrInstr* ret = irTerminator(block);
+    if (ret->op != irRet) return 0;
+    for (size_t i=0; i+1<block->instrs.size; i++){
+        if (((IrInstr*)block->instrs.elem[i])->op != irPhi) return 0;
+    }
+    return ret->args.size == 0 || ((IrInstr*)ret->args.elem[0])->block == block;
+}
+
+// Jumps from a call to a block that returns the call's value become returns
+static char pullReturns(IrFunction* func){
+    char changed = 0;
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        IrInstr* jmp = irTerminator(block);
+        if (jmp->op != irJmp || block->instrs.size < 2 || !onlyReturns(jmp->targets[0])) continue;
+        IrBlock* target = jmp->targets[0];
+        IrInstr* call = block->instrs.elem[block->instrs.size - 2];
+        IrInstr* ret = irTerminator(target);
+        if (call->op != irCall) continue;
+        if (ret->args.size && ((IrInstr*)ret->args.elem[0])->args.elem[irPredIndex(target, block)] != call) continue;
+        irRemoveEdge(block, target);
+        jmp->op = irRet;
+        jmp->targets[0] = NULL;
+        if (ret->args.size) irAddArg(jmp, call);
+        changed = 1;
+    }
+    if (changed) irRemoveUnreachable(func);
+    return changed;
+}
+
+char irTailRecursion(IrFunction* func){
+    char pulled = pullReturns(func);
+    Array(vptr) tails;
+    if (!arrInit(vptr)(&tails, 2, NULL, NULL)) exit(1);
+    for (size_t i=0; i<func->blocks.size; i++){
+        IrBlock* block = func->blocks.elem[i];
+        if (block->instrs.size >= 2 && isSelfTailCall(func, block, block->instrs.size - 2)){
+            if (!arrPush(vptr)(&tails, block->instrs.elem[block->instrs.size - 2])) exit(1);
+        }
+    }
+    if (tails.size == 0){
+        arrDispose(vptr)(&tails);
+        if (pulled) irNumberValues(func);
+        return pulled;
+    }
+
+    IrBlock* entry = func->blocks.elem[0];
+    IrBlock* header = newIrBlock(func);
+    New(IrInstr*, params, func->paramCount + 1);
+    New(IrInstr*, phis, func->paramCount + 1);
+    for (size_t i=0; i<func->paramCount; i++){
+        params[i] = NULL;
+    }
+    size_t kept = 0;
+    for (size_t i=0; i<entry->instrs.size; i++){
+        IrInstr* instr = entry->instrs.elem[i];
+        if (instr->op == irParam){
+            params[instr->data.index] = instr;
+            entry->instrs.elem[kept++] = instr;
+            continue;
+        }
+        instr->block = header;
+        if (!arrPush(vptr)(&header->instrs, instr)) exit(1);
+    }
+    entry->instrs.size = kept;
+    //Dead code elimination may have dropped unused params, which the tail calls still pass
+    for (size_t i=0; i<func->paramCount; i++){
+        if (params[i] != NULL) continue;
+        IrInstr* call = tails.elem[0];
+        params[i] = irInsertAt(entry, newIrInstr(func, irParam, ((IrInstr*)call->args.elem[i])->type), 0);
+        params[i]->data.index = i;
+    }
+    for (size_t i=0; i<irSuccCount(header); i++){
+        IrBlock* succ = irSucc(header, i);
+        succ->preds.elem[irPredIndex(succ, entry)] = header;
+    }
+    IrInstr* jmp = newIrInstr(func, irJmp, typNone);
+    jmp->targets[0] = header;
+    irAppend(entry, jmp);
+
+    //Uses of the params move over to the phis before the params become the phis' first args
+    for (size_t i=0; i<func->paramCount; i++){
+        phis[i] = irInsertAt(header, newIrInstr(func, irPhi, params[i]->type), i);
+        irReplaceUses(params[i], phis[i]);
+    }
+    irApplyReplacements(func);
+    for (size_t i=0; i<func->paramCount; i++){
+        params[i]->replacement = NULL;
+        irAddArg(phis[i], params[i]);
+    }
+    for (size_t i=0; i<tails.size; i++){
+        //Calls in the entry block have moved to the header by now
+        IrInstr* call = tails.elem[i];
+        IrBlock* block = call->block;
+        IrInstr* ret = irTerminator(block);
+        for (size_t j=0; j<func->paramCount; j++){
+            irAddArg(phis[j], call->args.elem[j]);
+        }
+        irErase(call);
+        ret->op = irJmp;
+        ret->args.size = 0;
+        ret->targets[0] = header;
+        irAddEdge(block, header);
+    }
+    irSweep(func);
+    irNumberValues(func);
+    free(params);
+    free(phis);
+    arrDispose(vptr)(&tails);
+    return 1;
+}
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include "utils.h"
+#include "array.h"
+#include "ir/ir.h"
+// Checks the structural invariants of the IR and that every value dominates its uses
+
+static const IrFunction* curFunc;
+static char valid;
+
+static void irError(const IrBlock* block, const char_t* message, ...){
+    fprintf(stderr, "IR error in '%s', block %u: ", curFunc->name, (unsigned)block->id);
+    va_list args;
+    va_start(args, message);
+    vfprintf(stderr, message, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+    valid = 0;
+}
+
+static size_t expectedArgs(const IrInstr* instr){
+    switch (instr->op){
+        case irConst:
+        case irParam:
+        case irLoad:
+        case irJmp:
+            return 0;
+        case irStore:
+        case irCopy:
+        case irConv:
+        case irNeg:
+        case irNot:
+        case irBranch:
+        case irSwitch:
+            return 1;
+        case irAdd:
+        case irSub:
+        case irMul:
+        case irDiv:
+        case irCmp:
+            return 2;
+        case irSelect:
+            return 3;
+        default:
+            return SIZE_MAX;
+    }
+}
+
+// Position of an instruction in its block, used for dominance within a block
+static size_t position(const IrInstr* instr){
+    const IrBlock* block = instr->block;
+    for (size_t i=0; i<block->instrs.size; i++){
+        if (block->instrs.elem[i] == instr) return i;
+    }
+    return SIZE_MAX;
+}
+
+static void verifyArg(const IrBlock* block, const IrInstr* user, size_t userPos, const IrInstr* arg){
+    if (arg == NULL){
+        irError(block, "%s has a missing operand", irOpcodeStr(user->op));
+        return;
+    }
+    if (arg->dead || arg->block == NULL || arg->block->mark != 1){
+        irError(block, "%s uses a value that isn't in the function", irOpcodeStr(user->op));
+        return;
+    }
+    if (!irHasValue(arg)){
+        irError(block, "%s uses the result of %s, which has no value", irOpcodeStr(user->op), irOpcodeStr(arg->op));
+        return;
+    }
+    //Uses in unreachable blocks are never run
+    if (block->rpoIndex == SIZE_MAX) return;
+    if (arg->block == block ? position(arg) >= userPos : !irDominates(arg->block, block)){
+        irError(block, "%s uses a value that doesn't dominate it", irOpcodeStr(user->op));
+    }
+}
+
+static void verifyBlock(const IrBlock* block){
+    if (block->instrs.size == 0 || irTerminator(block) == NULL){
+        irError(block, "block doesn't end in a terminator");
+        return;
+    }
+    char pastPhis = 0;
+    for (size_t i=0; i<block->instrs.size; i++){
+        IrInstr* instr = block->instrs.elem[i];
+        if (instr->block != block){
+            irError(block, "%s doesn't know its block", irOpcodeStr(instr->op));
+        }
+        if (instr->dead){
+            irError(block, "erased %s was never swept", irOpcodeStr(instr->op));
+        }
+        if (irIsTerminator(instr->op) && i != block->instrs.size - 1){
+            irError(block, "%s in the middle of a block", irOpcodeStr(instr->op));
+        }
+        if (instr->op != irPhi){
+            pastPhis = 1;
+        }
+        else if (pastPhis){
+            irError(block, "phi after a non-phi instruction");
+        }
+        size_t expected = expectedArgs(instr);
+        if (expected != SIZE_MAX && instr->args.size != expected){
+            irError(block, "%s has %u operands", irOpcodeStr(instr->op), (unsigned)instr->args.size);
+        }
+        if (instr->op == irPhi){
+            if (instr->args.size != block->preds.size){
+                irError(block, "phi has %u args for %u preds", (unsigned)instr->args.size, (unsigned)block->preds.size);
+                continue;
+            }
+            //Phi args only need to be available at the end of their pred
+            for (size_t j=0; j<instr->args.size; j++){
+                const IrBlock* pred = block->preds.elem[j];
+                const IrInstr* arg = instr->args.elem[j];
+                verifyArg(pred, instr, pred->instrs.size, arg);
+            }
+        }
+        else{
+            for (size_t j=0; j<instr->args.size; j++){
+                verifyArg(block, instr, i, instr->args.elem[j]);
+            }
+        }
+    }
+    //Preds and succs must agree with each other
+    for (size_t i=0; i<irSuccCount(block); i++){
+        IrBlock* succ = irSucc(block, i);
+        if (succ == NULL || succ->mark != 1){
+            irError(block, "jumps to a block that isn't in the function");
+        }
+        else if (irPredIndex(succ, block) == SIZE_MAX){
+            irError(block, "missing from the preds of its successor %u", (unsigned)succ->id);
+        }
+    }
+    //Each successor of a switch has one edge, so its cases can't share targets or values
+    const IrInstr* term = irTerminator(block);
+    for (size_t i=0; i<term->caseCount; i++){
+        for (size_t j=0; j<i; j++){
+            if (term->cases[j].num == term->cases[i].num) irError(block, "case %u has the value of case %u", (unsigned)i, (unsigned)j);
+        }
+        for (size_t j=0; j<=i; j++){
+            if (irSucc(block, j) == term->cases[i].target) irError(block, "case %u shares its target", (unsigned)i);
+        }
+    }
+    for (size_t i=0; i<block->preds.size; i++){
+        const IrBlock* pred = block->preds.elem[i];
+        char found = 0;
+        for (size_t j=0; j<irSuccCount(pred); j++){
+            found |= irSucc(pred, j) == block;
+        }
+        if (!found){
+            irError(block, "pred %u doesn't jump to it", (unsigned)pred->id);
+        }
+        for (size_t j=0; j<i; j++){
+            if (block->preds.elem[j] == pred) irError(block, "duplicate pred %u", (unsigned)pred->id);
+        }
+    }
+}
+
+char irVerify(IrFunction* func){
+    curFunc = func;
+    valid = 1;
+    if (func->blocks.size == 0){
+        fprintf(stderr, "IR error in '%s': no entry block\n", func->name);
+        return 0;
+    }
+    if (((IrBlock*)func->blocks.elem[0])->preds.size){
+        irError(func->blocks.elem[0], "entry block has preds");
+    }
+    irComputeDominators(func);
+    //Marks tell which blocks belong to the function
+    for (size_t i=0; i<func->blocks.size; i++){
+        ((IrBlock*)func->blocks.elem[i])->mark = 1;
+    }
+    for (size_t i=0; i<func->blocks.size; i++){
+        verifyBlock(func->blocks.elem[i]);
+    }
+    return valid;
+}
@@ -81,15 +81,21 @@ void disposeLexer(){
     arrDispose(char_t)(&stringBuffer);
 }
 
-//Recognizes decimal sequence and adds it to floatVal. Returns whether decimals were recognized
+//Recognizes decimal sequence and adds it to floatVal. Returns whether decimals were recognized.
+//The digits are gathered into an integer and divided once at the end, so that short decimals like .125 come out exact.
+//Digits past what a double can hold are dropped
 static char lexDecimals(){
     if (isDigit(curChar)){
-        double d = 0.1;
+        uint64_t digits = 0;
+        double scale = 1;
         do{
-            floatVal += d * (curChar - '0');
+            if (scale < 1e18){
+                digits = digits * 10 + (curChar - '0');
+                scale *= 10;
+            }
             getNext();
-            d /= 10;
         } while(isDigit(curChar));
+        floatVal += digits / scale;
         return 1;
     }
     return 0;
@@ -136,20 +142,31 @@ Token lexToken(){
             }
             goto identifier;
         case 'c':
-            //char
+            //char, case or continue
             storeNext('c');
             if (curChar == 'h'){
                 if (lexKeyword("har")){
                     return tokChar;
                 }
             }
+            else if (curChar == 'a'){
+                if (lexKeyword("ase")){
+                    return tokCase;
+                }
+            }
             else if (lexKeyword("ontinue")){
                 return tokContinue;
             }
             goto identifier;
         case 'd':
-            //double or do
-            if (lexKeywordPart("do")){
+            //double, do or default
+            storeNext('d');
+            if (curChar == 'e'){
+                if (lexKeyword("efault")){
+                    return tokDefault;
+                }
+            }
+            else if (lexKeywordPart("o")){
                 //If "do" is not followed by identifier char that makes it an isolated keyword
                 if (!isIdentChar(curChar)){
                     return tokDo;
@@ -197,13 +214,18 @@ Token lexToken(){
             } 
             goto identifier;
         case 's':
-            //signed or short
+            //signed, short or switch
             storeNext('s');
             if (curChar == 'i'){
                 if (lexKeyword("igned")){
                     return tokSigned;
                 }
             }
+            else if (curChar == 'w'){
+                if (lexKeyword("witch")){
+                    return tokSwitch;
+                }
+            }
             else if (lexKeyword("hort")){
                 return tokShort;
             }
@@ -309,12 +331,30 @@ Token lexToken(){
                 return tokMultiAssign;
             }
             return tokMulti;
+        case '&':
+            //Only logical and is supported, so a lone & is unexpected
+            getNext();
+            if (curChar == '&'){
+                getNext();
+                return tokAnd;
+            }
+            return tokUnexpected;
+        case '|':
+            getNext();
+            if (curChar == '|'){
+                getNext();
+                return tokOr;
+            }
+            return tokUnexpected;
         case ',':
             getNext();
             return tokComma;
         case ';':
             getNext();
             return tokSemicolon;
+        case ':':
+            getNext();
+            return tokColon;
         case '{':
             getNext();
             return tokLBrace;
@@ -472,6 +512,12 @@ const char_t * stringifyToken(Token tok){
             return "keyword \"break\"";
         case tokContinue:
             return "keyword \"continue\"";
+        case tokSwitch:
+            return "keyword \"switch\"";
+        case tokCase:
+            return "keyword \"case\"";
+        case tokDefault:
+            return "keyword \"default\"";
         case tokIdent:
             return "identifier";
         case tokNumDouble:
@@ -518,6 +564,10 @@ const char_t * stringifyToken(Token tok){
             return ">=";
         case tokLessEquals:
             return "<=";
+        case tokAnd:
+            return "&&";
+        case tokOr:
+            return "||";
         case tokDiv:
             return "/";
         case tokMulti:
@@ -530,6 +580,8 @@ const char_t * stringifyToken(Token tok){
             return ")";
         case tokSemicolon:
             return ";";
+        case tokColon:
+            return ":";
         case tokLBrace:
             return "{";
         case tokRBrace:
@@ -23,6 +23,9 @@ typedef enum {
     tokDo,
     tokBreak,
     tokContinue,
+    tokSwitch,
+    tokCase,
+    tokDefault,
     tokIdent,   //Identifier [a-zA-Z][a-zA-Z_0-9]*  stored in stringBuffer
     tokNumDouble,  //64-bit floating pt literal .[0-9]+ | [0-9]+.[0-9]* in floatVal
     tokNumFloat,   //32-bit floating pt literal .[0-9]+ | [0-9]+.[0-9]*(f|F)
@@ -50,10 +53,13 @@ typedef enum {
     tokLess,    // <
     tokGreaterEquals,   // >=
     tokLessEquals,  // <=
+    tokAnd,     // &&
+    tokOr,      // ||
     tokComma,   // , token 
     tokLParen,      // ( token
     tokRParen,      // ) token
     tokSemicolon,
+    tokColon,
     tokLBrace,
     tokRBrace,
 } Token;
@@ -123,7 +123,7 @@ static ExprBase* parseRightUnopExpr(){
         switch(curTok){
             case tokDec:
             case tokInc:
-                expr = (ExprBase*)verifyExprUnop(newExprUnop(opLine, opPos, curTok, expr, 0));
+                expr = verifyExprUnop(newExprUnop(opLine, opPos, curTok, expr, 0));
                 getTok();
                 break;
             default:
@@ -146,7 +146,7 @@ static ExprBase* parseLeftUnopExpr(){
             getTok();
             ExprBase* operand = parseLeftUnopExpr();
             if (operand){
-                return (ExprBase*)verifyExprUnop(newExprUnop(opLine, opPos, op, operand, 1));
+                return verifyExprUnop(newExprUnop(opLine, opPos, op, operand, 1));
             }
             return NULL;
         }
@@ -168,6 +168,10 @@ static int operatorPrec(Token op){
         case tokDivAssign:
         case tokAssign:
             return 1;
+        case tokOr:
+            return 4;
+        case tokAnd:
+            return 5;
         case tokEquals:
         case tokNotEquals:
             return 6;
@@ -186,7 +190,8 @@ static int operatorPrec(Token op){
     return 0;
 }
 
-//Precedence climbing algorithm for binops. Constructs lhs from subsequent terms. Will not free lhs. Returns updated lhs or error
+//Precedence climbing algorithm for binops. Constructs lhs from subsequent terms. Takes ownership of lhs, freeing it on error. 
+//Returns updated lhs or error. Verification may fold lhs into a new node, so only the returned pointer is valid
 //exprBinop := [ [+-/*] primeExpr]*
 static ExprBase* parseBinopExpr(ExprBase* lhs, int minPrec){
     int prec;
@@ -198,19 +203,21 @@ static ExprBase* parseBinopExpr(ExprBase* lhs, int minPrec){
         size_t opPos = linePos;
         getTok(); //Consume binop
         //Attempt to parse 1st atom of rhs expression
-        if ((rhs = parseLeftUnopExpr()) == NULL) return rhs;
+        if ((rhs = parseLeftUnopExpr()) == NULL){
+            disposeAst(lhs);
+            return NULL;
+        }
         //While next binop is of higher precedence (or equal for right assiciative ops), accumulate expression into rhs.
         while (operatorPrec(curTok) > prec || isAssignmentOp(op) && operatorPrec(curTok) == prec){
-            //Attempt to parse subsequent atoms at a precedece equal to current binop
-            ExprBase* newRhs = parseBinopExpr(rhs, operatorPrec(curTok));
-            if (newRhs == NULL){
-                disposeAst(rhs); //Responsible for delete rhs, which was created in this function
+            //Attempt to parse subsequent atoms at a precedece equal to current binop. Rhs is freed on failure
+            rhs = parseBinopExpr(rhs, operatorPrec(curTok));
+            if (rhs == NULL){
+                disposeAst(lhs);
                 return NULL;
             }
-            rhs = newRhs;
         }
         //After rhs has been fully built, merge it with lhs and then continue
-        lhs = (ExprBase*)verifyExprBinop(newExprBinop(opLine, opPos, op, lhs, rhs));
+        lhs = verifyExprBinop(newExprBinop(opLine, opPos, op, lhs, rhs));
     }
     return lhs;
 }
@@ -219,11 +226,7 @@ static ExprBase* parseBinopExpr(ExprBase* lhs, int minPrec){
 ExprBase* parseExpr(){
     ExprBase* lhs = parseLeftUnopExpr(); //Parse the 1st primary expression
     if (lhs == NULL) return lhs; 
-    ExprBase* expr = parseBinopExpr(lhs, 1); //Parse all following binops
-    if (expr == NULL){
-        disposeAst(lhs);
-    }
-    return expr;
+    return parseBinopExpr(lhs, 1); //Parse all following binops
 }
 
 ExprBase* parseBracketedExpr(){
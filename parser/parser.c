@@ -222,6 +222,49 @@ Ast* parseStmt(){
             }
             disposeAst(cond);
             return NULL;
+        case tokSwitch: {
+            getTok();
+            ExprBase* expr = parseBracketedExpr();
+            if (expr){
+                StmtSwitch* stmt = newStmtSwitch(stmtLineNum, stmtLinePos, expr);
+                StmtSwitch* enclosing = preverifySwitch(stmt);
+                stmt->stmt = parseStmt();
+                postVerifySwitch(enclosing);
+                if (stmt->stmt){
+                    return (Ast*)stmt;
+                }
+                disposeAst(stmt);
+            }
+            return NULL;
+        }
+        //Labels are verified before the statements they label, so that the cases are in order
+        case tokCase:
+        case tokDefault: {
+            StmtCase* label;
+            if (curTok == tokCase){
+                getTok();
+                ExprBase* expr = parseExpr();
+                if (!expr) return NULL;
+                label = newStmtCase(stmtLineNum, stmtLinePos, expr);
+            }
+            else{
+                getTok();
+                label = newStmtDefault(stmtLineNum, stmtLinePos);
+            }
+            if (curTok == tokColon){
+                getTok();
+                verifyStmtCase(label);
+                label->stmt = parseStmt();
+                if (label->stmt){
+                    return (Ast*)label;
+                }
+            }
+            else{
+                syntaxError(stringifyToken(tokColon));
+            }
+            disposeAst(label);
+            return NULL;
+        }
 
         //These are tokens that expressions can't start with, so they automatically trigger statement error
         case tokRBrace:
@@ -239,6 +282,7 @@ Ast* parseStmt(){
         case tokSigned:
         case tokUnsigned:
         case tokElse:
+        case tokColon:
             syntaxError("statement");
             return NULL;
         //Checks for expression/declaration statements as last resort
@@ -0,0 +1,369 @@
+#include "semantics/fold.h"
+#include "ast/ast.h"
+#include "ast/type.h"
+#include "lexer/lexer.h"
+#include "utils.h"
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+//IMPORTANT Constant nodes always hold a value of their own type. Any time the type of a constant changes it has to go through castExpr
+//Integer constants are handled as 64-bit values wrapped to the width of their type, then sign or zero extended
+
+char isConstExpr(const ExprBase* expr){
+    switch(expr->ast.label){
+        case astExprInt:
+        case astExprLong:
+        case astExprFloat:
+        case astExprDouble:
+            return 1;
+    }
+    return 0;
+}
+
+char hasSideEffects(const ExprBase* expr){
+    switch(expr->ast.label){
+        case astExprCall:
+            return 1;
+        case astExprUnop: {
+            const ExprUnop* unop = (const ExprUnop*)expr;
+            return unop->op == tokInc || unop->op == tokDec || hasSideEffects(unop->operand);
+        }
+        case astExprBinop: {
+            const ExprBinop* binop = (const ExprBinop*)expr;
+            return isAssignmentOp(binop->op) || hasSideEffects(binop->left) || hasSideEffects(binop->right);
+        }
+    }
+    return 0;
+}
+
+static uint64_t wrapInt(uint64_t val, Type type){
+    switch(type){
+        case typInt8: return (int64_t)(int8_t)val;
+        case typUInt8: return (uint8_t)val;
+        case typInt16: return (int64_t)(int16_t)val;
+        case typUInt16: return (uint16_t)val;
+        case typInt32: return (int64_t)(int32_t)val;
+        case typUInt32: return (uint32_t)val;
+        case typInt64:
+        case typUInt64:
+            return val;
+        default:
+            assert(0 && "Not an integer type");
+    }
+}
+
+static ExprBase* newIntConst(const Ast* pos, Type type, uint64_t val){
+    ExprBase* expr;
+    if (type == typInt64 || type == typUInt64){
+        expr = (ExprBase*)newExprLong(pos->lineNumber, pos->linePos, val);
+    }
+    else{
+        expr = (ExprBase*)newExprInt(pos->lineNumber, pos->linePos, (uint32_t)val);
+    }
+    expr->type = type;
+    return expr;
+}
+
+static ExprBase* newFloatConst(const Ast* pos, Type type, double val){
+    ExprBase* expr;
+    if (type == typFloat32){
+        expr = (ExprBase*)newExprFloat(pos->lineNumber, pos->linePos, (float)val);
+    }
+    else{
+        expr = (ExprBase*)newExprDouble(pos->lineNumber, pos->linePos, val);
+    }
+    expr->type = type;
+    return expr;
+}
+
+uint64_t intConstValue(const ExprBase* expr){
+    switch(expr->ast.label){
+        case astExprInt:
+            return wrapInt(((const ExprInt*)expr)->num, expr->type);
+        case astExprLong:
+            return ((const ExprLong*)expr)->num;
+        default:
+            assert(0 && "Not an integer constant");
+    }
+}
+
+static double floatConstValue(const ExprBase* expr){
+    switch(expr->ast.label){
+        case astExprFloat:
+            return ((const ExprFloat*)expr)->num;
+        case astExprDouble:
+            return ((const ExprDouble*)expr)->num;
+        default:
+            if (isSignedType(expr->type)){
+                return (int64_t)intConstValue(expr);
+            }
+            return intConstValue(expr);
+    }
+}
+
+ExprBase* castExpr(ExprBase* expr, Type type){
+    if (!isConstExpr(expr) || expr->type == type){
+        expr->type = type;
+        return expr;
+    }
+    ExprBase* result;
+    if (isFloatType(type)){
+        result = newFloatConst(&expr->ast, type, floatConstValue(expr));
+    }
+    else if (isFloatType(expr->type)){
+        double val = floatConstValue(expr);
+        result = newIntConst(&expr->ast, type, wrapInt(val < 0 ? (uint64_t)(int64_t)val : (uint64_t)val, type));
+    }
+    else{
+        result = newIntConst(&expr->ast, type, wrapInt(intConstValue(expr), type));
+    }
+    disposeAst(expr);
+    return result;
+}
+
+static ExprBase* replaceWithInt(ExprBase* expr, Type type, uint64_t val){
+    ExprBase* result = newIntConst(&expr->ast, type, wrapInt(val, type));
+    disposeAst(expr);
+    return result;
+}
+
+//Keep only one operand of the binop, which then takes on the binop's type
+static ExprBase* takeOperand(ExprBinop* binop, char takeLeft){
+    ExprBase* kept;
+    if (takeLeft){
+        kept = binop->left;
+        binop->left = NULL;
+    }
+    else{
+        kept = binop->right;
+        binop->right = NULL;
+    }
+    kept = castExpr(kept, binop->base.type);
+    disposeAst(binop);
+    return kept;
+}
+
+static char isConstTrue(const ExprBase* expr){
+    if (isFloatType(expr->type)){
+        return floatConstValue(expr) != 0;
+    }
+    return intConstValue(expr) != 0;
+}
+
+ExprBase* foldUnop(ExprUnop* unop){
+    ExprBase* operand = unop->operand;
+    if (unop->base.type == typNone || !isConstExpr(operand)){
+        return (ExprBase*)unop;
+    }
+    ExprBase* result;
+    switch(unop->op){
+        case tokMinus:
+            if (isFloatType(unop->base.type)){
+                result = newFloatConst(&unop->base.ast, unop->base.type, -floatConstValue(operand));
+            }
+            else{
+                result = newIntConst(&unop->base.ast, unop->base.type, wrapInt(-intConstValue(operand), unop->base.type));
+            }
+            break;
+        case tokNot:
+            result = newIntConst(&unop->base.ast, typInt32, !isConstTrue(operand));
+            break;
+        default:
+            return (ExprBase*)unop;
+    }
+    disposeAst(unop);
+    return result;
+}
+
+//Short-circuited operands are never evaluated, so they can be dropped even if they have side effects
+static ExprBase* foldLogical(ExprBinop* binop){
+    char decidedOn = binop->op == tokOr;
+    if (isConstExpr(binop->left)){
+        if (isConstTrue(binop->left) == decidedOn){
+            return replaceWithInt((ExprBase*)binop, typInt32, decidedOn);
+        }
+        if (isConstExpr(binop->right)){
+            return replaceWithInt((ExprBase*)binop, typInt32, isConstTrue(binop->right));
+        }
+    }
+    else if (isConstExpr(binop->right) && isConstTrue(binop->right) == decidedOn && !hasSideEffects(binop->left)){
+        return replaceWithInt((ExprBase*)binop, typInt32, decidedOn);
+    }
+    return (ExprBase*)binop;
+}
+
+static ExprBase* foldRel(ExprBinop* binop){
+    if (!isConstExpr(binop->left) || !isConstExpr(binop->right)){
+        return (ExprBase*)binop;
+    }
+    //Operands have already been promoted to the same type
+    Type type = binop->left->type;
+    int cmp;
+    if (isFloatType(type)){
+        double a = floatConstValue(binop->left), b = floatConstValue(binop->right);
+        //NaNs are unordered, so every comparison other than != is false
+        if (a != a || b != b){
+            return replaceWithInt((ExprBase*)binop, typInt32, binop->op == tokNotEquals);
+        }
+        cmp = (a > b) - (a < b);
+    }
+    else if (isSignedType(type)){
+        int64_t a = intConstValue(binop->left), b = intConstValue(binop->right);
+        cmp = (a > b) - (a < b);
+    }
+    else{
+        uint64_t a = intConstValue(binop->left), b = intConstValue(binop->right);
+        cmp = (a > b) - (a < b);
+    }
+    char result;
+    switch(binop->op){
+        case tokEquals: result = cmp == 0; break;
+        case tokNotEquals: result = cmp != 0; break;
+        case tokGreater: result = cmp > 0; break;
+        case tokLess: result = cmp < 0; break;
+        case tokGreaterEquals: result = cmp >= 0; break;
+        case tokLessEquals: result = cmp <= 0; break;
+        default:
+            assert(0 && "Not a relational operator");
+    }
+    return replaceWithInt((ExprBase*)binop, typInt32, result);
+}
+
+static ExprBase* foldFloatArith(ExprBinop* binop){
+    double a = floatConstValue(binop->left), b = floatConstValue(binop->right);
+    double val;
+    switch(binop->op){
+        case tokPlus: val = a + b; break;
+        case tokMinus: val = a - b; break;
+        case tokMulti: val = a * b; break;
+        case tokDiv: val = a / b; break;
+        default:
+            assert(0 && "Not an arithmetic operator");
+    }
+    ExprBase* result = newFloatConst(&binop->base.ast, binop->base.type, val);
+    disposeAst(binop);
+    return result;
+}
+
+static ExprBase* foldIntArith(ExprBinop* binop){
+    Type type = binop->base.type;
+    uint64_t a = intConstValue(binop->left), b = intConstValue(binop->right);
+    uint64_t val;
+    switch(binop->op){
+        case tokPlus: val = a + b; break;
+        case tokMinus: val = a - b; break;
+        case tokMulti: val = a * b; break;
+        case tokDiv:
+            //Division by 0 is left for runtime
+            if (b == 0) return (ExprBase*)binop;
+            if (isSignedType(type)){
+                //Negating instead of dividing by -1 avoids overflowing on the most negative value
+                val = (int64_t)b == -1 ? -a : (uint64_t)((int64_t)a / (int64_t)b);
+            }
+            else{
+                val = a / b;
+            }
+            break;
+        default:
+            assert(0 && "Not an arithmetic operator");
+    }
+    return replaceWithInt((ExprBase*)binop, type, val);
+}
+
+static ExprBase* foldArith(ExprBinop* binop);
+
+//Merges constant chains such as (x + 1) + 2 into x + 3. Integer wraparound makes this exact as long as both ops have the same type
+static ExprBase* reassociate(ExprBinop* binop){
+    Type type = binop->base.type;
+    ExprBinop* inner = (ExprBinop*)binop->left;
+    if (inner->base.ast.label != astExprBinop || !isConstExpr(inner->right) || inner->right->type != type){
+        return (ExprBase*)binop;
+    }
+    uint64_t c1 = intConstValue(inner->right);
+    uint64_t c2 = intConstValue(binop->right);
+    uint64_t combined;
+    if (binop->op == tokMulti){
+        if (inner->op != tokMulti) return (ExprBase*)binop;
+        combined = c1 * c2;
+    }
+    else{
+        if (inner->op != tokPlus && inner->op != tokMinus) return (ExprBase*)binop;
+        //Constants are summed up with their signs, which always leaves an addition
+        combined = (inner->op == tokPlus ? c1 : -c1) + (binop->op == tokPlus ? c2 : -c2);
+        inner->op = tokPlus;
+    }
+    inner->right = replaceWithInt(inner->right, type, combined);
+    //Combined constant might simplify further, ie. x + 1 - 1
+    return foldArith((ExprBinop*)takeOperand(binop, 1));
+}
+
+static char isSameVariable(const ExprBase* a, const ExprBase* b){
+    return a->ast.label == astExprIdent && b->ast.label == astExprIdent &&
+        !strcmp(((const ExprIdent*)a)->name, ((const ExprIdent*)b)->name);
+}
+
+static ExprBase* foldArith(ExprBinop* binop){
+    Type type = binop->base.type;
+    //Move constants to the right of commutative operators so that only right side constants need checking
+    if ((binop->op == tokPlus || binop->op == tokMulti) && isConstExpr(binop->left) && !isConstExpr(binop->right)){
+        ExprBase* temp = binop->left;
+        binop->left = binop->right;
+        binop->right = temp;
+    }
+    if (isConstExpr(binop->left) && isConstExpr(binop->right)){
+        return isFloatType(type) ? foldFloatArith(binop) : foldIntArith(binop);
+    }
+    //Identities don't hold for floats because of NaNs, infinities and signed zeroes
+    if (isFloatType(type)){
+        return (ExprBase*)binop;
+    }
+    if (!isConstExpr(binop->right)){
+        if (binop->op == tokMinus && isSameVariable(binop->left, binop->right)){
+            return replaceWithInt((ExprBase*)binop, type, 0);
+        }
+        return (ExprBase*)binop;
+    }
+    uint64_t num = intConstValue(binop->right);
+    switch(binop->op){
+        case tokPlus:
+        case tokMinus:
+            if (num == 0) return takeOperand(binop, 1);
+            return reassociate(binop);
+        case tokMulti:
+            if (num == 1) return takeOperand(binop, 1);
+            if (num == 0 && !hasSideEffects(binop->left)) return replaceWithInt((ExprBase*)binop, type, 0);
+            return reassociate(binop);
+        case tokDiv:
+            if (num == 1) return takeOperand(binop, 1);
+            return (ExprBase*)binop;
+        default:
+            assert(0 && "Not an arithmetic operator");
+    }
+}
+
+ExprBase* foldBinop(ExprBinop* binop){
+    //Failed verifications leave the type as none, in which case the tree is left alone
+    if (binop->base.type == typNone){
+        return (ExprBase*)binop;
+    }
+    switch(binop->op){
+        case tokAnd:
+        case tokOr:
+            return foldLogical(binop);
+        case tokEquals:
+        case tokNotEquals:
+        case tokGreater:
+        case tokLess:
+        case tokGreaterEquals:
+        case tokLessEquals:
+            return foldRel(binop);
+        case tokPlus:
+        case tokMinus:
+        case tokMulti:
+        case tokDiv:
+            return foldArith(binop);
+        default:
+            return (ExprBase*)binop;
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "ast/ast.h"
+#include "ast/type.h"
+#include <stdint.h>
+// Constant folding and algebraic simplification of verified expressions
+
+char isConstExpr(const ExprBase* expr);
+char hasSideEffects(const ExprBase* expr);
+//Value of an integer constant, sign or zero extended to 64 bits
+uint64_t intConstValue(const ExprBase* expr);
+
+//Converts expression to type. Constants get replaced by a new constant of that type, so always use the returned node
+ExprBase* castExpr(ExprBase* expr, Type type);
+
+//Both take ownership of the expression and return the simplified tree
+ExprBase* foldUnop(ExprUnop* unop);
+ExprBase* foldBinop(ExprBinop* binop);
@@ -1,6 +1,7 @@
 #include "semantics/semantics.h"
 #include "scope/scope.h"
 #include "semantics/symtable.h"
+#include "semantics/fold.h"
 #include "io/error.h"
 #include "ast/type.h"
 #include <string.h>
@@ -10,12 +11,14 @@ static Type returnType = typNone;
 static char correct = 1;
 static size_t breakDepth = 0;
 static size_t continueDepth = 0;
+static StmtSwitch* curSwitch = NULL;
 
 void initSemantics(){
     returnType = typNone;
     correct = 1;
     breakDepth = 0;
     continueDepth = 0;
+    curSwitch = NULL;
 }
 char checkSemantics(){
     return correct;
@@ -97,7 +100,7 @@ static char isLvalue(ExprBase* expr){
     return 0;
 }
 
-ExprUnop* verifyExprUnop(ExprUnop* unop){
+ExprBase* verifyExprUnop(ExprUnop* unop){
     Type operandType = unop->operand->type;
     switch(unop->op){
         case tokDec:
@@ -106,23 +109,33 @@ ExprUnop* verifyExprUnop(ExprUnop* unop){
                 semanticError(unop->base.ast, "lvalue required as operand of %s.", stringifyToken(unop->op));
                 break;
             }
-        case tokMinus:
             unop->base.type = operandType;
             break;
+        case tokMinus:{
+            //Negation promotes its operand like any other arithmetic
+            if (operandType != typNone && operandType != typVoid){
+                operandType = arithTypePromotion(operandType, operandType);
+                unop->operand = castExpr(unop->operand, operandType);
+            }
+            unop->base.type = operandType;
+            break;
+        }
         case tokNot:
             unop->base.type = typInt32;
             break;
         default:
             assert(0 && "Not an unary token operator");
     }
-    return unop;
+    return foldUnop(unop);
 }
 
 //Assume that both expression types are not void nor none
 static void verifyArithBinop(ExprBinop* binop){
     Type promoted = arithTypePromotion(binop->left->type, binop->right->type);
     if (promoted != typNone){
-        binop->base.type = binop->left->type = binop->right->type = promoted;
+        binop->base.type = promoted;
+        binop->left = castExpr(binop->left, promoted);
+        binop->right = castExpr(binop->right, promoted);
     }
     else{
         semanticError(
@@ -135,7 +148,8 @@ static void verifyRelBinop(ExprBinop* binop){
     Type promoted = arithTypePromotion(binop->left->type, binop->right->type);
     //TODO pointer comparisons need to be supported
     if (promoted != typNone){
-        binop->left->type = binop->right->type = promoted;
+        binop->left = castExpr(binop->left, promoted);
+        binop->right = castExpr(binop->right, promoted);
         binop->base.type = typInt32;
     }
     else{
@@ -145,6 +159,10 @@ static void verifyRelBinop(ExprBinop* binop){
         );
     }
 }
+//Logical operators only test each operand against 0, so the operands keep their own types
+static void verifyLogicalBinop(ExprBinop* binop){
+    binop->base.type = typInt32;
+}
 static void verifyAssignBinop(ExprBinop* binop){
     if (!isLvalue(binop->left)){
         semanticError(binop->left->ast, "lvalue required on left of assignment.");
@@ -166,7 +184,8 @@ static void verifyAssignBinop(ExprBinop* binop){
         if (promoted != typNone){
             // Assignment result has same type as left variable, but arith promotion still occurs for both operands
             binop->base.type = binop->left->type;
-            binop->left->type = binop->right->type = promoted;   
+            binop->left->type = promoted;
+            binop->right = castExpr(binop->right, promoted);
         }
         else{
             semanticError(
@@ -177,7 +196,8 @@ static void verifyAssignBinop(ExprBinop* binop){
     }
 }
 
-ExprBinop* verifyExprBinop(ExprBinop* binop){
+//Returns the constant folded expression, which may not be the original binop
+ExprBase* verifyExprBinop(ExprBinop* binop){
     if (binop->left->type == typVoid || binop->right->type == typVoid){
         if (binop->left->type == typVoid){
             semanticError(binop->left->ast, VOID_ERROR_MSG);
@@ -203,6 +223,10 @@ ExprBinop* verifyExprBinop(ExprBinop* binop){
             case tokLessEquals:
                 verifyRelBinop(binop);
                 break;
+            case tokAnd:
+            case tokOr:
+                verifyLogicalBinop(binop);
+                break;
             case tokAssign:
             case tokPlusAssign:
             case tokMinusAssign:
@@ -214,7 +238,7 @@ ExprBinop* verifyExprBinop(ExprBinop* binop){
                 assert(0 && "Unhandled binop.");
         }
     }
-    return binop;
+    return foldBinop(binop);
 }
 
 ExprIdent* verifyExprIdent(ExprIdent* ident){
@@ -346,6 +370,63 @@ Ast* verifyStmtContinue(Ast* stmt){
     return stmt;
 }
 
+//Returns the switch it's nested in, which becomes the current switch again once this one is verified
+StmtSwitch* preverifySwitch(StmtSwitch* stmt){
+    Type type = stmt->expr->type;
+    if (type == typVoid){
+        semanticError(stmt->expr->ast, VOID_ERROR_MSG);
+    }
+    else if (isFloatType(type)){
+        semanticError(stmt->expr->ast, "switch value must have an integer type.");
+    }
+    //The value is promoted like any other arithmetic operand
+    else if (type != typNone){
+        stmt->expr = castExpr(stmt->expr, argTypePromotion(type));
+    }
+    StmtSwitch* enclosing = curSwitch;
+    curSwitch = stmt;
+    breakDepth++;
+    return enclosing;
+}
+void postVerifySwitch(StmtSwitch* enclosing){
+    assert(breakDepth > 0 && curSwitch != NULL && "Probably forgot matching preverifySwitch");
+    breakDepth--;
+    curSwitch = enclosing;
+}
+
+//Case values are converted to the type of the switch, so that they're compared the same way the value is
+StmtCase* verifyStmtCase(StmtCase* label){
+    if (curSwitch == NULL){
+        semanticError(label->ast, "%s label placed outside of switch block.", label->ast.label == astStmtCase ? "case" : "default");
+        return label;
+    }
+    if (label->ast.label == astStmtDefault){
+        if (curSwitch->defaultCase){
+            semanticError(label->ast, "multiple default labels in one switch.");
+        }
+        curSwitch->defaultCase = label;
+        return label;
+    }
+    Type type = curSwitch->expr->type;
+    if (!isConstExpr(label->expr) || isFloatType(label->expr->type)){
+        semanticError(label->expr->ast, "case value must be an integer constant.");
+        return label;
+    }
+    //Errors in the switch value already got reported
+    if (type == typNone || type == typVoid || isFloatType(type)) return label;
+    label->expr = castExpr(label->expr, type);
+    label->num = intConstValue(label->expr);
+    for (size_t i=0; i<curSwitch->cases.size; i++){
+        if (((StmtCase*)curSwitch->cases.elem[i])->num == label->num){
+            semanticError(label->expr->ast, "duplicate case value.");
+            return label;
+        }
+    }
+    label->index = curSwitch->cases.size;
+    if (!arrPush(vptr)(&curSwitch->cases, label)) exit(1);
+    return label;
+}
+
 static void verifyParamTypes(Array(vptr)* params){
     for (size_t i=0; i<params->size; i++){
         StmtVar* param = params->elem[i];
@@ -13,8 +13,8 @@ ExprLong* verifyExprUnsignedLong(ExprLong* expint);
 ExprDouble* verifyExprDouble(ExprDouble* expdb);
 ExprFloat* verifyExprFloat(ExprFloat* expdb);
 
-ExprUnop* verifyExprUnop(ExprUnop* unop);
-ExprBinop* verifyExprBinop(ExprBinop* binop);
+ExprBase* verifyExprUnop(ExprUnop* unop);
+ExprBase* verifyExprBinop(ExprBinop* binop);
 ExprIdent* verifyExprIdent(ExprIdent* ident);
 ExprCall* verifyExprCall(ExprCall* call);
 
@@ -27,6 +27,9 @@ void preverifyLoop();
 void postVerifyLoop();
 Ast* verifyStmtBreak(Ast* stmt);
 Ast* verifyStmtContinue(Ast* stmt);
+StmtSwitch* preverifySwitch(StmtSwitch* stmt);
+void postVerifySwitch(StmtSwitch* enclosing);
+StmtCase* verifyStmtCase(StmtCase* label);
 
 void verifyFunctionSignature(Function* func, char isDecl);
 void verifyFunctionBody();
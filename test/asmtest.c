@@ -12,22 +12,60 @@ static void ts(AsmInstruction instr, const char* expected) {
 }
 
 static void testEmitLabel(){
-    ts(labelInstruction("jmp", numLabel(3)), "\tjmp .L3\n");
-    ts(labelInstruction(".globl", strLabel("main")), "\t.globl main\n");
+    ts(labelInstruction(plainOp(opJmp), numLabel(3)), "\tjmp .L3\n");
+    ts(labelInstruction(plainOp(opGlobl), strLabel("main")), "\t.globl main\n");
     ts(labelDeclInstruction(numLabel(222)), ".L222:\n");
 }
 
 static void testEmitOperations(){
-    ts(op0Instruction("cqlt"), "\tcqlt\n");
-    ts(op1Instruction("pushq", numberAddress(11111)), "\tpushq $11111\n");
-    ts(op1Instruction("divq", registerAddress($rsp)), "\tdivq %rsp\n");
-    ts(op2Instruction("addq", symbolAddress("x"), indirectAddress(-16, $rax)), "\taddq x, -16(%rax)\n");
+    ts(op0Instruction(plainOp(opCqto)), "\tcqto\n");
+    ts(op1Instruction(widthOp(opPush, 8), numberAddress(11111)), "\tpushq $11111\n");
+    ts(op1Instruction(widthOp(opDiv, 8), registerAddress($rsp)), "\tdivq %rsp\n");
+    ts(op2Instruction(widthOp(opAdd, 8), symbolAddress("x"), indirectAddress(-16, $rax)), "\taddq x, -16(%rax)\n");
+    ts(op2Instruction(widthOp(opLea, 8), indexedAddress($rax, $rcx, 4), registerAddress($rax)), "\tleaq (%rax,%rcx,4), %rax\n");
+    ts(op2Instruction(widthOp(opAddF, 8), labelAddress(7), registerAddress($xmm0)), "\taddsd .L7(%rip), %xmm0\n");
+    ts(dataInstruction(8, 4607182418800017408), "\t.quad 4607182418800017408\n");
+    ts(labelDiffInstruction(4, 12, 3), "\t.long .L12-.L3\n");
+}
+
+// Mnemonics are put together from the opcode and its width or condition code
+static void testEmitOpcodes(){
+    ts(op1Instruction(condOp(opSet, condAE), registerAddress($al)), "\tsetae %al\n");
+    ts(labelInstruction(condOp(opJcc, condNP), numLabel(1)), "\tjnp .L1\n");
+    ts(op2Instruction(condOp(opCmov, condLE), registerAddress($ecx), registerAddress($eax)), "\tcmovle %ecx, %eax\n");
+    ts(op2Instruction(widthOp(opMovzw, 4), registerAddress($cx), registerAddress($eax)), "\tmovzwl %cx, %eax\n");
+    ts(op2Instruction(widthOp(opUcomiF, 4), registerAddress($xmm1), registerAddress($xmm0)), "\tucomiss %xmm1, %xmm0\n");
+    ts(op2Instruction(widthOp(opXorF, 8), registerAddress($xmm1), registerAddress($xmm1)), "\txorpd %xmm1, %xmm1\n");
+    ts(op2Instruction(widthOp(opCvtsi2sd, 8), registerAddress($rax), registerAddress($xmm0)), "\tcvtsi2sdq %rax, %xmm0\n");
+    ts(op2Instruction(plainOp(opCvttss2si), registerAddress($xmm0), registerAddress($eax)), "\tcvttss2si %xmm0, %eax\n");
+    ts(op1Instruction(plainOp(opJmpIndirect), registerAddress($rax)), "\tjmp *%rax\n");
+    ts(op0Instruction(widthOp(opAlign, 8)), "\t.align 8\n");
+    ts(op0Instruction(plainOp(opRodata)), "\t.section .rodata\n");
+    ts(dataInstruction(1, 255), "\t.byte 255\n");
+}
+
+// Numbers are formatted by hand, so the edges of their ranges get checked
+static void testEmitNumbers(){
+    ts(op1Instruction(widthOp(opPush, 8), numberAddress(0)), "\tpushq $0\n");
+    ts(op1Instruction(widthOp(opPush, 8), numberAddress(UINT64_MAX)), "\tpushq $18446744073709551615\n");
+    ts(op1Instruction(widthOp(opInc, 8), indirectAddress(0, $rbp)), "\tincq 0(%rbp)\n");
+    ts(op1Instruction(widthOp(opInc, 8), indirectAddress(INT64_MIN, $rbp)), "\tincq -9223372036854775808(%rbp)\n");
+    ts(op1Instruction(widthOp(opInc, 8), indirectAddress(INT64_MAX, $r15)), "\tincq 9223372036854775807(%r15)\n");
+    //Names longer than a whole line still come out in one piece
+    char_t name[300];
+    char_t expected[320];
+    memset(name, 'f', sizeof(name) - 1);
+    name[sizeof(name) - 1] = 0;
+    sprintf(expected, "\tcall %s\n", name);
+    ts(labelInstruction(plainOp(opCall), strLabel(name)), expected);
+    sprintf(expected, "\tmovq %s, %%xmm5\n", name);
+    ts(op2Instruction(widthOp(opMov, 8), symbolAddress(name), registerAddress($xmm5)), expected);
 }
 
 static void testEmitAll(){
     initAsm();
     for (size_t i=1; i<5; i++){
-        appendInstr(labelInstruction("je", numLabel(i)));
+        appendInstr(labelInstruction(condOp(opJcc, condE), numLabel(i)));
     }
     ioSetup("");
     emitAllAsm();
@@ -35,17 +73,178 @@ static void testEmitAll(){
     disposeAsm();
 }
 
+static void testRemoveInstr(){
+    initAsm();
+    AsmInstruction* instrs[4];
+    for (size_t i=1; i<4; i++){
+        instrs[i] = appendInstr(labelInstruction(condOp(opJcc, condE), numLabel(i)));
+    }
+    removeInstr(instrs[2]);
+    assertEqNum(instrCount(), 2);
+    assertEqNum(nextInstr(firstInstr())->args.label.data.num, 3);
+    ioSetup("");
+    emitAllAsm();
+    assertEqStr(output, "\tje .L1\n\tje .L3\n");
+    //The removed instruction's place is used by the next one
+    assertEqNum(appendInstr(labelInstruction(condOp(opJcc, condE), numLabel(4))), instrs[2]);
+    disposeAsm();
+}
+
+static void testInsertInstr(){
+    initAsm();
+    AsmInstruction* last = appendInstr(labelInstruction(condOp(opJcc, condE), numLabel(3)));
+    AsmInstruction* first = insertInstr(labelInstruction(condOp(opJcc, condE), numLabel(1)), last);
+    insertInstr(labelInstruction(condOp(opJcc, condE), numLabel(2)), last);
+    insertInstr(labelInstruction(condOp(opJcc, condE), numLabel(4)), NULL);
+    assertEqNum(firstInstr(), first);
+    ioSetup("");
+    emitAllAsm();
+    assertEqStr(output, "\tje .L1\n\tje .L2\n\tje .L3\n\tje .L4\n");
+    disposeAsm();
+}
+
+// Instructions don't move however many come after them, and a new program reuses the old one's chunks
+static void testStableInstrs(){
+    initAsm();
+    AsmInstruction* first = appendInstr(labelInstruction(condOp(opJcc, condE), numLabel(0)));
+    for (size_t i=1; i<5000; i++){
+        appendInstr(labelInstruction(condOp(opJcc, condE), numLabel(i)));
+    }
+    assertEqNum(instrCount(), 5000);
+    assertEqNum(first->args.label.data.num, 0);
+    size_t i = 0;
+    for (const AsmInstruction* ins = firstInstr(); ins != NULL; ins = nextInstr(ins), i++){
+        assertEqNum(ins->args.label.data.num, i);
+    }
+    assertEqNum(i, 5000);
+    disposeAsm();
+    initAsm();
+    assertEqNum(firstInstr(), NULL);
+    appendInstr(labelInstruction(condOp(opJcc, condE), numLabel(0)));
+    assertEqNum(instrCount(), 1);
+    disposeAsm();
+}
+
 static void testRegStr(){
-    for (Register reg=$rbp; reg<=$r11; reg++){
+    for (Register reg=$rbp; reg<=$xmm5; reg++){
         registerStr(reg);
     }
+    assertEqStr(registerStr($r10b), "%r10b");
+    assertEqStr(registerStr($xmm5), "%xmm5");
+}
+
+static void testSizedRegister(){
+    assertEqNum(sizedRegister($rax, 8), $rax);
+    assertEqNum(sizedRegister($rax, 4), $eax);
+    assertEqNum(sizedRegister($r9, 2), $r9w);
+    assertEqNum(sizedRegister($rcx, 1), $cl);
+    assertEqNum(sizedRegister($r11, 1), $r11b);
+    assertEqNum(sizedRegister($rbp, 4), $rbp);
+    assertEqNum(sizedRegister($xmm1, 4), $xmm1);
+    ts(op2Instruction(widthOp(opMovzb, 4), registerAddress(sizedRegister($r10, 1)), registerAddress(sizedRegister($r10, 4))), "\tmovzbl %r10b, %r10d\n");
+}
+
+// Encodes the instruction buffer and compares each byte of the code that comes out
+static void te(const uint8_t* expected, size_t size, ObjectCode* object){
+    encodeAllAsm(object);
+    assertEqNum(object->sections[secText].size, size);
+    for (size_t i=0; i<size && i<object->sections[secText].size; i++){
+        assertEqNum(object->sections[secText].elem[i], expected[i]);
+    }
+}
+
+static void testEncodeInstrs(){
+    ObjectCode object;
+    initAsm();
+    appendInstr(op1Instruction(widthOp(opPush, 8), registerAddress($rbp)));
+    appendInstr(op2Instruction(widthOp(opMov, 8), registerAddress($rsp), registerAddress($rbp)));
+    appendInstr(op2Instruction(widthOp(opSub, 8), numberAddress(32), registerAddress($rsp)));
+    appendInstr(op2Instruction(widthOp(opMov, 4), indirectAddress(-4, $rbp), registerAddress($r10d)));
+    appendInstr(op2Instruction(widthOp(opMovzb, 4), registerAddress($sil), registerAddress($eax)));
+    appendInstr(op2Instruction(widthOp(opAdd, 4), numberAddress(1000), registerAddress($eax)));
+    appendInstr(op2Instruction(widthOp(opLea, 8), indexedAddress($r13, $rax, 8), registerAddress($rax)));
+    appendInstr(op1Instruction(condOp(opSet, condE), registerAddress($al)));
+    appendInstr(op2Instruction(widthOp(opMovF, 8), registerAddress($xmm1), indirectAddress(8, $rsp)));
+    appendInstr(op0Instruction(plainOp(opLeave)));
+    appendInstr(op0Instruction(plainOp(opRet)));
+    const uint8_t expected[] = {
+        0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC, 0x20, 0x44, 0x8B, 0x55, 0xFC, 0x40, 0x0F, 0xB6, 0xC6,
+        0x05, 0xE8, 0x03, 0x00, 0x00, 0x49, 0x8D, 0x44, 0xC5, 0x00, 0x0F, 0x94, 0xC0,
+        0xF2, 0x0F, 0x11, 0x4C, 0x24, 0x08, 0xC9, 0xC3
+    };
+    te(expected, sizeof(expected), &object);
+    assertEqNum(object.relocations.size, 0);
+    disposeObjectCode(&object);
+    disposeAsm();
+}
+
+// Jumps stay short until their target is too far away for a byte
+static void testEncodeJumps(){
+    ObjectCode object;
+    initAsm();
+    appendInstr(labelDeclInstruction(numLabel(0)));
+    appendInstr(labelInstruction(condOp(opJcc, condNE), numLabel(1)));
+    appendInstr(labelInstruction(plainOp(opJmp), numLabel(0)));
+    appendInstr(labelDeclInstruction(numLabel(1)));
+    appendInstr(labelInstruction(condOp(opJcc, condL), numLabel(2)));
+    for (int i=0; i<130; i++){
+        appendInstr(op0Instruction(plainOp(opCltd)));
+    }
+    appendInstr(labelDeclInstruction(numLabel(2)));
+    uint8_t expected[140] = {0x75, 0x02, 0xEB, 0xFC, 0x0F, 0x8C, 0x82, 0x00, 0x00, 0x00};
+    for (int i=0; i<130; i++){
+        expected[10 + i] = 0x99;
+    }
+    te(expected, sizeof(expected), &object);
+    disposeObjectCode(&object);
+    disposeAsm();
+}
+
+// References to read-only data and other functions are left to the linker
+static void testEncodeRelocations(){
+    ObjectCode object;
+    initAsm();
+    appendInstr(op0Instruction(plainOp(opText)));
+    appendInstr(labelInstruction(plainOp(opGlobl), strLabel("f")));
+    appendInstr(labelDeclInstruction(strLabel("f")));
+    appendInstr(op2Instruction(widthOp(opMovF, 8), labelAddress(0), registerAddress($xmm0)));
+    appendInstr(op1Instruction(plainOp(opCall), symbolAddress("g")));
+    appendInstr(op0Instruction(plainOp(opRodata)));
+    appendInstr(op0Instruction(widthOp(opAlign, 8)));
+    appendInstr(labelDeclInstruction(numLabel(0)));
+    appendInstr(dataInstruction(8, 4607182418800017408));
+    appendInstr(op0Instruction(plainOp(opText)));
+    const uint8_t expected[] = {0xF2, 0x0F, 0x10, 0x05, 0, 0, 0, 0, 0xE8, 0, 0, 0, 0};
+    te(expected, sizeof(expected), &object);
+    assertEqNum(object.sections[secRodata].size, 8);
+    assertEqNum(object.relocations.size, 2);
+    assertEqNum(object.relocations.elem[0].type, relPc32);
+    assertEqNum(object.relocations.elem[0].offset, 4);
+    assertEqNum(object.relocations.elem[0].symbol, secRodata);
+    assertEqNum(object.relocations.elem[0].addend, -4);
+    Relocation call = object.relocations.elem[1];
+    assertEqNum(call.type, relPlt32);
+    assertEqNum(call.offset, 9);
+    assertEqStr(object.symbols.elem[call.symbol].name, "g");
+    assert0(object.symbols.elem[call.symbol].defined);
+    disposeObjectCode(&object);
+    disposeAsm();
 }
 
 int main(int argc, char const *argv[])
 {
     testEmitLabel();
     testEmitOperations();
+    testEmitOpcodes();
+    testEmitNumbers();
     testEmitAll();
+    testRemoveInstr();
+    testInsertInstr();
+    testStableInstrs();
     testRegStr();
+    testSizedRegister();
+    testEncodeInstrs();
+    testEncodeJumps();
+    testEncodeRelocations();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,69 @@
+long long sdiv(long long a, long long b){
+    return a / b;
+}
+unsigned long long udiv(unsigned long long a, unsigned long long b){
+    return a / b;
+}
+long long smul(long long a, long long b){
+    return a * b;
+}
+
+int checkSigned(long long n){
+    if (n / 1LL != sdiv(n, 1LL)) return 1;
+    if (n / 2LL != sdiv(n, 2LL)) return 2;
+    if (n / 3LL != sdiv(n, 3LL)) return 3;
+    if (n / 7LL != sdiv(n, 7LL)) return 4;
+    if (n / 10LL != sdiv(n, 10LL)) return 5;
+    if (n / 64LL != sdiv(n, 64LL)) return 6;
+    if (n / 641LL != sdiv(n, 641LL)) return 7;
+    if (n / 1000000007LL != sdiv(n, 1000000007LL)) return 8;
+    if (n / -4 != sdiv(n, -4)) return 9;
+    if (n / -7 != sdiv(n, -7)) return 10;
+    return 0;
+}
+
+int checkUnsigned(unsigned long long n){
+    if (n / 1LLU != udiv(n, 1LLU)) return 11;
+    if (n / 8LLU != udiv(n, 8LLU)) return 12;
+    if (n / 3LLU != udiv(n, 3LLU)) return 13;
+    if (n / 7LLU != udiv(n, 7LLU)) return 14;
+    if (n / 10LLU != udiv(n, 10LLU)) return 15;
+    if (n / 641LLU != udiv(n, 641LLU)) return 16;
+    if (n / 4000000000LLU != udiv(n, 4000000000LLU)) return 17;
+    if (n / 12345678901234LLU != udiv(n, 12345678901234LLU)) return 18;
+    return 0;
+}
+
+int checkMulti(long long n){
+    long long m = n;
+    if (n * 0 != smul(n, 0)) return 21;
+    if (n * 1 != smul(n, 1)) return 22;
+    if (n * 3 != smul(n, 3)) return 23;
+    if (n * 8 != smul(n, 8)) return 24;
+    if (n * 40 != smul(n, 40)) return 25;
+    if (n * -16 != smul(n, -16)) return 26;
+    if (n * 7 != smul(n, 7)) return 27;
+    if (n * 5000000000LL != smul(n, 5000000000LL)) return 28;
+    m *= 9;
+    if (m != smul(n, 9)) return 29;
+    m /= 9;
+    if (m != n) return 30;
+    return 0;
+}
+
+int main(){
+    long long n = -100000;
+    int result;
+    while (n < 100000){
+        if (result = checkSigned(n)) return result;
+        if (result = checkUnsigned(n)) return result;
+        if (result = checkMulti(n)) return result;
+        n += 997;
+    }
+    n = 9223372036854775807LL;
+    if (result = checkSigned(n)) return result;
+    if (result = checkSigned(-n - 1)) return result;
+    if (result = checkUnsigned(18446744073709551615LLU)) return result;
+    if (result = checkUnsigned(n)) return result;
+    return 0;
+}
@@ -0,0 +1,28 @@
+int unreachable(int x){
+    while (x){
+        x--;
+        break;
+        x = x + 100;
+    }
+    return x;
+    x = 50;
+    return x;
+}
+
+int unused(int x){
+    int never = x * 1000;
+    int effect = x++;
+    int shadowed = 7;
+    {
+        int shadowed = x;
+        x = shadowed + 1;
+    }
+    return x;
+}
+
+//Return 9;
+int main(){
+    int dead = 3;
+    dead = 4;
+    return unreachable(3) + unused(5);
+}
@@ -0,0 +1,11 @@
+//Functions from the C library, with float and integer args mixed
+double ldexp(double x, int e);
+int abs(int x);
+
+double twice(double x, int n){
+    return ldexp(x, n - abs(n) + 1);
+}
+
+int main(){
+    return ldexp(1.5, 3) + twice(abs(-3), 5) + abs(-2);
+}
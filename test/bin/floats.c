@@ -0,0 +1,66 @@
+double half(double x){
+    return x / 2;
+}
+
+float scale(float f, int n, double d, float g){
+    return f * n + d - g;
+}
+
+//Float params past the fourth go on the stack
+double fifth(int a, double b, float c, long long d, double e){
+    return e - b;
+}
+
+int cmp(double a, double b){
+    return (a < b) + (a <= b) * 2 + (a > b) * 4 + (a >= b) * 8 + (a == b) * 16 + (a != b) * 32;
+}
+
+unsigned long long big(double d){
+    return d;
+}
+
+//Returns 0 if float arithmetic, comparisons, conversions and float args all work, NaN included
+int main(){
+    double d = 1.5;
+    float f = 2.25f;
+    int i = 7;
+    d += i;
+    if (d != 8.5) return 1;
+    f = f * 2;
+    if (f < 4.5f || f > 4.5f) return 2;
+    if (half(9) != 4.5) return 3;
+    if (scale(1.5f, 3, 0.25, 0.75f) != 4) return 4;
+    if (fifth(1, 2.5, 3.0f, 4, 10.0) != 7.5) return 5;
+    i = d * 3;
+    if (i != 25) return 6;
+    double z = 0;
+    double nan = z / z;
+    if (cmp(1, 2) != 1 + 2 + 32) return 7;
+    if (cmp(2, 2) != 2 + 8 + 16) return 8;
+    if (cmp(nan, 2) != 32) return 9;
+    if (nan) {} else return 10;
+    if (!nan) return 11;
+    if (!z){} else return 12;
+    if (-d != -8.5) return 13;
+    d++;
+    --f;
+    if (d != 9.5 || f != 3.5) return 14;
+    unsigned long long u = 65536;
+    u = u * u * u * 49152;
+    double ud = u;
+    if (ud != 13835058055282163712.0) return 15;
+    if (big(ud) != u) return 16;
+    unsigned int ui = 4000000000u;
+    double uid = ui;
+    if (uid != 4000000000.0) return 17;
+    char c = -3;
+    float cf = c;
+    if (cf != -3) return 18;
+    c = 100.75;
+    if (c != 100) return 19;
+    i = -2.75;
+    if (i != -2) return 20;
+    float small = d;
+    if (small != 9.5f) return 21;
+    return 0;
+}
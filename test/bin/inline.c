@@ -0,0 +1,35 @@
+int square(int x){return x * x;}
+
+//Several returns merge into one value where the call was
+int clamp(int x, int low, int high){
+    if (x < low) return low;
+    if (x > high) return high;
+    return x;
+}
+
+//Calls to helpers that were inlined themselves
+int area(int w, int h){
+    return clamp(w, 0, 10) * clamp(h, 0, 10);
+}
+
+void nothing(int x){
+    x = x + 1;
+}
+
+//Recursive functions are never inlined
+int sum(int n){
+    if (n == 0) return 0;
+    return n + sum(n - 1);
+}
+
+//Should return 49
+int main(){
+    int total = 0;
+    int i = 0;
+    //Args are evaluated once, before the inlined body runs
+    while (i < 4){
+        nothing(i);
+        total = total + square(i++);
+    }
+    return total + area(3, 20) - clamp(-5, 1, 2) + sum(3);
+}
@@ -0,0 +1,35 @@
+int safediv(int a, int b){
+    if (b != 0 && a / b > 2) return 1;
+    return 0;
+}
+
+int either(int a, int b){
+    return a || b;
+}
+
+int both(int a, int b){
+    return a && b;
+}
+
+int range(int x){
+    return !(x < 0 || x > 10) && x != 5;
+}
+
+int main(){
+    int count = 0;
+    if (safediv(10, 0) != 0) return 1;
+    if (safediv(10, 2) != 1) return 2;
+    if (either(0, 0) != 0) return 3;
+    if (either(0, 7) != 1) return 4;
+    if (both(3, 0) != 0) return 5;
+    if (both(3, -3) != 1) return 6;
+    if (range(-1) || range(11) || range(5)) return 7;
+    if (!range(0) || !range(10)) return 8;
+    while (count < 10 && count != 4){
+        count += 1;
+    }
+    do {
+        count += 1;
+    } while (count < 20 && !(count == 8 || count == 15));
+    return count;
+}
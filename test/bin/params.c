@@ -1,6 +1,14 @@
 int a(int x, int y, int z, int c, int d) {return x;}
 
+//Returns 0 if every arg arrives intact
+int order(int x, int y, int z, int c, int d){
+    return (x - 4) + (y - 1) * 3 + (z - 3) * 7 + (c - 2) * 15 + (d - 2) * 31;
+}
+
 //Should return 3
 int main(){
-    return a(3, 2, 1, 4, 5);
+    int n = 9;
+    int m = 7;
+    //Divisions and calls in later args must not clobber the args before them
+    return a(3, 2, 1, 4, 5) + order(n / 2, m / 7, a(1, 2, 3, 4, 5) * 3, (n + 3) / 5, a(2, 1, 1, 1, 1));
 }
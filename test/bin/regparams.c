@@ -0,0 +1,30 @@
+int add(int a, int b){return a + b;}
+
+//The second param comes in rdx, which division clobbers
+int divide(int a, int b, int c){
+    return a / b + c / b;
+}
+
+//Params live across calls, and more values are live at once than there are registers to keep them in
+int mix(int a, int b, int c, int d, int e, int f){
+    int g = a * 3;
+    int h = b * 5;
+    int i = c * 7;
+    int j = d * 11;
+    int k = e * 13;
+    int l = f * 17;
+    int m = add(a, b);
+    int n = add(g, h) - add(i, j);
+    return a + b + c + d + e + f + g + h + i + j + k + l + m + n;
+}
+
+//Should return 43
+int main(){
+    int total = 0;
+    int i = 0;
+    while (i < 3){
+        total = total + divide(17, i + 2, 9);
+        i++;
+    }
+    return total + mix(1, 2, 3, 4, 5, 6) - 200;
+}
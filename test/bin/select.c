@@ -0,0 +1,36 @@
+int max(int a, int b){
+    int m = b;
+    if (a > b) m = a;
+    return m;
+}
+
+//Nested ifs become two selects
+int clamp(int x, int lo, int hi){
+    if (x < lo) x = lo;
+    else if (x > hi) x = hi;
+    return x;
+}
+
+//Unsigned comparisons and small types pick the right values
+unsigned char pick(unsigned int a, unsigned int b, unsigned char x, unsigned char y){
+    unsigned char r;
+    if (a < b) r = x;
+    else r = y;
+    return r;
+}
+
+//Conditions that aren't comparisons, with both values set on one side
+int flags(int c, int a){
+    int b = 2;
+    if (c) {
+        a = a + 1;
+        b = a * 3;
+    }
+    return a + b;
+}
+
+//Should return 44
+int main(){
+    unsigned int big = 4000000000;
+    return max(3, 7) + max(-4, -9) + clamp(50, 0, 10) + clamp(-5, 1, 10) + pick(1, big, 5, 9) + pick(big, 1, 5, 9) + flags(1, 2) + flags(0, 2);
+}
@@ -0,0 +1,90 @@
+//Dense cases go through a jump table
+int dense(int x){
+    switch (x){
+        case 1: return 3;
+        case 2: return 5;
+        case 3: return 7;
+        case 5: return 11;
+        case 6: return 13;
+        default: return 1;
+    }
+}
+
+//Few targets with many cases test bits, and cases fall through into each other
+int kind(int c){
+    int k = 0;
+    switch (c){
+        case 2:
+        case 3:
+        case 5:
+        case 7:
+            k = k + 1;
+        case 4:
+        case 6:
+            k = k + 2;
+            break;
+        case 1:
+            k = 10;
+    }
+    return k;
+}
+
+//Sparse cases are searched, including negative and far apart ones
+int sparse(long long x){
+    int r = 0;
+    switch (x){
+        case -1000: r = 1; break;
+        case -3: r = 2; break;
+        case 17: r = 3; break;
+        case 400: r = 4; break;
+        default: r = 9; break;
+        case 90000: r = 5; break;
+        case 2000000000: r = 6; break;
+        case 123456: r = 7; break;
+    }
+    return r;
+}
+
+//Unsigned values compare as unsigned, so the big one is above the others
+int big(unsigned int x){
+    switch (x){
+        case 1: return 1;
+        case 10: return 2;
+        case 100: return 3;
+        case 4000000000: return 4;
+        case 1000: return 5;
+    }
+    return 0;
+}
+
+//Break leaves the switch while continue goes on with the loop, and a nested switch has its own cases
+int loop(int n){
+    int total = 0;
+    int i = 0;
+    while (i < n){
+        i = i + 1;
+        switch (i){
+            case 1:
+                continue;
+            case 2:
+                switch (n){
+                    case 5: total = total + 100; break;
+                    default: total = total + 1000;
+                }
+                break;
+            default:
+                total = total + i;
+        }
+        total = total + 1;
+    }
+    return total;
+}
+
+//Should return 98
+int main(){
+    int sum = dense(1) + dense(3) + dense(4) + dense(6) + dense(9) + dense(-1);
+    sum = sum + kind(1) + kind(2) + kind(4) + kind(7) + kind(8);
+    sum = sum + sparse(-1000) + sparse(-3) + sparse(400) + sparse(2000000000) + sparse(123456) + sparse(0);
+    sum = sum + big(4000000000) + big(1000) + big(7);
+    return sum + loop(5) - 100;
+}
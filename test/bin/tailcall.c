@@ -0,0 +1,29 @@
+int odd(int n);
+
+//Returns its own result for the next n, so it becomes a loop
+int sumTo(int n, int acc){
+    if (n == 0) return acc;
+    return sumTo(n - 1, acc + n);
+}
+
+//Each returns the other's result, which becomes a jump to it
+int even(int n){
+    if (n == 0) return 1;
+    return odd(n - 1);
+}
+
+int odd(int n){
+    if (n == 0) return 0;
+    return even(n - 1);
+}
+
+//The args are swapped on the way into the next call
+int gcd(int a, int b){
+    if (b == 0) return a;
+    return gcd(b, a - a / b * b);
+}
+
+//Should return 42
+int main(){
+    return sumTo(100, 0) / 500 + even(1001) * 10 + odd(999) * 20 + gcd(84, 36);
+}
@@ -0,0 +1,21 @@
+char narrow(long long x){return x;}
+unsigned short widen(unsigned char c, short s){return c + s;}
+
+//Returns 0 if every value is truncated and extended the way its type says
+int main(){
+    int big = 2147483647;
+    big = big + 1;
+    int wrapped = big < 0;
+    char c = 200;
+    unsigned char uc = 200;
+    short s = 70000;
+    unsigned int u = -1;
+    long long l = u;
+    long long neg = c;
+    int quotient = -7;
+    quotient = quotient / 2;
+    unsigned int uq = u / 3;
+    c += 100;
+    return (wrapped - 1) + (c - 44) + (uc - 200) + (s - 4464) + ((l + 1) / 65536 - 65536) + (neg + 56) +
+        (quotient + 3) + (uq - 1431655765) + (narrow(511) + 1) + (widen(255, -256) - 65535);
+}
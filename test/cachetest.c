@@ -0,0 +1,160 @@
+#include "io/cache.h"
+#include "io/error.h"
+#include "test/utils/assert.h"
+#include <stdlib.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define CACHE_DIR "cachetest.dir"
+#define SOURCE "cachetest_source.c"
+#define OUTPUT "cachetest.o"
+
+static void writeFile(const char_t* filename, const char_t* contents){
+    FILE* file = fopen(filename, "wb");
+    fputs(contents, file);
+    fclose(file);
+}
+
+static void readFile(const char_t* filename, char_t* contents, size_t size){
+    FILE* file = fopen(filename, "rb");
+    contents[0] = 0;
+    if (file == NULL) return;
+    contents[fread(contents, 1, size - 1, file)] = 0;
+    fclose(file);
+}
+
+static void removeCache(){
+    DIR* dir = opendir(CACHE_DIR);
+    if (dir != NULL){
+        for (struct dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir)){
+            char_t path[300];
+            sprintf(path, "%s/%s", CACHE_DIR, entry->d_name);
+            unlink(path);
+        }
+        closedir(dir);
+    }
+    rmdir(CACHE_DIR);
+    unlink(SOURCE);
+    unlink(OUTPUT);
+}
+
+static char entryExists(uint64_t hash){
+    char_t path[300];
+    sprintf(path, "%s/%016llx", CACHE_DIR, (unsigned long long)hash);
+    return access(path, F_OK) == 0;
+}
+
+// Makes an entry look like it was last used at the time
+static void setUsed(uint64_t hash, time_t time){
+    char_t path[300];
+    sprintf(path, "%s/%016llx", CACHE_DIR, (unsigned long long)hash);
+    struct timeval times[2] = {{time, 0}, {time, 0}};
+    utimes(path, times);
+}
+
+// Published XXH64 values
+static void testHash(){
+    assertEqNum(hash64("", 0, 0) == 0xEF46DB3751D8E999ULL, 1);
+    assertEqNum(hash64("a", 1, 0) == 0xD24EC4F1A98C6E5BULL, 1);
+    assertEqNum(hash64("abc", 3, 0) == 0x44BC2CF5AD770999ULL, 1);
+    const char_t* longer = "Nobody inspects the spammish repetition";
+    assertEqNum(hash64(longer, strlen(longer), 0) == 0xFBCEA83C8A378BF1ULL, 1);
+    assertNotEqNum(hash64("abc", 3, 1), hash64("abc", 3, 0));
+}
+
+static void testKey(){
+    removeCache();
+    CacheKey key, other;
+    writeFile(SOURCE, "int main(){ return 0; }");
+    assertEqNum(cacheKey(SOURCE, "-O0", &key), 1);
+    assertEqNum(key.sourceSize, 23);
+    assertEqNum(cacheKey(SOURCE, "-O0", &other), 1);
+    assertEqNum(other.hash, key.hash);
+    assertEqNum(cacheKey(SOURCE, "-O2", &other), 1);
+    assertNotEqNum(other.hash, key.hash);
+    writeFile(SOURCE, "int main(){ return 1; }");
+    assertEqNum(cacheKey(SOURCE, "-O0", &other), 1);
+    assertNotEqNum(other.hash, key.hash);
+    assertEqNum(cacheKey("cachetest.missing", "-O0", &other), 0);
+    unlink(SOURCE);
+}
+
+// A hit gives back the output, the diagnostics and the exit code that were stored
+static void testStoreFetch(){
+    removeCache();
+    assertEqNum(openCache(CACHE_DIR, 1 << 20), 1);
+    CacheKey key = {1234, 5};
+    int code = -1;
+    assertEqNum(cacheFetch(&key, OUTPUT, &code), 0);
+    writeFile(OUTPUT, "object code");
+    captureDiagnostics(1);
+    writeDiagnostic("Inlining '%s' into '%s', size %u.\n", "f", "main", 3);
+    size_t size;
+    assertEqStr(capturedDiagnostics(&size), "Inlining 'f' into 'main', size 3.\n");
+    cacheStore(&key, OUTPUT, 0);
+    captureDiagnostics(0);
+    unlink(OUTPUT);
+
+    assertEqNum(cacheFetch(&key, OUTPUT, &code), 1);
+    assertEqNum(code, 0);
+    char_t contents[100];
+    readFile(OUTPUT, contents, sizeof(contents));
+    assertEqStr(contents, "object code");
+    //Same hash from a source of another size is a collision
+    CacheKey collision = {1234, 6};
+    assertEqNum(cacheFetch(&collision, OUTPUT, &code), 0);
+
+    //Failed compiles are stored with their errors but no output
+    CacheKey failed = {99, 5};
+    captureDiagnostics(1);
+    cacheStore(&failed, OUTPUT, 3);
+    captureDiagnostics(0);
+    assertEqNum(cacheFetch(&failed, OUTPUT, &code), 1);
+    assertEqNum(code, 3);
+    readFile(OUTPUT, contents, sizeof(contents));
+    assertEqStr(contents, "");
+
+    CacheStats stats;
+    readCacheStats(&stats);
+    assertEqNum(stats.hits, 2);
+    assertEqNum(stats.misses, 2);
+    assertEqNum(stats.evictions, 0);
+    assertEqNum(stats.bytes > 11, 1);
+    removeCache();
+}
+
+// Once the entries outgrow the limit, the ones used longest ago go first until they fit in 3/4 of it
+static void testEviction(){
+    removeCache();
+    char_t output[401];
+    memset(output, 'x', 400);
+    output[400] = 0;
+    writeFile(OUTPUT, output);
+    assertEqNum(openCache(CACHE_DIR, 1600), 1);
+    for (uint64_t hash=1; hash<=3; hash++){
+        cacheStore(&(CacheKey){hash, 1}, OUTPUT, 0);
+    }
+    setUsed(1, 1000);
+    setUsed(2, 3000);
+    setUsed(3, 2000);
+    cacheStore(&(CacheKey){4, 1}, OUTPUT, 0);
+    assertEqNum(entryExists(1), 0);
+    assertEqNum(entryExists(2), 1);
+    assertEqNum(entryExists(3), 0);
+    assertEqNum(entryExists(4), 1);
+    CacheStats stats;
+    readCacheStats(&stats);
+    assertEqNum(stats.evictions, 2);
+    assertEqNum(stats.bytes <= 1200, 1);
+    removeCache();
+}
+
+int main(int argc, char const *argv[])
+{
+    testHash();
+    testKey();
+    testStoreFetch();
+    testEviction();
+    return 0;
+}
@@ -123,6 +123,27 @@ static void testLoops(){
     );
 }
 
+static void testSwitch(){
+    test("int m(int a){switch(a){case 1: break; default: return 2;} while(a) switch(a) case 3: continue;}");
+    test("int m(char c){switch(c){case 300: case -1: return 1;}}");
+    testErr(
+        "int m(int a){case 1: default: return a;}",
+        "1:13 case label placed outside of switch block.\n"
+        "1:21 default label placed outside of switch block.\n"
+    );
+    testErr(
+        "int m(int a){switch(a){case 1: case 1: default: default: break;}}",
+        "1:36 duplicate case value.\n"
+        "1:48 multiple default labels in one switch.\n"
+    );
+    testErr(
+        "int m(int a){switch(a){case a: case 1.5: break;}}",
+        "1:28 case value must be an integer constant.\n"
+        "1:36 case value must be an integer constant.\n"
+    );
+    testErr("int m(double d){switch(d){case 1: break;}}", "1:23 switch value must have an integer type.\n");
+}
+
 int main(int argc, char const *argv[])
 {
     testReturn();
@@ -134,5 +155,6 @@ int main(int argc, char const *argv[])
     testUnop();
     testDefineVar();
     testLoops();
+    testSwitch();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,51 @@
+#include "utils.h"
+#include "test/utils/programs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+int driver(int argc, char_t const *argv[]);
+// Times how long each program takes from the start of compiling to having its exit code, built into an executable and run,
+// run in memory, and interpreted. Run it from test/bin
+
+#define REPEATS 5
+
+static double now(){
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+// Builds the executable next to the source and runs it
+static int buildAndRun(int i){
+    const char_t* driverArgs[2] = {NULL, CFILES[i]};
+    if (driver(2, driverArgs)) return -1;
+    return system(EXEFILES[i]);
+}
+
+static int runInProcess(const char_t* flag, int i){
+    const char_t* driverArgs[3] = {NULL, flag, CFILES[i]};
+    return driver(3, driverArgs);
+}
+
+int main(int argc, char const *argv[])
+{
+    double totals[3] = {0};
+    printf("%-16s %10s %10s %12s\n", "program", "native", "--run", "--interpret");
+    for (int i=0; i<FILE_COUNT; i++){
+        double times[3];
+        for (int mode=0; mode<3; mode++){
+            double start = now();
+            for (int repeat=0; repeat<REPEATS; repeat++){
+                int code = mode == 0 ? buildAndRun(i) : runInProcess(mode == 1 ? "--run" : "--interpret", i);
+                //A time is only worth comparing if the program still gives the right answer
+                if (code != EXPECTED_OUT[i]) fprintf(stderr, "%s exited with %d instead of %d.\n", CFILES[i], code, EXPECTED_OUT[i]);
+            }
+            times[mode] = (now() - start) / REPEATS;
+            totals[mode] += times[mode];
+        }
+        printf("%-16s %8.2fms %8.2fms %10.2fms\n", CFILES[i], times[0], times[1], times[2]);
+    }
+    printf("%-16s %8.2fms %8.2fms %10.2fms\n", "total", totals[0], totals[1], totals[2]);
+    return 0;
+}
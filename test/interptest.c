@@ -0,0 +1,114 @@
+#include "semantics/symtable.h"
+#include "semantics/semantics.h"
+#include "utils.h"
+#include "ast/ast.h"
+#include "parser/parser.h"
+#include "lexer/lexer.h"
+#include "interp/interp.h"
+
+#include "test/utils/io.c"
+#include "test/utils/assert.h"
+
+// Interprets a whole program and checks what its main returns. It's a macro so a failure points at the test's line
+#define testInterpret(source, expected) do {\
+    ioSetup(source);\
+    initLexer();\
+    initParser();\
+    initSymbolTable();\
+    TopLevel* ast = parseTopLevel();\
+    assertNotEqNum(ast, NULL);\
+    assertEqNum(checkSemantics(), 1);\
+    int code = interpretTopLevel(ast);\
+    disposeAst(ast);\
+    disposeSymbolTable();\
+    disposeLexer();\
+    assertEqNum(code, expected);\
+} while(0)
+
+static void testArithmetic(){
+    testInterpret("int main(){ return 3 + 4 * 5 - 6 / 4; }", 22);
+    testInterpret("int main(){ int a = 7; int b = -3; return a / b + 10; }", 8);
+    testInterpret("int main(){ int a = 5; a += 3; a *= 2; a -= 1; return a; }", 15);
+    testInterpret("int main(){ int a = 0; return !a + !!a + -(-a) + 1; }", 2);
+    testInterpret("int main(){ }", 0);
+}
+
+// Values wrap and compare the way their types say
+static void testWidths(){
+    testInterpret("int main(){ char c = 127; c++; return c == -128; }", 1);
+    testInterpret("int main(){ unsigned char c = 255; c += 2; return c; }", 1);
+    testInterpret("int main(){ unsigned int u = 0; u--; return u > 5; }", 1);
+    testInterpret("int main(){ int i = -1; unsigned int u = 1; return i < u; }", 0);
+    testInterpret("int main(){ signed char c = -2; unsigned int u = c; return u + 2 == 0; }", 1);
+    testInterpret("int main(){ short s = 40000; long long l = s; return l == -25536; }", 1);
+    testInterpret("int main(){ unsigned int a = 2000000000; a *= 2; return a / 3 == 1333333333; }", 1);
+    testInterpret("int main(){ unsigned long long a = 0; a = a - 1; return a / 2 > a / 3; }", 1);
+}
+
+static void testFloats(){
+    testInterpret("int main(){ double d = 2.5; float f = 1.25f; return d * 4 + f * 8; }", 20);
+    testInterpret("int main(){ double d = -2.75; int i = d; return i + 10; }", 8);
+    testInterpret("int main(){ float f = 0.1f; double d = f; return d != 0.1; }", 1);
+    testInterpret("int main(){ unsigned long long u = 0; u--; double d = u; return d / 4294967296.0 > 4294967295.0; }", 1);
+    testInterpret("int main(){ double d = 0.0; if (d) return 1; return !d + (d < 0.5) + (1.5 >= d); }", 3);
+    testInterpret("double half(double x){ return x / 2; } int main(){ return half(9) * 2; }", 9);
+}
+
+static void testControlFlow(){
+    testInterpret("int main(){ int s = 0; int i = 0; while (i < 10){ s += i; i++; } return s; }", 45);
+    testInterpret("int main(){ int i = 0; do { i += 3; } while (i < 10); return i; }", 12);
+    testInterpret(
+        "int main(){ int s = 0; int i = 0;"
+        "    while (1){ i++; if (i > 20) break; if (i - i / 2 * 2) continue; s += i; }"
+        "    return s; }", 110
+    );
+    testInterpret("int main(){ int a = 0; int b = 5; return (a && b / a) + (b || a) + (a || 0); }", 1);
+    testInterpret("int main(){ int a = 3; if (a > 2 && a < 4) return 7; else return 8; }", 7);
+}
+
+// Dense cases go through a table and sparse ones are searched
+static void testSwitch(){
+    const char_t* dense =
+        "int f(int x){ switch (x){ case 1: return 10; case 2: return 20; case 3: case 4: return 34; case 6: return 60;"
+        "    default: return -1; } }";
+    const char_t* sparse =
+        "int f(int x){ int r = 0; switch (x){ case -1000: r = 1; break; case 7: r = 2; case 90000: r += 3; break;"
+        "    default: r = 9; } return r; }";
+    char_t source[400];
+    sprintf(source, "%s int main(){ return f(1) + f(4) + f(6) + f(5) + f(100); }", dense);
+    testInterpret(source, 102);
+    sprintf(source, "%s int main(){ return f(-1000) * 1000 + f(7) * 100 + f(90000) * 10 + f(8); }", sparse);
+    testInterpret(source, 1539);
+}
+
+static void testCalls(){
+    testInterpret("int fib(int n){ if (n < 2) return n; return fib(n - 1) + fib(n - 2); } int main(){ return fib(15); }", 610);
+    testInterpret(
+        "int f(char a, long long b, double c, unsigned short d, int e, float g, int h){ return a + b + c + d + e + g + h; }"
+        "int main(){ return f(300, 2, 3.5, 70000, 5, 1.5f, 7); }", 44 + 2 + 3 + 4464 + 5 + 1 + 7 + 1
+    );
+    //Args are converted to the param types before the call
+    testInterpret("int f(unsigned char c){ return c; } int main(){ return f(-1); }", 255);
+    //Deep recursion doesn't use up the host's stack
+    testInterpret("int f(int n){ if (n == 0) return 0; return 1 + f(n - 1); } int main(){ return f(50000) == 50000; }", 1);
+}
+
+// Functions that the program only declares come from the C library
+static void testExterns(){
+    testInterpret("int abs(int x); int main(){ return abs(-7) + 1; }", 8);
+    testInterpret("long long llabs(long long x); int main(){ long long x = -2000000000; x *= 2; return llabs(x) / 2 == 2000000000; }", 1);
+    testInterpret("double ldexp(double x, int e); int main(){ return ldexp(1.5, 3); }", 12);
+    testInterpret("int notInTheLibrary(int x); int main(){ return notInTheLibrary(1) + 5; }", 1);
+}
+
+int main(int argc, char const *argv[])
+{
+    testArithmetic();
+    testWidths();
+    testFloats();
+    testControlFlow();
+    testSwitch();
+    testCalls();
+    testExterns();
+    return 0;
+}
@@ -0,0 +1,672 @@
+#include "semantics/symtable.h"
+#include "semantics/semantics.h"
+#include "utils.h"
+#include "ast/ast.h"
+#include "parser/parser.h"
+#include "lexer/lexer.h"
+#include "ir/ir.h"
+
+#include "test/utils/io.c"
+#include "test/utils/assert.h"
+
+// Builds IR for the last function in the source into func. If a pass is given, it's run after mem2reg
+static void buildLast(const char_t* source, TopLevel** ast, IrFunction** func, char (*pass)(IrFunction*)){
+    *func = NULL;
+    ioSetup(source);
+    initLexer();
+    initParser();
+    initSymbolTable();
+    *ast = parseTopLevel();
+    assertNotEqNum(*ast, NULL);
+    assertEqNum(checkSemantics(), 1);
+    *func = irBuildFunction((*ast)->globals.elem[(*ast)->globals.size - 1]);
+    if (*func != NULL && pass != NULL){
+        irMem2Reg(*func);
+        if (pass != &irMem2Reg) pass(*func);
+        assertEqNum(irVerify(*func), 1);
+    }
+}
+
+static void finish(IrFunction* func, TopLevel* ast){
+    if (func) disposeIrFunction(func);
+    disposeAst(ast);
+    disposeSymbolTable();
+    disposeLexer();
+}
+
+// Lays blocks out the way lowering does
+static char irLayoutPass(IrFunction* func){
+    irSplitCriticalEdges(func);
+    irLayoutBlocks(func);
+    return 1;
+}
+
+#define testDump(source, pass, expected) do {\
+    TopLevel* ast;\
+    IrFunction* func;\
+    buildLast(source, &ast, &func, pass);\
+    assertEqNum(irVerify(func), 1);\
+    memset(output, 0, MOCKBUFSIZ*sizeof(char_t));\
+    olen = 0;\
+    irDump(func);\
+    assertEqStr(output, expected);\
+    finish(func, ast);\
+} while(0)
+
+static void testBuild(){
+    testDump(
+        "int f(int a){ int b = a + 1; return b * 2; }", NULL,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    store $0, %0\n"
+        "    %2 = load int $0\n"
+        "    %3 = const int 1\n"
+        "    %4 = add int %2, %3\n"
+        "    store $1, %4\n"
+        "    %6 = load int $1\n"
+        "    %7 = const int 2\n"
+        "    %8 = mul int %6, %7\n"
+        "    ret %8\n"
+    );
+    //Code after a return is unreachable and dropped
+    testDump(
+        "void f(int a){ while (a) { a--; break; a++; } }", NULL,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    store $0, %0\n"
+        "    jmp b1\n"
+        "b1: preds b0\n"
+        "    %3 = load int $0\n"
+        "    br %3, b2, b3\n"
+        "b2: preds b1\n"
+        "    %5 = load int $0\n"
+        "    %6 = const int 1\n"
+        "    %7 = sub int %5, %6\n"
+        "    store $0, %7\n"
+        "    jmp b3\n"
+        "b3: preds b1, b2\n"
+        "    ret\n"
+    );
+    //Values are converted wherever they are used as a different type. Compound assignment works in the promoted type
+    testDump(
+        "long long f(char c, int i){ c += i; return c; }", NULL,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param char 0\n"
+        "    store $0, %0\n"
+        "    %2 = param int 1\n"
+        "    store $1, %2\n"
+        "    %4 = load int $1\n"
+        "    %5 = load char $0\n"
+        "    %6 = conv int %5\n"
+        "    %7 = add int %6, %4\n"
+        "    %8 = conv char %7\n"
+        "    store $0, %8\n"
+        "    %10 = load char $0\n"
+        "    %11 = conv long long %10\n"
+        "    ret %11\n"
+    );
+}
+
+static void testMem2Reg(){
+    testDump(
+        "int f(int a){ int b = 1; if (a > 0) b = a; return b; }", &irMem2Reg,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    %1 = const int 1\n"
+        "    %2 = const int 0\n"
+        "    %3 = cmp.g int %0, %2\n"
+        "    br %3, b1, b2\n"
+        "b1: preds b0\n"
+        "    jmp b2\n"
+        "b2: preds b0, b1\n"
+        "    %6 = phi int [b0: %1], [b1: %0]\n"
+        "    ret %6\n"
+    );
+    //Loop carried variables get a phi in the loop header
+    testDump(
+        "int f(int n){ int s = 0; while (n) { s += n; n--; } return s; }", &irMem2Reg,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    %1 = const int 0\n"
+        "    jmp b1\n"
+        "b1: preds b0, b2\n"
+        "    %3 = phi int [b0: %1], [b2: %6]\n"
+        "    %4 = phi int [b0: %0], [b2: %8]\n"
+        "    br %4, b2, b3\n"
+        "b2: preds b1\n"
+        "    %6 = add int %3, %4\n"
+        "    %7 = const int 1\n"
+        "    %8 = sub int %4, %7\n"
+        "    jmp b1\n"
+        "b3: preds b1\n"
+        "    ret %3\n"
+    );
+    //Logical operators used as values become a phi of constants
+    testDump(
+        "int f(int a, int b){ return a && b; }", &irMem2Reg,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    %1 = param int 1\n"
+        "    br %0, b4, b2\n"
+        "b1: preds b4\n"
+        "    %3 = const int 1\n"
+        "    jmp b3\n"
+        "b2: preds b0, b4\n"
+        "    %5 = const int 0\n"
+        "    jmp b3\n"
+        "b3: preds b1, b2\n"
+        "    %7 = phi int [b1: %3], [b2: %5]\n"
+        "    ret %7\n"
+        "b4: preds b0\n"
+        "    br %1, b1, b2\n"
+    );
+    //Each case gets its own block, which the case before it falls through into
+    testDump(
+        "int f(char c){ int r = 0; switch (c) { case 1: r = 5; case -2: r++; break; default: r = 9; } return r; }", &irMem2Reg,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param char 0\n"
+        "    %1 = const int 0\n"
+        "    %2 = conv int %0\n"
+        "    switch %2, default b4, 1 b1, -2 b2\n"
+        "b1: preds b0\n"
+        "    %4 = const int 5\n"
+        "    jmp b2\n"
+        "b2: preds b0, b1\n"
+        "    %6 = phi int [b0: %1], [b1: %4]\n"
+        "    %7 = const int 1\n"
+        "    %8 = add int %6, %7\n"
+        "    jmp b3\n"
+        "b3: preds b2, b4\n"
+        "    %10 = phi int [b2: %8], [b4: %12]\n"
+        "    ret %10\n"
+        "b4: preds b0\n"
+        "    %12 = const int 9\n"
+        "    jmp b3\n"
+    );
+}
+
+static void testSccp(){
+    //Branches on configuration constants compile away, along with the code they guard
+    testDump(
+        "int f(){ int mode = 2; if (mode == 1) return 5; return mode * 3; }", &irSccp,
+        "function f\n"
+        "b0:\n"
+        "    %0 = const int 2\n"
+        "    %1 = const int 1\n"
+        "    %2 = const int 0\n"
+        "    %3 = const int 3\n"
+        "    %4 = const int 6\n"
+        "    ret %4\n"
+    );
+    //Variables that stay constant around a loop are still found to be constant
+    testDump(
+        "int f(int n){ int x = 1; while (n) { if (x != 1) x = 2; n--; } return x; }", &irSccp,
+        "function f\n"
+        "b0:\n"
+        "    %0 = const int 1\n"
+        "    %1 = const int 1\n"
+        "    %2 = param int 0\n"
+        "    %3 = const int 1\n"
+        "    jmp b1\n"
+        "b1: preds b0, b2\n"
+        "    %5 = phi int [b0: %2], [b2: %10]\n"
+        "    br %5, b2, b3\n"
+        "b2: preds b1\n"
+        "    %7 = const int 1\n"
+        "    %8 = const int 0\n"
+        "    %9 = const int 1\n"
+        "    %10 = sub int %5, %9\n"
+        "    jmp b1\n"
+        "b3: preds b1\n"
+        "    ret %1\n"
+    );
+    //Division by 0 is left for runtime
+    testDump(
+        "int f(){ int zero = 0; return 1 / zero; }", &irSccp,
+        "function f\n"
+        "b0:\n"
+        "    %0 = const int 0\n"
+        "    %1 = const int 1\n"
+        "    %2 = div int %1, %0\n"
+        "    ret %2\n"
+    );
+    //Folded values wrap around to the width of their type
+    testDump(
+        "int f(){ int big = 2147483647; char c = 200; unsigned char u = c; return (big + 1 < 0) + u; }", &irSccp,
+        "function f\n"
+        "b0:\n"
+        "    %0 = const int 2147483647\n"
+        "    %1 = const char -56\n"
+        "    %2 = const unsigned char 200\n"
+        "    %3 = const int 1\n"
+        "    %4 = const int -2147483648\n"
+        "    %5 = const int 0\n"
+        "    %6 = const int 1\n"
+        "    %7 = const int 200\n"
+        "    %8 = const int 201\n"
+        "    ret %8\n"
+    );
+    //A switch on a constant goes straight to its case
+    testDump(
+        "int f(int a){ int x = 3; switch (x) { case 1: a = 2; break; case 3: a++; } return a; }", &irSccp,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    %1 = const int 3\n"
+        "    %2 = const int 1\n"
+        "    %3 = add int %0, %2\n"
+        "    ret %3\n"
+    );
+}
+
+static void testGvn(){
+    //Repeated arithmetic is computed once, including when the operands are swapped
+    testDump(
+        "int f(int a, int b){ return a*b + b*a; }", &irGvn,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    %1 = param int 1\n"
+        "    %2 = mul int %0, %1\n"
+        "    %3 = add int %2, %2\n"
+        "    ret %3\n"
+    );
+    //Values from dominating blocks are reused in every block below them
+    testDump(
+        "int f(int a, int b){ int x = a + b; if (a) x = a + b + 1; else x = (a + b) * 2; return x + (a + b); }", &irGvn,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    %1 = param int 1\n"
+        "    %2 = add int %0, %1\n"
+        "    br %0, b1, b3\n"
+        "b1: preds b0\n"
+        "    %4 = const int 1\n"
+        "    %5 = add int %2, %4\n"
+        "    jmp b2\n"
+        "b2: preds b1, b3\n"
+        "    %7 = phi int [b1: %5], [b3: %11]\n"
+        "    %8 = add int %7, %2\n"
+        "    ret %8\n"
+        "b3: preds b0\n"
+        "    %10 = const int 2\n"
+        "    %11 = mul int %2, %10\n"
+        "    jmp b2\n"
+    );
+    //Reassigning an operand makes a new value, so the expression is recomputed
+    testDump(
+        "int f(int a, int b){ int x = a + b; a++; return x * (a + b); }", &irGvn,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    %1 = param int 1\n"
+        "    %2 = add int %0, %1\n"
+        "    %3 = const int 1\n"
+        "    %4 = add int %0, %3\n"
+        "    %5 = add int %4, %1\n"
+        "    %6 = mul int %2, %5\n"
+        "    ret %6\n"
+    );
+}
+
+static void testLicm(){
+    //Invariant arithmetic moves in front of the loop, while anything using a variable changed in the loop stays
+    testDump(
+        "int f(int n, int a, int b){ int s = 0; while (n) { s += a * b + n; n--; } return s; }", &irLicm,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    %1 = param int 1\n"
+        "    %2 = param int 2\n"
+        "    %3 = const int 0\n"
+        "    %4 = mul int %1, %2\n"
+        "    %5 = const int 1\n"
+        "    jmp b1\n"
+        "b1: preds b0, b2\n"
+        "    %7 = phi int [b0: %3], [b2: %11]\n"
+        "    %8 = phi int [b0: %0], [b2: %12]\n"
+        "    br %8, b2, b3\n"
+        "b2: preds b1\n"
+        "    %10 = add int %4, %8\n"
+        "    %11 = add int %7, %10\n"
+        "    %12 = sub int %8, %5\n"
+        "    jmp b1\n"
+        "b3: preds b1\n"
+        "    ret %7\n"
+    );
+    //Calls stay in the loop, and the do-while body gets a preheader split off the branch going into it
+    testDump(
+        "int g(int a){ return a; } int f(int n, int a){ if (n) do { n = n - g(a) - a * 3; } while (n > 0); return n; }", &irLicm,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    %1 = param int 1\n"
+        "    br %0, b1, b2\n"
+        "b1: preds b0\n"
+        "    %3 = const int 3\n"
+        "    %4 = mul int %1, %3\n"
+        "    %5 = const int 0\n"
+        "    jmp b3\n"
+        "b2: preds b0, b4\n"
+        "    %7 = phi int [b0: %0], [b4: %12]\n"
+        "    ret %7\n"
+        "b3: preds b1, b5\n"
+        "    %9 = phi int [b1: %0], [b5: %12]\n"
+        "    %10 = call int g(%1)\n"
+        "    %11 = sub int %9, %10\n"
+        "    %12 = sub int %11, %4\n"
+        "    jmp b5\n"
+        "b4: preds b5\n"
+        "    jmp b2\n"
+        "b5: preds b3\n"
+        "    %15 = cmp.g int %12, %5\n"
+        "    br %15, b3, b4\n"
+    );
+}
+
+static void testDce(){
+    //Values that never reach a side effect are dropped, including overwritten and unused variables
+    testDump(
+        "int g(int a){ return a; } int f(int a){ int unused = a * 3; int x = a + 1; x = g(a); return x; }", &irDce,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    %1 = call int g(%0)\n"
+        "    ret %1\n"
+    );
+    //Loops that only update dead variables keep their control flow but lose the updates
+    testDump(
+        "int f(int n){ int s = 0; while (n) { s += n; n--; } return 0; }", &irDce,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    jmp b1\n"
+        "b1: preds b0, b2\n"
+        "    %2 = phi int [b0: %0], [b2: %5]\n"
+        "    br %2, b2, b3\n"
+        "b2: preds b1\n"
+        "    %4 = const int 1\n"
+        "    %5 = sub int %2, %4\n"
+        "    jmp b1\n"
+        "b3: preds b1\n"
+        "    %7 = const int 0\n"
+        "    ret %7\n"
+    );
+}
+
+static void testLayout(){
+    //The loop header goes after the body, so the only jump in the loop is the branch back to the top
+    testDump(
+        "int f(int n){ int s = 0; while (n) { s += n; n--; } return s; }", &irLayoutPass,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    %1 = const int 0\n"
+        "    jmp b2\n"
+        "b1: preds b2\n"
+        "    %3 = add int %7, %8\n"
+        "    %4 = const int 1\n"
+        "    %5 = sub int %8, %4\n"
+        "    jmp b2\n"
+        "b2: preds b0, b1\n"
+        "    %7 = phi int [b0: %1], [b1: %3]\n"
+        "    %8 = phi int [b0: %0], [b1: %5]\n"
+        "    br %8, b1, b3\n"
+        "b3: preds b2\n"
+        "    ret %7\n"
+    );
+    //Early returns go to the end, letting the rest of the function fall through
+    testDump(
+        "int f(int n){ if (n < 0) return 0; n = n * 2; return n; }", &irLayoutPass,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    %1 = const int 0\n"
+        "    %2 = cmp.l int %0, %1\n"
+        "    br %2, b2, b1\n"
+        "b1: preds b0\n"
+        "    %4 = const int 2\n"
+        "    %5 = mul int %0, %4\n"
+        "    ret %5\n"
+        "b2: preds b0\n"
+        "    %7 = const int 0\n"
+        "    ret %7\n"
+    );
+}
+
+// Every function but the last is optimized and offered for inlining, then calls in the last one are inlined
+static void testInlineDump(const char_t* source, const char_t* expected){
+    TopLevel* ast;
+    irInitInlining();
+    IrFunction* func;
+    buildLast(source, &ast, &func, NULL);
+    for (size_t i=0; i+1<ast->globals.size; i++){
+        IrFunction* callee = irBuildFunction(ast->globals.elem[i]);
+        irOptimize(callee, 2);
+        irOfferInlinee(callee);
+        disposeIrFunction(callee);
+    }
+    irMem2Reg(func);
+    irInline(func);
+    assertEqNum(irVerify(func), 1);
+    memset(output, 0, MOCKBUFSIZ*sizeof(char_t));
+    olen = 0;
+    irDump(func);
+    assertEqStr(output, expected);
+    finish(func, ast);
+    irDisposeInlining();
+}
+
+static void testInline(){
+    //Params become the args and the returns jump past the call, merging their values
+    testInlineDump(
+        "int g(int x){ if (x > 3) return x; return 3; } int f(int a){ int b = g(a + 1); return b * 2; }",
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    %1 = const int 1\n"
+        "    %2 = add int %0, %1\n"
+        "    %3 = const int 3\n"
+        "    %4 = cmp.g int %2, %3\n"
+        "    br %4, b2, b3\n"
+        "b1: preds b2, b3\n"
+        "    %6 = phi int [b2: %2], [b3: %3]\n"
+        "    %7 = const int 2\n"
+        "    %8 = mul int %6, %7\n"
+        "    ret %8\n"
+        "b2: preds b0\n"
+        "    jmp b1\n"
+        "b3: preds b0\n"
+        "    jmp b1\n"
+    );
+    //Recursive callees stay calls, unless the recursion was turned into a loop
+    testInlineDump(
+        "int g(int x){ if (x) return 1 + g(x - 1); return 0; } int f(int a){ return g(a); }",
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    %1 = call int g(%0)\n"
+        "    ret %1\n"
+    );
+}
+
+static void testTailRecursion(){
+    //The entry block only keeps the params, which become phis in the loop the tail call jumps back to
+    testDump(
+        "int f(int n, int acc){ if (n == 0) return acc; return f(n - 1, acc + n); }", &irTailRecursion,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    %1 = param int 1\n"
+        "    jmp b3\n"
+        "b1: preds b3\n"
+        "    ret %9\n"
+        "b2: preds b3\n"
+        "    %4 = add int %9, %8\n"
+        "    %5 = const int 1\n"
+        "    %6 = sub int %8, %5\n"
+        "    jmp b3\n"
+        "b3: preds b0, b2\n"
+        "    %8 = phi int [b0: %0], [b2: %6]\n"
+        "    %9 = phi int [b0: %1], [b2: %4]\n"
+        "    %10 = const int 0\n"
+        "    %11 = cmp.e int %8, %10\n"
+        "    br %11, b1, b2\n"
+    );
+    //A call whose value only passes through a phi to the return gets a return of its own first
+    testDump(
+        "int f(int n){ int r = 0; if (n) r = f(n - 1); return r; }", &irTailRecursion,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    jmp b3\n"
+        "b1: preds b3\n"
+        "    %2 = const int 1\n"
+        "    %3 = sub int %7, %2\n"
+        "    jmp b3\n"
+        "b2: preds b3\n"
+        "    %5 = phi int [b3: %8]\n"
+        "    ret %5\n"
+        "b3: preds b0, b1\n"
+        "    %7 = phi int [b0: %0], [b1: %3]\n"
+        "    %8 = const int 0\n"
+        "    br %7, b1, b2\n"
+    );
+}
+
+static void testIfConvert(){
+    //Both sides are cheap, so they run unconditionally and the phi becomes a select
+    testDump(
+        "int f(int a, int b){ int m; if (a > b) m = a - b; else m = b - a; return m; }", &irIfConvert,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    %1 = param int 1\n"
+        "    %2 = sub int %0, %1\n"
+        "    %3 = sub int %1, %0\n"
+        "    %4 = cmp.g int %0, %1\n"
+        "    %5 = select int %4, %2, %3\n"
+        "    ret %5\n"
+    );
+    //A side that goes straight to the join keeps the value from before the if
+    testDump(
+        "int f(int a){ if (a < 0) a = -a; return a; }", &irIfConvert,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    %1 = const int 0\n"
+        "    %2 = neg int %0\n"
+        "    %3 = cmp.l int %0, %1\n"
+        "    %4 = select int %3, %2, %0\n"
+        "    ret %4\n"
+    );
+    //Divisions and calls aren't speculated
+    testDump(
+        "int g(int a){ return a; } int f(int a, int b){ if (b) a = a / b; else a = g(a); return a; }", &irIfConvert,
+        "function f\n"
+        "b0:\n"
+        "    %0 = param int 0\n"
+        "    %1 = param int 1\n"
+        "    br %1, b1, b3\n"
+        "b1: preds b0\n"
+        "    %3 = div int %0, %1\n"
+        "    jmp b2\n"
+        "b2: preds b1, b3\n"
+        "    %5 = phi int [b1: %3], [b3: %7]\n"
+        "    ret %5\n"
+        "b3: preds b0\n"
+        "    %7 = call int g(%0)\n"
+        "    jmp b2\n"
+    );
+}
+
+static void testUnsupported(){
+    TopLevel* ast;
+    IrFunction* func;
+    buildLast("double f(double a){ return a; }", &ast, &func, &irMem2Reg);
+    assertEqNum(func, NULL);
+    finish(func, ast);
+}
+
+// Diamond with a loop on one side: 0 -> 1 -> 3, 0 -> 2 -> 2 -> 3
+static void testDominators(){
+    IrFunction* func = newIrFunction("f", typInt32, 1);
+    IrBlock* blocks[4];
+    for (int i=0; i<4; i++) blocks[i] = newIrBlock(func);
+    IrInstr* param = irAppend(blocks[0], newIrInstr(func, irParam, typInt32));
+    IrInstr* br = irAddArg(newIrInstr(func, irBranch, typNone), param);
+    br->targets[0] = blocks[1];
+    br->targets[1] = blocks[2];
+    irAppend(blocks[0], br);
+    IrInstr* jmp = newIrInstr(func, irJmp, typNone);
+    jmp->targets[0] = blocks[3];
+    irAppend(blocks[1], jmp);
+    br = irAddArg(newIrInstr(func, irBranch, typNone), param);
+    br->targets[0] = blocks[2];
+    br->targets[1] = blocks[3];
+    irAppend(blocks[2], br);
+    irAppend(blocks[3], irAddArg(newIrInstr(func, irRet, typNone), param));
+    assertEqNum(irVerify(func), 1);
+
+    irComputeDominators(func);
+    assertEqNum(blocks[0]->idom, NULL);
+    assertEqNum(blocks[1]->idom, blocks[0]);
+    assertEqNum(blocks[2]->idom, blocks[0]);
+    assertEqNum(blocks[3]->idom, blocks[0]);
+    assertEqNum(irDominates(blocks[0], blocks[3]), 1);
+    assertEqNum(irDominates(blocks[1], blocks[3]), 0);
+    assertEqNum(blocks[1]->frontier.size, 1);
+    assertEqNum(blocks[1]->frontier.elem[0], blocks[3]);
+    //Loops put a block in its own frontier
+    assertEqNum(blocks[2]->frontier.size, 2);
+
+    //Using a value from a block that doesn't dominate the use is caught
+    IrInstr* neg = irAddArg(newIrInstr(func, irNeg, typInt32), param);
+    irInsertBeforeTerminator(blocks[1], neg);
+    irTerminator(blocks[3])->args.elem[0] = neg;
+    assertEqNum(irVerify(func), 0);
+    disposeIrFunction(func);
+}
+
+static void testVerifyStructure(){
+    IrFunction* func = newIrFunction("f", typVoid, 0);
+    IrBlock* entry = newIrBlock(func);
+    //Blocks must end in terminators
+    irAppend(entry, newIrInstr(func, irConst, typInt32));
+    assertEqNum(irVerify(func), 0);
+    irAppend(entry, newIrInstr(func, irRet, typNone));
+    assertEqNum(irVerify(func), 1);
+    //Phis need one arg for each pred
+    IrBlock* other = newIrBlock(func);
+    irInsertAt(other, newIrInstr(func, irPhi, typInt32), 0);
+    irAppend(other, newIrInstr(func, irRet, typNone));
+    assertEqNum(irVerify(func), 1);
+    irAddArg(other->instrs.elem[0], entry->instrs.elem[0]);
+    assertEqNum(irVerify(func), 0);
+    disposeIrFunction(func);
+}
+
+int main(int argc, char const *argv[])
+{
+    testBuild();
+    testMem2Reg();
+    testSccp();
+    testGvn();
+    testLicm();
+    testDce();
+    testLayout();
+    testInline();
+    testTailRecursion();
+    testIfConvert();
+    testUnsupported();
+    testDominators();
+    testVerifyStructure();
+    return 0;
+}
@@ -79,6 +79,18 @@ static void testTokenKeywordIdentifier(){
     test(tokDouble);
     testStr(tokIdent, "double0");
     teardown();
+
+    setup("switch case:default: cas def swit defaults");
+    test(tokSwitch);
+    test(tokCase);
+    test(tokColon);
+    test(tokDefault);
+    test(tokColon);
+    testStr(tokIdent, "cas");
+    testStr(tokIdent, "def");
+    testStr(tokIdent, "swit");
+    testStr(tokIdent, "defaults");
+    teardown();
 }
 
 static void testTokenString(){
@@ -119,6 +131,14 @@ static void testTokenNumber(){
     test(tokUnexpected);
     assertEqNum(curChar, '.');
     teardown();
+
+    //Decimals that doubles can represent are read exactly
+    setup("6.125 .1");
+    test(tokNumDouble);
+    assertEqNum((floatVal == 6.125), 1);
+    test(tokNumDouble);
+    assertEqNum((floatVal == .1), 1);
+    teardown();
 }
 
 static void testTokenNumberExtensions(){
@@ -135,7 +155,7 @@ static void testTokenNumberExtensions(){
 }
 
 static void testTokenSymbols(){
-    setup(", +++---*/! =+=-=*=/= ==<><=>=!= {};");
+    setup(", +++---*/! =+=-=*=/= ==<><=>=!= &&|| {};");
     test(tokComma);
     test(tokInc);
     test(tokPlus);
@@ -158,6 +178,9 @@ static void testTokenSymbols(){
     test(tokGreaterEquals);
     test(tokNotEquals);
 
+    test(tokAnd);
+    test(tokOr);
+
     test(tokLBrace);
     test(tokRBrace);
     test(tokSemicolon);
@@ -1,38 +1,51 @@
 #include "utils.h"
 #include "test/utils/assert.h"
+#include "test/utils/programs.h"
 #include <stdlib.h>
 
 int driver(int argc, char_t const *argv[]);
 
-#define FILE_COUNT 10
-const char_t* CFILES[FILE_COUNT] = {
-    "basic.c", "basicif.c", "binop.c", "params.c", 
-    "unop.c", "void.c", "assign.c", "loop.c", 
-    "controlflow.c", "condition.c"
-};
-const char_t* EXEFILES[FILE_COUNT] = {
-    "basic.exe", "basicif.exe", "binop.exe", "params.exe", 
-    "unop.exe", "void.exe", "assign.exe", "loop.exe", 
-    "controlflow.exe", "condition.exe"
-};
-const int EXPECTED_OUT[FILE_COUNT] = {
-    0, 1, 0, 3, 
-    48, 6, 0, 42, 
-    10, 17
-};
-
 #define DITCH_LEVEL 1
-static void testDriver(int i){
-    const char_t *driverArgs[2];
-    driverArgs[1] = CFILES[i];
-    assertEqNum(driver(2, driverArgs), 0);
+// Every program is compiled both straight from the AST and through the optimizing IR pipeline, and once more as assembly
+// for gcc to assemble
+static void testDriver(int i, const char_t* optFlag){
+    const char_t *driverArgs[3];
+    driverArgs[1] = optFlag;
+    driverArgs[2] = CFILES[i];
+    assertEqNum(driver(3, driverArgs), 0);
     assertEqNum(system(EXEFILES[i]), EXPECTED_OUT[i]);
 }
 
+// Running in memory doesn't make an executable, so the exit code comes straight back from the driver
+static void testRun(int i, const char_t* optFlag){
+    const char_t *driverArgs[4] = {NULL, "--run", optFlag, CFILES[i]};
+    assertEqNum(driver(4, driverArgs), EXPECTED_OUT[i]);
+}
+
+static void testInterpret(int i){
+    const char_t *driverArgs[3] = {NULL, "--interpret", CFILES[i]};
+    assertEqNum(driver(3, driverArgs), EXPECTED_OUT[i]);
+}
+
+// The first compile might be stored and the second found in the cache, and both have to build the same program
+static void testCache(int i){
+    const char_t *driverArgs[4] = {NULL, "--cache=cache", "-O2", CFILES[i]};
+    for (int repeat=0; repeat<2; repeat++){
+        assertEqNum(driver(4, driverArgs), 0);
+        assertEqNum(system(EXEFILES[i]), EXPECTED_OUT[i]);
+    }
+}
+
 int main(int argc, char const *argv[])
 {
     for (int i=0; i<FILE_COUNT; i++){
-        testDriver(i);
+        testDriver(i, "-O0");
+        testDriver(i, "-O2");
+        testDriver(i, "-fno-integrated-as");
+        testRun(i, "-O0");
+        testRun(i, "-O2");
+        testInterpret(i);
+        testCache(i);
     }
     return 0;
 }
\ No newline at end of file
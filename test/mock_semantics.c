@@ -13,8 +13,8 @@ ExprLong* verifyExprUnsignedLong(ExprLong* expint) {return expint;}
 ExprDouble* verifyExprDouble(ExprDouble* expdb) {return expdb;}
 ExprFloat* verifyExprFloat(ExprFloat* expdb) {return expdb;}
 
-ExprUnop* verifyExprUnop(ExprUnop* unop) {return unop;}
-ExprBinop* verifyExprBinop(ExprBinop* binop) {return binop;}
+ExprBase* verifyExprUnop(ExprUnop* unop) {return (ExprBase*)unop;}
+ExprBase* verifyExprBinop(ExprBinop* binop) {return (ExprBase*)binop;}
 ExprIdent* verifyExprIdent(ExprIdent* ident) {return ident;}
 ExprCall* verifyExprCall(ExprCall* call) {return call;}
 
@@ -27,6 +27,9 @@ void preverifyLoop(){}
 void postVerifyLoop(){}
 Ast* verifyStmtBreak(Ast* stmt) {return stmt;}
 Ast* verifyStmtContinue(Ast* stmt) {return stmt;}
+StmtSwitch* preverifySwitch(StmtSwitch* stmt) {return NULL;}
+void postVerifySwitch(StmtSwitch* enclosing){}
+StmtCase* verifyStmtCase(StmtCase* label) {return label;}
 
 void verifyFunctionSignature(Function* func, char isDecl){}
 void verifyFunctionBody(){}
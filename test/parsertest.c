@@ -123,6 +123,22 @@ void outputAst(Ast* ast){
             }
             return;
         }
+        case astStmtSwitch: {
+            StmtSwitch* stmt = (StmtSwitch*)ast;
+            emitOut("switch ");
+            outputAst((Ast*)stmt->expr);
+            outputAst(stmt->stmt);
+            return;
+        }
+        case astStmtCase:
+            emitOut("case ");
+            outputAst((Ast*)((StmtCase*)ast)->expr);
+            outputAst(((StmtCase*)ast)->stmt);
+            return;
+        case astStmtDefault:
+            emitOut("default ");
+            outputAst(((StmtCase*)ast)->stmt);
+            return;
         case astFunction: {
             Function* fn = (Function*)ast;
             size_t paramCount = fn->params.size;
@@ -209,6 +225,8 @@ void testParseBinop(){
     test(parseStmtOrDef, "x = a > b < c;", "= id:x < > id:a id:b id:c ");
     test(parseStmtOrDef, "a <= b == c;", "== <= id:a id:b id:c ");
     test(parseStmtOrDef, "a != b >= c;", "!= id:a >= id:b id:c ");
+    test(parseStmtOrDef, "a || b && c == d;", "|| id:a && id:b == id:c id:d ");
+    test(parseStmtOrDef, "x = a && b || !c;", "= id:x || && id:a id:b !:id:c ");
 }
 
 void testParseUnop(){
@@ -253,6 +271,15 @@ void testIfElse(){
     testErr(parseStmtOrDef, "if ()", "1:4 expected expression before ).\n");
 }
 
+void testSwitch(){
+    test(parseStmtOrDef, "switch (a) { case 1: b; case 2: default: break; }", "switch id:a block:2 case int:1 id:b case int:2 default break ");
+    //Labels can go on any statement, even inside other statements
+    test(parseStmtOrDef, "switch (a) while (b) { case 3: c; }", "switch id:a while id:b block:1 case int:3 id:c ");
+    testErr(parseStmtOrDef, "switch (a) { case 1 b; }", "1:20 expected : before identifier.\n");
+    testErr(parseStmtOrDef, "switch (a) { default: }", "1:22 expected statement before }.\n");
+    testErr(parseStmtOrDef, "switch a", "1:7 expected ( before identifier.\n");
+}
+
 void testParseFunction(){
     //This one also tests all the types so far
     test(
@@ -289,6 +316,7 @@ void testParseError(){
     testErr(parseStmtOrDef, "do {} while(a)", "1:14 expected ; before end of file.\n");
     testErr(parseStmtOrDef, "do {} ", "1:6 expected keyword \"while\" before end of file.\n");
     testErr(parseStmtOrDef, "{ ", "1:2 expected statement before end of file.\n");
+    testErr(parseStmtOrDef, "a & b;", "1:3 expected ; before ' '.\n");
 
     testErr(parseTopLevel, "int Blue(a)", "1:9 expected type name before identifier.\n");
     testErr(parseTopLevel, "int Blue(long, )", "1:15 expected type name before ).\n");
@@ -307,6 +335,7 @@ int main(int argc, char const *argv[])
     testParseUnop();
     testParseStmt();
     testIfElse();
+    testSwitch();
     testParseFunction();
     testParseError();
     return 0;
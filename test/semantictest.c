@@ -35,47 +35,51 @@ static void testVerifyLiteral(){
     disposeAst(flt);
 }
 
+//Identifiers are verified against the symbol table, so their types are set manually instead
+static ExprBase* typedIdent(const char_t* name, Type type){
+    ExprIdent* ident = newExprIdent(1, 2, strdup(name));
+    ident->base.type = type;
+    return (ExprBase*)ident;
+}
+
 static void testVerifyBinop(){
     static const Token arithOp[] = {tokPlus, tokMinus, tokDiv, tokMulti};
     #define arithCount 4
     static const Token relOp[] = {tokEquals, tokNotEquals, tokGreater, tokLess, tokGreaterEquals, tokLessEquals};
     #define relCount 6
+    static const Token logicalOp[] = {tokAnd, tokOr};
+    #define logicalCount 2
     static const Token assignOp[] = {tokAssign, tokPlusAssign, tokMinusAssign, tokDivAssign, tokMultiAssign};
     #define assignCount 5
 
     for (int i=0; i<arithCount; i++){
-        ExprBinop* binop = newExprBinop(
-            1, 2, arithOp[i],
-            (ExprBase*)verifyExprInt(newExprInt(1, 2, 3)),
-            (ExprBase*)verifyExprUnsignedLong(newExprLong(1, 2, 3))
-        );
-        assertEqNum(verifyExprBinop(binop)->base.type, typUInt64);
+        ExprBinop* binop = newExprBinop(1, 2, arithOp[i], typedIdent("a", typInt32), typedIdent("b", typUInt64));
+        assertEqNum(verifyExprBinop(binop)->type, typUInt64);
         assertEqNum(binop->left->type, typUInt64);
         assertEqNum(binop->right->type, typUInt64);
         disposeAst(binop);
     }
 
     for (int i=0; i<relCount; i++){
-        ExprBinop* binop = newExprBinop(
-            1, 2, relOp[i],
-            (ExprBase*)verifyExprInt(newExprInt(1, 2, 3)),
-            (ExprBase*)verifyExprUnsignedLong(newExprLong(1, 2, 3))
-        );
-        assertEqNum(verifyExprBinop(binop)->base.type, typInt32);
+        ExprBinop* binop = newExprBinop(1, 2, relOp[i], typedIdent("a", typInt32), typedIdent("b", typUInt64));
+        assertEqNum(verifyExprBinop(binop)->type, typInt32);
         assertEqNum(binop->left->type, typUInt64);
         assertEqNum(binop->right->type, typUInt64);
         disposeAst(binop);
     }
 
+    for (int i=0; i<logicalCount; i++){
+        ExprBinop* binop = newExprBinop(1, 2, logicalOp[i], typedIdent("a", typFloat64), typedIdent("b", typUInt64));
+        assertEqNum(verifyExprBinop(binop)->type, typInt32);
+        // Operands are only compared against 0, so they aren't promoted
+        assertEqNum(binop->left->type, typFloat64);
+        assertEqNum(binop->right->type, typUInt64);
+        disposeAst(binop);
+    }
+
     for (int i=0; i<assignCount; i++){
-        ExprBinop* binop = newExprBinop(
-            1, 2, assignOp[i],
-            //Verifying the identifier requires the symbol table, so I set its type manually instead
-            (ExprBase*)newExprIdent(1, 2, strdup("var")),
-            (ExprBase*)verifyExprUnsignedLong(newExprLong(1, 2, 3))
-        );
-        binop->left->type = typUInt32;
-        assertEqNum(verifyExprBinop(binop)->base.type, typUInt32);
+        ExprBinop* binop = newExprBinop(1, 2, assignOp[i], typedIdent("var", typUInt32), typedIdent("b", typUInt64));
+        assertEqNum(verifyExprBinop(binop)->type, typUInt32);
         // Arith promotions should happen when doing arith assignments
         if (assignOp[i] != tokAssign){
             assertEqNum(binop->left->type, typUInt64);
@@ -85,6 +89,106 @@ static void testVerifyBinop(){
     }
 }
 
+static ExprBase* intLit(uint32_t num){
+    return (ExprBase*)verifyExprInt(newExprInt(1, 2, num));
+}
+static ExprBase* verifiedBinop(Token op, ExprBase* left, ExprBase* right){
+    return verifyExprBinop(newExprBinop(1, 2, op, left, right));
+}
+static ExprBase* verifiedUnop(Token op, ExprBase* operand){
+    return verifyExprUnop(newExprUnop(1, 2, op, operand, 1));
+}
+
+// Folded expressions must come back as a constant with the given type
+static void testFoldedInt(ExprBase* expr, Type type, uint64_t expected){
+    assertEqNum(expr->type, type);
+    if (type == typInt64 || type == typUInt64){
+        assertEqNum(expr->ast.label, astExprLong);
+        assertEqNum(((ExprLong*)expr)->num, expected);
+    }
+    else{
+        assertEqNum(expr->ast.label, astExprInt);
+        assertEqNum(((ExprInt*)expr)->num, (uint32_t)expected);
+    }
+    disposeAst(expr);
+}
+
+static void testFoldConstants(){
+    initSemantics();
+    testFoldedInt(verifiedBinop(tokPlus, verifiedBinop(tokMulti, intLit(3), intLit(4)), intLit(5)), typInt32, 17);
+    testFoldedInt(verifiedUnop(tokMinus, intLit(5)), typInt32, -5);
+    testFoldedInt(verifiedUnop(tokNot, intLit(5)), typInt32, 0);
+    // Wraparound happens at the width of the promoted type
+    testFoldedInt(verifiedBinop(tokPlus, intLit(0x7FFFFFFF), intLit(1)), typInt32, 0x80000000);
+    testFoldedInt(
+        verifiedBinop(tokPlus, intLit(0x7FFFFFFF), (ExprBase*)verifyExprLong(newExprLong(1, 2, 1))), typInt64, 0x80000000
+    );
+    testFoldedInt(verifiedBinop(tokMinus, (ExprBase*)verifyExprUnsignedInt(newExprInt(1, 2, 0)), intLit(1)), typUInt32, 0xFFFFFFFF);
+    testFoldedInt(verifiedBinop(tokDiv, verifiedUnop(tokMinus, intLit(7)), intLit(2)), typInt32, -3);
+    testFoldedInt(verifiedBinop(tokDiv, verifiedUnop(tokMinus, intLit(7)), (ExprBase*)verifyExprUnsignedInt(newExprInt(1, 2, 2))), typUInt32, 0x7FFFFFFC);
+    // Comparisons happen after promotion, so -1 is huge when compared as unsigned
+    testFoldedInt(verifiedBinop(tokLess, verifiedUnop(tokMinus, intLit(1)), intLit(0)), typInt32, 1);
+    testFoldedInt(verifiedBinop(tokLess, verifiedUnop(tokMinus, intLit(1)), (ExprBase*)verifyExprUnsignedInt(newExprInt(1, 2, 0))), typInt32, 0);
+    testFoldedInt(verifiedBinop(tokOr, intLit(0), intLit(3)), typInt32, 1);
+    // Division by 0 is left alone
+    ExprBase* divZero = verifiedBinop(tokDiv, intLit(1), intLit(0));
+    assertEqNum(divZero->ast.label, astExprBinop);
+    disposeAst(divZero);
+
+    ExprBase* dbl = verifiedBinop(tokMulti, (ExprBase*)verifyExprDouble(newExprDouble(1, 2, 1.5)), intLit(3));
+    assertEqNum(dbl->ast.label, astExprDouble);
+    assertEqNum(dbl->type, typFloat64);
+    assertEqFlt(((ExprDouble*)dbl)->num, 4.5);
+    disposeAst(dbl);
+}
+
+static void testFoldIdentities(){
+    initSemantics();
+    ExprBase* expr = verifiedBinop(tokMinus, verifiedBinop(tokPlus, verifiedBinop(tokMulti, intLit(3), intLit(4)), verifiedBinop(tokMulti, typedIdent("x", typInt32), intLit(1))), intLit(0));
+    // 3 * 4 + x * 1 - 0 is x + 12, with the constant moved to the right
+    assertEqNum(expr->ast.label, astExprBinop);
+    assertEqNum(((ExprBinop*)expr)->op, tokPlus);
+    assertEqNum(((ExprBinop*)expr)->left->ast.label, astExprIdent);
+    testFoldedInt(((ExprBinop*)expr)->right, typInt32, 12);
+    ((ExprBinop*)expr)->right = NULL;
+    disposeAst(expr);
+
+    // (x + 1) - 3 is x + -2
+    expr = verifiedBinop(tokMinus, verifiedBinop(tokPlus, typedIdent("x", typInt32), intLit(1)), intLit(3));
+    assertEqNum(((ExprBinop*)expr)->left->ast.label, astExprIdent);
+    testFoldedInt(((ExprBinop*)expr)->right, typInt32, -2);
+    ((ExprBinop*)expr)->right = NULL;
+    disposeAst(expr);
+
+    // Chains of different widths aren't merged since they wrap differently
+    expr = verifiedBinop(tokPlus, verifiedBinop(tokPlus, typedIdent("x", typInt32), intLit(1)), (ExprBase*)verifyExprLong(newExprLong(1, 2, 1)));
+    assertEqNum(((ExprBinop*)expr)->left->ast.label, astExprBinop);
+    disposeAst(expr);
+
+    testFoldedInt(verifiedBinop(tokMinus, typedIdent("x", typUInt64), typedIdent("x", typUInt64)), typUInt64, 0);
+    testFoldedInt(verifiedBinop(tokMulti, typedIdent("x", typInt32), intLit(0)), typInt32, 0);
+    // Short-circuited calls never run, so they can be dropped
+    ExprCall* call = newExprCall(1, 2, strdup("f"));
+    call->base.type = typInt32;
+    testFoldedInt(verifiedBinop(tokAnd, intLit(0), (ExprBase*)call), typInt32, 0);
+    expr = verifiedBinop(tokPlus, typedIdent("x", typInt64), intLit(0));
+    assertEqNum(expr->ast.label, astExprIdent);
+    assertEqNum(expr->type, typInt64);
+    disposeAst(expr);
+
+    // Calls may have side effects, so multiplying them by 0 has to keep them around
+    call = newExprCall(1, 2, strdup("f"));
+    call->base.type = typInt32;
+    expr = verifiedBinop(tokMulti, (ExprBase*)call, intLit(0));
+    assertEqNum(expr->ast.label, astExprBinop);
+    disposeAst(expr);
+
+    // Floats don't have these identities because of NaNs and signed zeroes
+    expr = verifiedBinop(tokPlus, typedIdent("x", typFloat64), intLit(0));
+    assertEqNum(expr->ast.label, astExprBinop);
+    disposeAst(expr);
+}
+
 static void testVerifyUnop(){
     static const Token unops[] = {tokInc, tokDec, tokMinus, tokNot};
     #define unopCount 4
@@ -92,13 +196,23 @@ static void testVerifyUnop(){
         ExprUnop* unop = newExprUnop(1, 2, unops[i], (ExprBase*)newExprIdent(1, 2, strdup("ddd")), 1);
         unop->operand->type = typUInt32;
         if (unops[i] == tokNot){
-            assertEqNum(verifyExprUnop(unop)->base.type, typInt32);
+            assertEqNum(verifyExprUnop(unop)->type, typInt32);
         }
         else{
-            assertEqNum(verifyExprUnop(unop)->base.type, typUInt32);
+            assertEqNum(verifyExprUnop(unop)->type, typUInt32);
         }
         disposeAst(unop);    
     }
+    //Only negation promotes small operands
+    ExprUnop* neg = newExprUnop(1, 2, tokMinus, (ExprBase*)newExprIdent(1, 2, strdup("ddd")), 1);
+    neg->operand->type = typUInt8;
+    assertEqNum(verifyExprUnop(neg)->type, typInt32);
+    assertEqNum(neg->operand->type, typInt32);
+    disposeAst(neg);
+    ExprUnop* inc = newExprUnop(1, 2, tokInc, (ExprBase*)newExprIdent(1, 2, strdup("ddd")), 1);
+    inc->operand->type = typUInt8;
+    assertEqNum(verifyExprUnop(inc)->type, typUInt8);
+    disposeAst(inc);
 }
 
 static void testVerifyIdent(){
@@ -151,6 +265,36 @@ static void testVerifyBlock(){
     disposeSymbolTable();
 }
 
+static void testVerifySwitch(){
+    initSemantics();
+
+    StmtSwitch* stmt = newStmtSwitch(1, 2, typedIdent("a", typUInt8));
+    StmtSwitch* enclosing = preverifySwitch(stmt);
+    assertEqNum(enclosing, NULL);
+    // The value is promoted like an arithmetic operand
+    assertEqNum(stmt->expr->type, typInt32);
+
+    StmtCase* first = newStmtCase(1, 2, (ExprBase*)verifyExprUnsignedInt(newExprInt(1, 2, 0xFFFFFFFF)));
+    verifyStmtCase(first);
+    assertEqNum(first->expr->type, typInt32);
+    assertEqNum(first->num, (uint64_t)-1);
+    assertEqNum(first->index, 0);
+
+    StmtCase* dup = newStmtCase(1, 2, (ExprBase*)verifyExprInt(newExprInt(1, 2, -1)));
+    verifyStmtCase(dup);
+    assertEqNum(checkSemantics(), 0);
+    StmtCase* dflt = newStmtDefault(1, 2);
+    verifyStmtCase(dflt);
+    assertEqNum(stmt->cases.size, 1);
+    assertEqNum(stmt->defaultCase, dflt);
+
+    postVerifySwitch(enclosing);
+    disposeAst(first);
+    disposeAst(dup);
+    disposeAst(dflt);
+    disposeAst(stmt);
+}
+
 static void testVerifyFunctionDecl(){
     initSemantics();
     initSymbolTable();
@@ -190,9 +334,12 @@ int main(int argc, char const *argv[])
     testVerifyLiteral();
     testVerifyBinop();
     testVerifyUnop();
+    testFoldConstants();
+    testFoldIdentities();
     testVerifyIdent();
     testVerifyCall();
     testVerifyBlock(); 
+    testVerifySwitch();
     testVerifyFunctionDecl();
     testVerifyFunctionDef();
     return 0;
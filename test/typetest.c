@@ -31,6 +31,19 @@ static void testIsIntOrFloat(){
     intOrFloat(typFloat64, 0);
 }
 
+static void testTypeSize(){
+    assertEqNum(typeSize(typInt8), 1);
+    assertEqNum(typeSize(typUInt8), 1);
+    assertEqNum(typeSize(typInt16), 2);
+    assertEqNum(typeSize(typUInt16), 2);
+    assertEqNum(typeSize(typInt32), 4);
+    assertEqNum(typeSize(typUInt32), 4);
+    assertEqNum(typeSize(typFloat32), 4);
+    assertEqNum(typeSize(typInt64), 8);
+    assertEqNum(typeSize(typUInt64), 8);
+    assertEqNum(typeSize(typFloat64), 8);
+}
+
 #define checkArgPromotion(type, promoted) assertEqNum(argTypePromotion(type), promoted);
 static void testArgPromotion(){
     checkArgPromotion(typFloat64, typFloat64);
@@ -63,6 +76,7 @@ static void testArithPromotion(){
 int main(int argc, char const *argv[])
 {
     testSignedType();
+    testTypeSize();
     testArgPromotion();
     testArithPromotion();
     return 0;
@@ -71,4 +71,4 @@
 } while(0);
 
 // Will evaluate a and b multiple times, so must be used with care
-#define doubleEq(a, b) -0.0001 < ((a)-(b)) || ((a)-(b)) < 0.0001
\ No newline at end of file
+#define doubleEq(a, b) (-0.0001 < ((a)-(b)) && ((a)-(b)) < 0.0001)
\ No newline at end of file
@@ -36,6 +36,13 @@ void writeError(size_t line, size_t pos, char_t* message, ...){
     elen += above0(sprintf(&errorstr[elen], "\n"));
 }
 
+void writeDiagnostic(const char_t* format, ...){
+    va_list args;
+    va_start(args, format);
+    elen += above0(vsprintf(&errorstr[elen], format, args));
+    va_end(args);
+}
+
 //Output string to output array
 void emitOut(const char* format, ...) {
     va_list args;
@@ -44,6 +51,11 @@ void emitOut(const char* format, ...) {
     va_end(args);
 }
 
+void emitBytes(const void* bytes, size_t size){
+    memcpy(&output[olen], bytes, size);
+    olen += size;
+}
+
 void ioSetup(const char_t* str){
     strcpy(input, str); //Might need to be adjusted for bigger char types
     ilen = 0;
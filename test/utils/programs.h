@@ -0,0 +1,29 @@
+#pragma once
+#include "utils.h"
+// The whole programs in test/bin, with the executables built from them and the exit codes they should give
+
+#define FILE_COUNT 21
+static const char_t* CFILES[FILE_COUNT] = {
+    "basic.c", "basicif.c", "binop.c", "params.c", 
+    "unop.c", "void.c", "assign.c", "loop.c", 
+    "controlflow.c", "condition.c", "logical.c", "constarith.c",
+    "deadcode.c", "widths.c", "floats.c", "regparams.c",
+    "inline.c", "tailcall.c", "select.c", "switch.c",
+    "externs.c"
+};
+static const char_t* EXEFILES[FILE_COUNT] = {
+    "basic.exe", "basicif.exe", "binop.exe", "params.exe", 
+    "unop.exe", "void.exe", "assign.exe", "loop.exe", 
+    "controlflow.exe", "condition.exe", "logical.exe", "constarith.exe",
+    "deadcode.exe", "widths.exe", "floats.exe", "regparams.exe",
+    "inline.exe", "tailcall.exe", "select.exe", "switch.exe",
+    "externs.exe"
+};
+static const int EXPECTED_OUT[FILE_COUNT] = {
+    0, 1, 0, 3, 
+    48, 6, 0, 42, 
+    10, 17, 8, 0,
+    9, 0, 0, 43,
+    49, 42, 44, 98,
+    20
+};